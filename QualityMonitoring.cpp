@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "qms/qms.hpp"
+
+using Catalog = qms::DefaultCatalog;
+using MonitorChain = qms::MonitorChain; // The pipeline of every port group (see qms/monitor.hpp)
+using Scheduler = qms::MonitorScheduler;
+using PortSink = qms::Monitored<MonitorChain &>; // Counts the readings of one port for the watchdog
+
+// *** Monitor Context ***
+// What every pipeline of the process shares: the stages' context and how the
+// ports are read and watched.
+struct Monitor : qms::MonitorContext {
+    std::map<std::string, qms::PolledPort> &polled; // Modbus points by port name
+    qms::MemoryPolicy memory;
+    std::uint32_t cost_sampling; // CPU cost accounting: 1 in this many readings timed per phase (0: off)
+    bool device_time;            // Correct device timestamps onto the gateway clock
+    qms::Watchdog &watchdog;
+};
+
+// *** Shutdown Request ***
+// Set by SIGINT and SIGTERM. The pipelines then stop reading, drain their
+// queues and finish as if their ports had closed, so the logs, lots and
+// baselines are written out as at a normal end.
+static std::atomic<bool> shutdown_requested{false};
+
+static void request_shutdown(int) { shutdown_requested.store(true, std::memory_order_relaxed); }
+
+// *** Function: control_handler ***
+// Handles the in-band control lines of the ports: "@recipe <name>" changes
+// the port's line over; "@lot start <id>", "@batch <id>" and "@lot end" set
+// the lot it is making.
+static qms::ControlHandler control_handler(const Monitor &m) {
+    return [&m](qms::PortHandle port, std::string_view command, qms::Timestamp t) {
+        return m.recipes.command(port, command, t) || m.lots.command(port, command, t);
+    };
+}
+
+// *** Function: log_scheduling ***
+// Logs per criticality class how many readings were dispatched and shed and
+// how long they queued at most.
+static void log_scheduling(const Scheduler &scheduler) {
+    for (std::size_t c = 0; c < qms::criticality_classes; ++c) {
+        const auto level = static_cast<qms::Criticality>(c);
+        const qms::ClassMetrics &s = scheduler.metrics(level);
+        if (s.dispatched == 0 && s.shed == 0) continue;
+        qms::log(qms::LogLevel::Info, "Scheduling (%s): %llu dispatched, %llu shed, max queue %zu, max wait %.1f ms",
+                 qms::to_string(level), static_cast<unsigned long long>(s.dispatched),
+                 static_cast<unsigned long long>(s.shed), s.max_depth, s.max_wait / 1e6);
+    }
+}
+
+// *** Function: log_costs ***
+// Logs where the pipeline spent its CPU time: per phase, and for the sensors
+// and ports that cost the most, so ports can be rebalanced across gateways.
+static void log_costs(const qms::CostLedger &costs, const qms::Registry &registry) {
+    constexpr std::size_t top = 10;
+    if (!costs.enabled()) return;
+    const double ms_per_cycle = 1e3 / costs.cycles_per_second();
+    std::uint64_t attributed = 0;
+    for (const std::uint64_t c : costs.phases()) attributed += c;
+    if (attributed == 0) return;
+    std::string phases;
+    for (std::size_t p = 0; p < qms::cost_phases; ++p) {
+        char part[96];
+        std::snprintf(part, sizeof part, "%s%s %.1f ms (+%.1f ms in batches)", p ? ", " : "",
+                      qms::to_string(static_cast<qms::CostPhase>(p)),
+                      static_cast<double>(costs.phases()[p]) * ms_per_cycle,
+                      static_cast<double>(costs.unattributed()[p]) * ms_per_cycle);
+        phases += part;
+    }
+    qms::log(qms::LogLevel::Info, "CPU costs (1 in %u readings timed): %s", costs.period(), phases.c_str());
+    const auto share = [attributed](const qms::CostEntry &e) {
+        return static_cast<double>(e.total()) * 100 / static_cast<double>(attributed);
+    };
+    for (const qms::CostEntry &e : costs.top_ports(top)) {
+        const auto name = registry.port_name(static_cast<qms::PortHandle>(e.handle));
+        qms::log(qms::LogLevel::Info, "CPU cost of port %.*s: %.1f ms (%.1f%%), mostly %s",
+                 static_cast<int>(name.size()), name.data(), static_cast<double>(e.total()) * ms_per_cycle, share(e),
+                 qms::to_string(e.dominant()));
+    }
+    for (const qms::CostEntry &e : costs.top_sensors(top)) {
+        const auto id = registry.sensor_name(e.handle);
+        qms::log(qms::LogLevel::Info, "CPU cost of sensor %.*s: %.1f ms (%.1f%%), mostly %s",
+                 static_cast<int>(id.size()), id.data(), static_cast<double>(e.total()) * ms_per_cycle, share(e),
+                 qms::to_string(e.dominant()));
+    }
+}
+
+// *** Function: bind_to_group_node ***
+// Moves the calling thread onto the NUMA node of `group`, if it has one.
+static void bind_to_group_node(const qms::PortGroup &group) {
+    if (group.numa_node >= 0 && !qms::bind_thread_to_node(group.numa_node))
+        qms::log(qms::LogLevel::Error, "Unable to bind port group to NUMA node %d", group.numa_node);
+}
+
+#if defined(QMS_HAS_EXECUTOR)
+constexpr std::chrono::milliseconds modbus_timeout(200); // Longest wait for a slave's response
+
+// *** Function: run_port_group ***
+// Serves the ports of `group` on the calling thread: one coroutine per port on
+// a single executor, all feeding one pipeline. Ports with Modbus points are
+// polled adaptively; the others stream ASCII readings. The thread is bound to the
+// group's NUMA node first, so the executor, the pipeline and its buffers are
+// allocated node-locally. Port tasks only decode and queue; a dispatch task
+// passes the queued readings on by criticality between reads. The CSV log is
+// written whenever its batch is full or due, checked when the executor goes
+// idle and by the dispatch task. The thread and each port publish a heartbeat
+// to the watchdog.
+static void run_port_group(const Monitor &m, const qms::PortGroup &group, std::size_t index) {
+    bind_to_group_node(group);
+    qms::Executor executor;
+    qms::Heartbeat &heartbeat = m.watchdog.heartbeat("pipeline " + std::to_string(index));
+    qms::CostLedger costs(m.cost_sampling, {m.memory.huge_pages, group.numa_node});
+    MonitorChain chain = qms::make_monitor_chain(m, {m.memory.huge_pages, group.numa_node}, heartbeat, costs);
+    Scheduler &scheduler = chain.stage<2>().sink();
+    std::deque<PortSink> port_sinks;
+    qms::Executor::Signal work(executor);
+    std::size_t producers = 0;
+    scheduler.set_notify([&work] { work.notify(); });
+    executor.on_idle([&chain, &executor] { chain.poll(executor.now()); });
+    executor.on_idle([&executor] {
+        if (shutdown_requested.load(std::memory_order_relaxed)) executor.stop();
+    });
+    for (const std::string &name : group.ports) {
+        qms::SerialPort port = qms::setup_serial(name.c_str(), 9600);
+        if (!port.is_open()) continue;
+        PortSink &sink = port_sinks.emplace_back(chain, m.watchdog.heartbeat(name, m.registry.port(name)));
+        ++producers;
+        if (const auto polled = m.polled.find(name); polled != m.polled.end())
+            executor.spawn(qms::producer_task(
+                qms::adaptive_modbus_port_task(executor, std::move(port), m.registry, name, polled->second.points,
+                                               polled->second.schedule, modbus_timeout, sink),
+                producers, work));
+        else
+            executor.spawn(qms::producer_task(
+                qms::ascii_port_task(executor, std::move(port), m.registry, name, sink, control_handler(m), &costs,
+                                     m.device_time),
+                producers, work));
+    }
+    executor.spawn(qms::dispatch_task(executor, scheduler, work, producers,
+                                      std::chrono::nanoseconds(m.latency.min_target() / 4)));
+    executor.run();
+    chain.flush();
+    qms::finish_monitor_chain(chain, m, executor.now());
+
+    log_scheduling(scheduler);
+    log_costs(costs, m.registry);
+    for (const std::string &name : group.ports) {
+        const auto polled = m.polled.find(name);
+        if (polled == m.polled.end()) continue;
+        const qms::PollSchedule &schedule = polled->second.schedule;
+        const qms::PollMetrics &p = schedule.metrics();
+        qms::log(qms::LogLevel::Info,
+                 "Polling %s: %llu polls (%llu failed, %llu deferred), bus %.1f%% of %.0f%% budget", name.c_str(),
+                 static_cast<unsigned long long>(p.polls), static_cast<unsigned long long>(p.failures),
+                 static_cast<unsigned long long>(p.deferred), p.utilization() * 100,
+                 schedule.utilization_budget() * 100);
+    }
+    const qms::BatchMetrics &b = scheduler.sink().stage<0>().stage().stage<1>().stage().metrics();
+    qms::log(qms::LogLevel::Info,
+             "CSV batching: %llu readings in %llu writes (%.1f per write; %llu full, %llu deadline, %llu final), "
+             "last rate %.0f/s, batch limit %zu, max wait %.1f ms",
+             static_cast<unsigned long long>(b.readings), static_cast<unsigned long long>(b.flushes), b.mean_batch(),
+             static_cast<unsigned long long>(b.size_flushes), static_cast<unsigned long long>(b.deadline_flushes),
+             static_cast<unsigned long long>(b.forced_flushes), b.arrival_rate, b.batch_limit, b.max_wait / 1e6);
+}
+#endif
+
+// *** Function: main ***
+// The main function sets up and starts threads for monitoring multiple serial ports.
+// Steps:
+// 1. Take the serial ports to monitor from the command line, or use the defaults
+//    (e.g., "COM3", "COM4", "COM5"). `--config <file>` loads additional sensor
+//    definitions, port groups, latency targets, watchdog thresholds,
+//    criticality classes, polled Modbus points, the rollup period, the
+//    stale and alarm timing of quality states, recipes, production lines,
+//    golden profiles, seasonal baselines, anomaly models, plugins, the
+//    memory policy, CPU cost sampling, the JSON Lines log and the live
+//    dashboard.
+// 2. Split the ports into port groups; ports without a group form one more.
+// 3. On Linux, serve each group from one thread bound to the group's NUMA node,
+//    running one coroutine per port on an executor that shares one pipeline.
+//    Elsewhere, create a pipeline thread for each port.
+// 4. Watch every pipeline thread and port for stalls until every port has
+//    finished, or until SIGINT or SIGTERM asks the pipelines to stop.
+// 5. Close the open lots and save the learned baselines.
+//
+// Returns:
+// - 0 when the program completes successfully.
+int main(int argc, char **argv) {
+#if defined(_WIN32)
+    std::vector<std::string> ports = {"COM3", "COM4", "COM5"}; // List of serial ports
+#else
+    std::vector<std::string> ports = {"/dev/ttyUSB0", "/dev/ttyUSB1", "/dev/ttyUSB2"};
+#endif
+    const char *config_file = nullptr;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc) config_file = argv[++i];
+        else args.push_back(argv[i]);
+    }
+
+    qms::Registry registry;
+    Catalog catalog(registry); // Built-in sensor kinds
+    qms::Config config;
+    if (config_file) {
+        qms::load_config(config_file, config);
+        qms::apply_sensors(config, catalog);
+    }
+    if (!args.empty()) {
+        ports = args;
+    } else if (!config.groups.empty() || !config.modbus.empty()) {
+        ports.clear(); // The configured groups and Modbus points name the ports
+        for (const auto &group : config.groups) ports.insert(ports.end(), group.ports.begin(), group.ports.end());
+        for (const auto &point : config.modbus)
+            if (std::find(ports.begin(), ports.end(), point.port) == ports.end()) ports.push_back(point.port);
+    }
+    const std::vector<qms::PortGroup> groups = qms::place_port_groups(config, ports);
+    std::signal(SIGINT, request_shutdown);
+    std::signal(SIGTERM, request_shutdown);
+
+    qms::AlertPath alerts(registry);
+    const bool lot_column = !config.lines.empty(); // Lots are tracked on configured production lines
+    qms::SharedFile csv("sensor_data.csv", lot_column ? qms::CsvSink::tagged_header : qms::CsvSink::header);
+    qms::SharedFile json_lines(config.json_lines.empty() ? nullptr : config.json_lines.c_str());
+    qms::SharedFile rollups(config.rollup_seconds > 0 ? "sensor_rollups.csv" : nullptr, qms::RollupCsvSink::header);
+    const qms::LatencyTargets latency = qms::LatencyTargets::from_config(config, registry);
+    const qms::CriticalityTable classes = qms::CriticalityTable::from_config(config, registry);
+    const qms::SchedulerPolicy scheduling = qms::SchedulerPolicy::from_config(config);
+    std::map<std::string, qms::PolledPort> polled;
+    for (const auto &point : config.modbus)
+        if (!polled.count(point.port))
+            polled.emplace(point.port, qms::polled_port_from_config(config, point.port, registry, catalog));
+    qms::Watchdog watchdog(alerts, static_cast<qms::Timestamp>(config.stall_seconds * 1e9),
+                           static_cast<qms::Timestamp>(config.silence_seconds * 1e9));
+    watchdog.start();
+    const auto rollup_period = static_cast<qms::Timestamp>(config.rollup_seconds * 1e9);
+    const qms::StatePolicy states{static_cast<qms::Timestamp>(config.stale_seconds * 1e9),
+                                  static_cast<qms::Timestamp>(config.alarm_delay_seconds * 1e9)};
+    const qms::SensorTablePolicy sensor_table{config.compact_sensors,
+                                              static_cast<qms::Timestamp>(config.evict_seconds * 1e9)};
+    qms::SharedFile recipe_history(config.recipes.empty() ? nullptr : "recipe_history.csv",
+                                   qms::RecipeBook::history_header);
+    qms::RecipeBook recipes(registry, &recipe_history);
+    recipes.configure(config, ports, qms::system_clock().now());
+    qms::SharedFile lot_file(lot_column ? "lot_summaries.csv" : nullptr, qms::LotSummaryCsv::header);
+    qms::LotTracker lots(
+        recipes,
+        [&recipes, &catalog](qms::PortHandle port, qms::SensorHandle sensor, qms::Timestamp t) {
+            if (const qms::Limits *l = recipes.limits(port, sensor, t)) return *l;
+            const qms::SensorSpec &spec = catalog.spec(sensor);
+            return qms::Limits{spec.min_limit, spec.max_limit};
+        },
+        qms::LotSummaryCsv(lot_file, recipes));
+    std::vector<qms::GoldenReference> golden;
+    for (const auto &g : config.golden) {
+        qms::GoldenProfile profile;
+        if (!qms::load_golden_profile(g.file.c_str(), static_cast<qms::Timestamp>(g.step_seconds * 1e9), profile))
+            continue;
+        const auto band = static_cast<std::size_t>(std::lround(g.band_seconds / g.step_seconds));
+        golden.push_back({registry.sensor(g.sensor), std::move(profile), band, g.threshold});
+    }
+    std::vector<qms::BaselineSpec> baselines;
+    for (const auto &b : config.baselines) {
+        qms::BaselineSpec spec{registry.sensor(b.sensor)};
+        spec.cycle = (b.weekly ? 7 : 1) * qms::LocalWeekClock::day * 1000000000LL;
+        spec.bucket = static_cast<qms::Timestamp>(b.bucket_minutes * 60e9);
+        spec.sensitivity = b.sensitivity;
+        spec.min_spread = static_cast<float>(std::pow(10.0, -catalog.spec(spec.sensor).precision));
+        baselines.push_back(spec);
+    }
+    qms::BaselineStore baseline_store("sensor_baselines.csv");
+    if (!baselines.empty()) baseline_store.load();
+    std::vector<qms::Model> models;
+    for (const auto &file : config.models)
+        if (qms::Model model; qms::load_model(file.c_str(), registry, model)) models.push_back(std::move(model));
+    std::deque<qms::PluginLibrary> libraries;
+    std::vector<qms::PluginSpec> plugins;
+    for (const auto &p : config.plugins) {
+        auto library = std::find_if(libraries.begin(), libraries.end(),
+                                    [&p](const qms::PluginLibrary &l) { return l.path() == p.library; });
+        const qms::PluginLibrary &l = library != libraries.end() ? *library : libraries.emplace_back(p.library);
+        if (l.is_loaded()) plugins.push_back({&l, qms::plugin_scope(p.scope, registry), p.args});
+    }
+    std::vector<qms::RateSpec> rates;
+    for (const auto &r : config.rates)
+        rates.push_back({registry.sensor(r.sensor), static_cast<qms::Timestamp>(1e9 / r.hertz),
+                         r.tolerance_percent / 100});
+    qms::DashboardBoard board;
+    qms::DashboardBoard *dashboard_board = nullptr;
+#if defined(QMS_HAS_DASHBOARD)
+    qms::DashboardServer dashboard(
+        registry, board, {.port = config.dashboard_port, .max_rate = config.dashboard_rate, .states = states});
+    if (config.dashboard_port != 0 && dashboard.start()) dashboard_board = &board;
+#else
+    if (config.dashboard_port != 0) qms::log(qms::LogLevel::Error, "The live dashboard is not available here");
+#endif
+    const Monitor monitor{{registry, catalog, alerts, csv, json_lines, rollups, rollup_period, states, sensor_table,
+                           recipes, lots, lot_column, golden, baselines, baselines.empty() ? nullptr : &baseline_store,
+                           models, plugins, rates, latency, classes, scheduling, dashboard_board},
+                          polled, config.memory, config.cost_sampling, config.correct_device_time, watchdog};
+
+    std::vector<std::thread> threads;
+#if defined(QMS_HAS_EXECUTOR)
+    // One thread per port group; a single group runs on the main thread
+    for (std::size_t g = 1; g < groups.size(); ++g)
+        threads.emplace_back([&monitor, &group = groups[g], g] { run_port_group(monitor, group, g); });
+    if (!groups.empty()) run_port_group(monitor, groups[0], 0);
+#else
+    // Loop through each port and create a thread for monitoring
+    for (const qms::PortGroup &group : groups) {
+        for (const std::string &name : group.ports) {
+            if (polled.count(name)) {
+                qms::log(qms::LogLevel::Error, "Polling Modbus port %s needs the coroutine executor", name.c_str());
+                continue;
+            }
+            qms::SerialPort port = qms::setup_serial(name.c_str(), 9600);
+            if (!port.is_open()) continue;
+
+            threads.emplace_back([&monitor, &group, name, port = std::move(port)]() mutable {
+                bind_to_group_node(group);
+                const qms::MemoryPolicy memory{monitor.memory.huge_pages, group.numa_node};
+                qms::Heartbeat &heartbeat = monitor.watchdog.heartbeat(name, monitor.registry.port(name));
+                qms::CostLedger costs(monitor.cost_sampling, memory);
+                qms::SerialSource source(std::move(port), monitor.registry, name, std::chrono::milliseconds(1000));
+                source.set_control(control_handler(monitor));
+                source.set_costs(&costs);
+                source.set_device_time(monitor.device_time);
+                qms::Pipeline<qms::SerialSource, qms::Monitored<MonitorChain>> pipeline(
+                    std::move(source), qms::Monitored<MonitorChain>(
+                                           qms::make_monitor_chain(monitor, memory, heartbeat, costs), heartbeat));
+                pipeline.run(qms::system_clock(), shutdown_requested);
+                qms::finish_monitor_chain(pipeline.stage<0>().stage(), monitor, qms::system_clock().now());
+                log_costs(costs, monitor.registry);
+                pipeline.source().decoder().log_device_clock();
+            });
+        }
+    }
+#endif
+
+    // Wait for all threads to complete
+    for (auto &t : threads) t.join();
+    if (shutdown_requested.load(std::memory_order_relaxed)) qms::log(qms::LogLevel::Info, "Stopped on request");
+    lots.close_all(qms::system_clock().now());
+    if (!baselines.empty()) baseline_store.save();
+    watchdog.stop();
+#if defined(QMS_HAS_DASHBOARD)
+    if (dashboard_board) {
+        dashboard.stop();
+        const qms::DashboardMetrics &d = dashboard.metrics();
+        qms::log(qms::LogLevel::Info,
+                 "Dashboard: %llu clients, %llu deltas and %llu snapshots (%.1f KiB serialised), %llu deltas conflated",
+                 static_cast<unsigned long long>(d.clients), static_cast<unsigned long long>(d.deltas),
+                 static_cast<unsigned long long>(d.snapshots), static_cast<double>(d.bytes) / 1024,
+                 static_cast<unsigned long long>(d.conflated));
+    }
+#endif
+    std::printf("All threads finished.\n");
+    return 0;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "log.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+enum class AlertKind {
+    OutOfRange,       // A reading left its configured limits
+    Stall,            // System alarm: a pipeline thread or port stopped making progress
+    ProfileDeviation, // A run strayed too far from its golden profile
+    Anomaly,          // A reading strayed from its seasonal baseline
+    ModelScore,       // An anomaly model scored a port above its threshold
+    Plugin,           // A plugin flagged a reading
+    Rate,             // A device's reporting rate strayed from its configured rate
+};
+
+// *** Alert Structure ***
+// Describes one alert raised by a stage.
+// - `kind`: What triggered the alert.
+// - `sensor`, `port`: Where it came from.
+// - `value`: The offending value.
+// - `low`, `high`: The limits that were violated.
+// - `timestamp`: Time of the offending reading.
+// - `detail`: Description of a system alarm; only valid during the callback.
+//
+// For a Stall, `sensor` is `no_sensor`, `port` is the stalled port (or
+// `no_port`), `value` is how long it has stalled in seconds and `high` the
+// threshold it exceeded. For a ProfileDeviation, `value` is the cumulative
+// deviation of the run from its golden profile and `high` the threshold. For
+// an Anomaly, `low` and `high` are the range its baseline expected. For a
+// ModelScore, `sensor` is `no_sensor`, `detail` names the model, `value` is
+// its score and `high` the threshold. For a Plugin alert, `detail` is the name of the plugin. For a
+// Rate alert, `value` is the measured rate in readings per second and `low`
+// and `high` the range its configuration allows.
+struct Alert {
+    AlertKind kind;
+    SensorHandle sensor;
+    PortHandle port;
+    float value;
+    float low;
+    float high;
+    Timestamp timestamp;
+    const char *detail = nullptr;
+};
+
+// *** AlertPath ***
+// Fan-out point for alerts. Stages raise alerts here; subscribers forward them
+// to operators, PLCs or other systems. When nobody has subscribed, alerts are
+// printed through the library log.
+//
+// Subscribe during setup, before pipelines start; `raise` may then be called
+// from any number of pipeline threads.
+class AlertPath {
+public:
+    using Handler = std::function<void(const Alert &)>;
+
+    explicit AlertPath(const Registry &registry) : registry_(registry) {}
+
+    void subscribe(Handler handler) { handlers_.push_back(std::move(handler)); }
+
+    void raise(const Alert &alert) const {
+        if (handlers_.empty()) {
+            print(alert);
+            return;
+        }
+        for (const auto &h : handlers_) h(alert);
+    }
+
+    // Formats `alert` in the console format used by the default handler.
+    void print(const Alert &alert) const {
+        if (alert.kind == AlertKind::Stall) {
+            log(LogLevel::Alert, "Stall: %s", alert.detail ? alert.detail : "no progress");
+            return;
+        }
+        const auto port = registry_.port_name(alert.port);
+        if (alert.kind == AlertKind::ModelScore) {
+            log(LogLevel::Alert, "Model %s flags %.*s! Score: %.3f (Threshold: %.3f)",
+                alert.detail ? alert.detail : "?", static_cast<int>(port.size()), port.data(), alert.value, alert.high);
+            return;
+        }
+        const auto id = registry_.sensor_name(alert.sensor);
+        if (alert.kind == AlertKind::ProfileDeviation) {
+            log(LogLevel::Alert, "%.*s deviates from its golden profile on %.*s! Deviation: %.2f (Threshold: %.2f)",
+                static_cast<int>(id.size()), id.data(), static_cast<int>(port.size()), port.data(), alert.value,
+                alert.high);
+            return;
+        }
+        if (alert.kind == AlertKind::Anomaly) {
+            log(LogLevel::Alert, "%.*s off its baseline on %.*s! Value: %.2f (Expected: %.2f - %.2f)",
+                static_cast<int>(id.size()), id.data(), static_cast<int>(port.size()), port.data(), alert.value,
+                alert.low, alert.high);
+            return;
+        }
+        if (alert.kind == AlertKind::Plugin) {
+            log(LogLevel::Alert, "%.*s flagged by %s on %.*s! Value: %.2f (Limits: %.2f - %.2f)",
+                static_cast<int>(id.size()), id.data(), alert.detail ? alert.detail : "a plugin",
+                static_cast<int>(port.size()), port.data(), alert.value, alert.low, alert.high);
+            return;
+        }
+        if (alert.kind == AlertKind::Rate) {
+            log(LogLevel::Alert, "%.*s reports at %.3g/s on %.*s! (Configured: %.3g - %.3g/s)",
+                static_cast<int>(id.size()), id.data(), alert.value, static_cast<int>(port.size()), port.data(),
+                alert.low, alert.high);
+            return;
+        }
+        log(LogLevel::Alert, "%.*s out of range on %.*s! Value: %.2f (Limits: %.2f - %.2f)",
+            static_cast<int>(id.size()), id.data(), static_cast<int>(port.size()), port.data(),
+            alert.value, alert.low, alert.high);
+    }
+
+    const Registry &registry() const { return registry_; }
+
+private:
+    const Registry &registry_;
+    std::vector<Handler> handlers_;
+};
+
+} // namespace qms
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "alert.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+// *** LocalWeekClock ***
+// Converts timestamps to local time of week: seconds since Monday 00:00. The
+// UTC offset is looked up once per quarter hour, the finest step at which
+// time zones change it, so the conversion is a few integer operations.
+class LocalWeekClock {
+public:
+    static constexpr std::int64_t day = 86400;
+
+    std::int64_t seconds_of_week(Timestamp t) {
+        const std::int64_t sec = t / 1000000000;
+        if (sec < valid_from_ || sec >= valid_from_ + 900) refresh(sec);
+        const std::int64_t local = sec + offset_;
+        const std::int64_t days = local >= 0 ? local / day : (local - day + 1) / day;
+        // 1970-01-01 was a Thursday, day 3 of a week starting on Monday
+        return ((days + 3) % 7 + 7) % 7 * day + (local - days * day);
+    }
+
+private:
+    // Days from 1970-01-01 to the given civil date (proleptic Gregorian).
+    static std::int64_t days_from_civil(std::int64_t y, unsigned m, unsigned d) {
+        y -= m <= 2;
+        const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+        const auto yoe = static_cast<unsigned>(y - era * 400);
+        const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+    }
+
+    void refresh(std::int64_t sec) {
+        const auto t = static_cast<std::time_t>(sec);
+        std::tm tm{};
+#if defined(_WIN32)
+        localtime_s(&tm, &t);
+#else
+        localtime_r(&t, &tm);
+#endif
+        const std::int64_t days =
+            days_from_civil(tm.tm_year + 1900, static_cast<unsigned>(tm.tm_mon + 1), static_cast<unsigned>(tm.tm_mday));
+        const std::int64_t local = days * day + tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+        offset_ = local - sec;
+        valid_from_ = sec - sec % 900;
+    }
+
+    std::int64_t offset_ = 0;
+    std::int64_t valid_from_ = -1000000; // Forces a lookup first
+};
+
+// *** BaselineSpec Structure ***
+// The seasonal baseline of sensor `sensor`:
+// - `cycle`: Length of the season, a day or a week.
+// - `bucket`: Time of day (or week) each bucket of the profile covers.
+// - `sensitivity`: Standard deviations a reading may stray from its bucket's mean.
+// - `min_spread`: Least standard deviation assumed, e.g. the sensor's resolution.
+// - `min_samples`: Readings a bucket must have learned before it scores.
+// - `memory`: Readings after which a bucket forgets exponentially, following
+//   slow drift.
+struct BaselineSpec {
+    SensorHandle sensor;
+    Timestamp cycle = LocalWeekClock::day * 1000000000LL;
+    Timestamp bucket = 3600 * 1000000000LL;
+    double sensitivity = 3.0;
+    float min_spread = 0.01f;
+    std::uint32_t min_samples = 30;
+    std::uint32_t memory = 1000;
+
+    std::size_t buckets() const { return static_cast<std::size_t>((cycle + bucket - 1) / bucket); }
+};
+
+// *** BaselineBucket Structure ***
+// Mean and variance of the readings learned for one time of day.
+struct BaselineBucket {
+    std::uint32_t count = 0;
+    float mean = 0.0f;
+    float variance = 0.0f;
+
+    // Learns `x`: exactly (Welford) for the first `memory` readings, then as
+    // an exponentially weighted average over about `memory` readings.
+    void add(float x, std::uint32_t memory) {
+        if (count < memory) ++count;
+        const float a = 1.0f / static_cast<float>(count);
+        const float d = x - mean;
+        mean += a * d;
+        variance = (1.0f - a) * (variance + a * d * d);
+    }
+
+    float spread() const { return std::sqrt(variance); }
+};
+
+// *** BaselineStore ***
+// Keeps the learned baselines of every port and sensor in a CSV file across
+// restarts, one line per bucket:
+// Port, SensorID, CycleSeconds, BucketSeconds, Bucket, Count, Mean, StdDev
+//
+// `load` the file before the pipelines start; SeasonalBaseline stages `take`
+// a profile when they first see its port and sensor and `put` it back at
+// every checkpoint and when closed; `save` rewrites the file at checkpoints
+// and after the pipelines finished. Profiles whose geometry no longer
+// matches their BaselineSpec are learned afresh.
+class BaselineStore {
+public:
+    static constexpr std::string_view header = "Port,SensorID,CycleSeconds,BucketSeconds,Bucket,Count,Mean,StdDev\n";
+
+    explicit BaselineStore(std::string filename) : filename_(std::move(filename)) {}
+
+    // Reads the profiles saved in the file, if any.
+    void load() {
+        std::FILE *file = std::fopen(filename_.c_str(), "r");
+        if (file == nullptr) return;
+        char buffer[512];
+        std::size_t buckets = 0;
+        while (std::fgets(buffer, sizeof(buffer), file)) {
+            std::replace(buffer, buffer + std::strlen(buffer), ',', ' ');
+            std::string_view t[9];
+            std::int64_t cycle = 0;
+            std::int64_t bucket = 0;
+            std::size_t index = 0;
+            BaselineBucket b;
+            float spread = 0;
+            if (detail::tokenize(buffer, t, 9) != 8 || !detail::parse_number(t[2], cycle) ||
+                !detail::parse_number(t[3], bucket) || !detail::parse_number(t[4], index) ||
+                !detail::parse_number(t[5], b.count) || !detail::parse_number(t[6], b.mean) ||
+                !detail::parse_number(t[7], spread) || bucket <= 0 || cycle <= 0 ||
+                index >= static_cast<std::size_t>((cycle + bucket - 1) / bucket))
+                continue;
+            b.variance = spread * spread;
+            Profile &p = profiles_[key(t[0], t[1])];
+            p.cycle = cycle * 1000000000LL;
+            p.bucket = bucket * 1000000000LL;
+            if (index >= p.buckets.size()) p.buckets.resize(index + 1);
+            p.buckets[index] = b;
+            ++buckets;
+        }
+        std::fclose(file);
+        log(LogLevel::Info, "Loaded %zu baseline buckets of %zu sensors from %s", buckets, profiles_.size(),
+            filename_.c_str());
+    }
+
+    // The saved profile of `sensor` on `port` if it fits `spec`, otherwise an empty one.
+    std::vector<BaselineBucket> take(std::string_view port, std::string_view sensor, const BaselineSpec &spec) {
+        std::vector<BaselineBucket> buckets(spec.buckets());
+        std::lock_guard lock(mutex_);
+        const auto p = profiles_.find(key(port, sensor));
+        if (p == profiles_.end()) return buckets;
+        if (p->second.cycle != spec.cycle || p->second.bucket != spec.bucket) {
+            log(LogLevel::Info, "Baseline of %.*s on %.*s does not fit its buckets; learning it afresh",
+                static_cast<int>(sensor.size()), sensor.data(), static_cast<int>(port.size()), port.data());
+            return buckets;
+        }
+        std::copy_n(p->second.buckets.begin(), std::min(buckets.size(), p->second.buckets.size()), buckets.begin());
+        return buckets;
+    }
+
+    void put(std::string_view port, std::string_view sensor, const BaselineSpec &spec,
+             std::vector<BaselineBucket> buckets) {
+        std::lock_guard lock(mutex_);
+        profiles_[key(port, sensor)] = {spec.cycle, spec.bucket, std::move(buckets)};
+    }
+
+    // *** Function: save ***
+    // Rewrites the file with every profile, through a temporary file so a
+    // crash never leaves it half written. The profiles are copied first, so
+    // `take` and `put` do not wait for the file; saves from several
+    // pipelines take turns.
+    //
+    // Returns:
+    // - false if the file could not be written.
+    bool save() const {
+        std::lock_guard file_lock(file_mutex_);
+        std::map<std::string, Profile> profiles;
+        {
+            std::lock_guard lock(mutex_);
+            profiles = profiles_;
+        }
+        const std::string temporary = filename_ + ".tmp";
+        std::FILE *file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr) {
+            log(LogLevel::Error, "Unable to write baselines to %s", temporary.c_str());
+            return false;
+        }
+        std::fwrite(header.data(), 1, header.size(), file);
+        for (const auto &[k, p] : profiles) {
+            const std::size_t tab = k.find('\t');
+            for (std::size_t i = 0; i < p.buckets.size(); ++i) {
+                const BaselineBucket &b = p.buckets[i];
+                if (b.count == 0) continue;
+                std::fprintf(file, "%s,%s,%lld,%lld,%zu,%u,%.9g,%.9g\n", k.substr(0, tab).c_str(),
+                             k.substr(tab + 1).c_str(), static_cast<long long>(p.cycle / 1000000000),
+                             static_cast<long long>(p.bucket / 1000000000), i, b.count, b.mean, b.spread());
+            }
+        }
+        const bool ok = std::fclose(file) == 0;
+#if defined(_WIN32)
+        std::remove(filename_.c_str()); // rename does not replace files here
+#endif
+        // POSIX rename replaces the file atomically
+        return ok && std::rename(temporary.c_str(), filename_.c_str()) == 0;
+    }
+
+private:
+    struct Profile {
+        Timestamp cycle = 0;
+        Timestamp bucket = 0;
+        std::vector<BaselineBucket> buckets;
+    };
+
+    static std::string key(std::string_view port, std::string_view sensor) {
+        std::string k(port);
+        k += '\t';
+        k += sensor;
+        return k;
+    }
+
+    std::string filename_;
+    mutable std::mutex mutex_;                // Guards `profiles_`
+    mutable std::mutex file_mutex_;           // Serialises `save`
+    std::map<std::string, Profile> profiles_; // By "port\tsensor"
+};
+
+// *** SeasonalBaseline Stage ***
+// Scores the readings of sensors with a BaselineSpec against what is normal
+// for their port at that local time of day (or of the week), for sensors such
+// as HUMIDITY or ambient TEMP whose fixed limits are too loose at night and
+// too tight at noon.
+//
+// Each port and sensor has a profile of buckets, one per `bucket` of the
+// cycle, each learning the mean and spread of its readings. A reading finds
+// its bucket by index and is anomalous if it strays more than `sensitivity`
+// spreads from the mean; an Anomaly alert is raised where a run of anomalous
+// readings starts. Anomalous readings are learned at the edge of the
+// expected range, so an excursion barely widens it while a lasting shift is
+// still followed. Buckets that have not learned `min_samples` readings yet
+// only learn.
+//
+// With a store, `poll` checkpoints the profiles every `checkpoint_period`:
+// it hands them to the store and saves it, so a crash loses at most that
+// much learning.
+class SeasonalBaseline {
+public:
+    static constexpr Timestamp checkpoint_period = 300000000000; // 5 minutes
+
+    // Parameters:
+    // - `alerts`: Where anomalies are raised.
+    // - `specs`: The sensors with baselines.
+    // - `store`: Keeps the profiles across restarts (nullptr: learn afresh).
+    SeasonalBaseline(const AlertPath &alerts, const std::vector<BaselineSpec> &specs, BaselineStore *store = nullptr)
+        : alerts_(&alerts), specs_(&specs), store_(store) {
+        for (std::size_t i = 0; i < specs.size(); ++i) {
+            const SensorHandle s = specs[i].sensor;
+            if (s >= by_sensor_.size()) by_sensor_.resize(static_cast<std::size_t>(s) + 1, none);
+            by_sensor_[s] = i;
+        }
+    }
+
+    bool process(SensorData &r) {
+        if (r.sensor >= by_sensor_.size() || by_sensor_[r.sensor] == none) [[likely]]
+            return true;
+        const BaselineSpec &spec = (*specs_)[by_sensor_[r.sensor]];
+        Profile &p = profile(r.port, by_sensor_[r.sensor]);
+        const Timestamp at = clock_.seconds_of_week(r.timestamp) * 1000000000LL % spec.cycle;
+        BaselineBucket &b = p.buckets[static_cast<std::size_t>(at / spec.bucket)];
+        float learned = r.value;
+        if (b.count >= spec.min_samples) {
+            const float margin = static_cast<float>(spec.sensitivity) * std::max(b.spread(), spec.min_spread);
+            const float low = b.mean - margin;
+            const float high = b.mean + margin;
+            const bool anomalous = r.value < low || r.value > high;
+            if (anomalous && !p.anomalous)
+                alerts_->raise({AlertKind::Anomaly, r.sensor, r.port, r.value, low, high, r.timestamp});
+            p.anomalous = anomalous;
+            learned = std::clamp(r.value, low, high);
+        }
+        b.add(learned, spec.memory);
+        return true;
+    }
+
+    // Checkpoints the profiles once `checkpoint_period` has passed since the last checkpoint.
+    void poll(Timestamp now) {
+        if (store_ == nullptr) return;
+        if (next_checkpoint_ == 0) next_checkpoint_ = now + checkpoint_period;
+        if (now < next_checkpoint_) return;
+        next_checkpoint_ = now + checkpoint_period;
+        close();
+        store_->save();
+    }
+
+    // Hands the profiles learned so far to the store.
+    void close() {
+        if (store_ == nullptr) return;
+        const Registry &registry = alerts_->registry();
+        const std::size_t n = specs_->size();
+        for (std::size_t i = 0; i < profiles_.size(); ++i) {
+            if (profiles_[i].buckets.empty()) continue;
+            const BaselineSpec &spec = (*specs_)[i % n];
+            store_->put(registry.port_name(static_cast<PortHandle>(i / n)), registry.sensor_name(spec.sensor), spec,
+                        profiles_[i].buckets);
+        }
+    }
+
+    // The profile of sensor `(*specs)[spec]` on `port`, or nullptr if none was seen yet.
+    const std::vector<BaselineBucket> *buckets(PortHandle port, std::size_t spec) const {
+        const std::size_t i = static_cast<std::size_t>(port) * specs_->size() + spec;
+        return i < profiles_.size() && !profiles_[i].buckets.empty() ? &profiles_[i].buckets : nullptr;
+    }
+
+private:
+    static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+    struct Profile {
+        std::vector<BaselineBucket> buckets; // Empty until the port's first reading
+        bool anomalous = false;              // The last scored reading was
+    };
+
+    Profile &profile(PortHandle port, std::size_t spec) {
+        const std::size_t i = static_cast<std::size_t>(port) * specs_->size() + spec;
+        if (i >= profiles_.size()) [[unlikely]]
+            profiles_.resize(i + 1);
+        Profile &p = profiles_[i];
+        if (p.buckets.empty()) [[unlikely]] {
+            const BaselineSpec &s = (*specs_)[spec];
+            const Registry &registry = alerts_->registry();
+            p.buckets = store_ ? store_->take(registry.port_name(port), registry.sensor_name(s.sensor), s)
+                               : std::vector<BaselineBucket>(s.buckets());
+        }
+        return p;
+    }
+
+    const AlertPath *alerts_;
+    const std::vector<BaselineSpec> *specs_;
+    BaselineStore *store_;
+    std::vector<std::size_t> by_sensor_; // Spec index by sensor handle
+    std::vector<Profile> profiles_;      // By port, then spec
+    LocalWeekClock clock_;
+    Timestamp next_checkpoint_ = 0;      // 0: not polled yet
+};
+
+} // namespace qms
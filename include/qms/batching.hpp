@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+inline constexpr Timestamp no_latency_target = std::numeric_limits<Timestamp>::max() / 2;
+
+// *** LatencyTargets ***
+// How long a reading of each sensor class may wait in a batch before it must
+// be written out. Sensors without their own target use the default.
+class LatencyTargets {
+public:
+    explicit LatencyTargets(Timestamp default_target = 100'000'000) : default_(default_target) {}
+
+    // Builds the targets from the `latency` directives of `config`.
+    static LatencyTargets from_config(const Config &config, Registry &registry) {
+        LatencyTargets targets(config.default_latency_ms < 0 ? 100'000'000 : ms_to_ns(config.default_latency_ms));
+        for (const auto &l : config.latency) targets.set(registry.sensor(l.sensor), ms_to_ns(l.milliseconds));
+        return targets;
+    }
+
+    void set(SensorHandle sensor, Timestamp target) {
+        if (sensor >= targets_.size()) targets_.resize(static_cast<std::size_t>(sensor) + 1, -1);
+        targets_[sensor] = target;
+        min_ = std::min(min_, target);
+    }
+
+    Timestamp operator()(SensorHandle sensor) const {
+        return sensor < targets_.size() && targets_[sensor] >= 0 ? targets_[sensor] : default_;
+    }
+
+    Timestamp default_target() const { return default_; }
+
+    // The tightest target of any sensor class.
+    Timestamp min_target() const { return std::min(min_, default_); }
+
+private:
+    static Timestamp ms_to_ns(double ms) { return static_cast<Timestamp>(ms * 1e6); }
+
+    Timestamp default_;
+    Timestamp min_ = no_latency_target;
+    std::vector<Timestamp> targets_;
+};
+
+// *** BatchPolicy Structure ***
+// Bounds of the adaptive batch size. With `min_batch == max_batch` the batch
+// size is fixed and only the latency deadline adapts.
+struct BatchPolicy {
+    std::size_t min_batch = 1;
+    std::size_t max_batch = 4096;
+};
+
+// *** BatchMetrics Structure ***
+// What a BatchController decided and why, for monitoring:
+// - `arrival_rate`: Smoothed arrival rate, readings per second.
+// - `batch_limit`: Current batch size at which the batch is written early.
+// - `flush_timeout`: Latency target of the batch currently being filled.
+// - `size_flushes`, `deadline_flushes`, `forced_flushes`: Flushes by cause
+//   (batch full, latency deadline reached, end of input or shutdown).
+// - `max_wait`: Longest time a reading waited for its flush.
+struct BatchMetrics {
+    std::uint64_t readings = 0;
+    std::uint64_t flushes = 0;
+    std::uint64_t size_flushes = 0;
+    std::uint64_t deadline_flushes = 0;
+    std::uint64_t forced_flushes = 0;
+    double arrival_rate = 0.0;
+    std::size_t batch_limit = 1;
+    Timestamp flush_timeout = 0;
+    Timestamp max_wait = 0;
+
+    double mean_batch() const { return flushes ? static_cast<double>(readings) / static_cast<double>(flushes) : 0.0; }
+};
+
+// *** BatchController ***
+// Decides when a batch of buffered readings should be written out. It tracks
+// the arrival rate (a moving average over windows of at least 100 ms) and
+// sizes the batch so that, at that rate, it fills in half of the batch's
+// latency target: large batches when readings pour in, single readings when
+// they trickle. Independently, the batch is due once its oldest reading has
+// waited three quarters of the tightest target of the readings in it, which
+// leaves the last quarter for the poll period of the driver.
+class BatchController {
+public:
+    explicit BatchController(BatchPolicy policy = {}) : policy_(policy) { metrics_.batch_limit = policy.min_batch; }
+
+    // Records a reading that arrived at `t` with latency target `target`.
+    // Returns true when the batch is full and should be written now.
+    bool add(Timestamp t, Timestamp target) {
+        observe_rate(t);
+        if (pending_ == 0) {
+            oldest_ = t;
+            target_ = target;
+        } else {
+            target_ = std::min(target_, target);
+        }
+        ++pending_;
+        ++metrics_.readings;
+        metrics_.flush_timeout = target_;
+        metrics_.batch_limit = limit();
+        return pending_ >= metrics_.batch_limit;
+    }
+
+    // Whether the batch has reached its latency deadline at `now`.
+    bool due(Timestamp now) const { return pending_ > 0 && now - oldest_ >= target_ - target_ / 4; }
+
+    // Records that the batch was written at `now`; `cause` is the counter to bump.
+    void flushed(Timestamp now, std::uint64_t BatchMetrics::*cause) {
+        if (pending_ == 0) return;
+        metrics_.max_wait = std::max(metrics_.max_wait, now - oldest_);
+        ++(metrics_.*cause);
+        ++metrics_.flushes;
+        pending_ = 0;
+    }
+
+    std::size_t pending() const { return pending_; }
+    const BatchMetrics &metrics() const { return metrics_; }
+
+private:
+    static constexpr Timestamp window = 100'000'000;
+    static constexpr double smoothing = 0.3;
+
+    // Updates the smoothed rate once per window. Until then a window in
+    // progress that is already faster counts right away (after 1 ms), so a
+    // surge gets large batches within milliseconds.
+    void observe_rate(Timestamp t) {
+        if (window_count_++ == 0 && window_start_ == 0) window_start_ = t;
+        const Timestamp elapsed = t - window_start_;
+        if (elapsed < window / 100) return;
+        const double sample = static_cast<double>(window_count_) * 1e9 / static_cast<double>(elapsed);
+        if (elapsed < window) {
+            metrics_.arrival_rate = std::max(rate_, sample);
+            return;
+        }
+        rate_ = rate_ == 0.0 ? sample : smoothing * sample + (1 - smoothing) * rate_;
+        metrics_.arrival_rate = rate_;
+        window_start_ = t;
+        window_count_ = 0;
+    }
+
+    std::size_t limit() const {
+        const double fill = metrics_.arrival_rate * static_cast<double>(target_) / 2e9;
+        const double clamped = std::clamp(fill, static_cast<double>(policy_.min_batch),
+                                          static_cast<double>(policy_.max_batch));
+        return static_cast<std::size_t>(clamped);
+    }
+
+    BatchPolicy policy_;
+    BatchMetrics metrics_;
+    std::size_t pending_ = 0;
+    Timestamp oldest_ = 0;
+    Timestamp target_ = 0;
+    double rate_ = 0.0;
+    Timestamp window_start_ = 0;
+    std::uint64_t window_count_ = 0;
+};
+
+// *** Batched Stage ***
+// Wraps a buffered stage (a sink or a chain of sinks) and takes over the
+// decision when it flushes. Every reading is passed straight to the inner
+// stage; the inner stage is flushed when the BatchController says the batch is
+// full (in `process`) or due (in `poll`). `flush` always writes, for end of
+// input and shutdown, so drivers should call `poll(now)` when idle instead.
+//
+// Parameters:
+// - `stage`: The wrapped stage; may be a reference type to share it.
+// - `targets`: Latency targets per sensor class; must outlive the stage.
+// - `policy`: Batch size bounds.
+template <class S>
+class Batched {
+public:
+    Batched(S stage, const LatencyTargets &targets, BatchPolicy policy = {})
+        : stage_(std::forward<S>(stage)), targets_(&targets), controller_(policy) {}
+
+    bool process(SensorData &r) {
+        const bool keep = stage_.process(r);
+        last_ = r.timestamp;
+        if (controller_.add(r.timestamp, (*targets_)(r.sensor))) {
+            stage_.flush();
+            controller_.flushed(r.timestamp, &BatchMetrics::size_flushes);
+        }
+        return keep;
+    }
+
+    void poll(Timestamp now) {
+        if (!controller_.due(now)) return;
+        stage_.flush();
+        controller_.flushed(now, &BatchMetrics::deadline_flushes);
+    }
+
+    void flush() {
+        stage_.flush();
+        controller_.flushed(last_, &BatchMetrics::forced_flushes);
+    }
+
+    const BatchMetrics &metrics() const { return controller_.metrics(); }
+    std::size_t pending() const { return controller_.pending(); }
+    S &stage() { return stage_; }
+
+private:
+    S stage_;
+    const LatencyTargets *targets_;
+    BatchController controller_;
+    Timestamp last_ = 0;
+};
+
+} // namespace qms
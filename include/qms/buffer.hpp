@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace qms {
+
+// *** ByteBuffer ***
+// A growable byte buffer for building output in place. Writers ask for a
+// pointer with room for at most `n` bytes via `reserve_tail`, format directly
+// into it and `commit` the bytes actually written, so serialisers never go
+// through an intermediate string.
+class ByteBuffer {
+public:
+    ByteBuffer() = default;
+    explicit ByteBuffer(std::size_t capacity) { grow(capacity); }
+    ByteBuffer(ByteBuffer &&other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+          capacity_(std::exchange(other.capacity_, 0)) {}
+    ByteBuffer &operator=(ByteBuffer &&other) noexcept {
+        if (this != &other) {
+            std::free(data_);
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, 0);
+        }
+        return *this;
+    }
+    ByteBuffer(const ByteBuffer &) = delete;
+    ByteBuffer &operator=(const ByteBuffer &) = delete;
+    ~ByteBuffer() { std::free(data_); }
+
+    // Returns a pointer to at least `n` writable bytes past the current end.
+    char *reserve_tail(std::size_t n) {
+        if (capacity_ - size_ < n) grow(size_ + n);
+        return data_ + size_;
+    }
+
+    // Marks `n` bytes written through `reserve_tail` as part of the buffer.
+    void commit(std::size_t n) { size_ += n; }
+
+    void append(const void *src, std::size_t n) {
+        std::memcpy(reserve_tail(n), src, n);
+        size_ += n;
+    }
+    void append(std::string_view s) { append(s.data(), s.size()); }
+    void push_back(char c) { *reserve_tail(1) = c, ++size_; }
+
+    const char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    void clear() { size_ = 0; }
+
+private:
+    void grow(std::size_t min_capacity) {
+        std::size_t cap = capacity_ ? capacity_ * 2 : 4096;
+        while (cap < min_capacity) cap *= 2;
+        void *p = std::realloc(data_, cap);
+        if (!p) throw std::bad_alloc();
+        data_ = static_cast<char *>(p);
+        capacity_ = cap;
+    }
+
+    char *data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+} // namespace qms
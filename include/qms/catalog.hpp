@@ -0,0 +1,199 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "format.hpp"
+#include "log.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "sensor_traits.hpp"
+
+namespace qms {
+
+// Spec applied to sensors that are neither a built-in kind nor defined in the
+// configuration: the historical 0-1000 plausibility range, 5-25 limits and
+// two decimals.
+inline constexpr SensorSpec generic_sensor_spec{"", "", 0.0f, 1000.0f, 5.0f, 25.0f, 2};
+
+// Tag passed to SensorCatalog::visit callbacks for built-in kinds.
+template <SensorKind K>
+struct KindTag {
+    using kind = K;
+};
+
+template <class T>
+struct is_kind_tag : std::false_type {};
+template <class K>
+struct is_kind_tag<KindTag<K>> : std::true_type {};
+
+// *** SensorCatalog ***
+// Maps sensor handles to their SensorSpec. The built-in `Kinds` are interned
+// first so that they own handles 0..N-1; `visit` dispatches on the handle and
+// hands callbacks a KindTag for those, letting each kind's code path be
+// specialised with its constants. Sensors defined at runtime (from the
+// configuration) live in a table indexed by handle, and everything else gets
+// generic_sensor_spec.
+//
+// Define runtime sensors during setup; afterwards the catalog is read-only and
+// may be shared between pipeline threads.
+template <SensorKind... Kinds>
+class SensorCatalog {
+public:
+    static constexpr std::size_t known_kinds = sizeof...(Kinds);
+    static constexpr std::array<SensorSpec, known_kinds> known_specs{spec_of<Kinds>()...};
+
+    // *** Constructor ***
+    // Interns the built-in kinds into `registry`, which must not contain any
+    // sensors yet.
+    explicit SensorCatalog(Registry &registry) : registry_(registry) {
+        SensorHandle expected = 0;
+        for (const auto &spec : known_specs) {
+            if (registry.sensor(spec.id) != expected++)
+                throw std::logic_error("SensorCatalog must be created before any sensor is interned");
+        }
+    }
+
+    // *** Function: define ***
+    // Adds a sensor that is not a built-in kind (typically from the
+    // configuration file).
+    //
+    // Returns:
+    // - false if `spec.id` names a built-in kind, whose traits are fixed at compile time.
+    bool define(const SensorSpec &spec) {
+        const SensorHandle h = registry_.sensor(spec.id);
+        if (h < known_kinds) {
+            log(LogLevel::Error, "Sensor %.*s is a built-in kind and cannot be redefined",
+                static_cast<int>(spec.id.size()), spec.id.data());
+            return false;
+        }
+        if (h >= runtime_.size()) runtime_.resize(static_cast<std::size_t>(h) + 1, nullptr);
+        const std::string &unit = strings_.emplace_back(spec.unit);
+        SensorSpec &stored = specs_.emplace_back(spec);
+        stored.id = registry_.sensor_name(h);
+        stored.unit = unit;
+        runtime_[h] = &stored;
+        return true;
+    }
+
+    // *** Function: visit ***
+    // Calls `f(KindTag<K>{})` if `sensor` is the built-in kind K, otherwise
+    // `f(const SensorSpec&)` with the runtime or generic spec. For built-in
+    // kinds the callback sees the spec as compile-time constants.
+    template <class F>
+    decltype(auto) visit(SensorHandle sensor, F &&f) const {
+        return visit_impl(sensor, f, std::make_index_sequence<known_kinds>{});
+    }
+
+    const SensorSpec &spec(SensorHandle sensor) const {
+        if (sensor < known_kinds) return known_specs[sensor];
+        return runtime_spec(sensor);
+    }
+
+    static constexpr bool is_known(SensorHandle sensor) { return sensor < known_kinds; }
+
+    // Default statistics (limits) for a sensor seen for the first time.
+    SensorStats default_stats(SensorHandle sensor) const {
+        const SensorSpec &s = spec(sensor);
+        SensorStats stats;
+        stats.min_limit = s.min_limit;
+        stats.max_limit = s.max_limit;
+        stats.rate_seconds = rate_seconds(s.unit);
+        return stats;
+    }
+
+    Registry &registry() const { return registry_; }
+
+private:
+    const SensorSpec &runtime_spec(SensorHandle sensor) const {
+        if (sensor < runtime_.size() && runtime_[sensor]) return *runtime_[sensor];
+        return generic_sensor_spec;
+    }
+
+    template <class F, std::size_t I, std::size_t... Rest>
+    static decltype(auto) visit_kind(SensorHandle sensor, F &f, const SensorSpec &fallback) {
+        using K = std::tuple_element_t<I, std::tuple<Kinds...>>;
+        if (sensor == I) return f(KindTag<K>{});
+        if constexpr (sizeof...(Rest) == 0) return f(fallback);
+        else return visit_kind<F, Rest...>(sensor, f, fallback);
+    }
+
+    template <class F, std::size_t... I>
+    decltype(auto) visit_impl(SensorHandle sensor, F &f, std::index_sequence<I...>) const {
+        if constexpr (sizeof...(I) == 0) return f(runtime_spec(sensor));
+        else {
+            if (sensor >= known_kinds) return f(runtime_spec(sensor));
+            return visit_kind<F, I...>(sensor, f, generic_sensor_spec);
+        }
+    }
+
+    Registry &registry_;
+    std::vector<const SensorSpec *> runtime_;
+    std::deque<SensorSpec> specs_;
+    std::deque<std::string> strings_;
+};
+
+// The sensor kinds every monitor knows about.
+using DefaultCatalog =
+    SensorCatalog<kinds::Temp, kinds::Ph, kinds::Humidity, kinds::Pressure, kinds::Flow, kinds::Vibration>;
+
+// *** TypedValidate Stage ***
+// Rejects readings outside the physical range of their sensor kind. Built-in
+// kinds compare against compile-time bounds; the check itself is branch-free.
+template <class Catalog>
+class TypedValidate {
+public:
+    explicit TypedValidate(const Catalog &catalog) : catalog_(&catalog) {}
+
+    bool process(SensorData &r) const {
+        const float v = r.value;
+        const bool ok = catalog_->visit(r.sensor, [v](const auto &kind) {
+            using T = std::decay_t<decltype(kind)>;
+            if constexpr (is_kind_tag<T>::value) {
+                using K = typename T::kind;
+                return (v >= K::physical_min) & (v <= K::physical_max);
+            } else {
+                return (v >= kind.physical_min) & (v <= kind.physical_max);
+            }
+        });
+        if (!ok) [[unlikely]] {
+            const auto id = catalog_->registry().sensor_name(r.sensor);
+            log(LogLevel::Error, "Sensor value out of realistic range for %.*s: %.2f", static_cast<int>(id.size()),
+                id.data(), v);
+        }
+        return ok;
+    }
+
+private:
+    const Catalog *catalog_;
+};
+
+// *** CatalogFormat ***
+// Value formatter for the text sinks that writes each value with the precision
+// of its sensor kind.
+template <class Catalog>
+class CatalogFormat {
+public:
+    explicit CatalogFormat(const Catalog &catalog) : catalog_(&catalog) {}
+
+    // Writes `value` for `sensor` to `out` (room for 32 characters) and returns the new end.
+    char *operator()(char *out, SensorHandle sensor, float value) const {
+        return catalog_->visit(sensor, [out, value](const auto &kind) {
+            using T = std::decay_t<decltype(kind)>;
+            if constexpr (is_kind_tag<T>::value) return format_fixed<T::kind::precision>(out, value);
+            else return format_fixed_fast(out, value, kind.precision);
+        });
+    }
+
+private:
+    const Catalog *catalog_;
+};
+
+} // namespace qms
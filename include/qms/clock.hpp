@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "record.hpp"
+
+namespace qms {
+
+class VirtualClock;
+
+// *** Clock ***
+// The single source of time for the library. Every timestamp and every sleep
+// in sources, executors and time-driven stages goes through a Clock, so a
+// VirtualClock can replace wall time and let a simulation run hours of
+// traffic in seconds, deterministically.
+class Clock {
+public:
+    virtual ~Clock() = default;
+
+    // Current time in nanoseconds since the Unix epoch.
+    virtual Timestamp now() const = 0;
+
+    // Blocks the calling thread until `deadline`.
+    virtual void sleep_until(Timestamp deadline) = 0;
+
+    void sleep_for(std::chrono::nanoseconds d) { sleep_until(now() + d.count()); }
+
+    // Returns this clock as a VirtualClock, or nullptr for real time.
+    virtual VirtualClock *as_virtual() { return nullptr; }
+};
+
+// *** SystemClock ***
+// Wall-clock time (std::chrono::system_clock) and real sleeps.
+class SystemClock final : public Clock {
+public:
+    Timestamp now() const override {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void sleep_until(Timestamp deadline) override {
+        const Timestamp wait = deadline - now();
+        if (wait > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+    }
+};
+
+// *** VirtualClock ***
+// Simulated time. It only moves when advanced; sleeping jumps straight to the
+// deadline instead of waiting.
+class VirtualClock final : public Clock {
+public:
+    explicit VirtualClock(Timestamp start = 0) : now_(start) {}
+
+    Timestamp now() const override { return now_.load(std::memory_order_acquire); }
+
+    void sleep_until(Timestamp deadline) override { advance_to(deadline); }
+
+    // Moves time forward to `t`; time never moves backwards.
+    void advance_to(Timestamp t) {
+        Timestamp cur = now_.load(std::memory_order_relaxed);
+        while (t > cur && !now_.compare_exchange_weak(cur, t, std::memory_order_acq_rel)) {
+        }
+    }
+
+    void advance(std::chrono::nanoseconds d) { advance_to(now() + d.count()); }
+
+    VirtualClock *as_virtual() override { return this; }
+
+private:
+    std::atomic<Timestamp> now_;
+};
+
+// The process-wide real-time clock used when no clock is injected.
+inline Clock &system_clock() {
+    static SystemClock clock;
+    return clock;
+}
+
+} // namespace qms
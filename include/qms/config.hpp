@@ -0,0 +1,443 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "log.hpp"
+#include "memory.hpp"
+#include "protocols.hpp"
+#include "sensor_traits.hpp"
+
+namespace qms {
+
+// *** SensorConfig Structure ***
+// A sensor declared in the configuration file; owns the strings a SensorSpec points at.
+struct SensorConfig {
+    std::string id;
+    std::string unit;
+    float physical_min;
+    float physical_max;
+    float min_limit;
+    float max_limit;
+    int precision;
+
+    SensorSpec spec() const { return {id, unit, physical_min, physical_max, min_limit, max_limit, precision}; }
+};
+
+// *** PortGroup Structure ***
+// Ports served together by one pipeline thread, placed on one NUMA node
+// (`numa_node` -1 leaves placement to the operating system).
+struct PortGroup {
+    int numa_node = -1;
+    std::vector<std::string> ports;
+};
+
+// *** LatencyConfig Structure ***
+// The longest a reading of sensor `sensor` may wait in a batch before it is written.
+struct LatencyConfig {
+    std::string sensor;
+    double milliseconds;
+};
+
+// *** CriticalityConfig Structure ***
+// The criticality class of sensor `sensor` (see Criticality).
+struct CriticalityConfig {
+    std::string sensor;
+    Criticality level;
+};
+
+// *** ModbusConfig Structure ***
+// A value polled from a Modbus slave on port `port` (see ModbusPoint).
+struct ModbusConfig {
+    std::string port;
+    std::uint8_t slave;
+    std::uint16_t address;
+    ModbusFormat format;
+    float scale;
+    std::string sensor;
+};
+
+// *** PollConfig Structure ***
+// Bounds of the adaptive poll interval of sensor `sensor`.
+struct PollConfig {
+    std::string sensor;
+    double min_ms;
+    double max_ms;
+};
+
+// *** BusLoadConfig Structure ***
+// The share of time (0-1] polling may keep the bus of port `port` busy.
+struct BusLoadConfig {
+    std::string port;
+    double utilization;
+};
+
+// *** RecipeConfig Structure ***
+// The limits of sensor `sensor` while recipe `recipe` is running.
+struct RecipeConfig {
+    std::string recipe;
+    std::string sensor;
+    float min_limit;
+    float max_limit;
+};
+
+// *** LineConfig Structure ***
+// A production line, whose ports share the active recipe.
+struct LineConfig {
+    std::string name;
+    std::vector<std::string> ports;
+    std::string recipe; // Active at start (empty: none)
+};
+
+// *** GoldenConfig Structure ***
+// The golden profile of sensor `sensor`, read from `file` and sampled every
+// `step_seconds`, that runs may lag or lead by `band_seconds` and deviate
+// from by `threshold` in total.
+struct GoldenConfig {
+    std::string sensor;
+    std::string file;
+    double step_seconds;
+    double band_seconds;
+    double threshold;
+};
+
+// *** BaselineConfig Structure ***
+// The seasonal baseline of sensor `sensor`: buckets of `bucket_minutes` over
+// a day or a week, flagging readings `sensitivity` standard deviations off.
+struct BaselineConfig {
+    std::string sensor;
+    bool weekly;
+    double bucket_minutes;
+    double sensitivity;
+};
+
+// *** RateConfig Structure ***
+// Sensor `sensor` reports `hertz` readings per second, give or take
+// `tolerance_percent`.
+struct RateConfig {
+    std::string sensor;
+    double hertz;
+    double tolerance_percent;
+};
+
+// *** PluginConfig Structure ***
+// A plugin library applied to the readings of `scope` ("all", "port:<name>",
+// "sensor:<ID>" or "class:<criticality>") with arguments `args`.
+struct PluginConfig {
+    std::string library;
+    std::string scope;
+    std::string args;
+};
+
+// *** Config Structure ***
+// Everything read from a monitor configuration file.
+struct Config {
+    std::vector<SensorConfig> sensors;
+    std::vector<PortGroup> groups;
+    MemoryPolicy memory; // `numa_node` is set per port group
+    std::vector<LatencyConfig> latency;
+    double default_latency_ms = -1; // Negative: library default
+    double stall_seconds = 10;      // Watchdog: longest time a thread may spend in one stage
+    double silence_seconds = 60;    // Watchdog: longest time a port may deliver nothing (0: never)
+    std::vector<CriticalityConfig> criticality;
+    bool fair_scheduling = false;      // Weighted fair queuing across criticality classes, not strict priority
+    std::size_t queue_capacity = 4096; // Readings each criticality class may queue before it sheds load
+    std::vector<ModbusConfig> modbus;
+    std::vector<PollConfig> poll;
+    PollConfig default_poll{"", 100, 10000};
+    std::vector<BusLoadConfig> busload;
+    double default_busload = 0.5;
+    double rollup_seconds = 0;      // Rollup period (0: no rollups)
+    double stale_seconds = 60;      // A sensor's value counts as stale after this long (0: never)
+    double alarm_delay_seconds = 0; // Time out of limits before an excursion counts as alarmed
+    bool compact_sensors = false;   // Sensor table: hot state only for reporting sensors (see SensorTablePolicy)
+    double evict_seconds = 600;     // Compact sensor table: idle time after which a sensor is evicted
+    std::vector<RecipeConfig> recipes;
+    std::vector<LineConfig> lines;
+    std::vector<GoldenConfig> golden;
+    std::vector<BaselineConfig> baselines;
+    std::vector<std::string> models; // Model files (see load_model)
+    std::vector<PluginConfig> plugins;
+    std::vector<RateConfig> rates;
+    bool correct_device_time = true; // Map device timestamps onto the gateway clock, or use arrival times
+    std::uint32_t cost_sampling = 64; // CPU cost accounting: time 1 in this many readings per phase (0: off)
+    std::uint16_t dashboard_port = 0; // Live dashboard on this loopback port (0: off)
+    double dashboard_rate = 4;        // Most dashboard updates per second
+    std::string json_lines;           // Also log readings as JSON Lines to this file (empty: off)
+};
+
+namespace detail {
+
+// Splits `line` at whitespace into at most `max` tokens, ignoring a trailing '#' comment.
+inline std::size_t tokenize(std::string_view line, std::string_view *tokens, std::size_t max) {
+    if (const auto hash = line.find('#'); hash != std::string_view::npos) line = line.substr(0, hash);
+    std::size_t n = 0;
+    std::size_t i = 0;
+    while (n < max) {
+        i = line.find_first_not_of(" \t\r\n", i);
+        if (i == std::string_view::npos) break;
+        const std::size_t j = std::min(line.find_first_of(" \t\r\n", i), line.size());
+        tokens[n++] = line.substr(i, j - i);
+        i = j;
+    }
+    return n;
+}
+
+template <class T>
+bool parse_number(std::string_view s, T &out) {
+    if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+    const auto r = std::from_chars(s.data(), s.data() + s.size(), out);
+    return r.ec == std::errc() && r.ptr == s.data() + s.size();
+}
+
+} // namespace detail
+
+// *** Function: load_config ***
+// Reads a line-oriented configuration file into `config`. Blank lines and
+// text after '#' are ignored. Supported directives:
+//
+//   sensor <ID> <unit> <precision> <physical_min> <physical_max> <min_limit> <max_limit>
+//       Declares a sensor that is not one of the built-in kinds.
+//   group <node|any> <port> [port...]
+//       Serves the ports from one pipeline thread bound to NUMA node <node>.
+//   hugepages <on|off>
+//       Backs per-sensor state tables with huge pages.
+//   sensor_table <dense|compact> [idle_seconds]
+//       Per-sensor state for a few sensors that all report (dense), or for up
+//       to millions of which only some are active (compact): a compact table
+//       keeps full state only for reporting sensors and evicts those idle for
+//       <idle_seconds> (default 600) to a compact store.
+//   rate <ID> <hertz> [tolerance_percent]
+//       The rate the sensor's device reports at; an alert is raised when the
+//       measured rate strays more than <tolerance_percent> (default 20) from it.
+//   device_time <corrected|arrival>
+//       Timestamps readings that devices stamp with their own clock ("<ID>
+//       <value> t=<seconds>") at their device time corrected for the
+//       estimated offset and drift of the device clock (default), or at
+//       their arrival.
+//   costs <readings|off>
+//       Times one in <readings> readings (default 64) in each phase of the
+//       pipeline and attributes the CPU cycles to their sensor and port; the
+//       sensors and ports that cost the most are logged at exit.
+//   json_lines <file|off>
+//       Also logs every reading to <file> as JSON Lines, one object per
+//       reading, batched like the CSV log.
+//   dashboard <port|off> [updates_per_second]
+//       Serves a live dashboard on the loopback port: a page at "/" and a
+//       Server-Sent Events stream at "/events" of the sensors that changed,
+//       conflated to at most <updates_per_second> (default 4).
+//   latency <ID|default> <milliseconds>
+//       Latency target of the sensor's readings in batched sinks.
+//   watchdog <stall_seconds> <silence_seconds|off>
+//       Raise a stall alarm when a pipeline thread is stuck in a stage or a
+//       port delivers nothing for this long.
+//   criticality <ID> <critical|normal|cosmetic>
+//       Scheduling class of the sensor's readings; sensors default to normal.
+//   scheduling <strict|fair> [queue_capacity]
+//       Serve criticality classes by strict priority or weighted fair
+//       queuing, each queueing at most <queue_capacity> readings.
+//   modbus <port> <slave> <register> <int16|uint16|float32> <scale> <ID>
+//       Polls a holding register of a Modbus RTU slave on the port and reports
+//       it, multiplied by <scale>, as sensor <ID>.
+//   poll <ID|default> <min_ms> <max_ms>
+//       Range of the adaptive poll interval of a polled sensor.
+//   busload <port|default> <percent>
+//       Share of time polling may keep the port's bus busy.
+//   rollup <seconds|off>
+//       Writes per-sensor statistics for every period of this length.
+//   states <stale_seconds|off> <alarm_delay_seconds>
+//       When a sensor's last value counts as stale, and how long it must stay
+//       out of its limits to count as alarmed, for time-in-state accounting.
+//   recipe <name> <ID> <min_limit> <max_limit>
+//       Limits of the sensor while the recipe runs; one line per sensor.
+//       Sensors a recipe does not list keep their own limits.
+//   line <name> <recipe|none> <port> [port...]
+//       A production line and the recipe it starts with. A "@recipe <name>"
+//       line on any of its ports changes the line over. Ports outside every
+//       line form a line of their own, named after the port.
+//   golden <ID> <file> <step_seconds> <band_seconds> <threshold>
+//       Compares every lot and batch with the sensor's golden profile in
+//       <file> while it runs, allowing it to lag or lead by <band_seconds>,
+//       and alerts once its deviation summed over the steps exceeds <threshold>.
+//       A sensor has at most one golden profile.
+//   baseline <ID> <daily|weekly> <bucket_minutes> <sensitivity>
+//       Learns what is normal for the sensor at each time of day (or of the
+//       week) in buckets of <bucket_minutes>, and alerts on readings more
+//       than <sensitivity> standard deviations off.
+//   model <file>
+//       Scores a pre-trained linear or tree-ensemble anomaly model on every
+//       port (see load_model for the file format).
+//   plugin <library> <all|port:<name>|sensor:<ID>|class:<criticality>> [args...]
+//       Runs a validator or stage plugin (see qms_plugin.h) on the readings
+//       of the scope, passing it the arguments.
+//
+// Malformed lines are reported with their line number and skipped.
+//
+// Returns:
+// - true if the file was read without errors.
+inline bool load_config(const char *filename, Config &config) {
+    std::FILE *file = std::fopen(filename, "r");
+    if (file == nullptr) {
+        log(LogLevel::Error, "Unable to open configuration file %s", filename);
+        return false;
+    }
+
+    bool ok = true;
+    char buffer[1024];
+    int line_no = 0;
+    while (std::fgets(buffer, sizeof(buffer), file)) {
+        ++line_no;
+        std::string_view t[16];
+        const std::size_t n = detail::tokenize(buffer, t, 16);
+        if (n == 0) continue;
+
+        bool valid = false;
+        if (t[0] == "sensor" && n == 8) {
+            SensorConfig s{std::string(t[1]), std::string(t[2]), 0, 0, 0, 0, 0};
+            valid = detail::parse_number(t[3], s.precision) && detail::parse_number(t[4], s.physical_min) &&
+                    detail::parse_number(t[5], s.physical_max) && detail::parse_number(t[6], s.min_limit) &&
+                    detail::parse_number(t[7], s.max_limit) && s.precision >= 0 && s.precision <= 6 &&
+                    s.physical_min <= s.physical_max;
+            if (valid) config.sensors.push_back(std::move(s));
+        } else if (t[0] == "group" && n >= 3) {
+            PortGroup g;
+            valid = t[1] == "any" || (detail::parse_number(t[1], g.numa_node) && g.numa_node >= 0);
+            for (std::size_t i = 2; i < n; ++i) g.ports.emplace_back(t[i]);
+            if (valid) config.groups.push_back(std::move(g));
+        } else if (t[0] == "latency" && n == 3) {
+            double ms = 0;
+            valid = detail::parse_number(t[2], ms) && ms > 0;
+            if (valid && t[1] == "default") config.default_latency_ms = ms;
+            else if (valid) config.latency.push_back({std::string(t[1]), ms});
+        } else if (t[0] == "watchdog" && n == 3) {
+            double stall = 0;
+            double silence = 0;
+            valid = detail::parse_number(t[1], stall) && stall > 0 &&
+                    (t[2] == "off" || (detail::parse_number(t[2], silence) && silence > 0));
+            if (valid) config.stall_seconds = stall, config.silence_seconds = silence;
+        } else if (t[0] == "criticality" && n == 3) {
+            Criticality level{};
+            valid = parse_criticality(t[2], level);
+            if (valid) config.criticality.push_back({std::string(t[1]), level});
+        } else if (t[0] == "scheduling" && (n == 2 || n == 3)) {
+            std::size_t capacity = config.queue_capacity;
+            valid = (t[1] == "strict" || t[1] == "fair") &&
+                    (n == 2 || (detail::parse_number(t[2], capacity) && capacity > 0));
+            if (valid) config.fair_scheduling = t[1] == "fair", config.queue_capacity = capacity;
+        } else if (t[0] == "modbus" && n == 7) {
+            ModbusConfig m{std::string(t[1]), 0, 0, ModbusFormat::Int16, 1.0f, std::string(t[6])};
+            valid = detail::parse_number(t[2], m.slave) && m.slave >= 1 && m.slave <= 247 &&
+                    detail::parse_number(t[3], m.address) && parse_modbus_format(t[4], m.format) &&
+                    detail::parse_number(t[5], m.scale);
+            if (valid) config.modbus.push_back(std::move(m));
+        } else if (t[0] == "poll" && n == 4) {
+            PollConfig p{std::string(t[1]), 0, 0};
+            valid = detail::parse_number(t[2], p.min_ms) && detail::parse_number(t[3], p.max_ms) && p.min_ms > 0 &&
+                    p.min_ms <= p.max_ms;
+            if (valid && t[1] == "default") config.default_poll = p;
+            else if (valid) config.poll.push_back(std::move(p));
+        } else if (t[0] == "busload" && n == 3) {
+            double percent = 0;
+            valid = detail::parse_number(t[2], percent) && percent > 0 && percent <= 100;
+            if (valid && t[1] == "default") config.default_busload = percent / 100;
+            else if (valid) config.busload.push_back({std::string(t[1]), percent / 100});
+        } else if (t[0] == "rollup" && n == 2) {
+            double seconds = 0;
+            valid = t[1] == "off" || (detail::parse_number(t[1], seconds) && seconds > 0);
+            if (valid) config.rollup_seconds = seconds;
+        } else if (t[0] == "states" && n == 3) {
+            double stale = 0;
+            double delay = 0;
+            valid = (t[1] == "off" || (detail::parse_number(t[1], stale) && stale > 0)) &&
+                    detail::parse_number(t[2], delay) && delay >= 0;
+            if (valid) config.stale_seconds = stale, config.alarm_delay_seconds = delay;
+        } else if (t[0] == "recipe" && n == 5) {
+            RecipeConfig r{std::string(t[1]), std::string(t[2]), 0.0f, 0.0f};
+            valid = detail::parse_number(t[3], r.min_limit) && detail::parse_number(t[4], r.max_limit) &&
+                    r.min_limit <= r.max_limit;
+            if (valid) config.recipes.push_back(std::move(r));
+        } else if (t[0] == "line" && n >= 4) {
+            LineConfig l{std::string(t[1]), {}, t[2] == "none" ? std::string() : std::string(t[2])};
+            for (std::size_t i = 3; i < n; ++i) l.ports.emplace_back(t[i]);
+            config.lines.push_back(std::move(l));
+            valid = true;
+        } else if (t[0] == "golden" && n == 6) {
+            GoldenConfig g{std::string(t[1]), std::string(t[2]), 0, 0, 0};
+            valid = detail::parse_number(t[3], g.step_seconds) && detail::parse_number(t[4], g.band_seconds) &&
+                    detail::parse_number(t[5], g.threshold) && g.step_seconds > 0 && g.band_seconds >= 0 &&
+                    g.threshold > 0;
+            const bool duplicate = std::any_of(config.golden.begin(), config.golden.end(),
+                                               [&](const GoldenConfig &o) { return o.sensor == g.sensor; });
+            if (valid && duplicate)
+                log(LogLevel::Error, "%s:%d: sensor %s already has a golden profile", filename, line_no,
+                    g.sensor.c_str());
+            valid = valid && !duplicate;
+            if (valid) config.golden.push_back(std::move(g));
+        } else if (t[0] == "baseline" && n == 5) {
+            BaselineConfig b{std::string(t[1]), t[2] == "weekly", 0, 0};
+            valid = (t[2] == "daily" || t[2] == "weekly") && detail::parse_number(t[3], b.bucket_minutes) &&
+                    detail::parse_number(t[4], b.sensitivity) && b.bucket_minutes >= 1 && b.sensitivity > 0;
+            if (valid) config.baselines.push_back(std::move(b));
+        } else if (t[0] == "model" && n == 2) {
+            config.models.emplace_back(t[1]);
+            valid = true;
+        } else if (t[0] == "plugin" && n >= 3) {
+            PluginConfig p{std::string(t[1]), std::string(t[2]), {}};
+            for (std::size_t i = 3; i < n; ++i) p.args.append(i > 3 ? " " : "").append(t[i]);
+            Criticality level{};
+            valid = t[2] == "all" || (t[2].starts_with("port:") && t[2].size() > 5) ||
+                    (t[2].starts_with("sensor:") && t[2].size() > 7) ||
+                    (t[2].starts_with("class:") && parse_criticality(t[2].substr(6), level));
+            if (valid) config.plugins.push_back(std::move(p));
+        } else if (t[0] == "sensor_table" && (n == 2 || n == 3)) {
+            double idle = config.evict_seconds;
+            valid = (t[1] == "dense" || t[1] == "compact") &&
+                    (n == 2 || (detail::parse_number(t[2], idle) && idle > 0));
+            if (valid) config.compact_sensors = t[1] == "compact", config.evict_seconds = idle;
+        } else if (t[0] == "rate" && (n == 3 || n == 4)) {
+            RateConfig r{std::string(t[1]), 0, 20};
+            valid = detail::parse_number(t[2], r.hertz) && r.hertz > 0 &&
+                    (n == 3 || (detail::parse_number(t[3], r.tolerance_percent) && r.tolerance_percent > 0));
+            if (valid) config.rates.push_back(std::move(r));
+        } else if (t[0] == "device_time" && n == 2) {
+            valid = t[1] == "corrected" || t[1] == "arrival";
+            if (valid) config.correct_device_time = t[1] == "corrected";
+        } else if (t[0] == "costs" && n == 2) {
+            std::uint32_t period = 0;
+            valid = t[1] == "off" || (detail::parse_number(t[1], period) && period > 0);
+            if (valid) config.cost_sampling = period;
+        } else if (t[0] == "json_lines" && n == 2) {
+            config.json_lines = t[1] == "off" ? std::string() : std::string(t[1]);
+            valid = true;
+        } else if (t[0] == "dashboard" && (n == 2 || n == 3)) {
+            std::uint16_t port = 0;
+            double rate = config.dashboard_rate;
+            valid = (t[1] == "off" || (detail::parse_number(t[1], port) && port > 0)) &&
+                    (n == 2 || (detail::parse_number(t[2], rate) && rate > 0));
+            if (valid) config.dashboard_port = port, config.dashboard_rate = rate;
+        } else if (t[0] == "hugepages" && n == 2) {
+            valid = t[1] == "on" || t[1] == "off";
+            if (valid) config.memory.huge_pages = t[1] == "on";
+        }
+        if (!valid) {
+            log(LogLevel::Error, "%s:%d: invalid configuration line", filename, line_no);
+            ok = false;
+        }
+    }
+    std::fclose(file);
+    return ok;
+}
+
+// *** Function: apply_sensors ***
+// Defines every configured sensor in `catalog` (a SensorCatalog).
+template <class Catalog>
+void apply_sensors(const Config &config, Catalog &catalog) {
+    for (const auto &s : config.sensors) catalog.define(s.spec());
+}
+
+} // namespace qms
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "detail/chunked_array.hpp"
+#include "memory.hpp"
+#include "pipeline.hpp"
+#include "record.hpp"
+
+namespace qms {
+
+// Reads the processor's cycle counter (the time-stamp counter on x86, the
+// virtual counter on ARM64; steady-clock nanoseconds elsewhere). Not
+// serialising: good for sampled costs of a few hundred cycles and up.
+inline std::uint64_t cycle_count() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    std::uint64_t v;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// *** CostPhase Enumeration ***
+// The parts of the pipeline CPU time is accounted to.
+enum class CostPhase : std::uint8_t {
+    Parse,    // Framing, parsing and interning a line
+    Validate, // Physical range checks
+    Plugins,  // Validator plugins, per call on a batch
+    Monitor,  // Quality limits, rollups and lot aggregation
+    Rules,    // Golden profiles, seasonal baselines and anomaly models
+    Sinks,    // Console and log output
+};
+
+inline constexpr std::size_t cost_phases = 6;
+
+inline const char *to_string(CostPhase phase) {
+    switch (phase) {
+    case CostPhase::Parse: return "parse";
+    case CostPhase::Validate: return "validate";
+    case CostPhase::Plugins: return "plugins";
+    case CostPhase::Monitor: return "monitor";
+    case CostPhase::Rules: return "rules";
+    case CostPhase::Sinks: return "sinks";
+    }
+    return "unknown";
+}
+
+// Cycles per CostPhase.
+using PhaseCycles = std::array<std::uint64_t, cost_phases>;
+
+// *** CostEntry Structure ***
+// The estimated cycles a sensor or port cost, by phase.
+struct CostEntry {
+    std::uint32_t handle; // SensorHandle or PortHandle
+    PhaseCycles cycles;
+
+    std::uint64_t total() const {
+        std::uint64_t t = 0;
+        for (const std::uint64_t c : cycles) t += c;
+        return t;
+    }
+
+    // The phase that cost the most.
+    CostPhase dominant() const {
+        return static_cast<CostPhase>(std::max_element(cycles.begin(), cycles.end()) - cycles.begin());
+    }
+};
+
+// *** CostLedger ***
+// Attributes the CPU cycles one pipeline spends on each reading to its sensor
+// and port, by phase, so the sensors and ports that load a gateway can be
+// named. Work is sampled: each phase times about one in `period` readings,
+// chosen at random so periodic traffic (sensors reporting in a fixed
+// rotation) cannot alias with it, and counts the cycles `period` times.
+// Cycles of work not done for one reading (flushing a batch, polling) are
+// counted in full per phase, unattributed. Cycles are elapsed time, so a stage
+// that blocks (a console write) is charged for the wait.
+//
+// One ledger serves one pipeline thread; it is not thread-safe.
+//
+// Parameters:
+// - `period`: One in this many readings is timed per phase; 0 turns accounting off.
+// - `memory`: Where the per-sensor table gets its pages.
+class CostLedger {
+public:
+    static constexpr std::uint32_t default_period = 64;
+
+    explicit CostLedger(std::uint32_t period = default_period, MemoryPolicy memory = {})
+        : period_(period), threshold_(period == 0 ? 0 : UINT32_MAX / period), sensors_(memory),
+          start_cycles_(cycle_count()), start_(std::chrono::steady_clock::now()) {}
+
+    bool enabled() const { return period_ != 0; }
+    std::uint32_t period() const { return period_; }
+
+    // Whether to time the next unit of work (xorshift32, a few cycles).
+    bool sample() {
+        if (period_ == 0) return false;
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 17;
+        rng_ ^= rng_ << 5;
+        return rng_ <= threshold_;
+    }
+
+    // Records that a sampled unit of `phase` work on a reading of `sensor` on
+    // `port` took `cycles`; either handle may be absent (no_sensor, no_port).
+    void add(CostPhase phase, SensorHandle sensor, PortHandle port, std::uint64_t cycles) {
+        const auto p = static_cast<std::size_t>(phase);
+        const std::uint64_t estimate = cycles * period_;
+        phases_[p] += estimate;
+        if (sensor != no_sensor) {
+            if (sensor >= sensors_.size()) sensors_.resize(std::size_t{sensor} + 1, PhaseCycles{});
+            sensors_[sensor][p] += estimate;
+        }
+        if (port != no_port) {
+            if (port >= ports_.size()) ports_.resize(std::size_t{port} + 1, PhaseCycles{});
+            ports_[port][p] += estimate;
+        }
+    }
+
+    // Records `cycles` of `phase` work not done for a single reading.
+    void add_unattributed(CostPhase phase, std::uint64_t cycles) {
+        unattributed_[static_cast<std::size_t>(phase)] += cycles;
+    }
+
+    // Estimated cycles attributed to readings, by phase.
+    const PhaseCycles &phases() const { return phases_; }
+    const PhaseCycles &unattributed() const { return unattributed_; }
+
+    // The `n` sensors (or ports) that cost the most, most expensive first.
+    std::vector<CostEntry> top_sensors(std::size_t n) const { return top(sensors_, n); }
+    std::vector<CostEntry> top_ports(std::size_t n) const { return top(ports_, n); }
+
+    // Rate of cycle_count, measured over the ledger's life so far.
+    double cycles_per_second() const {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        return seconds > 0 ? static_cast<double>(cycle_count() - start_cycles_) / seconds : 0;
+    }
+
+private:
+    template <class Table>
+    static std::vector<CostEntry> top(const Table &table, std::size_t n) {
+        std::vector<CostEntry> entries;
+        for (std::size_t i = 0; i < table.size(); ++i) {
+            CostEntry e{static_cast<std::uint32_t>(i), table[i]};
+            if (e.total() > 0) entries.push_back(e);
+        }
+        n = std::min(n, entries.size());
+        std::partial_sort(entries.begin(), entries.begin() + static_cast<std::ptrdiff_t>(n), entries.end(),
+                          [](const CostEntry &a, const CostEntry &b) { return a.total() > b.total(); });
+        entries.resize(n);
+        return entries;
+    }
+
+    std::uint32_t period_;
+    std::uint32_t threshold_;
+    std::uint32_t rng_ = 0x9E3779B9;
+    PhaseCycles phases_{};
+    PhaseCycles unattributed_{};
+    detail::ChunkedArray<PhaseCycles> sensors_;
+    std::vector<PhaseCycles> ports_;
+    std::uint64_t start_cycles_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// *** Costed Stage ***
+// Accounts the cycles `stage` spends to `phase` in `ledger`: sampled per
+// reading and attributed to its sensor and port, and in full for flushes and
+// polls. Wrap a Chain to account several stages to one phase with a single
+// pair of counter reads.
+template <class S>
+class Costed {
+    using Inner = std::remove_reference_t<S>;
+
+public:
+    Costed(S stage, CostLedger &ledger, CostPhase phase)
+        : stage_(std::forward<S>(stage)), ledger_(&ledger), phase_(phase) {}
+
+    bool process(SensorData &r) {
+        if (!ledger_->sample()) [[likely]]
+            return stage_.process(r);
+        const SensorHandle sensor = r.sensor;
+        const PortHandle port = r.port;
+        const std::uint64_t start = cycle_count();
+        const bool keep = stage_.process(r);
+        ledger_->add(phase_, sensor, port, cycle_count() - start);
+        return keep;
+    }
+
+    void flush()
+        requires Flushable<Inner>
+    {
+        timed([this] { stage_.flush(); });
+    }
+
+    void poll(Timestamp now)
+        requires Pollable<Inner>
+    {
+        timed([this, now] { stage_.poll(now); });
+    }
+
+    void prefetch(const SensorData &r)
+        requires Prefetchable<Inner>
+    {
+        stage_.prefetch(r);
+    }
+
+    Inner &stage() { return stage_; }
+
+private:
+    template <class F>
+    void timed(F &&f) {
+        if (!ledger_->enabled()) return f();
+        const std::uint64_t start = cycle_count();
+        f();
+        ledger_->add_unattributed(phase_, cycle_count() - start);
+    }
+
+    S stage_;
+    CostLedger *ledger_;
+    CostPhase phase_;
+};
+
+} // namespace qms
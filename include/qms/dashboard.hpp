@@ -0,0 +1,596 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "buffer.hpp"
+#include "clock.hpp"
+#include "detail/stable_vector.hpp"
+#include "format.hpp"
+#include "log.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+// *** DashboardBoard ***
+// The latest reading of every sensor, written by the pipelines and read by a
+// DashboardServer. Only the latest value is kept, so however fast a sensor
+// reports, the dashboard sees one change per publication (conflation).
+//
+// `update` may be called from any pipeline thread: it costs a few relaxed
+// stores and one exchange of the sensor's changed flag, and takes the lock only
+// when a sensor changes for the first time since the server last took the
+// changed sensors. A reader may see the fields of two updates mixed; the later
+// one marks the sensor changed again, so the next publication corrects it.
+class DashboardBoard {
+public:
+    // *** Entry Structure ***
+    // A sensor's latest reading: its value and quality state, when it was
+    // taken and since when the sensor has been out of its limits (0: in them).
+    struct Entry {
+        float value;
+        SensorState state;
+        Timestamp read_at;
+        Timestamp excursion_since;
+    };
+
+    DashboardBoard() = default;
+    DashboardBoard(const DashboardBoard &) = delete;
+    DashboardBoard &operator=(const DashboardBoard &) = delete;
+
+    // Records the reading `r`, which has been through the QualityMonitor.
+    void update(const SensorData &r) {
+        if (r.sensor >= slots_.size()) [[unlikely]]
+            grow(r.sensor);
+        Slot &s = slots_[r.sensor];
+        const auto previous = static_cast<SensorState>(s.reading.load(std::memory_order_relaxed) >> 32);
+        if (!out_of_spec(r.state)) s.excursion_since.store(0, std::memory_order_relaxed);
+        else if (!out_of_spec(previous) || s.read_at.load(std::memory_order_relaxed) == 0)
+            s.excursion_since.store(r.timestamp, std::memory_order_relaxed);
+        s.read_at.store(r.timestamp, std::memory_order_relaxed);
+        s.reading.store(std::uint64_t{static_cast<std::uint8_t>(r.state)} << 32 | std::bit_cast<std::uint32_t>(r.value),
+                        std::memory_order_relaxed);
+        if (!s.changed.exchange(true, std::memory_order_acq_rel)) {
+            std::lock_guard lock(mutex_);
+            changed_.push_back(r.sensor);
+        }
+    }
+
+    // Moves the sensors that changed since the last call into `out` (which is
+    // cleared first), in the order they first changed.
+    void take_changed(std::vector<SensorHandle> &out) {
+        out.clear();
+        {
+            std::lock_guard lock(mutex_);
+            out.swap(changed_);
+        }
+        for (const SensorHandle h : out) slots_[h].changed.exchange(false, std::memory_order_acq_rel);
+    }
+
+    // The latest reading of `sensor`; `read_at` is 0 if it has none.
+    Entry entry(SensorHandle sensor) const {
+        if (sensor >= slots_.size()) return {0.0f, SensorState::InSpec, 0, 0};
+        const Slot &s = slots_[sensor];
+        const std::uint64_t reading = s.reading.load(std::memory_order_relaxed);
+        return {std::bit_cast<float>(static_cast<std::uint32_t>(reading)), static_cast<SensorState>(reading >> 32),
+                s.read_at.load(std::memory_order_relaxed), s.excursion_since.load(std::memory_order_relaxed)};
+    }
+
+    // Number of sensor slots (some may have no reading yet).
+    std::size_t size() const { return slots_.size(); }
+
+private:
+    struct Slot {
+        std::atomic<std::uint64_t> reading{0}; // State << 32 | value bits
+        std::atomic<Timestamp> read_at{0};
+        std::atomic<Timestamp> excursion_since{0};
+        std::atomic<bool> changed{false};
+    };
+
+    void grow(SensorHandle sensor) {
+        std::lock_guard lock(grow_mutex_);
+        while (slots_.size() <= sensor) slots_.emplace_back();
+    }
+
+    detail::StableVector<Slot> slots_;
+    std::mutex grow_mutex_;
+    std::mutex mutex_;
+    std::vector<SensorHandle> changed_;
+};
+
+// *** DashboardFeed Stage ***
+// Publishes every reading to a DashboardBoard. Put it after the
+// QualityMonitor, whose state it shows. Without a board it does nothing, so
+// pipelines can keep it when the dashboard is off.
+class DashboardFeed {
+public:
+    explicit DashboardFeed(DashboardBoard *board = nullptr) : board_(board) {}
+
+    bool process(SensorData &r) {
+        if (board_) board_->update(r);
+        return true;
+    }
+
+private:
+    DashboardBoard *board_;
+};
+
+} // namespace qms
+
+// The dashboard server speaks HTTP over POSIX sockets and is available on
+// Linux only; QMS_HAS_DASHBOARD tells callers whether it can be used.
+#if defined(__linux__)
+#define QMS_HAS_DASHBOARD 1
+
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace qms {
+
+// *** DashboardPolicy Structure ***
+// How a DashboardServer serves its clients:
+// - `port`: TCP port on the loopback interface.
+// - `max_rate`: Most publications per second; changes in between are
+//   conflated into the next one.
+// - `keepalive`: Longest silence before a comment line is sent, so clients and
+//   proxies keep the stream open and dead clients are noticed.
+// - `max_clients`: Connections served at once; more are refused.
+// - `states`: When a value shows as stale and an excursion as alarmed.
+struct DashboardPolicy {
+    std::uint16_t port = 8080;
+    double max_rate = 4;
+    Timestamp keepalive = 15'000'000'000;
+    std::size_t max_clients = 64;
+    StatePolicy states;
+};
+
+// *** DashboardMetrics Structure ***
+// What a DashboardServer has done:
+// - `deltas`, `snapshots`: Publications serialised (once each, for all clients).
+// - `bytes`: Bytes serialised; each byte is sent to every client it is for.
+// - `conflated`: Deltas a client skipped because it had not taken the
+//   previous one; it was sent a snapshot instead.
+// - `clients`: Event streams served.
+struct DashboardMetrics {
+    std::uint64_t deltas = 0;
+    std::uint64_t snapshots = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t conflated = 0;
+    std::uint64_t clients = 0;
+};
+
+// *** DashboardServer ***
+// Serves a live dashboard over HTTP on the loopback interface, from a
+// background thread:
+// - `GET /events`: A Server-Sent Events stream. A client first receives a
+//   "snapshot" event with every sensor that has reported, then "delta" events
+//   with only the sensors whose value, quality state or alarm changed.
+// - `GET /`: A page that renders the stream as a table.
+//
+// Only requests whose Host header names the loopback address ("127.0.0.1" or
+// "localhost", with the server's port) are answered, so a page on another
+// site cannot reach the feed through DNS rebinding; the stream carries no
+// CORS header, so other origins cannot read it either.
+//
+// Each event is a JSON object {"time": ms, "sensors": [{"id", "value",
+// "state", "alarmed", "time"}, ...]}, with times in milliseconds since the
+// epoch and `state` one of "in_spec", "low", "high" or "stale".
+//
+// The server publishes at most `max_rate` times per second. Each publication
+// is serialised once and the same bytes are queued to every client, so the
+// cost of serialising does not grow with the number of viewers. A client whose
+// socket has not taken the previous event skips the deltas until it has, then
+// gets the current snapshot (shared as well) instead, so a slow viewer costs
+// neither memory nor time for the others. Staleness and alarm delays do not
+// arrive as readings; they are found by sweeping `sweep` sensors per
+// publication.
+class DashboardServer {
+public:
+    static constexpr std::size_t sweep = 4096;
+    static constexpr std::size_t max_request = 4096;
+    static constexpr int send_buffer = 64 * 1024;
+
+    DashboardServer(const Registry &registry, DashboardBoard &board, DashboardPolicy policy = {},
+                    Clock &clock = system_clock())
+        : registry_(&registry), board_(&board), policy_(policy), clock_(&clock) {}
+    DashboardServer(const DashboardServer &) = delete;
+    DashboardServer &operator=(const DashboardServer &) = delete;
+    ~DashboardServer() { stop(); }
+
+    // *** Function: start ***
+    // Listens on the policy's loopback port and starts serving.
+    //
+    // Returns:
+    // - false if the port cannot be opened (the error is logged).
+    bool start() {
+        if (thread_.joinable()) return true;
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(policy_.port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (listen_fd_ < 0 || ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one) != 0 ||
+            ::bind(listen_fd_, reinterpret_cast<const sockaddr *>(&addr), sizeof addr) != 0 ||
+            ::listen(listen_fd_, 16) != 0 || ::pipe2(wake_, O_NONBLOCK | O_CLOEXEC) != 0) {
+            log(LogLevel::Error, "Unable to serve the dashboard on port %u: %s", policy_.port, std::strerror(errno));
+            close_all();
+            return false;
+        }
+        stopping_.store(false, std::memory_order_relaxed);
+        thread_ = std::thread([this] { run(); });
+        log(LogLevel::Info, "Dashboard on http://127.0.0.1:%u/", policy_.port);
+        return true;
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        stopping_.store(true, std::memory_order_relaxed);
+        const char c = 0;
+        [[maybe_unused]] const auto n = ::write(wake_[1], &c, 1);
+        thread_.join();
+        close_all();
+    }
+
+    // Valid once the server is stopped, or from the serving thread.
+    const DashboardMetrics &metrics() const { return metrics_; }
+
+private:
+    using Payload = std::shared_ptr<const std::string>;
+
+    // What the clients were last told about a sensor.
+    struct Shown {
+        float value = 0.0f;
+        SensorState state = SensorState::InSpec;
+        bool alarmed = false;
+        bool known = false;
+        Timestamp read_at = 0;
+    };
+
+    struct Client {
+        int fd = -1;
+        std::string request;
+        bool streaming = false;
+        bool resync = true;      // Needs a snapshot before further deltas
+        bool close_after = false; // Close once the queued response is sent
+        Payload out;
+        std::size_t sent = 0;
+        Timestamp last_write = 0;
+
+        bool pending() const { return out && sent < out->size(); }
+        void queue(Payload p) { out = std::move(p), sent = 0; }
+    };
+
+    // Serialises what changed on the board by `now` and queues it to every
+    // client; called at `max_rate`.
+    void publish(Timestamp now) {
+        delta_.reset();
+        snapshot_.reset();
+        board_->take_changed(changed_);
+        for (const SensorHandle h : changed_) refresh(h, now);
+        if (!shown_.empty())
+            for (std::size_t i = 0; i < std::min(sweep, shown_.size()); ++i, cursor_ = (cursor_ + 1) % shown_.size())
+                if (shown_[cursor_].known) refresh(static_cast<SensorHandle>(cursor_), now);
+        if (!out_.empty()) {
+            delta_ = finish_event("delta", now);
+            ++metrics_.deltas;
+        }
+        for (Client &c : clients_) {
+            if (!c.streaming) continue;
+            if (c.pending()) {
+                if (delta_) ++metrics_.conflated, c.resync = true;
+                continue;
+            }
+            if (c.resync) c.queue(snapshot(now)), c.resync = false;
+            else if (delta_) c.queue(delta_);
+            else if (now - c.last_write >= policy_.keepalive) c.queue(keepalive());
+            else continue;
+            c.last_write = now;
+            send(c);
+        }
+    }
+
+    void run() {
+        const auto period = static_cast<Timestamp>(1e9 / std::max(policy_.max_rate, 0.001));
+        Timestamp next = clock_->now();
+        std::vector<pollfd> fds;
+        while (!stopping_.load(std::memory_order_relaxed)) {
+            const Timestamp now = clock_->now();
+            if (now >= next) {
+                publish(now);
+                next = std::max(next + period, now);
+            }
+            fds.assign({{wake_[0], POLLIN, 0}, {listen_fd_, POLLIN, 0}});
+            for (const Client &c : clients_)
+                fds.push_back({c.fd, static_cast<short>(c.pending() ? POLLIN | POLLOUT : POLLIN), 0});
+            const int wait_ms = static_cast<int>((next - clock_->now() + 999'999) / 1'000'000);
+            if (::poll(fds.data(), fds.size(), std::max(wait_ms, 0)) < 0 && errno != EINTR) break;
+            if (fds[1].revents & POLLIN) accept_clients();
+            for (std::size_t i = 2; i < fds.size(); ++i) {
+                Client &c = clients_[i - 2];
+                if (fds[i].revents & (POLLERR | POLLHUP)) c.fd = close_fd(c.fd);
+                else {
+                    if (fds[i].revents & POLLIN) receive(c);
+                    if (c.fd >= 0 && (fds[i].revents & POLLOUT)) send(c);
+                }
+            }
+            std::erase_if(clients_, [](const Client &c) { return c.fd < 0; });
+        }
+        for (Client &c : clients_) close_fd(c.fd);
+        clients_.clear();
+    }
+
+    void accept_clients() {
+        for (;;) {
+            const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            if (clients_.size() >= policy_.max_clients) {
+                close_fd(fd);
+                continue;
+            }
+            // A small send buffer keeps a slow client from queueing old events in the kernel
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof send_buffer);
+            clients_.emplace_back().fd = fd;
+        }
+    }
+
+    // Reads what `c` sent: its request, or anything (ignored) once it streams.
+    void receive(Client &c) {
+        char buffer[1024];
+        const ssize_t n = ::recv(c.fd, buffer, sizeof buffer, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            c.fd = close_fd(c.fd);
+            return;
+        }
+        if (n < 0 || c.streaming || c.close_after) return;
+        c.request.append(buffer, static_cast<std::size_t>(n));
+        if (c.request.find("\r\n\r\n") != std::string::npos) respond(c);
+        else if (c.request.size() > max_request) c.fd = close_fd(c.fd);
+    }
+
+    void respond(Client &c) {
+        const std::string_view request(c.request);
+        const std::string_view target = request.substr(0, request.find(' ', 4));
+        std::string_view path = target.starts_with("GET ") ? target.substr(4) : std::string_view();
+        path = path.substr(0, path.find('?'));
+        if (!local_host(header(request, "host"))) {
+            reply(c, "403 Forbidden", "403 Forbidden");
+        } else if (path == "/events") {
+            c.streaming = true;
+            c.last_write = clock_->now();
+            c.queue(std::make_shared<const std::string>(
+                "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                "Connection: keep-alive\r\n\r\nretry: 2000\n\n"));
+            ++metrics_.clients;
+        } else {
+            const std::string_view status = !target.starts_with("GET ") ? "405 Method Not Allowed"
+                                            : path == "/"               ? "200 OK"
+                                                                        : "404 Not Found";
+            reply(c, status, path == "/" && target.starts_with("GET ") ? page : status);
+        }
+        c.request = {};
+        send(c);
+    }
+
+    // Queues a complete response to `c` and closes the connection after it.
+    static void reply(Client &c, std::string_view status, std::string_view body) {
+        std::string response = "HTTP/1.1 ";
+        response.append(status).append("\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: ");
+        response.append(std::to_string(body.size())).append("\r\nConnection: close\r\n\r\n").append(body);
+        c.queue(std::make_shared<const std::string>(std::move(response)));
+        c.close_after = true;
+    }
+
+    // The value of header `name` (lower case) in `request`, or an empty view.
+    static std::string_view header(std::string_view request, std::string_view name) {
+        for (std::size_t at = request.find("\r\n"); at != std::string_view::npos;) {
+            const std::size_t start = at + 2;
+            at = request.find("\r\n", start);
+            const std::string_view line = request.substr(start, at - start);
+            if (line.size() <= name.size() || line[name.size()] != ':') continue;
+            if (!std::equal(name.begin(), name.end(), line.begin(),
+                            [](char a, char b) { return a == (b | 0x20); })) // ASCII case folding
+                continue;
+            std::string_view value = line.substr(name.size() + 1);
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+            while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+            return value;
+        }
+        return {};
+    }
+
+    // Whether `host` (a Host header) names this server on the loopback interface.
+    bool local_host(std::string_view host) const {
+        const std::size_t colon = host.rfind(':');
+        const std::string_view name = host.substr(0, colon);
+        if (name != "127.0.0.1" && name != "localhost") return false;
+        if (colon == std::string_view::npos) return policy_.port == 80;
+        return host.substr(colon + 1) == std::to_string(policy_.port);
+    }
+
+    // Writes as much of the queued payload as the socket takes.
+    void send(Client &c) {
+        while (c.pending()) {
+            const ssize_t n = ::send(c.fd, c.out->data() + c.sent, c.out->size() - c.sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.sent += static_cast<std::size_t>(n);
+            } else {
+                if (n < 0 && errno != EAGAIN && errno != EINTR) c.fd = close_fd(c.fd);
+                return;
+            }
+        }
+        c.out.reset();
+        if (c.close_after) c.fd = close_fd(c.fd);
+    }
+
+    // Brings what is shown of `sensor` up to date at `now`, adding it to the
+    // delta being built if that changes.
+    void refresh(SensorHandle sensor, Timestamp now) {
+        const DashboardBoard::Entry e = board_->entry(sensor);
+        if (e.read_at == 0) return;
+        if (sensor >= shown_.size()) shown_.resize(static_cast<std::size_t>(sensor) + 1);
+        const StatePolicy &states = policy_.states;
+        const bool stale = states.stale_after > 0 && now - e.read_at >= states.stale_after;
+        Shown s{e.value, stale ? SensorState::Stale : e.state,
+                !stale && out_of_spec(e.state) && now - e.excursion_since >= states.alarm_delay, true, e.read_at};
+        Shown &old = shown_[sensor];
+        const bool changed = !old.known || std::bit_cast<std::uint32_t>(s.value) !=
+                                               std::bit_cast<std::uint32_t>(old.value) ||
+                             s.state != old.state || s.alarmed != old.alarmed;
+        old.read_at = s.read_at;
+        if (!changed) return;
+        old = s;
+        write_sensor(sensor, s);
+    }
+
+    // The snapshot at `now`, serialised on first use in a publication.
+    Payload snapshot(Timestamp now) {
+        if (snapshot_) return snapshot_;
+        out_.clear();
+        for (std::size_t h = 0; h < shown_.size(); ++h)
+            if (shown_[h].known) write_sensor(static_cast<SensorHandle>(h), shown_[h]);
+        snapshot_ = finish_event("snapshot", now);
+        ++metrics_.snapshots;
+        return snapshot_;
+    }
+
+    void write_sensor(SensorHandle sensor, const Shown &s) {
+        const std::string &id = json_name(sensor);
+        char *p = out_.reserve_tail(id.size() + 112);
+        char *const start = p;
+        std::memcpy(p, ",{\"id\":", 7), p += 7;
+        std::memcpy(p, id.data(), id.size()), p += id.size();
+        std::memcpy(p, ",\"value\":", 9), p += 9;
+        if (std::isfinite(s.value)) p = std::to_chars(p, p + 32, s.value).ptr;
+        else std::memcpy(p, "null", 4), p += 4; // NaN and infinities are not JSON
+        const std::string_view state = state_name(s.state);
+        std::memcpy(p, ",\"state\":\"", 10), p += 10;
+        std::memcpy(p, state.data(), state.size()), p += state.size();
+        const std::string_view alarmed = s.alarmed ? "\",\"alarmed\":true,\"time\":" : "\",\"alarmed\":false,\"time\":";
+        std::memcpy(p, alarmed.data(), alarmed.size()), p += alarmed.size();
+        p = std::to_chars(p, p + 20, s.read_at / 1'000'000).ptr;
+        *p++ = '}';
+        out_.commit(static_cast<std::size_t>(p - start));
+    }
+
+    // Wraps the sensors written to `out_` into an event named `name`.
+    Payload finish_event(std::string_view name, Timestamp now) {
+        std::string event;
+        event.reserve(out_.size() + 64);
+        event.append("event: ").append(name).append("\ndata: {\"time\":");
+        event.append(std::to_string(now / 1'000'000)).append(",\"sensors\":[");
+        if (!out_.empty()) event.append(out_.data() + 1, out_.size() - 1); // Without the first comma
+        event.append("]}\n\n");
+        out_.clear();
+        metrics_.bytes += event.size();
+        return std::make_shared<const std::string>(std::move(event));
+    }
+
+    Payload keepalive() {
+        static const Payload comment = std::make_shared<const std::string>(": keepalive\n\n");
+        return comment;
+    }
+
+    // The ID of `sensor` as a JSON string, escaped once per sensor.
+    const std::string &json_name(SensorHandle sensor) {
+        if (sensor >= names_.size()) names_.resize(static_cast<std::size_t>(sensor) + 1);
+        std::string &name = names_[sensor];
+        if (name.empty()) {
+            const std::string_view id = registry_->sensor_name(sensor);
+            name.resize(2 + 6 * id.size());
+            name.resize(static_cast<std::size_t>(format_json_string(name.data(), id) - name.data()));
+        }
+        return name;
+    }
+
+    static std::string_view state_name(SensorState s) {
+        switch (s) {
+        case SensorState::InSpec: return "in_spec";
+        case SensorState::Low: return "low";
+        case SensorState::High: return "high";
+        case SensorState::Stale: return "stale";
+        case SensorState::Alarmed: return "alarmed";
+        }
+        return "unknown";
+    }
+
+    static int close_fd(int fd) {
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    void close_all() {
+        listen_fd_ = close_fd(listen_fd_);
+        wake_[0] = close_fd(wake_[0]);
+        wake_[1] = close_fd(wake_[1]);
+    }
+
+    static constexpr std::string_view page = R"html(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>Quality Monitoring</title>
+<style>body{font-family:sans-serif}td,th{padding:2px 12px;text-align:left}
+.low,.high{color:#b60}.alarmed{color:#fff;background:#c00}.stale{color:#999}</style></head>
+<body><h1>Quality Monitoring</h1><table><thead><tr><th>Sensor</th><th>Value</th><th>State</th><th>Read at</th></tr>
+</thead><tbody id="sensors"></tbody></table><script>
+const rows = new Map(), body = document.getElementById("sensors");
+function show(e) {
+  const update = JSON.parse(e.data);
+  if (e.type === "snapshot") { rows.clear(); body.replaceChildren(); }
+  for (const s of update.sensors) {
+    let row = rows.get(s.id);
+    if (!row) { row = body.insertRow(); row.insertCell().textContent = s.id; row.insertCell(); row.insertCell();
+                row.insertCell(); rows.set(s.id, row); }
+    row.className = s.alarmed ? "alarmed" : s.state;
+    row.cells[1].textContent = s.value;
+    row.cells[2].textContent = s.state.replace("_", " ") + (s.alarmed ? " (alarmed)" : "");
+    row.cells[3].textContent = new Date(s.time).toLocaleTimeString();
+  }
+}
+const events = new EventSource("/events");
+events.addEventListener("snapshot", show);
+events.addEventListener("delta", show);
+</script></body></html>
+)html";
+
+    const Registry *registry_;
+    DashboardBoard *board_;
+    DashboardPolicy policy_;
+    Clock *clock_;
+    int listen_fd_ = -1;
+    int wake_[2] = {-1, -1};
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+
+    std::vector<Client> clients_;
+    std::vector<Shown> shown_;
+    std::vector<std::string> names_;
+    std::vector<SensorHandle> changed_;
+    std::size_t cursor_ = 0;
+    ByteBuffer out_; // Sensors of the event being built, each after a comma
+    Payload delta_;
+    Payload snapshot_;
+    DashboardMetrics metrics_;
+};
+
+} // namespace qms
+
+#endif // QMS_HAS_DASHBOARD
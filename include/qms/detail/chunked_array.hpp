@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../memory.hpp"
+
+namespace qms::detail {
+
+// *** ChunkedArray ***
+// A growable array of trivially destructible elements stored in fixed-size
+// chunks, so growing allocates one chunk at a time and never copies or moves
+// the elements already there; growing a table of a million sensors costs the
+// same as growing one of ten. Chunks come from a PageAllocator, so large
+// ones follow the MemoryPolicy (huge pages, NUMA node). With huge pages,
+// chunks of `page_allocation_threshold` or more are carved from blocks of as
+// many as fit in a 2 MiB page, rather than each taking a page of its own.
+//
+// Unlike StableVector, it is single-threaded and frees nothing until it is
+// destroyed.
+template <class T, std::size_t ChunkBits = 12>
+class ChunkedArray {
+    static_assert(std::is_trivially_destructible_v<T>, "ChunkedArray elements are never destroyed");
+
+public:
+    static constexpr std::size_t chunk_size = std::size_t{1} << ChunkBits;
+
+    explicit ChunkedArray(MemoryPolicy memory = {}) : allocator_(memory), block_chunks_(chunks_per_block(memory)) {}
+    ChunkedArray(ChunkedArray &&o) noexcept
+        : allocator_(o.allocator_), block_chunks_(o.block_chunks_), blocks_(std::move(o.blocks_)),
+          chunks_(std::move(o.chunks_)), size_(std::exchange(o.size_, 0)) {
+        o.blocks_.clear();
+        o.chunks_.clear();
+    }
+    ChunkedArray &operator=(ChunkedArray &&) = delete;
+
+    ~ChunkedArray() {
+        for (T *block : blocks_) allocator_.deallocate(block, block_chunks_ * chunk_size);
+    }
+
+    // Grows the array to `n` elements, the new ones copies of `fill`; never shrinks it.
+    void resize(std::size_t n, const T &fill) {
+        while (chunks_.size() * chunk_size < n) {
+            const std::size_t in_block = chunks_.size() % block_chunks_;
+            if (in_block == 0) blocks_.push_back(allocator_.allocate(block_chunks_ * chunk_size));
+            chunks_.push_back(blocks_.back() + in_block * chunk_size);
+        }
+        for (; size_ < n; ++size_) ::new (&(*this)[size_]) T(fill);
+    }
+
+    // Appends `value` and returns its index.
+    std::size_t push_back(const T &value) {
+        resize(size_ + 1, value);
+        return size_ - 1;
+    }
+
+    T &operator[](std::size_t i) { return chunks_[i >> ChunkBits][i & (chunk_size - 1)]; }
+    const T &operator[](std::size_t i) const { return chunks_[i >> ChunkBits][i & (chunk_size - 1)]; }
+
+    std::size_t size() const { return size_; }
+
+    // Bytes of element storage allocated, counting whole pages where mapped.
+    std::size_t capacity_bytes() const {
+        return blocks_.size() * allocator_.allocated_bytes(block_chunks_ * chunk_size);
+    }
+
+private:
+    static std::size_t chunks_per_block(const MemoryPolicy &memory) {
+        constexpr std::size_t bytes = chunk_size * sizeof(T);
+        if (!memory.huge_pages || bytes < page_allocation_threshold || bytes >= huge_page_size) return 1;
+        return huge_page_size / bytes;
+    }
+
+    PageAllocator<T> allocator_;
+    std::size_t block_chunks_; // Chunks per allocation
+    std::vector<T *> blocks_;
+    std::vector<T *> chunks_;
+    std::size_t size_ = 0;
+};
+
+} // namespace qms::detail
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace qms::detail {
+
+// *** InternIndex ***
+// Maps interned names to their handles for the Registry. It is an
+// open-addressing table of 8-byte (hash, handle) slots that compares names in
+// the caller's name store instead of keeping its own copy of every name.
+//
+// When it is three quarters full it grows incrementally: a table of twice
+// the size takes all new entries, and every insertion moves the next few
+// slots of the old table across. Lookups check both tables until the old one
+// is drained, so no single insertion rehashes the whole index, however many
+// names it holds.
+//
+// Not thread-safe; the Registry serialises access.
+class InternIndex {
+public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    // *** Function: find ***
+    // Returns the handle of `name`, whose hash is `hash`, or npos.
+    //
+    // Parameters:
+    // - `names`: The name of each handle, indexable by handle.
+    template <class Names>
+    std::size_t find(std::string_view name, std::size_t hash, const Names &names) const {
+        const auto h = static_cast<std::uint32_t>(hash);
+        if (const std::size_t i = find_in(table_, name, h, names); i != npos) return i;
+        return old_.size == 0 ? npos : find_in(old_, name, h, names);
+    }
+
+    // Adds `handle` under `hash`; its name must not be in the index yet.
+    void insert(std::size_t hash, std::size_t handle) {
+        if ((size_ + 1) * 4 > table_.size * 3) grow();
+        place(table_, {static_cast<std::uint32_t>(hash), static_cast<std::uint32_t>(handle + 1)});
+        ++size_;
+        migrate(migrate_step);
+    }
+
+    std::size_t size() const { return size_; }
+
+    // Bytes of slot storage allocated, including a table being drained.
+    std::size_t capacity_bytes() const { return (table_.size + old_.size) * sizeof(Slot); }
+
+private:
+    struct Slot {
+        std::uint32_t hash;
+        std::uint32_t entry; // Handle + 1; 0: empty
+    };
+
+    // Slots from calloc, whose large blocks arrive as untouched zero pages:
+    // a new table costs nothing up front and is faulted in as it fills.
+    struct Table {
+        struct Free {
+            void operator()(Slot *p) const { std::free(p); }
+        };
+
+        std::unique_ptr<Slot[], Free> slots;
+        std::size_t size = 0;
+
+        static Table make(std::size_t size) {
+            auto *p = static_cast<Slot *>(std::calloc(size, sizeof(Slot)));
+            if (p == nullptr) throw std::bad_alloc();
+            return {std::unique_ptr<Slot[], Free>(p), size};
+        }
+    };
+
+    static constexpr std::size_t initial_capacity = 64;
+    // Old slots moved per insertion: the old table is drained after a sixth
+    // of the insertions that fill the new one
+    static constexpr std::size_t migrate_step = 8;
+
+    template <class Names>
+    static std::size_t find_in(const Table &t, std::string_view name, std::uint32_t h, const Names &names) {
+        if (t.size == 0) return npos;
+        const std::size_t mask = t.size - 1;
+        for (std::size_t i = h & mask;; i = (i + 1) & mask) {
+            const Slot &s = t.slots[i];
+            if (s.entry == 0) return npos;
+            if (s.hash == h && names[s.entry - 1] == name) return s.entry - 1;
+        }
+    }
+
+    static void place(Table &t, Slot slot) {
+        const std::size_t mask = t.size - 1;
+        std::size_t i = slot.hash & mask;
+        while (t.slots[i].entry != 0) i = (i + 1) & mask;
+        t.slots[i] = slot;
+    }
+
+    void grow() {
+        migrate(old_.size); // Finish the previous growth first (only if the index was built very unevenly)
+        old_ = Table::make(table_.size == 0 ? initial_capacity : table_.size * 2);
+        std::swap(old_, table_);
+        cursor_ = 0;
+    }
+
+    void migrate(std::size_t n) {
+        if (old_.size == 0) return;
+        for (const std::size_t end = std::min(cursor_ + n, old_.size); cursor_ < end; ++cursor_)
+            if (old_.slots[cursor_].entry != 0) place(table_, old_.slots[cursor_]);
+        if (cursor_ == old_.size) old_ = Table();
+    }
+
+    Table table_;
+    Table old_; // Being moved into table_ from `cursor_` on
+    std::size_t cursor_ = 0;
+    std::size_t size_ = 0;
+};
+
+} // namespace qms::detail
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace qms::detail {
+
+// *** StableVector ***
+// An append-only vector whose elements never move once constructed.
+// Storage is a fixed directory of fixed-size chunks, so growing never copies
+// existing elements and readers holding an index obtained from `emplace_back`
+// can access it without taking the writer's lock.
+//
+// Appends must be serialised by the caller; reads of already published
+// indices are safe from any thread.
+template <class T, std::size_t ChunkBits = 12, std::size_t DirSize = 4096>
+class StableVector {
+public:
+    static constexpr std::size_t chunk_size = std::size_t{1} << ChunkBits;
+    static constexpr std::size_t max_size = chunk_size * DirSize;
+
+    StableVector() = default;
+    StableVector(const StableVector &) = delete;
+    StableVector &operator=(const StableVector &) = delete;
+
+    ~StableVector() {
+        const std::size_t n = size_.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < n; ++i) slot(i)->~T();
+        for (auto &chunk : dir_) ::operator delete(chunk.load(std::memory_order_relaxed));
+    }
+
+    // Constructs a new element at the end and returns its index.
+    template <class... Args>
+    std::size_t emplace_back(Args &&...args) {
+        const std::size_t i = size_.load(std::memory_order_relaxed);
+        if (i >= max_size) throw std::length_error("StableVector capacity exceeded");
+        auto &chunk = dir_[i >> ChunkBits];
+        if (chunk.load(std::memory_order_relaxed) == nullptr)
+            chunk.store(static_cast<T *>(::operator new(sizeof(T) * chunk_size)), std::memory_order_release);
+        ::new (slot(i)) T(std::forward<Args>(args)...);
+        size_.store(i + 1, std::memory_order_release);
+        return i;
+    }
+
+    T &operator[](std::size_t i) { return *slot(i); }
+    const T &operator[](std::size_t i) const { return *slot(i); }
+
+    std::size_t size() const { return size_.load(std::memory_order_acquire); }
+
+private:
+    T *slot(std::size_t i) const {
+        return dir_[i >> ChunkBits].load(std::memory_order_acquire) + (i & (chunk_size - 1));
+    }
+
+    std::array<std::atomic<T *>, DirSize> dir_{};
+    std::atomic<std::size_t> size_{0};
+};
+
+} // namespace qms::detail
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "record.hpp"
+
+namespace qms {
+
+// *** DriftPolicy Structure ***
+// How a DriftEstimator follows a device clock:
+// - `block`: Device time over which the least-delayed reading is kept.
+// - `blocks`: Blocks the fit spans (the window is `block * blocks`).
+// - `step`: A reading off the fitted line by more than this means the
+//   device clock was set, and the estimate starts over.
+struct DriftPolicy {
+    Timestamp block = 10'000'000'000;
+    std::size_t blocks = 32;
+    Timestamp step = 1'000'000'000;
+};
+
+// *** DriftEstimator ***
+// Estimates the offset and drift of a device clock against the gateway's from
+// readings stamped by the device, and maps device timestamps onto the gateway
+// clock.
+//
+// The arrival time of a reading is its device time, plus the offset and the
+// drift of the clocks, plus a transport and queueing delay that is never
+// negative but often large. Only the least-delayed reading of each `block`
+// is therefore kept, in a ring of `blocks`, and a line is fitted through
+// them with the Theil-Sen estimator (the median of the pairwise slopes),
+// which ignores blocks whose every reading was held up. A reading costs O(1);
+// closing a block costs O(blocks^2) on a fixed scratch buffer, once per block.
+//
+// A corrected timestamp is the device time mapped through the fitted line:
+// when the reading would have arrived with the least delay seen. It is never
+// later than the actual arrival. Until two blocks are closed, only the offset
+// is known.
+class DriftEstimator {
+public:
+    explicit DriftEstimator(DriftPolicy policy = {}) : policy_(policy) {}
+
+    // *** Function: correct ***
+    // Learns that a reading stamped `device` by the device arrived at
+    // `arrival`.
+    //
+    // Returns:
+    // - The reading's timestamp on the gateway clock.
+    Timestamp correct(Timestamp device, Timestamp arrival) {
+        if (samples_ == 0 || device < block_start_ - policy_.step) [[unlikely]]
+            restart(device, arrival);
+        double x = seconds(device - device0_);
+        double y = static_cast<double>(arrival - device - lag0_);
+        if (fitted_ >= 2 && y - predict(x) < -static_cast<double>(policy_.step)) [[unlikely]] {
+            restart(device, arrival); // The device clock jumped ahead
+            x = y = 0;
+        }
+        if (device - block_start_ >= policy_.block) close_block(device);
+        if (y < block_min_.y) block_min_ = {x, y};
+        ++samples_;
+        const double lag = fitted_ >= 2 ? predict(x) : std::min(block_min_.y, min_lag_);
+        return std::min(device + lag0_ + static_cast<Timestamp>(std::llround(lag)), arrival);
+    }
+
+    // Offset of the gateway clock from the device clock at the latest reading, in nanoseconds.
+    double offset() const {
+        return static_cast<double>(lag0_) + (fitted_ >= 2 ? predict(last_x()) : std::min(block_min_.y, min_lag_));
+    }
+
+    // Drift of the device clock behind the gateway's, in parts per million.
+    double drift_ppm() const { return slope_ * 1e-3; }
+
+    bool locked() const { return fitted_ >= 2; }
+    std::uint64_t samples() const { return samples_; }
+    std::uint32_t restarts() const { return restarts_; }
+
+private:
+    struct Point {
+        double x = 0; // Device seconds since `device0_`
+        double y = std::numeric_limits<double>::infinity(); // Arrival - device - `lag0_`, in nanoseconds
+    };
+
+    static double seconds(Timestamp ns) { return static_cast<double>(ns) * 1e-9; }
+
+    double predict(double x) const { return intercept_ + slope_ * x; }
+    double last_x() const { return fitted_ > 0 ? ring_[(head_ + fitted_ - 1) % ring_.size()].x : block_min_.x; }
+
+    void restart(Timestamp device, Timestamp arrival) {
+        if (samples_ > 0) ++restarts_;
+        device0_ = device;
+        lag0_ = arrival - device;
+        block_start_ = device;
+        block_min_ = {};
+        min_lag_ = std::numeric_limits<double>::infinity();
+        ring_.assign(std::max<std::size_t>(policy_.blocks, 2), Point{});
+        scratch_.reserve(ring_.size() * (ring_.size() - 1) / 2);
+        head_ = fitted_ = 0;
+        slope_ = intercept_ = 0;
+    }
+
+    // Ends the current block at `device`, keeping its least-delayed reading.
+    void close_block(Timestamp device) {
+        block_start_ = device;
+        const Point p = std::exchange(block_min_, Point{});
+        if (!std::isfinite(p.y)) return;
+        // A block entirely above the line means the device clock went back
+        if (fitted_ >= 2 && p.y - predict(p.x) > static_cast<double>(policy_.step)) {
+            ++restarts_;
+            head_ = fitted_ = 0;
+            min_lag_ = std::numeric_limits<double>::infinity();
+        }
+        min_lag_ = std::min(min_lag_, p.y);
+        if (fitted_ < ring_.size()) ++fitted_;
+        else head_ = (head_ + 1) % ring_.size();
+        ring_[(head_ + fitted_ - 1) % ring_.size()] = p;
+        if (fitted_ >= 2) fit();
+    }
+
+    // Theil-Sen: the median pairwise slope, then the median intercept.
+    void fit() {
+        scratch_.clear();
+        for (std::size_t i = 0; i < fitted_; ++i)
+            for (std::size_t j = i + 1; j < fitted_; ++j) {
+                const Point &a = ring_[(head_ + i) % ring_.size()];
+                const Point &b = ring_[(head_ + j) % ring_.size()];
+                if (b.x != a.x) scratch_.push_back((b.y - a.y) / (b.x - a.x));
+            }
+        if (scratch_.empty()) return;
+        slope_ = median(scratch_);
+        scratch_.clear();
+        for (std::size_t i = 0; i < fitted_; ++i) {
+            const Point &p = ring_[(head_ + i) % ring_.size()];
+            scratch_.push_back(p.y - slope_ * p.x);
+        }
+        intercept_ = median(scratch_);
+    }
+
+    static double median(std::vector<double> &v) {
+        const auto mid = v.begin() + static_cast<std::ptrdiff_t>(v.size() / 2);
+        std::nth_element(v.begin(), mid, v.end());
+        return *mid;
+    }
+
+    DriftPolicy policy_;
+    Timestamp device0_ = 0;
+    Timestamp lag0_ = 0;
+    Timestamp block_start_ = 0;
+    Point block_min_;
+    double min_lag_ = std::numeric_limits<double>::infinity(); // Least lag of the closed blocks
+    std::vector<Point> ring_;                                   // Least-delayed reading of each closed block
+    std::size_t head_ = 0;
+    std::size_t fitted_ = 0;
+    std::vector<double> scratch_;
+    double slope_ = 0;     // Nanoseconds of lag gained per device second
+    double intercept_ = 0; // Lag at `device0_`, in nanoseconds
+    std::uint64_t samples_ = 0;
+    std::uint32_t restarts_ = 0;
+};
+
+} // namespace qms
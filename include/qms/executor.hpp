@@ -0,0 +1,437 @@
+#pragma once
+
+// The coroutine executor is built on epoll and is available on Linux only;
+// QMS_HAS_EXECUTOR tells callers whether it can be used. Other platforms keep
+// the thread-per-port acquisition model.
+#if defined(__linux__)
+#define QMS_HAS_EXECUTOR 1
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "clock.hpp"
+#include "log.hpp"
+#include "serial.hpp"
+#include "task.hpp"
+
+namespace qms {
+
+// *** Executor ***
+// A single-threaded scheduler for coroutine tasks with an epoll reactor and a
+// timer queue. Port handlers are written as Task<> coroutines that co_await
+// reads, writes and sleeps; a suspended handler costs only its coroutine frame
+// (a few hundred bytes) rather than a thread and its stack, so one executor
+// thread can serve thousands of ports.
+//
+// Time comes from the injected Clock. With a VirtualClock the executor never
+// sleeps: when only timers are pending it advances the clock straight to the
+// next deadline, so simulated time runs as fast as the tasks can process it.
+//
+// All methods except `stop` must be called from the thread running `run`.
+// To use several cores, run one Executor per thread (e.g. per port group).
+class Executor {
+public:
+    using time_point = Timestamp;
+    using duration = std::chrono::nanoseconds;
+
+    static constexpr duration forever = duration::max();
+
+    explicit Executor(Clock &clock = system_clock()) : clock_(&clock) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0) throw std::runtime_error("unable to create epoll reactor");
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr; // The wake-up eventfd
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    }
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+
+    ~Executor() {
+        timers_.clear();
+        ready_.clear();
+        for (void *root : std::exchange(roots_, {})) std::coroutine_handle<>::from_address(root).destroy();
+        ::close(wake_fd_);
+        ::close(epoll_fd_);
+    }
+
+    // *** Function: spawn ***
+    // Schedules `task` to start on the next iteration of `run`. The executor
+    // owns the task until it completes; exceptions escaping it are logged.
+    void spawn(Task<void> task) {
+        const auto root = detach(std::move(task)).handle;
+        root.promise().ex = this;
+        roots_.insert(root.address());
+        ready_.push_back(root);
+    }
+
+    // *** Function: run ***
+    // Runs tasks until all spawned tasks have finished or `stop` is called.
+    void run() {
+        stopping_.store(false, std::memory_order_relaxed);
+        while (!roots_.empty() && !stopping_.load(std::memory_order_relaxed)) {
+            while (!ready_.empty()) {
+                const auto h = ready_.front();
+                ready_.pop_front();
+                h.resume();
+            }
+            if (roots_.empty()) break;
+            for (auto &hook : idle_hooks_) hook();
+            poll(ready_.empty());
+        }
+        for (auto &hook : idle_hooks_) hook();
+    }
+
+    // Asks `run` to return; safe to call from any thread.
+    void stop() {
+        stopping_.store(true, std::memory_order_relaxed);
+        const std::uint64_t one = 1;
+        [[maybe_unused]] auto n = ::write(wake_fd_, &one, sizeof(one));
+    }
+
+    // Registers a callback invoked whenever the executor runs out of ready
+    // work, before it blocks for I/O. Pipelines use it to flush their sinks
+    // once per burst of input rather than once per read.
+    void on_idle(std::function<void()> hook) { idle_hooks_.push_back(std::move(hook)); }
+
+    std::size_t live_tasks() const { return roots_.size(); }
+    time_point now() const { return clock_->now(); }
+    Clock &clock() const { return *clock_; }
+
+    struct FdState;
+
+    // *** Waiter ***
+    // State of one suspended operation; lives in the awaiting coroutine's frame.
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        bool timed_out = false;
+        bool has_timer = false;
+        std::multimap<time_point, Waiter *>::iterator timer;
+        FdState *fd = nullptr;
+    };
+
+    // *** FdState ***
+    // One registered file descriptor and the operations waiting on it.
+    struct FdState {
+        int fd;
+        Waiter *reader = nullptr;
+        Waiter *writer = nullptr;
+    };
+
+    // *** Function: sleep_until / sleep_for ***
+    // Suspends the calling coroutine until the given time.
+    auto sleep_until(time_point deadline) {
+        struct Awaiter {
+            Executor &ex;
+            time_point deadline;
+            Waiter w;
+            bool await_ready() const { return deadline <= ex.now(); }
+            void await_suspend(std::coroutine_handle<> h) {
+                w.handle = h;
+                ex.arm_timer(w, deadline);
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, deadline, {}};
+    }
+    auto sleep_for(duration d) { return sleep_until(now() + d.count()); }
+
+    // Suspends the calling coroutine until it is rescheduled behind all
+    // currently ready work.
+    auto yield() {
+        struct Awaiter {
+            Executor &ex;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { ex.ready_.push_back(h); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    // *** Signal ***
+    // Wakes one coroutine of this executor from another: `wait` suspends until
+    // `notify` is called or `timeout` elapses, and a `notify` without a waiter
+    // is remembered for the next `wait`. The awaited result is false on timeout.
+    class Signal {
+    public:
+        explicit Signal(Executor &ex) : ex_(&ex) {}
+
+        auto wait(duration timeout = forever) {
+            struct Awaiter {
+                Signal &s;
+                duration timeout;
+                Waiter w;
+                bool await_ready() noexcept { return std::exchange(s.pending_, false); }
+                void await_suspend(std::coroutine_handle<> h) {
+                    w.handle = h;
+                    s.waiter_ = &w;
+                    if (timeout != forever) s.ex_->arm_timer(w, s.ex_->now() + timeout.count());
+                }
+                bool await_resume() noexcept {
+                    if (s.waiter_ == &w) s.waiter_ = nullptr;
+                    return !w.timed_out;
+                }
+            };
+            return Awaiter{*this, timeout, {}};
+        }
+
+        void notify() {
+            if (waiter_ && !waiter_->timed_out) ex_->wake(*std::exchange(waiter_, nullptr), false);
+            else pending_ = true;
+        }
+
+    private:
+        Executor *ex_;
+        Waiter *waiter_ = nullptr;
+        bool pending_ = false;
+    };
+
+    // Registers `fd` with the reactor. Called by AsyncPort.
+    FdState *watch(int fd) {
+        auto &slot = fds_[fd];
+        if (!slot) {
+            slot = std::make_unique<FdState>();
+            slot->fd = fd;
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            ev.data.ptr = slot.get();
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                fds_.erase(fd);
+                return nullptr;
+            }
+        }
+        return slot.get();
+    }
+
+    // Removes `fd` from the reactor. Must be called before the descriptor is closed.
+    void unwatch(int fd) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        fds_.erase(fd);
+    }
+
+    // Suspends `w` until `fd` becomes readable (`for_write` false) or writable,
+    // or until `timeout` elapses.
+    void wait_fd(Waiter &w, FdState &fd, bool for_write, duration timeout) {
+        w.fd = &fd;
+        (for_write ? fd.writer : fd.reader) = &w;
+        if (timeout != forever) arm_timer(w, now() + timeout.count());
+    }
+
+private:
+    struct Detached {
+        struct promise_type {
+            Executor *ex = nullptr;
+
+            // Deregisters the finished root, then lets the frame be destroyed.
+            struct Final {
+                bool await_ready() const noexcept { return false; }
+                bool await_suspend(std::coroutine_handle<promise_type> h) const noexcept {
+                    h.promise().ex->roots_.erase(h.address());
+                    return false;
+                }
+                void await_resume() const noexcept {}
+            };
+
+            Detached get_return_object() noexcept {
+                return {std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            Final final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept {}
+        };
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    static Detached detach(Task<void> task) {
+        try {
+            co_await task;
+        } catch (const std::exception &e) {
+            log(LogLevel::Error, "Task failed: %s", e.what());
+        } catch (...) {
+            log(LogLevel::Error, "Task failed with an unknown exception");
+        }
+    }
+
+    void arm_timer(Waiter &w, time_point deadline) {
+        w.timer = timers_.emplace(deadline, &w);
+        w.has_timer = true;
+    }
+
+    void wake(Waiter &w, bool timed_out) {
+        if (w.has_timer) {
+            if (!timed_out) timers_.erase(w.timer);
+            w.has_timer = false;
+        }
+        if (w.fd) {
+            if (w.fd->reader == &w) w.fd->reader = nullptr;
+            if (w.fd->writer == &w) w.fd->writer = nullptr;
+            w.fd = nullptr;
+        }
+        w.timed_out = timed_out;
+        ready_.push_back(w.handle);
+    }
+
+    void poll(bool may_block) {
+        VirtualClock *virtual_clock = clock_->as_virtual();
+        int timeout_ms = 0;
+        if (may_block && (timers_.empty() || !virtual_clock)) {
+            if (timers_.empty()) {
+                timeout_ms = -1;
+            } else {
+                const duration wait(timers_.begin()->first - now());
+                timeout_ms = wait <= duration::zero()
+                                 ? 0
+                                 : static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(wait).count());
+            }
+        }
+
+        epoll_event events[256];
+        const int n = epoll_wait(epoll_fd_, events, 256, timeout_ms);
+        if (virtual_clock && may_block && n <= 0 && !timers_.empty())
+            virtual_clock->advance_to(timers_.begin()->first); // Nothing else can happen before the next timer
+        for (int i = 0; i < n; ++i) {
+            auto *fd = static_cast<FdState *>(events[i].data.ptr);
+            if (fd == nullptr) {
+                std::uint64_t count;
+                [[maybe_unused]] auto r = ::read(wake_fd_, &count, sizeof(count));
+                continue;
+            }
+            const std::uint32_t e = events[i].events;
+            if ((e & (EPOLLIN | EPOLLERR | EPOLLHUP)) && fd->reader) wake(*fd->reader, false);
+            if ((e & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && fd->writer) wake(*fd->writer, false);
+        }
+
+        const time_point t = now();
+        while (!timers_.empty() && timers_.begin()->first <= t) {
+            Waiter *w = timers_.begin()->second;
+            timers_.erase(timers_.begin());
+            wake(*w, true);
+        }
+    }
+
+    Clock *clock_;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::deque<std::coroutine_handle<>> ready_;
+    std::multimap<time_point, Waiter *> timers_;
+    std::unordered_map<int, std::unique_ptr<FdState>> fds_;
+    std::vector<std::function<void()>> idle_hooks_;
+    std::unordered_set<void *> roots_; // Frames of the spawned tasks
+};
+
+// *** AsyncPort ***
+// A serial port (or any file descriptor) driven by an Executor. The port is
+// switched to non-blocking mode and registered with the reactor for its
+// lifetime; `read` and `write` are awaitables that suspend the calling
+// coroutine instead of blocking the thread.
+class AsyncPort {
+public:
+    AsyncPort(Executor &ex, SerialPort port) : ex_(&ex), port_(std::move(port)) {
+        const int fd = port_.native_handle();
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        state_ = ex.watch(fd);
+        if (state_ == nullptr) throw std::runtime_error("unable to register port with the reactor");
+    }
+    AsyncPort(const AsyncPort &) = delete;
+    AsyncPort &operator=(const AsyncPort &) = delete;
+    ~AsyncPort() { ex_->unwatch(port_.native_handle()); }
+
+    // *** Function: read ***
+    // co_await port.read(buffer, size, timeout) yields the number of bytes
+    // read, 0 if `timeout` elapsed first, or -1 on error or hang-up.
+    auto read(void *buffer, std::size_t size, Executor::duration timeout = Executor::forever) {
+        return IoAwaiter<false>{*this, buffer, size, timeout, {}};
+    }
+
+    // *** Function: write ***
+    // co_await port.write(buffer, size, timeout) yields the number of bytes
+    // written (possibly fewer than `size`), 0 on timeout, or -1 on error.
+    auto write(const void *buffer, std::size_t size, Executor::duration timeout = Executor::forever) {
+        return IoAwaiter<true>{*this, const_cast<void *>(buffer), size, timeout, {}};
+    }
+
+    // *** Function: write_all ***
+    // Writes the whole buffer, suspending as needed.
+    //
+    // Returns:
+    // - false on error or if `timeout` elapsed during any partial write.
+    Task<bool> write_all(const void *buffer, std::size_t size, Executor::duration timeout = Executor::forever) {
+        const char *p = static_cast<const char *>(buffer);
+        while (size > 0) {
+            const long n = co_await write(p, size, timeout);
+            if (n <= 0) co_return false;
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        co_return true;
+    }
+
+    Executor &executor() const { return *ex_; }
+    SerialPort &port() { return port_; }
+
+private:
+    template <bool ForWrite>
+    struct IoAwaiter {
+        AsyncPort &self;
+        void *buffer;
+        std::size_t size;
+        Executor::duration timeout;
+        Executor::Waiter w;
+        long result = 0;
+
+        // Edge-triggered: attempt the operation first and only wait after EAGAIN,
+        // so that the next edge is guaranteed to be reported.
+        bool await_ready() { return attempt(); }
+        void await_suspend(std::coroutine_handle<> h) {
+            w.handle = h;
+            self.ex_->wait_fd(w, *self.state_, ForWrite, timeout);
+        }
+        long await_resume() {
+            if (!w.handle) return result; // Completed without suspending
+            if (w.timed_out || !attempt()) return 0;
+            return result;
+        }
+
+        // Returns true if the operation completed (successfully or not).
+        bool attempt() {
+            const int fd = self.port_.native_handle();
+            const ssize_t n = ForWrite ? ::write(fd, buffer, size) : ::read(fd, buffer, size);
+            if (n > 0) {
+                result = static_cast<long>(n);
+                return true;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return false;
+            result = -1; // Error, or end-of-file on read
+            return true;
+        }
+    };
+
+    Executor *ex_;
+    SerialPort port_;
+    Executor::FdState *state_ = nullptr;
+};
+
+} // namespace qms
+
+#endif // __linux__
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+#include <system_error>
+
+#include "record.hpp"
+
+namespace qms {
+
+// *** Function: format_fixed ***
+// Writes `value` with `precision` decimals (like "%.*f") to `out`. A value
+// too long for that in the room up to `end` (e.g. 1e30 with 6 decimals in 32
+// characters) is written in its shortest exact form ("1e+30") instead; if
+// even that does not fit, nothing is written.
+//
+// Returns:
+// - A pointer one past the last character written.
+inline char *format_fixed(char *out, char *end, float value, int precision = 2) {
+    const auto fixed = std::to_chars(out, end, value, std::chars_format::fixed, precision);
+    if (fixed.ec == std::errc()) [[likely]]
+        return fixed.ptr;
+    const auto shortest = std::to_chars(out, end, value);
+    return shortest.ec == std::errc() ? shortest.ptr : out;
+}
+
+namespace detail {
+
+constexpr double pow10(int n) { return n == 0 ? 1.0 : 10.0 * pow10(n - 1); }
+
+} // namespace detail
+
+// *** Function: format_fixed<Precision> ***
+// Fast path of format_fixed for a precision known at compile time: the value
+// is scaled to an integer and printed digit by digit, with no locale or
+// format-string handling. Needs room for 32 characters at `out`.
+//
+// Returns:
+// - A pointer one past the last character written.
+template <int Precision>
+inline char *format_fixed(char *out, float value) {
+    static_assert(Precision >= 0 && Precision <= 6, "precision out of range");
+    constexpr double scale = detail::pow10(Precision);
+    const double x = static_cast<double>(value) * scale;
+    if (!(x < 9.0e15 && x > -9.0e15)) return format_fixed(out, out + 32, value, Precision); // NaN or huge
+    // As to_chars: the sign is kept when the value rounds to zero ("-0.00"),
+    // and ties round to even (`x` is exact, a float times a power of ten).
+    const bool negative = std::signbit(value);
+    if (negative) *out++ = '-';
+    const double y = negative ? -x : x;
+    auto n = static_cast<unsigned long long>(y);
+    const double rest = y - static_cast<double>(n);
+    n += rest > 0.5 || (rest == 0.5 && (n & 1));
+    constexpr auto divisor = static_cast<unsigned long long>(scale);
+    unsigned long long frac = n % divisor;
+    out = std::to_chars(out, out + 20, n / divisor).ptr;
+    if constexpr (Precision > 0) {
+        *out = '.';
+        for (int i = Precision; i > 0; --i, frac /= 10) out[i] = static_cast<char>('0' + frac % 10);
+        out += Precision + 1;
+    }
+    return out;
+}
+
+// Runtime-precision front end to format_fixed<Precision>. Needs room for 32 characters.
+inline char *format_fixed_fast(char *out, float value, int precision) {
+    switch (precision) {
+    case 0: return format_fixed<0>(out, value);
+    case 1: return format_fixed<1>(out, value);
+    case 2: return format_fixed<2>(out, value);
+    case 3: return format_fixed<3>(out, value);
+    case 4: return format_fixed<4>(out, value);
+    case 5: return format_fixed<5>(out, value);
+    case 6: return format_fixed<6>(out, value);
+    default: return format_fixed(out, out + 32, value, precision);
+    }
+}
+
+// *** Function: format_json_string ***
+// Writes `s` as a quoted JSON string to `out`, escaping quotes, backslashes
+// and control characters. Needs room for `2 + 6 * s.size()` characters.
+//
+// Returns:
+// - A pointer one past the closing quote.
+inline char *format_json_string(char *out, std::string_view s) {
+    static constexpr char hex[] = "0123456789abcdef";
+    *out++ = '"';
+    for (const char c : s) {
+        const auto u = static_cast<unsigned char>(c);
+        if (u == '"' || u == '\\') {
+            *out++ = '\\';
+            *out++ = c;
+        } else if (u < 0x20) {
+            std::memcpy(out, "\\u00", 4);
+            out[4] = hex[u >> 4];
+            out[5] = hex[u & 15];
+            out += 6;
+        } else {
+            *out++ = c;
+        }
+    }
+    *out++ = '"';
+    return out;
+}
+
+// *** TimestampFormatter ***
+// Formats timestamps as local time "YYYY-MM-DD HH:MM:SS", the format the
+// MATLAB analysis script reads. Consecutive readings usually fall in the same
+// second, so the last formatted second is cached and reused.
+class TimestampFormatter {
+public:
+    static constexpr std::size_t length = 19;
+
+    // Writes exactly `length` characters to `out` and returns `out + length`.
+    char *format(char *out, Timestamp ts) {
+        const std::time_t sec = static_cast<std::time_t>(ts / 1000000000);
+        if (sec != cached_second_) {
+            std::tm tm{};
+#if defined(_WIN32)
+            localtime_s(&tm, &sec);
+#else
+            localtime_r(&sec, &tm);
+#endif
+            std::strftime(cached_, sizeof(cached_), "%Y-%m-%d %H:%M:%S", &tm);
+            cached_second_ = sec;
+        }
+        std::memcpy(out, cached_, length);
+        return out + length;
+    }
+
+private:
+    std::time_t cached_second_ = -1;
+    char cached_[length + 1] = {};
+};
+
+} // namespace qms
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "alert.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "lots.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+// *** GoldenProfile Structure ***
+// The reference course of one sensor over a good run: `values[k]` is the
+// value `k * step` after the run started.
+struct GoldenProfile {
+    std::vector<float> values;
+    Timestamp step = 0;
+};
+
+// *** Function: load_golden_profile ***
+// Reads a golden profile from a text file of "<seconds> <value>" pairs, one
+// per line and separated by whitespace, ',' or ';', with the seconds counted
+// from the start of the run and strictly increasing. Lines that do not hold a
+// pair (e.g. a CSV header) are skipped. The pairs are interpolated linearly
+// onto a grid of `step` starting at the first pair.
+//
+// Returns:
+// - false if the file cannot be read or holds fewer than two pairs.
+inline bool load_golden_profile(const char *filename, Timestamp step, GoldenProfile &profile) {
+    std::FILE *file = std::fopen(filename, "r");
+    if (file == nullptr) {
+        log(LogLevel::Error, "Unable to open golden profile %s", filename);
+        return false;
+    }
+    std::vector<double> times;
+    std::vector<float> values;
+    bool ordered = true;
+    char buffer[256];
+    while (std::fgets(buffer, sizeof(buffer), file)) {
+        std::replace_if(buffer, buffer + std::strlen(buffer), [](char c) { return c == ',' || c == ';'; }, ' ');
+        std::string_view t[3];
+        double seconds = 0;
+        float value = 0;
+        if (detail::tokenize(buffer, t, 3) != 2 || !detail::parse_number(t[0], seconds) ||
+            !detail::parse_number(t[1], value))
+            continue;
+        ordered = ordered && (times.empty() || seconds > times.back());
+        times.push_back(seconds);
+        values.push_back(value);
+    }
+    std::fclose(file);
+    if (times.size() < 2 || !ordered || step <= 0) {
+        log(LogLevel::Error, "Golden profile %s needs at least two points in increasing time", filename);
+        return false;
+    }
+
+    profile.step = step;
+    profile.values.clear();
+    const double dt = static_cast<double>(step) / 1e9;
+    std::size_t i = 0;
+    for (double at = times.front(); at <= times.back(); at = times.front() + profile.values.size() * dt) {
+        while (times[i + 1] < at) ++i;
+        const double f = (at - times[i]) / (times[i + 1] - times[i]);
+        profile.values.push_back(static_cast<float>(values[i] + f * (values[i + 1] - values[i])));
+    }
+    return true;
+}
+
+// *** StreamingDtw ***
+// Dynamic time warping of a run against a reference, computed one run sample
+// at a time. Warping paths are limited to a Sakoe-Chiba band: run sample `i`
+// may only be matched to reference samples `i - band` to `i + band`, so a run
+// may lead or lag the reference by up to `band` samples. The cost of matching
+// is the absolute difference of the values.
+//
+// Only the current row of the cost matrix is needed to compute the next, so
+// the comparison keeps two rows of `2 * band + 1` cells whatever the length
+// of the run.
+class StreamingDtw {
+public:
+    StreamingDtw(const std::vector<float> &reference, std::size_t band)
+        : reference_(&reference), band_(band), previous_(2 * band + 1), current_(2 * band + 1) {}
+
+    // Starts comparing a new run.
+    void reset() { samples_ = 0; }
+
+    // *** Function: push ***
+    // Adds the next sample `x` of the run.
+    //
+    // Returns:
+    // - The cost of the cheapest warping path of the run so far, ending
+    //   anywhere in the band. Costs only grow along a path, so the cost of the
+    //   complete run will be at least this much.
+    // - Infinity once the run has outlasted the reference by more than the band.
+    double push(float x) {
+        constexpr double none = std::numeric_limits<double>::infinity();
+        const std::vector<float> &ref = *reference_;
+        const auto i = static_cast<std::ptrdiff_t>(samples_);
+        const auto band = static_cast<std::ptrdiff_t>(band_);
+        std::swap(previous_, current_);
+        double best = none;
+        // Cell k of a row for run sample i holds reference sample i - band + k
+        for (std::ptrdiff_t k = 0; k <= 2 * band; ++k) {
+            const std::ptrdiff_t j = i - band + k;
+            if (j < 0 || j >= static_cast<std::ptrdiff_t>(ref.size())) {
+                current_[k] = none;
+                continue;
+            }
+            double from = none;
+            if (i == 0) {
+                from = j == 0 ? 0.0 : none;
+            } else {
+                if (k + 1 <= 2 * band) from = previous_[k + 1]; // (i - 1, j)
+                if (j > 0) from = std::min(from, previous_[k]); // (i - 1, j - 1)
+            }
+            if (k > 0) from = std::min(from, current_[k - 1]); // (i, j - 1)
+            current_[k] = from + std::abs(static_cast<double>(x) - ref[j]);
+            best = std::min(best, current_[k]);
+        }
+        ++samples_;
+        return best;
+    }
+
+    // *** Function: end_cost ***
+    // The cost of the cheapest warping path that matches the whole run so far
+    // to the whole reference, first sample to first and last to last: the
+    // dynamic time warping distance D[n][m].
+    //
+    // Returns:
+    // - Infinity if the last reference sample is not within the band of the
+    //   last run sample, i.e. the run is too short or too long to match end
+    //   to end.
+    double end_cost() const {
+        if (samples_ == 0 || reference_->empty()) return std::numeric_limits<double>::infinity();
+        const auto k = static_cast<std::ptrdiff_t>(reference_->size()) - static_cast<std::ptrdiff_t>(samples_) +
+                       static_cast<std::ptrdiff_t>(band_); // Cell of the last reference sample in the current row
+        return k >= 0 && k <= static_cast<std::ptrdiff_t>(2 * band_) ? current_[static_cast<std::size_t>(k)]
+                                                                       : std::numeric_limits<double>::infinity();
+    }
+
+    // Run samples compared so far.
+    std::size_t samples() const { return samples_; }
+
+private:
+    const std::vector<float> *reference_;
+    std::size_t band_;
+    std::vector<double> previous_;
+    std::vector<double> current_;
+    std::size_t samples_ = 0;
+};
+
+// *** GoldenReference Structure ***
+// Compares runs of sensor `sensor` against `profile`, warping them by up to
+// `band` profile steps, and alerts when their cumulative deviation exceeds
+// `threshold` (in value units times profile steps).
+struct GoldenReference {
+    SensorHandle sensor;
+    GoldenProfile profile;
+    std::size_t band;
+    double threshold;
+};
+
+// *** GoldenBatch Stage ***
+// Compares every run of a sensor with a GoldenReference against its golden
+// profile while the run is in progress. A run is one lot context of a line
+// (see LotTracker): a lot, or a batch of it, so each batch is compared from
+// its own start. A reading belongs to the context at its timestamp.
+//
+// A run's readings are sampled at the profile's step from the start of the
+// context, each sample holding the last reading at or before it, and fed to
+// a StreamingDtw. As soon as the cheapest warping path so far costs more
+// than the threshold, the run cannot end below it, so a ProfileDeviation
+// alert is raised at once, mid-run; once per run. When a run ends it is
+// logged with its end-to-end deviation (see StreamingDtw::end_cost), or, if
+// it ended too early or too late to match the profile end to end, with how
+// many steps it had and the open-end bound.
+//
+// Each pipeline compares the runs of the ports it serves, so the sensors of
+// a reference should reach a line through one port.
+class GoldenBatch {
+public:
+    GoldenBatch(const AlertPath &alerts, const LotTracker &lots, const std::vector<GoldenReference> &references)
+        : alerts_(&alerts), lots_(&lots), references_(&references) {
+        for (std::size_t i = 0; i < references.size(); ++i) {
+            const SensorHandle s = references[i].sensor;
+            if (s >= by_sensor_.size()) by_sensor_.resize(static_cast<std::size_t>(s) + 1, none);
+            if (by_sensor_[s] != none) {
+                const auto id = alerts.registry().sensor_name(s);
+                log(LogLevel::Error, "Ignoring a second golden profile for sensor %.*s", static_cast<int>(id.size()),
+                    id.data());
+                continue;
+            }
+            by_sensor_[s] = i;
+        }
+    }
+
+    bool process(SensorData &r) {
+        if (r.sensor >= by_sensor_.size() || by_sensor_[r.sensor] == none) [[likely]]
+            return true;
+        const std::size_t ref = by_sensor_[r.sensor];
+        const LotContext *context = lots_->context(r.port, r.timestamp);
+        const std::size_t line = context ? context->line : lots_->lines().line_of(r.port);
+        if (line == RecipeBook::no_line) return true;
+        Run &run = this->run(line, ref);
+        if (run.context != context) {
+            finish(run, ref);
+            if (context) start(run, context);
+        }
+        if (!run.context || run.done) return true;
+        const GoldenReference &g = (*references_)[ref];
+        if (!run.sampling) {
+            // The first sample is the first grid point at or after the first reading
+            const Timestamp since = std::max<Timestamp>(r.timestamp - run.context->start, 0);
+            run.next = run.context->start + (since + g.profile.step - 1) / g.profile.step * g.profile.step;
+            run.sampling = true;
+        }
+        while (run.next < r.timestamp && !run.done) sample(run, ref, r.port);
+        run.held = r.value;
+        return true;
+    }
+
+    // Ends the runs in progress, e.g. at shutdown, logging their deviation.
+    void close() {
+        for (std::size_t i = 0; i < runs_.size(); ++i) finish(runs_[i], i % references_->size());
+    }
+
+private:
+    static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+    struct Run {
+        explicit Run(const GoldenReference &g) : dtw(g.profile.values, g.band) {}
+        const LotContext *context = nullptr;
+        StreamingDtw dtw;
+        Timestamp next = 0; // Time of the next sample
+        float held = 0.0f;  // Last reading
+        double cost = 0.0;  // Of the cheapest warping path so far, ending anywhere
+        double end = std::numeric_limits<double>::infinity(); // End to end, up to the last sample
+        bool sampling = false;
+        bool alerted = false;
+        bool done = false; // Outlasted the profile
+    };
+
+    Run &run(std::size_t line, std::size_t ref) {
+        const std::size_t n = references_->size();
+        while (runs_.size() < (line + 1) * n) runs_.emplace_back((*references_)[runs_.size() % n]);
+        return runs_[line * n + ref];
+    }
+
+    static void start(Run &run, const LotContext *context) {
+        run.context = context;
+        run.dtw.reset();
+        run.cost = 0.0;
+        run.end = std::numeric_limits<double>::infinity();
+        run.sampling = run.alerted = run.done = false;
+    }
+
+    void sample(Run &run, std::size_t ref, PortHandle port) {
+        const GoldenReference &g = (*references_)[ref];
+        const double cost = run.dtw.push(run.held);
+        if (std::isinf(cost)) {
+            run.done = true;
+            return;
+        }
+        run.cost = cost;
+        run.end = run.dtw.end_cost();
+        if (!run.alerted && cost > g.threshold) {
+            run.alerted = true;
+            alerts_->raise({AlertKind::ProfileDeviation, g.sensor, port, static_cast<float>(cost), 0.0f,
+                            static_cast<float>(g.threshold), run.next});
+        }
+        run.next += g.profile.step;
+    }
+
+    void finish(Run &run, std::size_t ref) {
+        if (!run.context) return;
+        if (run.dtw.samples() > 0) {
+            const GoldenReference &g = (*references_)[ref];
+            const auto id = alerts_->registry().sensor_name(g.sensor);
+            const std::string &line = lots_->lines().line_name(run.context->line);
+            if (std::isfinite(run.end) && !run.done)
+                log(LogLevel::Info, "Run %s of line %s, sensor %.*s: deviation %.3f over %zu steps",
+                    run.context->tag.c_str(), line.c_str(), static_cast<int>(id.size()), id.data(), run.end,
+                    run.dtw.samples());
+            else
+                log(LogLevel::Info,
+                    "Run %s of line %s, sensor %.*s: %zu steps %s the profile's %zu, deviation at least %.3f",
+                    run.context->tag.c_str(), line.c_str(), static_cast<int>(id.size()), id.data(),
+                    run.dtw.samples(), run.done ? "outlast" : "do not span", g.profile.values.size(), run.cost);
+        }
+        run.context = nullptr;
+    }
+
+    const AlertPath *alerts_;
+    const LotTracker *lots_;
+    const std::vector<GoldenReference> *references_;
+    std::vector<std::size_t> by_sensor_; // Reference index by sensor handle
+    std::vector<Run> runs_;              // By line, then reference
+};
+
+} // namespace qms
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+
+namespace qms {
+
+enum class LogLevel { Info, Error, Alert };
+
+// Signature of a diagnostic handler; `message` is already formatted and has no
+// trailing newline.
+using LogHandler = void (*)(LogLevel level, const char *message);
+
+namespace detail {
+
+inline void console_log_handler(LogLevel level, const char *message) {
+    static constexpr const char *prefix[] = {"", "[ERROR] ", "[ALERT] "};
+    std::printf("%s%s\n", prefix[static_cast<int>(level)], message);
+}
+
+inline std::atomic<LogHandler> &log_handler() {
+    static std::atomic<LogHandler> handler{console_log_handler};
+    return handler;
+}
+
+} // namespace detail
+
+// *** Function: set_log_handler ***
+// Redirects all library diagnostics. Embedding applications use this to route
+// messages into their own logging instead of stdout. Passing nullptr restores
+// the console handler.
+inline void set_log_handler(LogHandler handler) {
+    detail::log_handler().store(handler ? handler : detail::console_log_handler);
+}
+
+// *** Function: log ***
+// printf-style diagnostic output through the installed handler.
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+inline void log(LogLevel level, const char *fmt, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, fmt);
+    std::vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    detail::log_handler().load(std::memory_order_relaxed)(level, message);
+}
+
+} // namespace qms
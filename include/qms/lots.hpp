@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "buffer.hpp"
+#include "format.hpp"
+#include "log.hpp"
+#include "recipes.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "sinks.hpp"
+
+namespace qms {
+
+// *** LotContext Structure ***
+// The production context of a line from `start` until its next context: lot
+// `lot`, optionally narrowed to batch `batch`, or no lot where `lot` is
+// empty (the lot before it ended). `tag` is what the logs record ("lot" or
+// "lot/batch"); `opening` is the context that started the lot. Each context
+// links to the line's `previous` one, so they form the line's history.
+// Contexts are never freed, so a pointer to one identifies a run of readings.
+struct LotContext {
+    std::size_t line;
+    std::string lot;
+    std::string batch;
+    std::string tag;
+    Timestamp start;
+    const LotContext *opening;  // nullptr between lots
+    const LotContext *previous; // nullptr for the line's first
+};
+
+// *** LotSensorStats Structure ***
+// What one sensor did during one lot:
+// - `count`, `sum`, `min_value`, `max_value`: Of its readings.
+// - `out_of_spec`: Readings outside their limits; `excursions`: runs of them.
+// - `limits`, `histogram`: The limits when the lot first saw the sensor, and
+//   the readings below them, in ten equal bins across them, and above them.
+struct LotSensorStats {
+    static constexpr std::size_t bins = 10;
+
+    std::uint64_t count = 0;
+    double sum = 0.0;
+    float min_value = std::numeric_limits<float>::infinity();
+    float max_value = -std::numeric_limits<float>::infinity();
+    std::uint64_t out_of_spec = 0;
+    std::uint64_t excursions = 0;
+    Limits limits{0.0f, 0.0f};
+    std::array<std::uint64_t, bins + 2> histogram{}; // [0]: below, [bins + 1]: above
+    bool was_out = false;
+
+    void add(const SensorData &r) {
+        ++count;
+        sum += r.value;
+        min_value = std::min(min_value, r.value);
+        max_value = std::max(max_value, r.value);
+        const bool out = qms::out_of_spec(r.state);
+        out_of_spec += out;
+        excursions += out && !was_out;
+        was_out = out;
+        std::size_t bin = 0;
+        if (r.value > limits.max_limit) {
+            bin = bins + 1;
+        } else if (r.value >= limits.min_limit) {
+            const float width = limits.max_limit - limits.min_limit;
+            const auto i = width > 0.0f ? static_cast<std::size_t>((r.value - limits.min_limit) / width * bins) : 0;
+            bin = 1 + std::min<std::size_t>(i, bins - 1);
+        }
+        ++histogram[bin];
+    }
+
+    double average() const { return count ? sum / static_cast<double>(count) : 0.0; }
+};
+
+// *** LotTracker ***
+// Tracks the lot each production line of a RecipeBook is making and
+// aggregates the readings of every lot per sensor. Lines change context on
+// the in-band control lines of their ports:
+// - "@lot start <id>": Closes the open lot, if any, and opens lot <id>.
+// - "@batch <id>": Tags the following readings with batch <id> of the open lot.
+// - "@lot end": Closes the open lot.
+//
+// Control lines are handled as they are decoded, while the readings decoded
+// before them may still wait in the pipeline's queues. So a reading belongs
+// to the context its line was in at the reading's timestamp (see `context`),
+// looked up in the line's history of contexts, not to the one it is in when
+// the reading reaches a stage. A closed lot is handed to `on_summary` (see
+// LotSummaryCsv), with one entry per sensor it saw, once `settle_time` has
+// passed since its end (see `settle`); readings of the lot that arrive later
+// are not counted.
+//
+// Each line's aggregates have their own mutex, taken only for readings
+// within a lot, so lines spread over several pipelines stay consistent.
+class LotTracker {
+public:
+    // Contexts a lookup walks back at most; older readings belong to no lot.
+    static constexpr std::size_t history = 64;
+    // How long after a lot ends its readings may still reach LotAggregate.
+    static constexpr Timestamp settle_time = 2000000000;
+
+    // Limits a lot's histogram of a sensor on a port is binned across, given its first reading's time.
+    using LimitsFn = std::function<Limits(PortHandle, SensorHandle, Timestamp)>;
+    // Receives a closed lot, its end, its recipe and its per-sensor statistics (indexed by handle).
+    using SummaryFn = std::function<void(const LotContext &, Timestamp end, const Recipe *,
+                                         const std::vector<LotSensorStats> &)>;
+
+    LotTracker(const RecipeBook &lines, LimitsFn limits, SummaryFn on_summary = {})
+        : lines_(lines), limits_(std::move(limits)), on_summary_(std::move(on_summary)), states_(lines.lines()) {}
+    LotTracker(const LotTracker &) = delete;
+    LotTracker &operator=(const LotTracker &) = delete;
+
+    // The context of `port`'s line at `t`, or nullptr outside a lot.
+    const LotContext *context(PortHandle port, Timestamp t) const {
+        const std::size_t line = lines_.line_of(port);
+        if (line >= states_.size()) return nullptr;
+        const LotContext *c = states_[line].context.load(std::memory_order_acquire);
+        for (std::size_t i = 0; c && c->start > t && i < history; ++i) c = c->previous;
+        return c && c->start <= t && c->opening ? c : nullptr;
+    }
+
+    // Adds `r` to the lot of its line at its timestamp, if any.
+    void record(const SensorData &r) {
+        const LotContext *c = context(r.port, r.timestamp);
+        if (c == nullptr) return;
+        LineState &l = states_[c->line];
+        std::lock_guard lock(l.mutex);
+        const auto lot =
+            std::find_if(l.lots.begin(), l.lots.end(), [c](const Lot &x) { return x.opening == c->opening; });
+        if (lot == l.lots.end()) return; // Summarised already
+        if (r.sensor >= lot->sensors.size()) lot->sensors.resize(static_cast<std::size_t>(r.sensor) + 1);
+        LotSensorStats &s = lot->sensors[r.sensor];
+        if (s.count == 0) s.limits = limits_(r.port, r.sensor, r.timestamp);
+        s.add(r);
+    }
+
+    // *** Function: command ***
+    // Handles the control lines "lot start <id>", "lot end" and "batch <id>"
+    // received on `port` at `t`.
+    //
+    // Returns:
+    // - false if `command` is not a lot command.
+    bool command(PortHandle port, std::string_view command, Timestamp t) {
+        std::string_view words[3];
+        std::size_t n = 0;
+        while (n < 3 && !command.empty()) {
+            const std::size_t skip = command.find_first_not_of(" \t");
+            if (skip == std::string_view::npos) break;
+            command.remove_prefix(skip);
+            const std::size_t end = std::min(command.find_first_of(" \t"), command.size());
+            words[n++] = command.substr(0, end);
+            command.remove_prefix(end);
+        }
+        const bool start = n == 3 && words[0] == "lot" && words[1] == "start";
+        const bool end = n == 2 && words[0] == "lot" && words[1] == "end";
+        const bool batch = n == 2 && words[0] == "batch";
+        if (!start && !end && !batch) return false;
+        settle(t); // Also where no pipeline polls
+        const std::size_t line = lines_.line_of(port);
+        if (line >= states_.size()) {
+            const auto p = lines_.registry().port_name(port);
+            log(LogLevel::Error, "Port %.*s belongs to no line", static_cast<int>(p.size()), p.data());
+            return true;
+        }
+        if (start) open_lot(line, words[2], t);
+        else if (end) close_lot(line, t);
+        else start_batch(line, words[1], t);
+        return true;
+    }
+
+    void open_lot(std::size_t line, std::string_view lot, Timestamp t) {
+        close_lot(line, t);
+        LineState &l = states_[line];
+        std::lock_guard lock(l.mutex);
+        l.lot = &publish(l, line, lot, {}, t);
+        l.lots.push_back({l.lot, std::numeric_limits<Timestamp>::max(), {}});
+        log(LogLevel::Info, "Line %s started lot %.*s", lines_.line_name(line).c_str(), static_cast<int>(lot.size()),
+            lot.data());
+    }
+
+    void start_batch(std::size_t line, std::string_view batch, Timestamp t) {
+        LineState &l = states_[line];
+        std::lock_guard lock(l.mutex);
+        if (l.lot == nullptr) {
+            log(LogLevel::Error, "Batch %.*s on line %s outside a lot", static_cast<int>(batch.size()), batch.data(),
+                lines_.line_name(line).c_str());
+            return;
+        }
+        publish(l, line, l.lot->lot, batch, t);
+    }
+
+    // Closes the open lot of `line`, if any; its summary follows once it settles.
+    void close_lot(std::size_t line, Timestamp t) {
+        LineState &l = states_[line];
+        std::lock_guard lock(l.mutex);
+        if (l.lot == nullptr) return;
+        publish(l, line, {}, {}, t);
+        for (Lot &lot : l.lots)
+            if (lot.opening == l.lot) lot.end = t;
+        log(LogLevel::Info, "Line %s finished lot %s", lines_.line_name(line).c_str(), l.lot->lot.c_str());
+        l.lot = nullptr;
+    }
+
+    // *** Function: settle ***
+    // Hands on the summaries of the lots that ended `settle_time` before `now`
+    // or earlier. LotAggregate calls it from its pipeline's polls, and every
+    // lot command before it is handled.
+    void settle(Timestamp now) {
+        for (std::size_t line = 0; line < states_.size(); ++line) {
+            LineState &l = states_[line];
+            std::lock_guard lock(l.mutex);
+            while (!l.lots.empty() && l.lots.front().end != std::numeric_limits<Timestamp>::max() &&
+                   now - l.lots.front().end >= settle_time) {
+                const Lot &lot = l.lots.front();
+                if (on_summary_)
+                    on_summary_(*lot.opening, lot.end, lines_.active_at(line, lot.opening->start), lot.sensors);
+                l.lots.pop_front();
+            }
+        }
+    }
+
+    // Closes the open lots of every line and hands on every summary, e.g. at
+    // shutdown once the pipelines have stopped.
+    void close_all(Timestamp t) {
+        for (std::size_t line = 0; line < states_.size(); ++line) close_lot(line, t);
+        settle(std::numeric_limits<Timestamp>::max());
+    }
+
+    const RecipeBook &lines() const { return lines_; }
+
+private:
+    // A lot whose readings are being aggregated; `end` is the maximum while it is open.
+    struct Lot {
+        const LotContext *opening;
+        Timestamp end;
+        std::vector<LotSensorStats> sensors;
+    };
+
+    struct LineState {
+        std::atomic<const LotContext *> context{nullptr}; // Latest context; null before the first
+        std::mutex mutex;                                 // Guards the rest
+        const LotContext *lot = nullptr;                  // Context that opened the open lot, if any
+        std::deque<Lot> lots;                             // Not yet summarised, oldest first
+    };
+
+    // Stores a new context and makes it the line's latest one (mutex held).
+    const LotContext &publish(LineState &l, std::size_t line, std::string_view lot, std::string_view batch,
+                              Timestamp t) {
+        std::string tag(lot);
+        if (!batch.empty()) tag.append("/").append(batch);
+        const LotContext *previous = l.context.load(std::memory_order_relaxed);
+        LotContext *c;
+        {
+            std::lock_guard lock(contexts_mutex_);
+            c = &contexts_.emplace_back(
+                LotContext{line, std::string(lot), std::string(batch), std::move(tag), t, l.lot, previous});
+        }
+        if (lot.empty()) c->opening = nullptr;
+        else if (batch.empty()) c->opening = c;
+        l.context.store(c, std::memory_order_release);
+        return *c;
+    }
+
+    const RecipeBook &lines_;
+    LimitsFn limits_;
+    SummaryFn on_summary_;
+    std::deque<LineState> states_;
+    std::mutex contexts_mutex_;    // Guards `contexts_` across lines
+    std::deque<LotContext> contexts_; // Never shrinks: logs compare context pointers
+};
+
+// *** LotAggregate Stage ***
+// Adds every reading to the lot of its line at its timestamp (see
+// LotTracker), and hands on the lots that have settled from `poll`. Place it
+// after QualityMonitor, which sets the reading's state.
+class LotAggregate {
+public:
+    explicit LotAggregate(LotTracker &tracker) : tracker_(&tracker) {}
+
+    bool process(SensorData &r) {
+        tracker_->record(r);
+        return true;
+    }
+
+    void poll(Timestamp now) { tracker_->settle(now); }
+
+private:
+    LotTracker *tracker_;
+};
+
+// *** LotSummaryCsv ***
+// Writes closed lots to a CSV file, one line per lot and sensor:
+// Line, Lot, Start, End, Recipe, SensorID, Count, Mean, Min, Max, OutOfSpec,
+// Excursions, the histogram limits and the readings below, in each of the
+// ten bins across and above them. Use it as a LotTracker's summary callback.
+class LotSummaryCsv {
+public:
+    static constexpr std::string_view header =
+        "Line,Lot,Start,End,Recipe,SensorID,Count,Mean,Min,Max,OutOfSpec,Excursions,LowLimit,HighLimit,Below,"
+        "Bin1,Bin2,Bin3,Bin4,Bin5,Bin6,Bin7,Bin8,Bin9,Bin10,Above\n";
+
+    LotSummaryCsv(SharedFile &file, const RecipeBook &lines) : file_(&file), lines_(&lines) {}
+
+    void operator()(const LotContext &lot, Timestamp end, const Recipe *recipe,
+                    const std::vector<LotSensorStats> &sensors) {
+        ByteBuffer buffer;
+        TimestampFormatter timestamps;
+        const std::string &line = lines_->line_name(lot.line);
+        const std::string_view rname = recipe ? std::string_view(recipe->name()) : std::string_view("none");
+        for (std::size_t h = 0; h < sensors.size(); ++h) {
+            const LotSensorStats &s = sensors[h];
+            if (s.count == 0) continue;
+            const auto id = lines_->registry().sensor_name(static_cast<SensorHandle>(h));
+            const std::size_t prefix = line.size() + lot.lot.size() + rname.size() + id.size();
+            char *out = buffer.reserve_tail(prefix + 2 * TimestampFormatter::length + 512);
+            char *p = out;
+            p = std::copy(line.begin(), line.end(), p);
+            *p++ = ',';
+            p = std::copy(lot.lot.begin(), lot.lot.end(), p);
+            *p++ = ',';
+            p = timestamps.format(p, lot.start);
+            *p++ = ',';
+            p = timestamps.format(p, end);
+            *p++ = ',';
+            p = std::copy(rname.begin(), rname.end(), p);
+            *p++ = ',';
+            p = std::copy(id.begin(), id.end(), p);
+            p += std::snprintf(p, 160, ",%llu,%.6g,%.6g,%.6g,%llu,%llu,%g,%g", static_cast<unsigned long long>(s.count),
+                               s.average(), s.min_value, s.max_value, static_cast<unsigned long long>(s.out_of_spec),
+                               static_cast<unsigned long long>(s.excursions), s.limits.min_limit, s.limits.max_limit);
+            for (const std::uint64_t n : s.histogram)
+                p += std::snprintf(p, 24, ",%llu", static_cast<unsigned long long>(n));
+            *p++ = '\n';
+            buffer.commit(static_cast<std::size_t>(p - out));
+        }
+        file_->write(buffer.data(), buffer.size());
+    }
+
+private:
+    SharedFile *file_;
+    const RecipeBook *lines_;
+};
+
+} // namespace qms
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace qms {
+
+// *** MemoryPolicy Structure ***
+// Where large, long-lived buffers such as per-sensor state tables get their
+// pages from:
+// - `huge_pages`: Back them with 2 MiB pages to cut TLB misses. Reserved
+//   hugetlbfs pages are used when available, transparent huge pages otherwise.
+// - `numa_node`: Prefer pages on this NUMA node, or -1 for the default
+//   (first-touch) placement.
+struct MemoryPolicy {
+    bool huge_pages = false;
+    int numa_node = -1;
+
+    friend bool operator==(const MemoryPolicy &, const MemoryPolicy &) = default;
+};
+
+inline constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+// Allocations below this size come from the ordinary heap: mapping them
+// separately would waste most of a page.
+inline constexpr std::size_t page_allocation_threshold = std::size_t(256) << 10;
+
+namespace detail {
+
+// Bytes mapped for an allocate_pages block of `size` bytes.
+inline std::size_t mapping_size(std::size_t size, const MemoryPolicy &policy) {
+    const std::size_t align = policy.huge_pages ? huge_page_size : 4096;
+    return (size + align - 1) / align * align;
+}
+
+#if defined(__linux__)
+// Sets the preferred node of [addr, addr + size) before its pages are touched.
+inline void prefer_node(void *addr, std::size_t size, int node) {
+    constexpr int mpol_preferred = 1;
+    constexpr int max_nodes = 1024;
+    constexpr int bits = 8 * sizeof(unsigned long);
+    if (node < 0 || node >= max_nodes) return;
+    unsigned long mask[max_nodes / bits] = {};
+    mask[node / bits] = 1ul << (node % bits);
+    ::syscall(SYS_mbind, addr, size, mpol_preferred, mask, max_nodes + 1, 0); // Best effort
+}
+#endif
+
+} // namespace detail
+
+// *** Function: allocate_pages ***
+// Maps `size` bytes of zeroed, page-aligned memory according to `policy`,
+// rounded up to whole pages (2 MiB ones with huge pages). Huge pages and
+// node placement are best effort: without reserved huge pages the mapping is
+// aligned to 2 MiB for transparent ones, and without those it still succeeds
+// with normal pages on any node.
+//
+// Returns:
+// - The mapping; throws std::bad_alloc if no memory is available.
+inline void *allocate_pages(std::size_t size, const MemoryPolicy &policy) {
+#if defined(__linux__)
+    const std::size_t length = detail::mapping_size(size, policy);
+    constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void *p = MAP_FAILED;
+    if (policy.huge_pages) p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED) {
+        const std::size_t slack = policy.huge_pages ? huge_page_size : 0; // Room to align to a huge page
+        p = ::mmap(nullptr, length + slack, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        if (policy.huge_pages) {
+            // Only 2 MiB-aligned ranges can be backed by transparent huge pages: trim the rest
+            const auto base = reinterpret_cast<std::uintptr_t>(p);
+            const std::uintptr_t aligned = (base + huge_page_size - 1) & ~(huge_page_size - 1);
+            if (aligned > base) ::munmap(p, aligned - base);
+            ::munmap(reinterpret_cast<void *>(aligned + length), base + slack - aligned);
+            p = reinterpret_cast<void *>(aligned);
+            ::madvise(p, length, MADV_HUGEPAGE);
+        }
+    }
+    detail::prefer_node(p, length, policy.numa_node);
+    return p;
+#else
+    return ::operator new(detail::mapping_size(size, policy), std::align_val_t{4096});
+#endif
+}
+
+// *** Function: free_pages ***
+// Releases memory from `allocate_pages` called with the same `size` and `policy`.
+inline void free_pages(void *p, std::size_t size, const MemoryPolicy &policy) noexcept {
+#if defined(__linux__)
+    ::munmap(p, detail::mapping_size(size, policy));
+#else
+    ::operator delete(p, std::align_val_t{4096});
+    (void)size, (void)policy;
+#endif
+}
+
+// *** PageAllocator ***
+// A standard allocator that takes large blocks from `allocate_pages`, so any
+// container can be backed by huge pages on a chosen NUMA node. Small blocks
+// use the ordinary heap, aligned for T (pages are aligned for any T).
+template <class T>
+class PageAllocator {
+public:
+    using value_type = T;
+
+    PageAllocator() = default;
+    explicit PageAllocator(MemoryPolicy policy) : policy_(policy) {}
+    template <class U>
+    PageAllocator(const PageAllocator<U> &other) : policy_(other.policy()) {}
+
+    T *allocate(std::size_t n) {
+        const std::size_t bytes = n * sizeof(T);
+        if (bytes < page_allocation_threshold)
+            return static_cast<T *>(::operator new(bytes, std::align_val_t{alignof(T)}));
+        return static_cast<T *>(allocate_pages(bytes, policy_));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        const std::size_t bytes = n * sizeof(T);
+        if (bytes < page_allocation_threshold) ::operator delete(p, std::align_val_t{alignof(T)});
+        else free_pages(p, bytes, policy_);
+    }
+
+    // Bytes a block of `n` elements occupies: the whole mapping for blocks from
+    // allocate_pages, so a huge page backing a small block counts in full.
+    std::size_t allocated_bytes(std::size_t n) const {
+        const std::size_t bytes = n * sizeof(T);
+        return bytes < page_allocation_threshold ? bytes : detail::mapping_size(bytes, policy_);
+    }
+
+    const MemoryPolicy &policy() const { return policy_; }
+
+    template <class U>
+    friend bool operator==(const PageAllocator &a, const PageAllocator<U> &b) {
+        return a.policy() == b.policy();
+    }
+
+private:
+    MemoryPolicy policy_;
+};
+
+} // namespace qms
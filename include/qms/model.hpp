@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "alert.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+// What a model feature takes from the readings of its sensor.
+enum class FeatureKind {
+    Last,  // The last value
+    Mean,  // Exponentially weighted mean over the window
+    Sd,    // Exponentially weighted standard deviation over the window
+    Delta, // The last value minus the window mean
+    Rate,  // Change per second between the last two readings
+};
+
+inline bool parse_feature_kind(std::string_view s, FeatureKind &kind) {
+    if (s == "last") kind = FeatureKind::Last;
+    else if (s == "mean") kind = FeatureKind::Mean;
+    else if (s == "sd") kind = FeatureKind::Sd;
+    else if (s == "delta") kind = FeatureKind::Delta;
+    else if (s == "rate") kind = FeatureKind::Rate;
+    else return false;
+    return true;
+}
+
+// *** ModelFeature Structure ***
+// One input of a model: `kind` of the readings of `sensor` over `window`.
+struct ModelFeature {
+    SensorHandle sensor;
+    FeatureKind kind;
+    Timestamp window;
+};
+
+// *** TreeNode Structure ***
+// A node of a flattened regression tree. Trees are stored in preorder, so
+// the left child of a split is the next node and only the right one needs an
+// index. A leaf has `feature == leaf` and its score in `value`.
+struct TreeNode {
+    static constexpr std::uint32_t leaf = 0xFFFFFFFF;
+
+    std::uint32_t feature;
+    float value; // Split threshold (go left below it) or leaf score
+    std::uint32_t right;
+};
+
+// *** Model Structure ***
+// A pre-trained anomaly model: a linear model (`weights`) or a tree ensemble
+// (`nodes`, all trees in one array, starting at `roots`), scored every `step`
+// as `bias` plus the weighted features or the sum of the trees' leaves,
+// optionally through the logistic function. Scores above `threshold` are
+// anomalous. A row waits at most `max_delay()` for the rest of its batch:
+// `delay`, or `batch` steps where it is negative.
+struct Model {
+    std::string name;
+    std::vector<ModelFeature> features;
+    bool logistic = false;
+    float bias = 0.0f;
+    std::vector<float> weights;
+    std::vector<TreeNode> nodes;
+    std::vector<std::uint32_t> roots;
+    Timestamp step = 1000000000;
+    std::size_t batch = 16;
+    Timestamp delay = -1;
+    float threshold = 0.0f;
+
+    bool is_trees() const { return !roots.empty(); }
+
+    Timestamp max_delay() const { return delay >= 0 ? delay : static_cast<Timestamp>(batch) * step; }
+
+    // *** Function: score ***
+    // Scores `n` feature rows of `features.size()` values each, stored row
+    // after row in `rows`, into `out`. Trees are walked one at a time over
+    // every row, so each tree's nodes stay in cache for the whole batch.
+    void score(const float *rows, std::size_t n, float *out) const {
+        const std::size_t width = features.size();
+        std::fill(out, out + n, bias);
+        if (!is_trees()) {
+            for (std::size_t i = 0; i < n; ++i)
+                for (std::size_t f = 0; f < width; ++f) out[i] += weights[f] * rows[i * width + f];
+        } else {
+            for (const std::uint32_t root : roots) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    const float *x = rows + i * width;
+                    const TreeNode *node = &nodes[root];
+                    while (node->feature != TreeNode::leaf)
+                        node = x[node->feature] < node->value ? node + 1 : &nodes[root + node->right];
+                    out[i] += node->value;
+                }
+            }
+        }
+        if (logistic)
+            for (std::size_t i = 0; i < n; ++i) out[i] = 1.0f / (1.0f + std::exp(-out[i]));
+    }
+};
+
+// *** Function: load_model ***
+// Reads a model from a text file of directives, one per line; text after
+// '#' is ignored:
+//
+//   name <name>                    Names the model in alerts.
+//   feature <ID> <last|mean|sd|delta|rate> [window_seconds]
+//                                  Adds the next input; windows default to 60 s.
+//   step <seconds>                 Scoring period (default 1).
+//   batch <steps>                  Time steps scored together (default 16).
+//   delay <seconds>                Longest a row waits for its batch (default:
+//                                  `batch` steps). Shorter delays raise alerts
+//                                  sooner but score fewer rows per batch; at
+//                                  one step or less rows are scored one by one.
+//   threshold <score>              Scores above it raise an alert.
+//   link <identity|logistic>       Applied to the raw score (default identity).
+//   bias <value>                   Added to every score (base score).
+//   weights <w> [w...]             Linear model: weights of the next features.
+//   tree                           Tree ensemble: starts the next tree, whose
+//                                  nodes follow in preorder:
+//   split <feature> <threshold> <right>
+//                                  Go to the next node if input <feature>
+//                                  (0-based) is below <threshold>, otherwise
+//                                  to node <right> of this tree (0-based).
+//   leaf <score>                   Adds <score>.
+//
+// Returns:
+// - false if the file cannot be read or does not describe a valid model.
+inline bool load_model(const char *filename, Registry &registry, Model &model) {
+    std::FILE *file = std::fopen(filename, "r");
+    if (file == nullptr) {
+        log(LogLevel::Error, "Unable to open model %s", filename);
+        return false;
+    }
+
+    bool ok = true;
+    char buffer[4096];
+    int line_no = 0;
+    std::size_t tree = 0; // First node of the current tree
+    while (ok && std::fgets(buffer, sizeof(buffer), file)) {
+        ++line_no;
+        std::string_view t[256];
+        const std::size_t n = detail::tokenize(buffer, t, 256);
+        if (n == 0) continue;
+
+        bool valid = false;
+        if (t[0] == "name" && n == 2) {
+            model.name = std::string(t[1]);
+            valid = true;
+        } else if (t[0] == "feature" && (n == 3 || n == 4)) {
+            ModelFeature f{registry.sensor(t[1]), FeatureKind::Last, 60000000000LL};
+            double window = 60;
+            valid = parse_feature_kind(t[2], f.kind) && (n == 3 || (detail::parse_number(t[3], window) && window > 0));
+            f.window = static_cast<Timestamp>(window * 1e9);
+            if (valid) model.features.push_back(f);
+        } else if (t[0] == "step" && n == 2) {
+            double seconds = 0;
+            valid = detail::parse_number(t[1], seconds) && seconds > 0;
+            model.step = static_cast<Timestamp>(seconds * 1e9);
+        } else if (t[0] == "batch" && n == 2) {
+            valid = detail::parse_number(t[1], model.batch) && model.batch > 0;
+        } else if (t[0] == "delay" && n == 2) {
+            double seconds = 0;
+            valid = detail::parse_number(t[1], seconds) && seconds >= 0;
+            model.delay = static_cast<Timestamp>(seconds * 1e9);
+        } else if (t[0] == "threshold" && n == 2) {
+            valid = detail::parse_number(t[1], model.threshold);
+        } else if (t[0] == "link" && n == 2) {
+            valid = t[1] == "identity" || t[1] == "logistic";
+            model.logistic = t[1] == "logistic";
+        } else if (t[0] == "bias" && n == 2) {
+            valid = detail::parse_number(t[1], model.bias);
+        } else if (t[0] == "weights" && n >= 2) {
+            valid = true;
+            for (std::size_t i = 1; i < n && valid; ++i) {
+                float w = 0;
+                valid = detail::parse_number(t[i], w);
+                model.weights.push_back(w);
+            }
+        } else if (t[0] == "tree" && n == 1) {
+            tree = model.nodes.size();
+            model.roots.push_back(static_cast<std::uint32_t>(tree));
+            valid = true;
+        } else if (t[0] == "split" && n == 4 && !model.roots.empty()) {
+            TreeNode node{0, 0.0f, 0};
+            valid = detail::parse_number(t[1], node.feature) && detail::parse_number(t[2], node.value) &&
+                    detail::parse_number(t[3], node.right) && node.right > model.nodes.size() - tree;
+            model.nodes.push_back(node);
+        } else if (t[0] == "leaf" && n == 2 && !model.roots.empty()) {
+            TreeNode node{TreeNode::leaf, 0.0f, 0};
+            valid = detail::parse_number(t[1], node.value);
+            model.nodes.push_back(node);
+        }
+        if (!valid) {
+            log(LogLevel::Error, "%s:%d: invalid model line", filename, line_no);
+            ok = false;
+        }
+    }
+    std::fclose(file);
+    if (!ok) return false;
+
+    // Every split must point into its tree and at an input, and every tree must end in leaves
+    const std::size_t width = model.features.size();
+    for (std::size_t r = 0; r < model.roots.size() && ok; ++r) {
+        const std::size_t begin = model.roots[r];
+        const std::size_t end = r + 1 < model.roots.size() ? model.roots[r + 1] : model.nodes.size();
+        std::size_t open = 1; // Subtrees still to read in preorder
+        for (std::size_t i = begin; i < end && ok; ++i) {
+            const TreeNode &node = model.nodes[i];
+            ok = open > 0 && (node.feature == TreeNode::leaf || (node.feature < width && begin + node.right < end));
+            if (node.feature == TreeNode::leaf) --open;
+            else ++open;
+        }
+        ok = ok && open == 0;
+    }
+    if (ok && width == 0) ok = false;
+    if (ok && !model.is_trees()) ok = model.weights.size() == width && model.nodes.empty();
+    if (!ok) {
+        log(LogLevel::Error, "Model %s is incomplete: check its features, weights and trees", filename);
+        return false;
+    }
+    if (model.name.empty()) model.name = filename;
+    return true;
+}
+
+// *** ModelScoring Stage ***
+// Scores pre-trained models (see load_model) on the readings of each port.
+// The stage keeps, per port and model, the last value and exponentially
+// weighted window aggregates of every input, updated in O(1) per reading.
+// Every `step` the inputs form one feature row; rows are scored `batch` at a
+// time (see Model::score), or sooner once the oldest has waited its delay
+// (see Model::max_delay), and a ModelScore alert is raised where a run of
+// scores above the threshold starts. A port is scored once every input of
+// the model has had a reading; quiet ports keep being formed and scored
+// through `poll`.
+class ModelScoring {
+public:
+    ModelScoring(const AlertPath &alerts, const std::vector<Model> &models) : alerts_(&alerts), models_(&models) {
+        for (std::size_t m = 0; m < models.size(); ++m)
+            for (std::size_t f = 0; f < models[m].features.size(); ++f) {
+                const SensorHandle s = models[m].features[f].sensor;
+                if (s >= inputs_.size()) inputs_.resize(static_cast<std::size_t>(s) + 1);
+                inputs_[s].push_back({m, f});
+            }
+    }
+
+    bool process(SensorData &r) {
+        if (r.sensor >= inputs_.size() || inputs_[r.sensor].empty()) [[likely]]
+            return true;
+        for (const Input &in : inputs_[r.sensor]) {
+            State &s = state(r.port, in.model);
+            advance(s, in.model, r.port, r.timestamp);
+            s.features[in.feature].add(r.value, r.timestamp, (*models_)[in.model].features[in.feature].window);
+            if (s.next == 0) s.next = r.timestamp;
+        }
+        return true;
+    }
+
+    // Forms the rows of the steps that passed by `now` on every port, and
+    // scores the rows that have waited their delay for their batch.
+    void poll(Timestamp now) {
+        const std::size_t n = models_->size();
+        for (std::size_t i = 0; i < states_.size(); ++i)
+            if (states_[i].next != 0) advance(states_[i], i % n, static_cast<PortHandle>(i / n), now);
+    }
+
+    // Scores the rows still waiting for a full batch, e.g. at shutdown.
+    void close() {
+        const std::size_t n = models_->size();
+        for (std::size_t i = 0; i < states_.size(); ++i) score(states_[i], i % n, static_cast<PortHandle>(i / n));
+    }
+
+    // Rows scored and scores above the threshold so far.
+    std::uint64_t scored() const { return scored_; }
+    std::uint64_t flagged() const { return flagged_; }
+
+private:
+    struct Input {
+        std::size_t model;
+        std::size_t feature;
+    };
+
+    // Last value and exponentially weighted aggregates of one input.
+    struct Aggregate {
+        float last = std::numeric_limits<float>::quiet_NaN(); // No reading yet
+        float previous = std::numeric_limits<float>::quiet_NaN();
+        Timestamp at = 0;
+        Timestamp previous_at = 0;
+        double mean = 0.0;
+        double variance = 0.0;
+
+        void add(float x, Timestamp t, Timestamp window) {
+            if (std::isnan(last)) {
+                mean = x;
+            } else {
+                const double a = 1.0 - std::exp(-static_cast<double>(std::max<Timestamp>(t - at, 0)) / window);
+                const double d = x - mean;
+                mean += a * d;
+                variance = (1.0 - a) * (variance + a * d * d);
+            }
+            previous = last, previous_at = at;
+            last = x, at = t;
+        }
+
+        float value(FeatureKind kind) const {
+            switch (kind) {
+            case FeatureKind::Last: return last;
+            case FeatureKind::Mean: return static_cast<float>(mean);
+            case FeatureKind::Sd: return static_cast<float>(std::sqrt(variance));
+            case FeatureKind::Delta: return static_cast<float>(last - mean);
+            case FeatureKind::Rate:
+                if (at <= previous_at || std::isnan(previous)) return 0.0f;
+                return static_cast<float>((last - previous) * 1e9 / static_cast<double>(at - previous_at));
+            }
+            return 0.0f;
+        }
+    };
+
+    struct State {
+        std::vector<Aggregate> features;
+        std::vector<float> rows;   // Feature rows waiting to be scored
+        std::vector<Timestamp> at; // Their times
+        Timestamp next = 0;        // Time of the next row (0: no reading yet)
+        bool flagged = false;      // The last score was above the threshold
+    };
+
+    State &state(PortHandle port, std::size_t model) {
+        const std::size_t i = static_cast<std::size_t>(port) * models_->size() + model;
+        if (i >= states_.size()) [[unlikely]]
+            states_.resize(i + 1);
+        State &s = states_[i];
+        if (s.features.empty()) [[unlikely]]
+            s.features.resize((*models_)[model].features.size());
+        return s;
+    }
+
+    // Forms a row for every step before `now`, scoring full batches and
+    // partial ones whose oldest row has waited its delay.
+    void advance(State &s, std::size_t model, PortHandle port, Timestamp now) {
+        const Model &m = (*models_)[model];
+        while (s.next != 0 && s.next < now) {
+            const bool ready = std::none_of(s.features.begin(), s.features.end(),
+                                            [](const Aggregate &a) { return std::isnan(a.last); });
+            if (ready) {
+                for (std::size_t f = 0; f < m.features.size(); ++f)
+                    s.rows.push_back(s.features[f].value(m.features[f].kind));
+                s.at.push_back(s.next);
+                if (s.at.size() >= m.batch) score(s, model, port);
+            }
+            s.next += m.step;
+        }
+        if (!s.at.empty() && now - s.at.front() >= m.max_delay()) score(s, model, port);
+    }
+
+    void score(State &s, std::size_t model, PortHandle port) {
+        if (s.at.empty()) return;
+        const Model &m = (*models_)[model];
+        scores_.resize(s.at.size());
+        m.score(s.rows.data(), s.at.size(), scores_.data());
+        for (std::size_t i = 0; i < s.at.size(); ++i) {
+            const bool flagged = scores_[i] > m.threshold;
+            if (flagged && !s.flagged)
+                alerts_->raise({AlertKind::ModelScore, no_sensor, port, scores_[i], 0.0f, m.threshold, s.at[i],
+                                m.name.c_str()});
+            s.flagged = flagged;
+            flagged_ += flagged;
+        }
+        scored_ += s.at.size();
+        s.rows.clear();
+        s.at.clear();
+    }
+
+    const AlertPath *alerts_;
+    const std::vector<Model> *models_;
+    std::vector<std::vector<Input>> inputs_; // Model inputs by sensor handle
+    std::vector<State> states_;              // By port, then model
+    std::vector<float> scores_;
+    std::uint64_t scored_ = 0;
+    std::uint64_t flagged_ = 0;
+};
+
+} // namespace qms
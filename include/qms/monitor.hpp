@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "alert.hpp"
+#include "baseline.hpp"
+#include "batching.hpp"
+#include "catalog.hpp"
+#include "costs.hpp"
+#include "dashboard.hpp"
+#include "golden.hpp"
+#include "log.hpp"
+#include "lots.hpp"
+#include "memory.hpp"
+#include "model.hpp"
+#include "pipeline.hpp"
+#include "plugin.hpp"
+#include "recipes.hpp"
+#include "registry.hpp"
+#include "rollup.hpp"
+#include "scheduling.hpp"
+#include "sinks.hpp"
+#include "stages.hpp"
+#include "timing.hpp"
+#include "watchdog.hpp"
+
+namespace qms {
+
+// *** Monitor Pipeline ***
+// The acquisition pipeline for the serial ports, shared by the monitor and
+// the simulation (qms_sim):
+// 1. Read readings from the serial port(s), mapping the timestamps of
+//    devices with their own clock onto the gateway clock.
+// 2. Track the arrival rate, jitter and burstiness of each sensor and port,
+//    and alert when a device strays from its configured rate.
+// 3. Validate them against the physical range of their sensor kind.
+// 4. Run the configured plugins on them in batches.
+// 5. Queue them by the criticality class of their sensor, so critical readings
+//    overtake bursts of less critical ones.
+// 6. Echo them to the console.
+// 7. Log them to the CSV file with the precision of their sensor kind, in
+//    batches sized to the arrival rate and the sensors' latency targets, with
+//    the lot of their line as a run-length column, and likewise to a JSON
+//    Lines file if one is configured.
+// 8. Monitor their quality against the limits of the line's active recipe
+//    and issue alerts.
+// 9. Summarise each sensor per rollup period, with time-weighted statistics,
+//    totals and time in each quality state.
+// 10. Aggregate each sensor per lot of its line.
+// 11. Publish each sensor's latest value and quality state to the live
+//     dashboard, if it is served.
+// 12. Compare each lot and batch with the golden profiles of its sensors.
+// 13. Score readings against what is normal for their sensor at that time of
+//     day, learning it as they go and checkpointing it every five minutes.
+// 14. Score pre-trained anomaly models on the features of each port.
+// All stage types are known at compile time, so the per-reading path is one
+// fully inlined loop. The CPU time of parsing, validation, plugins, steps 6-7
+// (sinks), 2 and 8-11 (monitor) and 12-14 (rules) is sampled per sensor and
+// port.
+using MonitorCsvLog = BasicCsvSink<CatalogFormat<DefaultCatalog>>;
+using MonitorJsonLog = BasicJsonLinesSink<CatalogFormat<DefaultCatalog>>;
+using MonitorSinks =
+    Chain<Monitored<ConsoleEcho>, Monitored<Batched<MonitorCsvLog>>, Monitored<Batched<MonitorJsonLog>>>;
+using MonitorStages = Chain<QualityMonitor, Rollup<RollupCsvSink>, LotAggregate, DashboardFeed>;
+using MonitorRules = Chain<GoldenBatch, SeasonalBaseline, ModelScoring>;
+using MonitorProcess = Chain<Costed<MonitorSinks>, Costed<MonitorStages>, Costed<MonitorRules>>;
+using MonitorScheduler = ClassScheduler<MonitorProcess>;
+using MonitorChain =
+    Chain<Costed<ArrivalTiming>, Costed<TypedValidate<DefaultCatalog>>, PluginStage<MonitorScheduler>>;
+
+// *** MonitorContext Structure ***
+// What every monitor pipeline of a process shares; it must outlive them.
+struct MonitorContext {
+    Registry &registry;
+    const DefaultCatalog &catalog;
+    const AlertPath &alerts;
+    SharedFile &csv;
+    SharedFile &json_lines; // Discards everything when JSON Lines are off
+    SharedFile &rollups;
+    Timestamp rollup_period; // 0: no rollups
+    StatePolicy states;
+    SensorTablePolicy sensor_table;
+    RecipeBook &recipes;
+    LotTracker &lots;
+    bool lot_column; // Tag the CSV log with the lot of each line
+    const std::vector<GoldenReference> &golden;
+    const std::vector<BaselineSpec> &baselines;
+    BaselineStore *baseline_store; // Where baselines are kept across restarts (nullptr: not kept)
+    const std::vector<Model> &models;
+    const std::vector<PluginSpec> &plugins;
+    const std::vector<RateSpec> &rates;
+    const LatencyTargets &latency;
+    const CriticalityTable &classes;
+    const SchedulerPolicy &scheduling;
+    DashboardBoard *dashboard; // Latest readings for the live dashboard (nullptr: not served)
+};
+
+// *** Function: make_monitor_chain ***
+// Builds the stages of one monitor pipeline, with its sensor state table and
+// queues placed according to `memory`. The console and CSV stages, which can
+// block, report what they are doing on `heartbeat`; every phase accounts its
+// CPU time to `costs`. Its driver polls it as time passes (see Pollable) and
+// ends it with finish_monitor_chain.
+inline MonitorChain make_monitor_chain(const MonitorContext &m, const MemoryPolicy &memory, Heartbeat &heartbeat,
+                                       CostLedger &costs) {
+    SchedulerPolicy scheduling = m.scheduling;
+    scheduling.memory = memory;
+    QualityMonitor quality(m.alerts, m.catalog, memory, m.states, m.sensor_table);
+    quality.set_recipes(&m.recipes);
+    MonitorCsvLog csv(m.csv, m.registry, CatalogFormat<DefaultCatalog>(m.catalog));
+    MonitorJsonLog json(m.json_lines, m.registry, CatalogFormat<DefaultCatalog>(m.catalog));
+    if (m.lot_column) {
+        const TagSource tags = [&lots = m.lots](PortHandle port, Timestamp t) -> const std::string * {
+            const LotContext *c = lots.context(port, t);
+            return c ? &c->tag : nullptr;
+        };
+        csv.set_tags(tags);
+        json.set_tags(tags);
+    }
+    MonitorSinks sinks(
+        Monitored<ConsoleEcho>(ConsoleEcho(m.registry), heartbeat, "console echo"),
+        Monitored<Batched<MonitorCsvLog>>(Batched<MonitorCsvLog>(std::move(csv), m.latency), heartbeat, "csv write"),
+        Monitored<Batched<MonitorJsonLog>>(Batched<MonitorJsonLog>(std::move(json), m.latency), heartbeat,
+                                           "json write"));
+    MonitorStages monitoring(std::move(quality),
+                             Rollup<RollupCsvSink>(RollupCsvSink(m.rollups, m.registry, m.catalog), m.rollup_period,
+                                                   m.states, memory),
+                             LotAggregate(m.lots), DashboardFeed(m.dashboard));
+    MonitorRules rules(GoldenBatch(m.alerts, m.lots, m.golden),
+                       SeasonalBaseline(m.alerts, m.baselines, m.baseline_store), ModelScoring(m.alerts, m.models));
+    MonitorProcess process(Costed<MonitorSinks>(std::move(sinks), costs, CostPhase::Sinks),
+                           Costed<MonitorStages>(std::move(monitoring), costs, CostPhase::Monitor),
+                           Costed<MonitorRules>(std::move(rules), costs, CostPhase::Rules));
+    PluginStage<MonitorScheduler> plugins(MonitorScheduler(std::move(process), m.classes, scheduling), m.plugins,
+                                          m.registry, m.alerts, m.classes);
+    plugins.set_costs(&costs);
+    return MonitorChain(
+        Costed<ArrivalTiming>(ArrivalTiming(m.alerts, m.rates, memory), costs, CostPhase::Monitor),
+        Costed<TypedValidate<DefaultCatalog>>(TypedValidate<DefaultCatalog>(m.catalog), costs, CostPhase::Validate),
+        std::move(plugins));
+}
+
+namespace detail {
+
+// Logs how `what` (a sensor or port) `name` reported: its rate, the one it is
+// configured to report at (if any), its jitter percentiles and burstiness.
+inline void log_arrivals(const char *what, std::string_view name, const ArrivalStats &a, const RateSpec *spec) {
+    char configured[48] = "";
+    if (spec)
+        std::snprintf(configured, sizeof configured, " (configured %.3g/s)", 1e9 / static_cast<double>(spec->period));
+    log(LogLevel::Info, "%s %.*s: %.3g readings/s%s, jitter p50 %.3g ms, p90 %.3g ms, p99 %.3g ms, burstiness %.2f",
+        what, static_cast<int>(name.size()), name.data(), a.rate(), configured, a.jitter_quantile(0.5) / 1e6,
+        a.jitter_quantile(0.9) / 1e6, a.jitter_quantile(0.99) / 1e6, a.burstiness());
+}
+
+} // namespace detail
+
+// *** Function: finish_monitor_chain ***
+// Writes out the partial rollup periods at `now`, ends the golden profile
+// comparisons in progress, hands the learned baselines to their store,
+// scores the last model rows and logs, per sensor, the sample mean next to the
+// time-weighted mean and standard deviation, the total, the time spent in
+// each quality state and its arrival timing, then the arrival timing of each
+// port.
+inline void finish_monitor_chain(MonitorChain &chain, const MonitorContext &m, Timestamp now) {
+    const ArrivalTiming &timing = chain.stage<0>().stage();
+    MonitorProcess &process = chain.stage<2>().sink().sink();
+    MonitorStages &monitoring = process.stage<1>().stage();
+    MonitorRules &rules = process.stage<2>().stage();
+    monitoring.stage<1>().close(now);
+    rules.stage<0>().close();
+    rules.stage<1>().close();
+    ModelScoring &models = rules.stage<2>();
+    models.close();
+    if (models.scored() > 0)
+        log(LogLevel::Info, "Models: %llu rows scored, %llu above threshold",
+            static_cast<unsigned long long>(models.scored()), static_cast<unsigned long long>(models.flagged()));
+    QualityMonitor &quality = monitoring.stage<0>();
+    const SensorTable &table = quality.table();
+    if (table.policy().compact)
+        log(LogLevel::Info, "Sensor table: %zu sensors, %zu active, %zu evicted, %.1f MiB", table.size(),
+            table.active(), table.evicted_count(), static_cast<double>(table.memory()) / (1 << 20));
+    for (std::size_t h = 0; h < quality.size(); ++h) {
+        const auto sensor = static_cast<SensorHandle>(h);
+        const SensorStats s = quality.snapshot(sensor, now);
+        if (s.count == 0) continue;
+        const TimeWeighted &w = s.weighted;
+        const StateDurations &t = s.states;
+        const auto id = m.registry.sensor_name(sensor);
+        log(LogLevel::Info,
+            "Sensor %.*s: %llu readings, mean %.3f, time-weighted mean %.3f (sd %.3f) over %.1f s, total %.6g",
+            static_cast<int>(id.size()), id.data(), static_cast<unsigned long long>(s.count), s.average(),
+            w.average(), std::sqrt(w.variance()), w.duration, s.total());
+        log(LogLevel::Info, "Sensor %.*s: %.1f s in spec, %.1f s low, %.1f s high, %.1f s stale, %.1f s alarmed",
+            static_cast<int>(id.size()), id.data(), t[SensorState::InSpec], t[SensorState::Low],
+            t[SensorState::High], t[SensorState::Stale], t[SensorState::Alarmed]);
+        if (const ArrivalStats *a = timing.sensor(sensor); a && a->count > 0)
+            detail::log_arrivals("Sensor", id, *a, timing.spec(sensor));
+    }
+    for (std::size_t p = 0; p < timing.ports(); ++p)
+        if (const ArrivalStats *a = timing.port(static_cast<PortHandle>(p)); a && a->count > 0)
+            detail::log_arrivals("Port", m.registry.port_name(static_cast<PortHandle>(p)), *a, nullptr);
+}
+
+} // namespace qms
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "config.hpp"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace qms {
+
+// NUMA topology and placement, read from /sys on Linux. Elsewhere the machine
+// is treated as a single node and binding is a no-op that reports failure.
+
+namespace detail {
+
+// Calls `f(n)` for every number in a sysfs list such as "0-3,8,10-11".
+template <class F>
+bool for_each_in_list(std::string_view list, F &&f) {
+    while (!list.empty() && list.front() != '\n') {
+        int first = 0;
+        int last = 0;
+        const std::size_t comma = std::min(list.find(','), list.size());
+        std::string_view item = list.substr(0, comma);
+        while (!item.empty() && (item.back() == '\n' || item.back() == ' ')) item.remove_suffix(1);
+        const std::size_t dash = item.find('-');
+        if (!parse_number(item.substr(0, dash), first)) return false;
+        if (dash == std::string_view::npos) last = first;
+        else if (!parse_number(item.substr(dash + 1), last)) return false;
+        for (int n = first; n <= last; ++n) f(n);
+        list.remove_prefix(std::min(comma + 1, list.size()));
+    }
+    return true;
+}
+
+inline std::string read_sysfs(const char *path) {
+    std::string text;
+    if (std::FILE *f = std::fopen(path, "r")) {
+        char buffer[4096];
+        if (std::fgets(buffer, sizeof(buffer), f)) text = buffer;
+        std::fclose(f);
+    }
+    return text;
+}
+
+} // namespace detail
+
+// *** Function: numa_nodes ***
+// Returns the online NUMA nodes; a machine without NUMA reports node 0 only.
+inline std::vector<int> numa_nodes() {
+    std::vector<int> nodes;
+    detail::for_each_in_list(detail::read_sysfs("/sys/devices/system/node/online"),
+                             [&nodes](int n) { nodes.push_back(n); });
+    if (nodes.empty()) nodes.push_back(0);
+    return nodes;
+}
+
+// *** Function: bind_thread_to_node ***
+// Restricts the calling thread to the CPUs of NUMA node `node` and makes that
+// node its preferred source of memory, so everything the thread allocates and
+// touches afterwards (its executor, pipeline stages and buffers) is node-local.
+//
+// Returns:
+// - true if both the CPU affinity and the memory policy were applied.
+inline bool bind_thread_to_node(int node) {
+#if defined(__linux__)
+    constexpr int mpol_preferred = 1;
+    constexpr int max_nodes = 1024;
+    constexpr int bits = 8 * sizeof(unsigned long);
+    if (node < 0 || node >= max_nodes) return false;
+
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    bool any = false;
+    detail::for_each_in_list(detail::read_sysfs(path), [&](int cpu) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpus);
+            any = true;
+        }
+    });
+    if (!any || ::sched_setaffinity(0, sizeof(cpus), &cpus) != 0) return false;
+
+    unsigned long mask[max_nodes / bits] = {};
+    mask[node / bits] = 1ul << (node % bits);
+    return ::syscall(SYS_set_mempolicy, mpol_preferred, mask, max_nodes + 1) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+// *** Function: place_port_groups ***
+// Splits `ports` into the port groups of `config`. A port named in a `group`
+// directive joins that group; the remaining ports form one unbound group
+// (`numa_node` -1). Empty groups are dropped.
+inline std::vector<PortGroup> place_port_groups(const Config &config, const std::vector<std::string> &ports) {
+    std::vector<PortGroup> groups;
+    PortGroup unbound;
+    for (const PortGroup &g : config.groups) groups.push_back({g.numa_node, {}});
+    for (const std::string &port : ports) {
+        PortGroup *target = &unbound;
+        for (std::size_t i = 0; i < config.groups.size() && target == &unbound; ++i)
+            for (const std::string &p : config.groups[i].ports)
+                if (p == port) target = &groups[i];
+        target->ports.push_back(port);
+    }
+    groups.push_back(std::move(unbound));
+    std::erase_if(groups, [](const PortGroup &g) { return g.ports.empty(); });
+    return groups;
+}
+
+} // namespace qms
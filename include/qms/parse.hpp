@@ -0,0 +1,133 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace qms {
+
+namespace detail {
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+// Parses "<SensorID> <value>" at the start of [p, end); returns the end of the value, or nullptr.
+inline const char *parse_id_value(const char *p, const char *end, std::string_view &id, float &value) {
+    while (p != end && is_space(*p)) ++p;
+    const char *id_begin = p;
+    while (p != end && !is_space(*p)) ++p;
+    if (p == id_begin) return nullptr;
+    id = std::string_view(id_begin, static_cast<std::size_t>(p - id_begin));
+
+    while (p != end && is_space(*p)) ++p;
+    if (p != end && *p == '+') ++p; // from_chars does not accept a leading '+'
+    const auto result = std::from_chars(p, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+} // namespace detail
+
+inline constexpr std::int64_t no_device_time = INT64_MIN;
+
+// Largest device time accepted, in seconds either side of the device's epoch
+// (about 126 years): well inside the nanosecond range of a Timestamp, with
+// room for the offsets a DriftEstimator adds to it.
+inline constexpr double max_device_seconds = 4e9;
+
+// *** Function: parse_reading ***
+// Parses one ASCII reading of the form "<SensorID> <value>", the format the
+// field devices send. Leading whitespace and trailing text are ignored.
+//
+// Parameters:
+// - `line`: The text to parse.
+// - `id`: Receives the sensor ID (a view into `line`).
+// - `value`: Receives the measured value.
+//
+// Returns:
+// - true if both fields were found, false otherwise.
+inline bool parse_reading(std::string_view line, std::string_view &id, float &value) {
+    return detail::parse_id_value(line.data(), line.data() + line.size(), id, value) != nullptr;
+}
+
+// Parses a reading that devices with their own clock may stamp as
+// "<SensorID> <value> t=<seconds>"; `device_time` receives the stamp in
+// nanoseconds of the device clock, or no_device_time if the line has none.
+// A stamp that is not finite or beyond `max_device_seconds` makes the whole
+// line invalid.
+inline bool parse_reading(std::string_view line, std::string_view &id, float &value, std::int64_t &device_time) {
+    const char *end = line.data() + line.size();
+    const char *p = detail::parse_id_value(line.data(), end, id, value);
+    device_time = no_device_time;
+    if (p == nullptr) return false;
+    while (p != end && detail::is_space(*p)) ++p;
+    double seconds = 0;
+    if (end - p > 2 && p[0] == 't' && p[1] == '=' && std::from_chars(p + 2, end, seconds).ec == std::errc()) {
+        if (!(std::fabs(seconds) <= max_device_seconds)) return false;
+        device_time = std::llround(seconds * 1e9);
+    }
+    return true;
+}
+
+// *** LineFramer ***
+// Reassembles newline-terminated lines from arbitrarily split reads. Bytes are
+// appended with `feed`, which invokes a callback for every complete line.
+// A line longer than the internal buffer is discarded and reported through
+// `on_overflow`.
+template <std::size_t Capacity = 256>
+class LineFramer {
+public:
+    // *** Function: feed ***
+    // Appends `size` bytes and calls `on_line(std::string_view)` for each
+    // complete line (without the terminator). Empty lines are skipped.
+    //
+    // Returns:
+    // - false if a partial line overflowed the buffer and was dropped.
+    template <class OnLine>
+    bool feed(const char *data, std::size_t size, OnLine &&on_line) {
+        bool ok = true;
+        const char *end = data + size;
+        while (data != end) {
+            const char *nl = static_cast<const char *>(std::memchr(data, '\n', static_cast<std::size_t>(end - data)));
+            const char *stop = nl ? nl : end;
+            const std::size_t n = static_cast<std::size_t>(stop - data);
+            if (discarding_) {
+                discarding_ = nl == nullptr; // Skip the rest of an overflowed line
+            } else if (used_ == 0 && nl) {
+                emit(std::string_view(data, n), on_line); // Fast path: line entirely inside this read
+            } else if (used_ + n <= Capacity) {
+                std::memcpy(buffer_ + used_, data, n);
+                used_ += n;
+                if (nl) {
+                    emit(std::string_view(buffer_, used_), on_line);
+                    used_ = 0;
+                }
+            } else {
+                used_ = 0;
+                ok = false;
+                discarding_ = nl == nullptr;
+            }
+            data = nl ? nl + 1 : end;
+        }
+        return ok;
+    }
+
+    void reset() {
+        used_ = 0;
+        discarding_ = false;
+    }
+
+private:
+    template <class OnLine>
+    static void emit(std::string_view line, OnLine &on_line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (!line.empty()) on_line(line);
+    }
+
+    char buffer_[Capacity];
+    std::size_t used_ = 0;
+    bool discarding_ = false;
+};
+
+} // namespace qms
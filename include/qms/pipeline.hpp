@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "clock.hpp"
+#include "record.hpp"
+
+namespace qms {
+
+// *** Stage Concept ***
+// A stage processes one reading at a time. `process` returns false to drop the
+// reading, which stops it from reaching the stages that follow. Sinks are
+// stages that always return true. A stage may also provide `flush()`, which
+// drivers call at the end of input so buffered sinks write out what they
+// hold. Time-driven stages may provide `poll(now)`, which drivers call
+// periodically even when no readings arrive, e.g. to write out a batch whose
+// deadline has passed. Stages with
+// per-sensor state may provide `prefetch(r)`, which drivers holding a queue of
+// readings call a few readings ahead so the state is in cache by the time `r`
+// is processed.
+template <class S>
+concept Stage = requires(S &s, SensorData &r) {
+    { s.process(r) } -> std::convertible_to<bool>;
+};
+
+template <class S>
+concept Flushable = requires(S &s) { s.flush(); };
+
+template <class S>
+concept Pollable = requires(S &s, Timestamp now) { s.poll(now); };
+
+template <class S>
+concept Prefetchable = requires(S &s, const SensorData &r) { s.prefetch(r); };
+
+// *** Source Concept ***
+// A source produces readings. `pump(emit)` performs one unit of acquisition
+// (typically one read from a port), calls `emit(SensorData&)` for every reading
+// it decoded and returns false once the source is exhausted or failed.
+template <class S>
+concept Source = requires(S &s) {
+    { s.pump([](SensorData &) {}) } -> std::convertible_to<bool>;
+};
+
+// *** Chain ***
+// A fixed sequence of stages known at compile time. Calling `process` runs the
+// reading through each stage in order; because every stage type is a template
+// parameter, the whole chain is inlined into the caller with no virtual calls.
+//
+// A stage type may be an lvalue reference (e.g. `CsvSink&`) to share one stage
+// object between several chains. A Chain is itself a Stage, so chains nest.
+template <class... Stages>
+class Chain {
+    static_assert((Stage<std::remove_reference_t<Stages>> && ...), "every chain element must model qms::Stage");
+
+public:
+    explicit Chain(Stages... stages) : stages_(std::forward<Stages>(stages)...) {}
+
+    bool process(SensorData &r) {
+        return std::apply([&r](auto &...s) { return (static_cast<bool>(s.process(r)) && ...); }, stages_);
+    }
+
+    void flush() {
+        std::apply([](auto &...s) { (flush_one(s), ...); }, stages_);
+    }
+
+    // Lets the time-driven stages act at `now` (see Pollable).
+    void poll(Timestamp now) {
+        std::apply([now](auto &...s) { (poll_one(s, now), ...); }, stages_);
+    }
+
+    // Lets the stages with per-sensor state load that of `r` (see Prefetchable).
+    void prefetch(const SensorData &r) {
+        std::apply([&r](auto &...s) { (prefetch_one(s, r), ...); }, stages_);
+    }
+
+    template <std::size_t I>
+    decltype(auto) stage() { return std::get<I>(stages_); }
+
+    static constexpr std::size_t size() { return sizeof...(Stages); }
+
+private:
+    template <class S>
+    static void flush_one(S &s) {
+        if constexpr (Flushable<S>) s.flush();
+    }
+
+    template <class S>
+    static void poll_one(S &s, Timestamp now) {
+        if constexpr (Pollable<S>) s.poll(now);
+    }
+
+    template <class S>
+    static void prefetch_one(S &s, const SensorData &r) {
+        if constexpr (Prefetchable<S>) s.prefetch(r);
+    }
+
+    std::tuple<Stages...> stages_;
+};
+
+// *** Pipeline ***
+// Binds a source to a chain of stages. `run` drives the source until it is
+// exhausted, pushing every reading through the chain and polling the chain at
+// the time of `clock` after each burst of input, so time-driven stages decide
+// when to write out; the chain is flushed once, at the end.
+//
+// Example (serial -> validate -> stats -> binary log):
+//   auto p = qms::make_pipeline(SerialSource(...), Validate(), QualityMonitor(alerts), BinaryLogSink(file, registry));
+//   p.run(qms::system_clock());
+template <class Src, class... Stages>
+class Pipeline {
+public:
+    explicit Pipeline(Src source, Stages... stages)
+        : source_(std::forward<Src>(source)), chain_(std::forward<Stages>(stages)...) {}
+
+    // *** Function: run ***
+    // Pumps the source until it reports end-of-input, polling all stages at
+    // `clock.now()` after every pump, then flushes all stages.
+    void run(const Clock &clock) {
+        while (source_.pump([this](SensorData &r) { chain_.process(r); })) chain_.poll(clock.now());
+        chain_.flush();
+    }
+
+    // Pumps the source until it reports end-of-input or `stop` is set, which
+    // is checked between bursts, polling and flushing as above.
+    void run(const Clock &clock, const std::atomic<bool> &stop) {
+        while (!stop.load(std::memory_order_relaxed) && source_.pump([this](SensorData &r) { chain_.process(r); }))
+            chain_.poll(clock.now());
+        chain_.flush();
+    }
+
+    // Pushes one externally produced reading through the chain.
+    bool push(SensorData &r) { return chain_.process(r); }
+    void flush() { chain_.flush(); }
+
+    Src &source() { return source_; }
+    Chain<Stages...> &chain() { return chain_; }
+
+    template <std::size_t I>
+    decltype(auto) stage() { return chain_.template stage<I>(); }
+
+private:
+    Src source_;
+    Chain<Stages...> chain_;
+};
+
+// *** Function: make_pipeline ***
+// Deduces a Pipeline from its arguments. Pass `std::ref(x)` to share a stage or
+// source by reference instead of moving it into the pipeline.
+template <class Src, class... Stages>
+auto make_pipeline(Src &&source, Stages &&...stages) {
+    return Pipeline<std::unwrap_ref_decay_t<Src>, std::unwrap_ref_decay_t<Stages>...>(
+        std::forward<Src>(source), std::forward<Stages>(stages)...);
+}
+
+// Deduces a Chain from its arguments, with the same std::ref convention as make_pipeline.
+template <class... Stages>
+auto make_chain(Stages &&...stages) {
+    return Chain<std::unwrap_ref_decay_t<Stages>...>(std::forward<Stages>(stages)...);
+}
+
+} // namespace qms
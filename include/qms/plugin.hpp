@@ -0,0 +1,317 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "alert.hpp"
+#include "costs.hpp"
+#include "log.hpp"
+#include "pipeline.hpp"
+#include "qms_plugin.h"
+#include "record.hpp"
+#include "registry.hpp"
+#include "scheduling.hpp"
+#include "sensor_traits.hpp"
+
+namespace qms {
+
+// *** PluginLibrary ***
+// A shared library implementing the plugin ABI (qms_plugin.h), loaded for
+// the life of the object.
+class PluginLibrary {
+public:
+    // Loads `path`; check `is_loaded` for the outcome, which is logged.
+    explicit PluginLibrary(std::string path) : path_(std::move(path)) {
+#if defined(_WIN32)
+        handle_ = LoadLibraryA(path_.c_str());
+        void *entry = handle_ ? reinterpret_cast<void *>(GetProcAddress(static_cast<HMODULE>(handle_),
+                                                                        QMS_PLUGIN_ENTRY))
+                              : nullptr;
+#else
+        handle_ = dlopen(path_.c_str(), RTLD_NOW | RTLD_LOCAL);
+        void *entry = handle_ ? dlsym(handle_, QMS_PLUGIN_ENTRY) : nullptr;
+#endif
+        if (entry == nullptr) {
+            log(LogLevel::Error, "Unable to load plugin %s", path_.c_str());
+            return;
+        }
+        const qms_plugin *api = reinterpret_cast<qms_plugin_entry_fn>(entry)();
+        if (api == nullptr || api->abi_version != QMS_PLUGIN_ABI_VERSION || !api->create || !api->process ||
+            !api->destroy) {
+            log(LogLevel::Error, "Plugin %s does not implement plugin ABI version %d", path_.c_str(),
+                QMS_PLUGIN_ABI_VERSION);
+            return;
+        }
+        api_ = api;
+    }
+    PluginLibrary(const PluginLibrary &) = delete;
+    PluginLibrary &operator=(const PluginLibrary &) = delete;
+    ~PluginLibrary() {
+        if (handle_ == nullptr) return;
+#if defined(_WIN32)
+        FreeLibrary(static_cast<HMODULE>(handle_));
+#else
+        dlclose(handle_);
+#endif
+    }
+
+    bool is_loaded() const { return api_ != nullptr; }
+    const qms_plugin &api() const { return *api_; }
+    const std::string &path() const { return path_; }
+
+private:
+    std::string path_;
+    void *handle_ = nullptr;
+    const qms_plugin *api_ = nullptr;
+};
+
+// *** PluginScope Structure ***
+// The readings a plugin sees: all of them, those of one port, of one sensor,
+// or of one criticality class of sensors.
+struct PluginScope {
+    enum Kind { All, Port, Sensor, Class };
+
+    Kind kind = All;
+    PortHandle port = no_port;
+    SensorHandle sensor = no_sensor;
+    Criticality level = Criticality::Normal;
+
+    bool matches(const SensorData &r, const CriticalityTable &classes) const {
+        switch (kind) {
+        case All: return true;
+        case Port: return r.port == port;
+        case Sensor: return r.sensor == sensor;
+        case Class: return classes(r.sensor) == level;
+        }
+        return false;
+    }
+};
+
+// Parses a scope as written in the configuration (see PluginConfig).
+inline PluginScope plugin_scope(std::string_view scope, Registry &registry) {
+    PluginScope s;
+    if (scope.starts_with("port:")) s.kind = PluginScope::Port, s.port = registry.port(scope.substr(5));
+    else if (scope.starts_with("sensor:")) s.kind = PluginScope::Sensor, s.sensor = registry.sensor(scope.substr(7));
+    else if (scope.starts_with("class:") && parse_criticality(scope.substr(6), s.level)) s.kind = PluginScope::Class;
+    return s;
+}
+
+// *** PluginSpec Structure ***
+// One configured use of a plugin: `library` applied to `scope` with `args`.
+struct PluginSpec {
+    const PluginLibrary *library;
+    PluginScope scope;
+    std::string args;
+};
+
+// *** PluginStage ***
+// Runs shared-library plugins (see qms_plugin.h) on the readings before they
+// reach `sink`. Readings are collected into batches; a batch is handed to the
+// plugins when it holds `batch_size` readings, on `poll` (after each burst of
+// input) and on `flush`. Each plugin gets the rows of its scope as columns,
+// gathered when it does not see them all, may correct or drop them, and the
+// kept readings are then passed to `sink` in their original order. Each stage
+// creates its own instance of every plugin.
+//
+// With a CostLedger (`set_costs`), every plugin call is timed and its cycles
+// are spread evenly over the rows it was given, each row's share sampled as
+// per-reading Plugins work, so an expensive plugin shows up against the
+// sensors and ports it ran on.
+//
+// Without plugins, readings go straight to `sink`.
+//
+// Parameters:
+// - `sink`: The stage readings go to; may be a reference type.
+// - `plugins`: The plugins to run, in order; their libraries must outlive the stage.
+// - `registry`: Resolves sensor IDs and names for the plugins.
+// - `alerts`: Where the plugins' alerts are raised.
+// - `classes`: Criticality of each sensor, for class scopes; must outlive the stage.
+template <class Sink>
+class PluginStage {
+    using Inner = std::remove_reference_t<Sink>;
+
+public:
+    PluginStage(Sink sink, const std::vector<PluginSpec> &plugins, Registry &registry, const AlertPath &alerts,
+                const CriticalityTable &classes, std::size_t batch_size = 256)
+        : sink_(std::forward<Sink>(sink)), classes_(&classes), batch_size_(batch_size),
+          host_(std::make_unique<Host>(registry, alerts)) {
+        for (const PluginSpec &spec : plugins) {
+            if (!spec.library->is_loaded()) continue;
+            const qms_plugin &api = spec.library->api();
+            std::string name = api.name ? api.name : spec.library->path();
+            void *instance = api.create(&host_->api, spec.args.c_str());
+            if (instance == nullptr) {
+                log(LogLevel::Error, "Plugin %s rejected its arguments \"%s\"", name.c_str(), spec.args.c_str());
+                continue;
+            }
+            instances_.emplace_back(&api, instance, spec.scope, std::move(name));
+        }
+    }
+
+    bool process(SensorData &r) {
+        if (instances_.empty()) return sink_.process(r);
+        pending_.push_back(r);
+        if (pending_.size() >= batch_size_) run();
+        return true;
+    }
+
+    void flush() {
+        run();
+        if constexpr (Flushable<Inner>) sink_.flush();
+    }
+
+    void poll(Timestamp now)
+        requires Pollable<Inner>
+    {
+        run();
+        sink_.poll(now);
+    }
+
+    void set_costs(CostLedger *costs) { costs_ = costs; }
+
+    Inner &sink() { return sink_; }
+    std::size_t pending() const { return pending_.size(); }
+
+private:
+    // What the plugins reach through qms_host; heap-allocated so it keeps its
+    // address when the stage moves.
+    struct Host {
+        Host(Registry &r, const AlertPath &a) : registry(&r), alerts(&a) {
+            api.abi_version = QMS_PLUGIN_ABI_VERSION;
+            api.context = this;
+            api.log = [](void *, int level, const char *message) {
+                const LogLevel l = level == QMS_LOG_ALERT   ? LogLevel::Alert
+                                   : level == QMS_LOG_ERROR ? LogLevel::Error
+                                                            : LogLevel::Info;
+                log(l, "%s", message);
+            };
+            api.sensor = [](void *c, const char *id) -> std::uint32_t {
+                return static_cast<Host *>(c)->registry->sensor(id);
+            };
+            api.sensor_name = [](void *c, std::uint32_t sensor) {
+                return static_cast<Host *>(c)->registry->sensor_name(sensor).data();
+            };
+            api.port_name = [](void *c, std::uint16_t port) {
+                return static_cast<Host *>(c)->registry->port_name(port).data();
+            };
+            api.alert = [](void *c, std::uint32_t sensor, std::uint16_t port, float value, float low, float high,
+                           std::int64_t timestamp) {
+                const Host &h = *static_cast<Host *>(c);
+                h.alerts->raise({AlertKind::Plugin, sensor, port, value, low, high, timestamp, h.current});
+            };
+        }
+
+        qms_host api{};
+        Registry *registry;
+        const AlertPath *alerts;
+        const char *current = nullptr; // Name of the plugin being called, for its alerts
+    };
+
+    // An instance of a plugin, destroyed with it.
+    class Instance {
+    public:
+        Instance(const qms_plugin *api, void *instance, PluginScope scope, std::string name)
+            : api_(api), instance_(instance), scope_(scope), name_(std::move(name)) {}
+        Instance(Instance &&o) noexcept
+            : api_(o.api_), instance_(std::exchange(o.instance_, nullptr)), scope_(o.scope_),
+              name_(std::move(o.name_)) {}
+        Instance &operator=(Instance &&) = delete;
+        ~Instance() {
+            if (instance_) api_->destroy(instance_);
+        }
+
+        const qms_plugin *api_;
+        void *instance_;
+        PluginScope scope_;
+        std::string name_;
+    };
+
+    // Runs the plugins on the pending readings and passes the kept ones on.
+    void run() {
+        const std::size_t n = pending_.size();
+        if (n == 0) return;
+        sensor_.resize(n), port_.resize(n), timestamp_.resize(n), value_.resize(n), keep_.assign(n, 1);
+        for (std::size_t i = 0; i < n; ++i) {
+            const SensorData &r = pending_[i];
+            sensor_[i] = r.sensor, port_[i] = r.port, timestamp_[i] = r.timestamp, value_[i] = r.value;
+        }
+        for (std::size_t p = 0; p < instances_.size(); ++p) call(p, n);
+        for (std::size_t i = 0; i < n; ++i) {
+            if (!keep_[i]) continue;
+            SensorData &r = pending_[i];
+            r.value = value_[i];
+            sink_.process(r);
+        }
+        pending_.clear();
+    }
+
+    void call(std::size_t p, std::size_t n) {
+        const Instance &in = instances_[p];
+        // The plugin sees the kept rows of its scope; all of them in place, or gathered
+        rows_.clear();
+        for (std::size_t i = 0; i < n; ++i)
+            if (keep_[i] && in.scope_.matches(pending_[i], *classes_)) rows_.push_back(static_cast<std::uint32_t>(i));
+        if (rows_.empty()) return;
+        const bool gathered = rows_.size() < n;
+        qms_batch batch{static_cast<std::uint32_t>(n), sensor_.data(), port_.data(), timestamp_.data(), value_.data(),
+                        keep_.data()};
+        if (gathered) {
+            const std::size_t m = rows_.size();
+            g_sensor_.resize(m), g_port_.resize(m), g_timestamp_.resize(m), g_value_.resize(m), g_keep_.assign(m, 1);
+            for (std::size_t j = 0; j < m; ++j) {
+                const std::uint32_t i = rows_[j];
+                g_sensor_[j] = sensor_[i], g_port_[j] = port_[i];
+                g_timestamp_[j] = timestamp_[i], g_value_[j] = value_[i];
+            }
+            batch = {static_cast<std::uint32_t>(m), g_sensor_.data(), g_port_.data(), g_timestamp_.data(),
+                     g_value_.data(), g_keep_.data()};
+        }
+        host_->current = in.name_.c_str();
+        const bool timed = costs_ != nullptr && costs_->enabled();
+        const std::uint64_t start = timed ? cycle_count() : 0;
+        if (in.api_->process(in.instance_, &batch) != 0)
+            log(LogLevel::Error, "Plugin %s failed on a batch of %u readings", host_->current, batch.count);
+        if (timed) account(batch, cycle_count() - start);
+        if (gathered)
+            for (std::size_t j = 0; j < rows_.size(); ++j) {
+                value_[rows_[j]] = g_value_[j];
+                keep_[rows_[j]] = g_keep_[j];
+            }
+    }
+
+    // Charges each row of `batch` its share of the `cycles` a plugin took on it.
+    void account(const qms_batch &batch, std::uint64_t cycles) {
+        const std::uint64_t share = cycles / batch.count;
+        for (std::uint32_t i = 0; i < batch.count; ++i)
+            if (costs_->sample()) costs_->add(CostPhase::Plugins, batch.sensor[i], batch.port[i], share);
+    }
+
+    Sink sink_;
+    const CriticalityTable *classes_;
+    CostLedger *costs_ = nullptr;
+    std::size_t batch_size_;
+    std::unique_ptr<Host> host_;
+    std::vector<Instance> instances_;
+    std::vector<SensorData> pending_;
+    // The batch as columns, and the rows of a scoped plugin gathered from it
+    std::vector<std::uint32_t> sensor_, g_sensor_;
+    std::vector<std::uint16_t> port_, g_port_;
+    std::vector<std::int64_t> timestamp_, g_timestamp_;
+    std::vector<float> value_, g_value_;
+    std::vector<std::uint8_t> keep_, g_keep_;
+    std::vector<std::uint32_t> rows_;
+};
+
+} // namespace qms
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+#include "protocols.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+// *** PollRange Structure ***
+// Bounds of the interval at which one polled value is requested.
+struct PollRange {
+    Timestamp min_interval = 100'000'000;
+    Timestamp max_interval = 10'000'000'000;
+};
+
+// *** AdaptivePoller ***
+// Decides how often one polled value is requested. A value that moved by more
+// than 1% of its limit band since the last poll, or that lies within 10% of
+// the band from a limit (or beyond it), is polled again after the minimum
+// interval. A stable value backs off by half of its interval per poll, up to
+// the maximum; a failed poll doubles the interval.
+class AdaptivePoller {
+public:
+    AdaptivePoller(PollRange range, float min_limit, float max_limit)
+        : range_(range), min_limit_(min_limit), max_limit_(max_limit), interval_(range.min_interval) {}
+
+    // Records a polled value; returns the interval until the next poll.
+    Timestamp observe(float value) {
+        const float band = max_limit_ > min_limit_ ? max_limit_ - min_limit_ : 1.0f;
+        const bool changing = has_last_ && std::fabs(value - last_) > change_fraction * band;
+        const bool near_limit = std::min(value - min_limit_, max_limit_ - value) < near_fraction * band;
+        last_ = value;
+        has_last_ = true;
+        interval_ = changing || near_limit ? range_.min_interval
+                                           : std::min(range_.max_interval, interval_ + interval_ / 2);
+        return interval_;
+    }
+
+    // Records a poll that returned no value; returns the interval until the next poll.
+    Timestamp failed() {
+        interval_ = std::min(range_.max_interval, interval_ * 2);
+        return interval_;
+    }
+
+    Timestamp interval() const { return interval_; }
+    const PollRange &range() const { return range_; }
+
+private:
+    static constexpr float change_fraction = 0.01f;
+    static constexpr float near_fraction = 0.1f;
+
+    PollRange range_;
+    float min_limit_;
+    float max_limit_;
+    Timestamp interval_;
+    float last_ = 0.0f;
+    bool has_last_ = false;
+};
+
+// *** PollMetrics Structure ***
+// What a PollSchedule did on its bus:
+// - `polls`, `failures`: Transactions, and those that returned no value.
+// - `busy`: Total time the bus was occupied by transactions.
+// - `deferred`: Polls that fell due while the bus was busy or resting to stay
+//   within its budget, and so started late.
+struct PollMetrics {
+    std::uint64_t polls = 0;
+    std::uint64_t failures = 0;
+    Timestamp busy = 0;
+    std::uint64_t deferred = 0;
+    Timestamp first = 0;
+    Timestamp last = 0;
+
+    // Share of time the bus was busy between the first and the last poll.
+    double utilization() const {
+        return last > first ? static_cast<double>(busy) / static_cast<double>(last - first) : 0.0;
+    }
+};
+
+// *** PollSchedule ***
+// Orders the polls of all values on one request/response bus (e.g. a serial
+// line with many Modbus slaves). The value due first is polled next, but never
+// before the bus budget allows: after a transaction that took `d` the bus
+// stays idle for `d * (1 - utilization) / utilization`, so polling occupies at
+// most `utilization` of the time however fast the values change. When the
+// budget runs short every value is polled late, in order of its due time.
+class PollSchedule {
+public:
+    explicit PollSchedule(double utilization = 0.5) : utilization_(std::clamp(utilization, 0.01, 1.0)) {}
+
+    // Adds a polled value, due immediately; returns its index.
+    std::size_t add(AdaptivePoller poller) {
+        entries_.push_back({poller, 0});
+        return entries_.size() - 1;
+    }
+
+    // *** Function: next ***
+    // Returns:
+    // - The index of the value to poll next and the earliest time to start.
+    std::pair<std::size_t, Timestamp> next() const {
+        std::size_t best = 0;
+        for (std::size_t i = 1; i < entries_.size(); ++i)
+            if (entries_[i].due < entries_[best].due) best = i;
+        return {best, std::max(entries_[best].due, bus_free_)};
+    }
+
+    // Records a transaction for value `i` that ran from `start` to `end` and
+    // returned `value`, or nullptr if it failed.
+    void completed(std::size_t i, Timestamp start, Timestamp end, const float *value) {
+        Entry &e = entries_[i];
+        if (metrics_.polls == 0) metrics_.first = start;
+        ++metrics_.polls;
+        metrics_.busy += end - start;
+        metrics_.last = end;
+        if (e.due < bus_free_) ++metrics_.deferred;
+        if (value) {
+            e.due = end + e.poller.observe(*value);
+        } else {
+            e.due = end + e.poller.failed();
+            ++metrics_.failures;
+        }
+        bus_free_ = end + static_cast<Timestamp>(static_cast<double>(end - start) * (1 - utilization_) / utilization_);
+    }
+
+    std::size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    const AdaptivePoller &poller(std::size_t i) const { return entries_[i].poller; }
+    double utilization_budget() const { return utilization_; }
+    const PollMetrics &metrics() const { return metrics_; }
+
+private:
+    struct Entry {
+        AdaptivePoller poller;
+        Timestamp due;
+    };
+
+    double utilization_;
+    std::vector<Entry> entries_;
+    Timestamp bus_free_ = 0;
+    PollMetrics metrics_;
+};
+
+// *** PolledPort Structure ***
+// The Modbus points configured on one port and the schedule that polls them;
+// `points[i]` is value `i` of `schedule`.
+struct PolledPort {
+    std::vector<ModbusPoint> points;
+    PollSchedule schedule;
+};
+
+// *** Function: polled_port_from_config ***
+// Collects the `modbus` points of port `port` from `config` with their `poll`
+// ranges and the port's `busload` budget. The limit band of each point comes
+// from its sensor's spec in `catalog`.
+template <class Catalog>
+PolledPort polled_port_from_config(const Config &config, std::string_view port, Registry &registry,
+                                   const Catalog &catalog) {
+    double budget = config.default_busload;
+    for (const auto &b : config.busload)
+        if (b.port == port) budget = b.utilization;
+    PolledPort polled{{}, PollSchedule(budget)};
+    for (const auto &m : config.modbus) {
+        if (m.port != port) continue;
+        PollConfig range = config.default_poll;
+        for (const auto &p : config.poll)
+            if (p.sensor == m.sensor) range = p;
+        const SensorHandle sensor = registry.sensor(m.sensor);
+        const SensorSpec &spec = catalog.spec(sensor);
+        polled.points.push_back({m.slave, m.address, m.format, m.scale, sensor});
+        polled.schedule.add(AdaptivePoller(
+            {static_cast<Timestamp>(range.min_ms * 1e6), static_cast<Timestamp>(range.max_ms * 1e6)},
+            spec.min_limit, spec.max_limit));
+    }
+    return polled;
+}
+
+} // namespace qms
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "executor.hpp"
+
+#if defined(QMS_HAS_EXECUTOR)
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "log.hpp"
+#include "polling.hpp"
+#include "protocols.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "serial.hpp"
+#include "sources.hpp"
+#include "task.hpp"
+
+namespace qms {
+
+// Coroutine port handlers. Each handler owns its port for its lifetime, pushes
+// every decoded reading into `sink` (any Stage, usually a Chain shared by all
+// ports of the executor) and finishes when the port fails or hangs up.
+// Register `sink.flush()` with Executor::on_idle to write sinks out once per
+// burst.
+
+// *** Function: ascii_port_task ***
+// Streams "<SensorID> <value>" lines from a port; control lines go to
+// `control`, and the cost of parsing to `costs` if given. Device timestamps
+// are corrected onto the gateway clock unless `device_time` is false (see
+// LineDecoder).
+template <class Sink>
+Task<> ascii_port_task(Executor &ex, SerialPort port, Registry &registry, std::string name, Sink &sink,
+                       ControlHandler control = {}, CostLedger *costs = nullptr, bool device_time = true) {
+    AsyncPort io(ex, std::move(port));
+    LineDecoder decoder(registry, registry.port(name));
+    decoder.set_control(std::move(control));
+    decoder.set_costs(costs);
+    decoder.set_device_time(device_time);
+    // Logged however the task ends, also when the executor destroys it on stop
+    struct ClockLog {
+        const LineDecoder &decoder;
+        ~ClockLog() { decoder.log_device_clock(); }
+    } clock_log{decoder};
+    auto emit = [&sink](SensorData &r) { sink.process(r); };
+    char buffer[128];
+    for (;;) {
+        const long n = co_await io.read(buffer, sizeof(buffer));
+        if (n < 0) break;
+        decoder.decode(buffer, static_cast<std::size_t>(n), ex.now(), emit);
+        co_await ex.yield(); // A busy port must not hold back the other ports or the dispatch task
+    }
+    log(LogLevel::Error, "Failed to read from port %s", name.c_str());
+}
+
+// *** Function: binary_port_task ***
+// Streams binary frames (see BinaryFrameDecoder) from a port.
+template <class Sink>
+Task<> binary_port_task(Executor &ex, SerialPort port, Registry &registry, std::string name, Sink &sink) {
+    AsyncPort io(ex, std::move(port));
+    BinaryFrameDecoder decoder;
+    const PortHandle port_handle = registry.port(name);
+    std::uint8_t buffer[128];
+    for (;;) {
+        const long n = co_await io.read(buffer, sizeof(buffer));
+        if (n < 0) break;
+        const Timestamp now = ex.now();
+        const std::size_t bad = decoder.feed(buffer, static_cast<std::size_t>(n), [&](std::string_view id, float v) {
+            SensorData r{.sensor = registry.sensor(id), .port = port_handle, .value = v, .timestamp = now};
+            sink.process(r);
+        });
+        if (bad) log(LogLevel::Error, "Discarded %zu corrupt frames on port %s", bad, name.c_str());
+        co_await ex.yield();
+    }
+    log(LogLevel::Error, "Failed to read from port %s", name.c_str());
+}
+
+// *** Function: modbus_transaction ***
+// Requests `point` from its slave and awaits the response for at most
+// `timeout`, storing the decoded value in `value`. A late or partial reply is
+// discarded.
+//
+// Returns:
+// - The outcome; PortError when the port failed and polling should stop.
+inline Task<ModbusStatus> modbus_transaction(AsyncPort &io, const ModbusPoint &point, Executor::duration timeout,
+                                             float &value) {
+    std::uint8_t frame[16];
+    const std::size_t request_size = modbus_read_request(frame, point);
+    const bool sent = co_await io.write_all(frame, request_size, timeout);
+    if (!sent) co_return ModbusStatus::PortError;
+
+    std::size_t have = 0;
+    long n = 0;
+    while (have < modbus_response_length(point, frame, have)) {
+        n = co_await io.read(frame + have, modbus_response_length(point, frame, have) - have, timeout);
+        if (n <= 0) break;
+        have += static_cast<std::size_t>(n);
+    }
+    if (n < 0) co_return ModbusStatus::PortError;
+
+    const ModbusStatus status = n == 0 ? ModbusStatus::Timeout : modbus_decode_response(point, frame, have, value);
+    if (status != ModbusStatus::Ok) tcflush(io.port().native_handle(), TCIFLUSH); // Drop a late or partial reply
+    co_return status;
+}
+
+// *** Function: modbus_port_task ***
+// Polls Modbus RTU slaves on a port: every `interval` each point is requested
+// in turn and its response awaited for at most `timeout`. A slave that does not
+// answer is reported and skipped until the next cycle.
+template <class Sink>
+Task<> modbus_port_task(Executor &ex, SerialPort port, Registry &registry, std::string name,
+                        std::vector<ModbusPoint> points, Executor::duration interval, Executor::duration timeout,
+                        Sink &sink) {
+    AsyncPort io(ex, std::move(port));
+    const PortHandle port_handle = registry.port(name);
+    for (;;) {
+        const Timestamp next_cycle = ex.now() + interval.count();
+        for (const ModbusPoint &point : points) {
+            float value = 0.0f;
+            const ModbusStatus status = co_await modbus_transaction(io, point, timeout, value);
+            if (status == ModbusStatus::PortError) {
+                log(LogLevel::Error, "Failed to poll port %s", name.c_str());
+                co_return;
+            }
+            if (status == ModbusStatus::Ok) {
+                SensorData r{.sensor = point.sensor, .port = port_handle, .value = value, .timestamp = ex.now()};
+                sink.process(r);
+            } else {
+                log(LogLevel::Error, "Modbus slave %u register %u on %s: %s", point.slave, point.address, name.c_str(),
+                    to_string(status));
+            }
+        }
+        co_await ex.sleep_until(next_cycle);
+    }
+}
+
+// *** Function: adaptive_modbus_port_task ***
+// Polls Modbus RTU slaves on a port in the order and at the rate `schedule`
+// decides (see PollSchedule): values that change or approach a limit are
+// polled often, stable ones rarely, and the bus stays within its utilization
+// budget. `points[i]` is value `i` of the schedule, which must outlive the task.
+template <class Sink>
+Task<> adaptive_modbus_port_task(Executor &ex, SerialPort port, Registry &registry, std::string name,
+                                 std::vector<ModbusPoint> points, PollSchedule &schedule, Executor::duration timeout,
+                                 Sink &sink) {
+    AsyncPort io(ex, std::move(port));
+    const PortHandle port_handle = registry.port(name);
+    while (!schedule.empty()) {
+        const auto [i, at] = schedule.next();
+        if (at > ex.now()) co_await ex.sleep_until(at);
+        const ModbusPoint &point = points[i];
+        const Timestamp start = ex.now();
+        float value = 0.0f;
+        const ModbusStatus status = co_await modbus_transaction(io, point, timeout, value);
+        if (status == ModbusStatus::PortError) {
+            log(LogLevel::Error, "Failed to poll port %s", name.c_str());
+            co_return;
+        }
+        const Timestamp end = ex.now();
+        schedule.completed(i, start, end, status == ModbusStatus::Ok ? &value : nullptr);
+        if (status == ModbusStatus::Ok) {
+            SensorData r{.sensor = point.sensor, .port = port_handle, .value = value, .timestamp = end};
+            sink.process(r);
+        } else {
+            log(LogLevel::Error, "Modbus slave %u register %u on %s: %s", point.slave, point.address, name.c_str(),
+                to_string(status));
+        }
+    }
+}
+
+// *** Function: poll_task ***
+// Calls `stage.poll(now)` every `period` for as long as any other task is
+// alive, so time-driven stages (e.g. a Batched sink waiting for its latency
+// deadline) act even when no readings arrive.
+template <class S>
+Task<> poll_task(Executor &ex, S &stage, Executor::duration period) {
+    while (ex.live_tasks() > 1) {
+        co_await ex.sleep_for(period);
+        stage.poll(ex.now());
+    }
+}
+
+// *** Function: producer_task ***
+// Runs `task`, then counts it out of `running` and raises `done`, so the
+// consumer of its readings (see dispatch_task) knows when input has ended.
+inline Task<> producer_task(Task<> task, std::size_t &running, Executor::Signal &done) {
+    co_await task;
+    --running;
+    done.notify();
+}
+
+// *** Function: dispatch_task ***
+// Drives a ClassScheduler on the executor: passes queued readings on in rounds
+// of at most `budget`, yielding to the port tasks between rounds so a critical
+// reading read meanwhile is dispatched in the next round. Sleeps on `work`
+// (which the scheduler should notify) while the queues are empty, waking every
+// `poll_period` to poll time-driven stages. Finishes once `producers` is zero
+// and the queues are drained.
+template <class Scheduler>
+Task<> dispatch_task(Executor &ex, Scheduler &scheduler, Executor::Signal &work, const std::size_t &producers,
+                     Executor::duration poll_period, std::size_t budget = 1024) {
+    while (producers > 0 || !scheduler.empty()) {
+        if (scheduler.empty()) {
+            const bool woken = co_await work.wait(poll_period); // Not inside the condition: GCC 12 miscompiles that
+            if (!woken) scheduler.poll(ex.now());
+            continue;
+        }
+        scheduler.dispatch(ex.now(), budget);
+        co_await ex.yield();
+    }
+}
+
+} // namespace qms
+
+#endif // QMS_HAS_EXECUTOR
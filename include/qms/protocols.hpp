@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "record.hpp"
+
+namespace qms {
+
+// *** BinaryFrameDecoder ***
+// Decoder for the binary device protocol. Each frame is:
+//   0xAA 0x55 | u8 id_length (1-63) | id bytes | f32 value (little-endian) | u8 checksum
+// where the checksum is the byte sum, modulo 256, of everything after the two
+// sync bytes. The decoder resynchronises on the next 0xAA 0x55 after a
+// corrupt frame.
+class BinaryFrameDecoder {
+public:
+    static constexpr std::size_t max_id_length = 63;
+
+    // Feeds `size` bytes and calls `on_frame(std::string_view id, float value)`
+    // for every valid frame.
+    //
+    // Returns:
+    // - The number of corrupt frames discarded while processing this input.
+    template <class OnFrame>
+    std::size_t feed(const std::uint8_t *data, std::size_t size, OnFrame &&on_frame) {
+        std::size_t bad = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            const std::uint8_t b = data[i];
+            switch (state_) {
+            case State::Sync0:
+                if (b == 0xAA) state_ = State::Sync1;
+                break;
+            case State::Sync1:
+                state_ = b == 0x55 ? State::Length : b == 0xAA ? State::Sync1 : State::Sync0;
+                break;
+            case State::Length:
+                if (b == 0 || b > max_id_length) {
+                    ++bad;
+                    state_ = b == 0xAA ? State::Sync1 : State::Sync0;
+                    break;
+                }
+                id_length_ = b;
+                used_ = 0;
+                sum_ = b;
+                state_ = State::Body;
+                break;
+            case State::Body:
+                if (used_ < id_length_ + 4u) {
+                    body_[used_++] = b;
+                    sum_ = static_cast<std::uint8_t>(sum_ + b);
+                    break;
+                }
+                if (b == sum_) {
+                    float value;
+                    std::memcpy(&value, body_ + id_length_, 4);
+                    on_frame(std::string_view(reinterpret_cast<const char *>(body_), id_length_), value);
+                } else {
+                    ++bad;
+                }
+                state_ = State::Sync0;
+                break;
+            }
+        }
+        return bad;
+    }
+
+    // Encodes one frame into `out` (room for 70 bytes) and returns its length.
+    static std::size_t encode(std::uint8_t *out, std::string_view id, float value) {
+        const auto n = static_cast<std::uint8_t>(id.size() > max_id_length ? max_id_length : id.size());
+        out[0] = 0xAA;
+        out[1] = 0x55;
+        out[2] = n;
+        std::memcpy(out + 3, id.data(), n);
+        std::memcpy(out + 3 + n, &value, 4);
+        std::uint8_t sum = 0;
+        for (std::size_t i = 2; i < 3u + n + 4u; ++i) sum = static_cast<std::uint8_t>(sum + out[i]);
+        out[3 + n + 4] = sum;
+        return 3u + n + 5u;
+    }
+
+private:
+    enum class State : std::uint8_t { Sync0, Sync1, Length, Body };
+
+    State state_ = State::Sync0;
+    std::uint8_t id_length_ = 0;
+    std::uint8_t sum_ = 0;
+    std::uint8_t used_ = 0;
+    std::uint8_t body_[max_id_length + 4];
+};
+
+// *** Modbus RTU ***
+
+// Register encodings supported when polling Modbus instruments.
+enum class ModbusFormat : std::uint8_t {
+    Int16,   // One register, signed
+    UInt16,  // One register, unsigned
+    Float32, // Two registers, IEEE-754, high word first
+};
+
+// *** ModbusPoint Structure ***
+// One value polled from a Modbus slave with function 0x03 (read holding
+// registers): value = raw * `scale`, reported as `sensor`.
+struct ModbusPoint {
+    std::uint8_t slave;
+    std::uint16_t address;
+    ModbusFormat format;
+    float scale;
+    SensorHandle sensor;
+};
+
+inline constexpr std::uint16_t modbus_register_count(ModbusFormat f) { return f == ModbusFormat::Float32 ? 2 : 1; }
+
+// Parses a register encoding as written in configuration files: int16, uint16 or float32.
+inline bool parse_modbus_format(std::string_view s, ModbusFormat &out) {
+    if (s == "int16") out = ModbusFormat::Int16;
+    else if (s == "uint16") out = ModbusFormat::UInt16;
+    else if (s == "float32") out = ModbusFormat::Float32;
+    else return false;
+    return true;
+}
+
+// CRC-16/MODBUS of `size` bytes.
+inline std::uint16_t modbus_crc16(const std::uint8_t *data, std::size_t size) {
+    std::uint16_t crc = 0xFFFF;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) crc = (crc & 1) ? static_cast<std::uint16_t>((crc >> 1) ^ 0xA001) : crc >> 1;
+    }
+    return crc;
+}
+
+// Builds the 8-byte "read holding registers" request for `point` into `out`.
+inline std::size_t modbus_read_request(std::uint8_t *out, const ModbusPoint &point) {
+    const std::uint16_t count = modbus_register_count(point.format);
+    out[0] = point.slave;
+    out[1] = 0x03;
+    out[2] = static_cast<std::uint8_t>(point.address >> 8);
+    out[3] = static_cast<std::uint8_t>(point.address);
+    out[4] = static_cast<std::uint8_t>(count >> 8);
+    out[5] = static_cast<std::uint8_t>(count);
+    const std::uint16_t crc = modbus_crc16(out, 6);
+    out[6] = static_cast<std::uint8_t>(crc);
+    out[7] = static_cast<std::uint8_t>(crc >> 8);
+    return 8;
+}
+
+// Length of the response expected for `point`, given the first `have` bytes
+// received so far (exception responses are shorter).
+inline std::size_t modbus_response_length(const ModbusPoint &point, const std::uint8_t *frame, std::size_t have) {
+    if (have >= 2 && (frame[1] & 0x80)) return 5;
+    return 5u + 2u * modbus_register_count(point.format);
+}
+
+enum class ModbusStatus { Ok, Timeout, BadCrc, BadReply, Exception, PortError };
+
+inline const char *to_string(ModbusStatus status) {
+    switch (status) {
+    case ModbusStatus::Ok: return "ok";
+    case ModbusStatus::Timeout: return "timeout";
+    case ModbusStatus::BadCrc: return "bad CRC";
+    case ModbusStatus::BadReply: return "bad reply";
+    case ModbusStatus::Exception: return "exception response";
+    case ModbusStatus::PortError: return "port error";
+    }
+    return "unknown";
+}
+
+// *** Function: modbus_decode_response ***
+// Validates a complete response to `point` and extracts the scaled value.
+inline ModbusStatus modbus_decode_response(const ModbusPoint &point, const std::uint8_t *frame, std::size_t size,
+                                           float &value) {
+    if (size < 5) return ModbusStatus::BadReply;
+    const std::uint16_t crc = modbus_crc16(frame, size - 2);
+    if (frame[size - 2] != static_cast<std::uint8_t>(crc) || frame[size - 1] != static_cast<std::uint8_t>(crc >> 8))
+        return ModbusStatus::BadCrc;
+    if (frame[0] != point.slave) return ModbusStatus::BadReply;
+    if (frame[1] & 0x80) return ModbusStatus::Exception;
+    const std::size_t bytes = 2u * modbus_register_count(point.format);
+    if (frame[1] != 0x03 || frame[2] != bytes || size != 5 + bytes) return ModbusStatus::BadReply;
+
+    const std::uint8_t *d = frame + 3;
+    switch (point.format) {
+    case ModbusFormat::Int16:
+        value = static_cast<float>(static_cast<std::int16_t>((d[0] << 8) | d[1])) * point.scale;
+        break;
+    case ModbusFormat::UInt16:
+        value = static_cast<float>(static_cast<std::uint16_t>((d[0] << 8) | d[1])) * point.scale;
+        break;
+    case ModbusFormat::Float32: {
+        const std::uint32_t bits = (std::uint32_t{d[0]} << 24) | (std::uint32_t{d[1]} << 16) |
+                                   (std::uint32_t{d[2]} << 8) | std::uint32_t{d[3]};
+        float f;
+        std::memcpy(&f, &bits, 4);
+        value = f * point.scale;
+        break;
+    }
+    }
+    return ModbusStatus::Ok;
+}
+
+} // namespace qms
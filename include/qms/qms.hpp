@@ -0,0 +1,44 @@
+#pragma once
+
+// Umbrella header for the quality monitoring pipeline library.
+
+#include "alert.hpp"
+#include "baseline.hpp"
+#include "batching.hpp"
+#include "buffer.hpp"
+#include "catalog.hpp"
+#include "clock.hpp"
+#include "config.hpp"
+#include "costs.hpp"
+#include "dashboard.hpp"
+#include "drift.hpp"
+#include "executor.hpp"
+#include "format.hpp"
+#include "golden.hpp"
+#include "log.hpp"
+#include "lots.hpp"
+#include "memory.hpp"
+#include "model.hpp"
+#include "monitor.hpp"
+#include "numa.hpp"
+#include "parse.hpp"
+#include "pipeline.hpp"
+#include "plugin.hpp"
+#include "polling.hpp"
+#include "port_tasks.hpp"
+#include "protocols.hpp"
+#include "recipes.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "rollup.hpp"
+#include "scheduling.hpp"
+#include "sensor_traits.hpp"
+#include "serial.hpp"
+#include "simulation.hpp"
+#include "sinks.hpp"
+#include "sources.hpp"
+#include "stages.hpp"
+#include "state_table.hpp"
+#include "task.hpp"
+#include "timing.hpp"
+#include "watchdog.hpp"
@@ -0,0 +1,93 @@
+#ifndef QMS_PLUGIN_H
+#define QMS_PLUGIN_H
+
+/*
+ * *** Plugin ABI ***
+ * The C interface of custom validators and stages loaded from shared
+ * libraries (see qms::PluginStage). It is plain C with fixed-width types, so
+ * a plugin built with any compiler works with any build of the monitor that
+ * has the same QMS_PLUGIN_ABI_VERSION.
+ *
+ * A plugin library exports one function, `qms_plugin_entry`, returning a
+ * static qms_plugin description. The monitor creates one instance per
+ * pipeline thread and scope it is configured for, and calls `process` with
+ * whole batches of readings as columns. Calls to one instance never overlap,
+ * so instances need no locking.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QMS_PLUGIN_ABI_VERSION 1
+#define QMS_PLUGIN_ENTRY "qms_plugin_entry"
+
+#if defined(_WIN32)
+#define QMS_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define QMS_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* Log levels of qms_host::log. */
+enum { QMS_LOG_INFO = 0, QMS_LOG_ERROR = 1, QMS_LOG_ALERT = 2 };
+
+/*
+ * *** qms_batch ***
+ * `count` readings as columns: row i is sensor[i] on port[i] at timestamp[i]
+ * (nanoseconds since the epoch) with value[i]. A plugin may correct values in
+ * place and drop a reading by clearing keep[i], which is 1 on entry. The
+ * columns are valid only during the call.
+ */
+typedef struct qms_batch {
+    uint32_t count;
+    const uint32_t *sensor;
+    const uint16_t *port;
+    const int64_t *timestamp;
+    float *value;
+    uint8_t *keep;
+} qms_batch;
+
+/*
+ * *** qms_host ***
+ * What the monitor offers its plugins. Every function takes `context` as its
+ * first argument. Names returned stay valid for the life of the process.
+ */
+typedef struct qms_host {
+    uint32_t abi_version;
+    void *context;
+    void (*log)(void *context, int level, const char *message);
+    /* Handle of a sensor ID, registering it if needed. */
+    uint32_t (*sensor)(void *context, const char *id);
+    const char *(*sensor_name)(void *context, uint32_t sensor);
+    const char *(*port_name)(void *context, uint16_t port);
+    /* Raises an alert on the monitor's alert path: `value` broke `low`-`high`. */
+    void (*alert)(void *context, uint32_t sensor, uint16_t port, float value, float low, float high,
+                  int64_t timestamp);
+} qms_host;
+
+/*
+ * *** qms_plugin ***
+ * - `abi_version`: QMS_PLUGIN_ABI_VERSION the plugin was built against.
+ * - `name`: Shown in logs and alerts.
+ * - `create`: Makes an instance for the configured arguments `args` (may be
+ *   empty); returns NULL on failure. `host` outlives the instance.
+ * - `process`: Validates or transforms one batch; returns 0 on success.
+ * - `destroy`: Frees an instance.
+ */
+typedef struct qms_plugin {
+    uint32_t abi_version;
+    const char *name;
+    void *(*create)(const qms_host *host, const char *args);
+    int (*process)(void *instance, qms_batch *batch);
+    void (*destroy)(void *instance);
+} qms_plugin;
+
+typedef const qms_plugin *(*qms_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QMS_PLUGIN_H */
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "buffer.hpp"
+#include "config.hpp"
+#include "format.hpp"
+#include "log.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "sinks.hpp"
+
+namespace qms {
+
+// *** Limits Structure ***
+// The acceptable range of one sensor.
+struct Limits {
+    float min_limit;
+    float max_limit;
+};
+
+// *** Recipe ***
+// A named set of limits for the product a line makes, indexed by sensor
+// handle. Sensors the recipe does not list keep their own limits.
+class Recipe {
+public:
+    explicit Recipe(std::string name) : name_(std::move(name)) {}
+
+    void set(SensorHandle sensor, Limits limits) {
+        if (sensor >= limits_.size()) limits_.resize(static_cast<std::size_t>(sensor) + 1);
+        limits_[sensor] = limits;
+    }
+
+    // The limits of `sensor`, or nullptr if the recipe does not list it.
+    const Limits *limits(SensorHandle sensor) const {
+        return sensor < limits_.size() && limits_[sensor] ? &*limits_[sensor] : nullptr;
+    }
+
+    const std::string &name() const { return name_; }
+
+private:
+    std::string name_;
+    std::vector<std::optional<Limits>> limits_;
+};
+
+// *** RecipeBook ***
+// The recipes of the plant and the production lines that run them. Each port
+// belongs to one line and each line keeps its last `history_depth`
+// changeovers in a ring, so a changeover stores a single pointer however many
+// sensors the recipe lists (and is appended to `history_file` if given).
+//
+// Changeovers are handled as the control line is decoded, while readings
+// decoded before it may still be queued. So a reading's limits come from the
+// recipe its line ran at the reading's timestamp: port to line, line to the
+// changeover in force then (the latest one, unless the reading is older),
+// recipe to sensor. Readings older than the ring take no recipe.
+//
+// Recipes and lines are set up before the pipelines start; after that,
+// `limits` may be called from any pipeline thread and `changeover` from any
+// thread. Lookups take no lock: each ring is read like a seqlock, its count
+// telling whether a slot was overwritten while it was read.
+class RecipeBook {
+public:
+    static constexpr std::size_t no_line = static_cast<std::size_t>(-1);
+    static constexpr std::size_t history_depth = 64;
+    static constexpr std::string_view history_header = "Line,Recipe,Start\n";
+
+    explicit RecipeBook(Registry &registry, SharedFile *history_file = nullptr)
+        : registry_(registry), history_file_(history_file) {}
+    RecipeBook(const RecipeBook &) = delete;
+    RecipeBook &operator=(const RecipeBook &) = delete;
+
+    // *** Function: configure ***
+    // Sets up the `recipe` and `line` directives of `config`. Each of `ports`
+    // outside every line gets a line of its own. Lines start with their
+    // configured recipe at `now`.
+    void configure(const Config &config, const std::vector<std::string> &ports, Timestamp now) {
+        for (const auto &r : config.recipes)
+            recipe(r.recipe).set(registry_.sensor(r.sensor), {r.min_limit, r.max_limit});
+        for (const auto &l : config.lines) {
+            const std::size_t line = add_line(l.name, l.ports);
+            if (!l.recipe.empty()) changeover(line, l.recipe, now);
+        }
+        for (const auto &port : ports)
+            if (line_of(registry_.port(port)) == no_line) add_line(port, {port});
+    }
+
+    // Returns the recipe called `name`, creating an empty one if needed.
+    Recipe &recipe(std::string_view name) {
+        for (Recipe &r : recipes_)
+            if (r.name() == name) return r;
+        return recipes_.emplace_back(std::string(name));
+    }
+
+    const Recipe *find(std::string_view name) const {
+        for (const Recipe &r : recipes_)
+            if (r.name() == name) return &r;
+        return nullptr;
+    }
+
+    // Adds a line serving `ports`; returns its index.
+    std::size_t add_line(std::string name, const std::vector<std::string> &ports) {
+        lines_.emplace_back(std::move(name));
+        const std::size_t line = lines_.size() - 1;
+        for (const auto &port : ports) {
+            const PortHandle p = registry_.port(port);
+            if (p >= port_lines_.size()) port_lines_.resize(static_cast<std::size_t>(p) + 1, no_line);
+            port_lines_[p] = line;
+        }
+        return line;
+    }
+
+    std::size_t line_of(PortHandle port) const { return port < port_lines_.size() ? port_lines_[port] : no_line; }
+
+    // The limits the recipe of `port`'s line at `t` sets for `sensor`, or nullptr.
+    const Limits *limits(PortHandle port, SensorHandle sensor, Timestamp t) const {
+        const std::size_t line = line_of(port);
+        if (line == no_line) return nullptr;
+        const Recipe *r = active_at(line, t);
+        return r ? r->limits(sensor) : nullptr;
+    }
+
+    // *** Function: changeover ***
+    // Makes `recipe` ("none" for no recipe) the active recipe of `line` from `t` on.
+    //
+    // Returns:
+    // - false if there is no such recipe.
+    bool changeover(std::size_t line, std::string_view recipe, Timestamp t) {
+        const Recipe *r = recipe == "none" ? nullptr : find(recipe);
+        if (r == nullptr && recipe != "none") {
+            log(LogLevel::Error, "Unknown recipe %.*s for line %s", static_cast<int>(recipe.size()), recipe.data(),
+                lines_[line].name.c_str());
+            return false;
+        }
+        Line &l = lines_[line];
+        {
+            std::lock_guard lock(mutex_); // Serialises the writers of the ring
+            const std::uint64_t n = l.changes.load(std::memory_order_relaxed);
+            l.starts[n % history_depth].store(t, std::memory_order_release);
+            l.recipes[n % history_depth].store(r, std::memory_order_release);
+            l.changes.store(n + 1, std::memory_order_release);
+        }
+        log(LogLevel::Info, "Line %s changed over to recipe %s", l.name.c_str(), r ? r->name().c_str() : "none");
+        if (history_file_) {
+            const std::string_view rname = r ? std::string_view(r->name()) : std::string_view("none");
+            ByteBuffer buffer;
+            TimestampFormatter timestamps;
+            char *out = buffer.reserve_tail(l.name.size() + rname.size() + TimestampFormatter::length + 4);
+            char *p = out;
+            p = std::copy(l.name.begin(), l.name.end(), p);
+            *p++ = ',';
+            p = std::copy(rname.begin(), rname.end(), p);
+            *p++ = ',';
+            p = timestamps.format(p, t);
+            *p++ = '\n';
+            buffer.commit(static_cast<std::size_t>(p - out));
+            history_file_->write(buffer.data(), buffer.size());
+        }
+        return true;
+    }
+
+    // *** Function: command ***
+    // Handles the in-band control line "recipe <name>" received on `port` at `t`.
+    //
+    // Returns:
+    // - false if `command` is not a recipe command.
+    bool command(PortHandle port, std::string_view command, Timestamp t) {
+        constexpr std::string_view verb = "recipe ";
+        if (!command.starts_with(verb)) return false;
+        std::string_view name = command.substr(verb.size());
+        while (!name.empty() && (name.back() == ' ' || name.back() == '\r')) name.remove_suffix(1);
+        while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+        const std::size_t line = line_of(port);
+        if (line == no_line) {
+            const auto p = registry_.port_name(port);
+            log(LogLevel::Error, "Port %.*s belongs to no line", static_cast<int>(p.size()), p.data());
+            return true;
+        }
+        changeover(line, name, t);
+        return true;
+    }
+
+    // The latest recipe of `line`.
+    const Recipe *active(std::size_t line) const { return active_at(line, std::numeric_limits<Timestamp>::max()); }
+
+    // The recipe `line` was running at `t`, from its ring of changeovers.
+    const Recipe *active_at(std::size_t line, Timestamp t) const {
+        const Line &l = lines_[line];
+        const std::uint64_t n = l.changes.load(std::memory_order_acquire);
+        // Slot `n - history_depth` may already be under rewrite
+        for (std::uint64_t i = n; i > 0 && n - i + 1 < history_depth; --i) {
+            const std::size_t slot = (i - 1) % history_depth;
+            const Timestamp start = l.starts[slot].load(std::memory_order_acquire);
+            const Recipe *r = l.recipes[slot].load(std::memory_order_acquire);
+            if (l.changes.load(std::memory_order_acquire) >= i - 1 + history_depth) return nullptr; // Lapped
+            if (start <= t) return r;
+        }
+        return nullptr;
+    }
+
+    std::size_t lines() const { return lines_.size(); }
+    Registry &registry() const { return registry_; }
+    const std::string &line_name(std::size_t line) const { return lines_[line].name; }
+
+private:
+    struct Line {
+        explicit Line(std::string n) : name(std::move(n)) {}
+        std::string name;
+        std::array<std::atomic<Timestamp>, history_depth> starts{}; // Changeover `i` is in slot `i % history_depth`
+        std::array<std::atomic<const Recipe *>, history_depth> recipes{};
+        std::atomic<std::uint64_t> changes{0};
+    };
+
+    Registry &registry_;
+    SharedFile *history_file_;
+    std::deque<Recipe> recipes_;
+    std::deque<Line> lines_;
+    std::vector<std::size_t> port_lines_;
+    std::mutex mutex_; // Serialises changeovers
+};
+
+} // namespace qms
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace qms {
+
+using SensorHandle = std::uint32_t; // Dense index of an interned sensor ID
+using PortHandle = std::uint16_t;   // Dense index of an interned port name
+using Timestamp = std::int64_t;     // Nanoseconds since the Unix epoch
+
+inline constexpr SensorHandle no_sensor = 0xFFFFFFFF; // Never handed out by the Registry
+inline constexpr PortHandle no_port = 0xFFFF;
+
+// Quality state of a sensor's value. InSpec, Low, High and Stale partition
+// the time a sensor has been reporting; Alarmed overlaps Low and High.
+enum class SensorState : std::uint8_t {
+    InSpec,  // Within its limits
+    Low,     // Below its lower limit
+    High,    // Above its upper limit
+    Stale,   // No reading for longer than the stale timeout
+    Alarmed, // Out of its limits for at least the alarm delay
+};
+
+inline constexpr std::size_t sensor_states = 5;
+
+inline constexpr bool out_of_spec(SensorState s) { return s == SensorState::Low || s == SensorState::High; }
+
+// *** SensorData Structure ***
+// This structure holds a single sensor reading as it flows through a pipeline.
+// It includes:
+// - `sensor`: Handle of the sensor ID (e.g., "TEMP", "HUMIDITY") in the Registry.
+// - `port`: Handle of the serial port the reading arrived on.
+// - `state`: InSpec, Low or High against the sensor's limits; set by the
+//   QualityMonitor stage, InSpec before it.
+// - `value`: A floating-point value representing the sensor's measurement.
+// - `timestamp`: Time at which the reading was received.
+struct SensorData {
+    SensorHandle sensor;                     // Sensor identifier
+    PortHandle port;                         // Source port
+    SensorState state = SensorState::InSpec; // Quality state (fills padding)
+    float value;                             // Measured value
+    Timestamp timestamp;                     // Arrival time
+};
+
+// *** TimeWeighted Structure ***
+// Time-weighted statistics of a sampled signal, taking each value to hold
+// until the next reading (sample-and-hold), so a sensor that reports fast
+// during excursions and slowly when stable is weighted by time, not by sample:
+// - `integral`: Integral of the value over time, in value-seconds.
+// - `duration`: Seconds covered.
+// - `mean`, `m2`: Time-weighted mean and sum of squared deviations, updated
+//   with West's weighted incremental algorithm so the variance stays accurate
+//   over long runs.
+struct TimeWeighted {
+    double integral = 0.0;
+    double duration = 0.0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    // Adds `value` held for `seconds`.
+    void add(double value, double seconds) {
+        if (seconds <= 0.0) return;
+        integral += value * seconds;
+        duration += seconds;
+        const double delta = value - mean;
+        mean += delta * seconds / duration;
+        m2 += seconds * delta * (value - mean);
+    }
+
+    double average() const { return mean; }
+    double variance() const { return duration > 0.0 ? m2 / duration : 0.0; }
+
+    // Totalizer: the integral of a rate per `time_base` seconds (60 for l/min
+    // gives litres); the integral itself when `time_base` is 0.
+    double total(double time_base) const { return time_base > 0.0 ? integral / time_base : integral; }
+};
+
+// *** StatePolicy Structure ***
+// How held values age:
+// - `stale_after`: A value held longer than this counts as Stale (0: never).
+// - `alarm_delay`: Time a sensor must stay out of its limits before the
+//   excursion counts as Alarmed.
+struct StatePolicy {
+    Timestamp stale_after = 60'000'000'000;
+    Timestamp alarm_delay = 0;
+};
+
+// *** StateDurations Structure ***
+// Seconds a sensor spent in each SensorState.
+struct StateDurations {
+    double seconds[sensor_states] = {};
+
+    double &operator[](SensorState s) { return seconds[static_cast<std::size_t>(s)]; }
+    double operator[](SensorState s) const { return seconds[static_cast<std::size_t>(s)]; }
+    double out_of_spec() const { return (*this)[SensorState::Low] + (*this)[SensorState::High]; }
+};
+
+// *** HeldValue Structure ***
+// The latest reading of a sensor, which holds until the next one:
+// - `value`, `state`: The reading and its quality state.
+// - `read_at`: Time of the reading; the value turns Stale after the policy's
+//   `stale_after` from here.
+// - `excursion_since`: Start of the current run of Low/High readings.
+struct HeldValue {
+    float value = 0.0f;
+    SensorState state = SensorState::InSpec;
+    bool valid = false; // A reading has been held
+    Timestamp read_at = 0;
+    Timestamp excursion_since = 0;
+
+    // Holds the reading `value` in `state` taken at `t`.
+    void update(float v, SensorState s, Timestamp t) {
+        if (out_of_spec(s) && !(valid && out_of_spec(state))) excursion_since = t;
+        value = v;
+        state = s;
+        read_at = t;
+        valid = true;
+    }
+
+    // Credits the value held until `t` to `weighted` and `states`, then holds
+    // `v` in `s` from `t` on. A reading older than the held one is ignored.
+    void hold(float v, SensorState s, Timestamp t, TimeWeighted &weighted, StateDurations &states,
+              const StatePolicy &policy) {
+        if (valid && t < read_at) return;
+        credit(weighted, states, read_at, t, policy);
+        update(v, s, t);
+    }
+
+    // Credits the value held from `from` to `to` to `weighted` and `states`.
+    void credit(TimeWeighted &weighted, StateDurations &states, Timestamp from, Timestamp to,
+                const StatePolicy &policy) const {
+        if (!valid || to <= from) return;
+        weighted.add(value, seconds(to - from));
+        const Timestamp fresh_end = policy.stale_after > 0 ? std::clamp(read_at + policy.stale_after, from, to) : to;
+        states[state] += seconds(fresh_end - from);
+        states[SensorState::Stale] += seconds(to - fresh_end);
+        if (out_of_spec(state)) {
+            const Timestamp alarm_from = std::max(from, excursion_since + policy.alarm_delay);
+            if (fresh_end > alarm_from) states[SensorState::Alarmed] += seconds(fresh_end - alarm_from);
+        }
+    }
+
+private:
+    static double seconds(Timestamp ns) { return static_cast<double>(ns) / 1e9; }
+};
+
+// *** SensorStats Structure ***
+// This structure is used to maintain statistics for a sensor.
+// It tracks:
+// - `min_limit` and `max_limit`: Define the acceptable range of values for the sensor.
+// - `total_value`: Sum of all recorded values for calculating the average.
+// - `max_value` and `min_value`: The maximum and minimum values observed.
+// - `count`: Number of recorded values, used for calculating the average.
+// - `weighted`, `states`: Time-weighted statistics and time in each state up
+//   to the latest reading, which is `held` from then on.
+// - `rate_seconds`: Time base of a rate unit (60 for l/min), so that
+//   `total()` is in the integrated unit; 0 for other units.
+struct SensorStats {
+    float min_limit = 5.0f;   // Minimum acceptable limit
+    float max_limit = 25.0f;  // Maximum acceptable limit
+    double total_value = 0.0; // Total value for averaging
+    float max_value = -std::numeric_limits<float>::infinity(); // Maximum recorded value
+    float min_value = std::numeric_limits<float>::infinity();  // Minimum recorded value
+    std::uint64_t count = 0;  // Number of recorded values
+    TimeWeighted weighted;    // Time-weighted statistics of the held values
+    StateDurations states;    // Time in each quality state
+    HeldValue held;           // Latest reading
+    double rate_seconds = 0;  // Time base of the unit, for the totalizer
+
+    double average() const { return count ? total_value / static_cast<double>(count) : 0.0; }
+    double total() const { return weighted.total(rate_seconds); }
+
+    // Credits the held value with the time until `t` and holds `value` in
+    // `state` from then on. A reading older than the held one does not move
+    // the hold back.
+    void hold(float value, SensorState state, Timestamp t, const StatePolicy &policy) {
+        held.hold(value, state, t, weighted, states, policy);
+    }
+
+    // A copy with the held value credited up to `now`.
+    SensorStats snapshot(Timestamp now, const StatePolicy &policy) const {
+        SensorStats s = *this;
+        if (now > held.read_at) held.credit(s.weighted, s.states, held.read_at, now, policy);
+        return s;
+    }
+};
+
+} // namespace qms
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "detail/intern_index.hpp"
+#include "detail/stable_vector.hpp"
+#include "record.hpp"
+
+namespace qms {
+
+// *** Registry ***
+// Interns sensor IDs and port names into dense handles so that readings carry
+// small integers instead of strings and per-sensor state can live in flat
+// arrays indexed by handle.
+//
+// Interning takes a lock; mapping a handle back to its name does not, because
+// names are stored in a StableVector and never move. The index from names to
+// handles grows incrementally (see InternIndex), so interning the millionth
+// name takes no longer than interning the first.
+class Registry {
+public:
+    static constexpr std::size_t max_name_length = 63;
+
+    // *** Function: sensor ***
+    // Returns the handle for `name`, interning it on first use.
+    SensorHandle sensor(std::string_view name) { return static_cast<SensorHandle>(intern(sensors_, name)); }
+
+    // *** Function: port ***
+    // Returns the handle for the port `name`, interning it on first use.
+    PortHandle port(std::string_view name) {
+        const std::size_t h = intern(ports_, name);
+        if (h >= no_port) throw std::length_error("too many ports");
+        return static_cast<PortHandle>(h);
+    }
+
+    std::string_view sensor_name(SensorHandle h) const { return sensors_.names[h]; }
+    std::string_view port_name(PortHandle h) const { return ports_.names[h]; }
+
+    std::size_t sensor_count() const { return sensors_.names.size(); }
+    std::size_t port_count() const { return ports_.names.size(); }
+
+private:
+    struct Table {
+        mutable std::shared_mutex mutex;
+        detail::InternIndex index;
+        detail::StableVector<std::string> names;
+    };
+
+    static std::size_t intern(Table &t, std::string_view name) {
+        const std::size_t hash = std::hash<std::string_view>{}(name);
+        {
+            std::shared_lock lock(t.mutex);
+            if (const std::size_t h = t.index.find(name, hash, t.names); h != detail::InternIndex::npos) return h;
+        }
+        std::unique_lock lock(t.mutex);
+        if (const std::size_t h = t.index.find(name, hash, t.names); h != detail::InternIndex::npos) return h;
+        const std::size_t h = t.names.emplace_back(name);
+        t.index.insert(hash, h);
+        return h;
+    }
+
+    Table sensors_;
+    Table ports_;
+};
+
+} // namespace qms
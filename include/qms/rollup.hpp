@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "buffer.hpp"
+#include "format.hpp"
+#include "memory.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "sensor_traits.hpp"
+#include "sinks.hpp"
+
+namespace qms {
+
+// *** RollupBucket Structure ***
+// Statistics of one sensor over one rollup period starting at `start`:
+// - `count`, `sum`, `min_value`, `max_value`: Of the readings in the period.
+// - `weighted`: Time-weighted statistics of the held value over the part of
+//   the period the sensor had a value, including the value carried over from
+//   before the period.
+// - `states`: Time in each quality state over the same part of the period.
+struct RollupBucket {
+    SensorHandle sensor = no_sensor;
+    Timestamp start = 0;
+    Timestamp period = 0;
+    std::uint64_t count = 0;
+    double sum = 0.0;
+    float min_value = std::numeric_limits<float>::infinity();
+    float max_value = -std::numeric_limits<float>::infinity();
+    TimeWeighted weighted;
+    StateDurations states;
+
+    double average() const { return count ? sum / static_cast<double>(count) : 0.0; }
+};
+
+// *** Rollup Stage ***
+// Summarises every sensor per fixed period (e.g. one minute), with periods
+// aligned to the epoch, and hands each completed RollupBucket to `out`, which
+// provides `write(const RollupBucket&)` and `flush()`. A reading costs O(1):
+// it credits the sensor's held value with the time since the last reading,
+// splitting it at a period boundary when it closes the previous bucket. Time
+// in each quality state follows the `state` QualityMonitor set on the
+// readings, aged by `states`.
+//
+// Buckets of sensors that fall silent are closed by `poll(now)` once per
+// period, with their last value held to the end of the period; `close(now)`
+// writes out the partial buckets at shutdown. Periods in which a silent
+// sensor's bucket was not closed by a poll are skipped, not written. A
+// `period` of 0 disables the stage.
+template <class Out>
+class Rollup {
+public:
+    Rollup(Out out, Timestamp period, StatePolicy states = {}, MemoryPolicy memory = {})
+        : out_(std::forward<Out>(out)), period_(period), policy_(states), states_(PageAllocator<State>(memory)) {}
+
+    bool process(SensorData &r) {
+        if (period_ <= 0) return true;
+        if (r.sensor >= states_.size()) [[unlikely]]
+            states_.resize(static_cast<std::size_t>(r.sensor) + 1);
+        State &s = states_[r.sensor];
+        const Timestamp start = bucket_start(r.timestamp);
+        if (!s.open) {
+            open(s, r.sensor, start, r.timestamp);
+        } else if (r.timestamp < s.held_since) {
+            // Late reading: counted, but it does not move the hold back
+        } else if (start != s.bucket.start) {
+            roll(s, start, r.timestamp);
+        } else {
+            s.held.credit(s.bucket.weighted, s.bucket.states, s.held_since, r.timestamp, policy_);
+            s.held_since = r.timestamp;
+        }
+        if (r.timestamp >= s.held_since) s.held.update(r.value, r.state, r.timestamp);
+        RollupBucket &b = s.bucket;
+        ++b.count;
+        b.sum += r.value;
+        b.min_value = std::min(b.min_value, r.value);
+        b.max_value = std::max(b.max_value, r.value);
+        return true;
+    }
+
+    // Closes the buckets of every period that ended by `now`; cheap between period boundaries.
+    void poll(Timestamp now) {
+        if (period_ <= 0 || now < next_boundary_) return;
+        const Timestamp start = bucket_start(now);
+        for (State &s : states_)
+            if (s.open && s.bucket.start < start) roll(s, start, start);
+        next_boundary_ = start + period_;
+        out_.flush();
+    }
+
+    void flush() { out_.flush(); }
+
+    // Writes out the partial bucket of every sensor, with values held until `now`.
+    void close(Timestamp now) {
+        const Timestamp start = period_ > 0 ? bucket_start(now) : 0;
+        for (State &s : states_) {
+            if (!s.open) continue;
+            if (s.bucket.start < start) roll(s, start, now);
+            else s.held.credit(s.bucket.weighted, s.bucket.states, s.held_since, now, policy_);
+            out_.write(s.bucket);
+            s.open = false;
+        }
+        out_.flush();
+    }
+
+    Timestamp period() const { return period_; }
+    Out &out() { return out_; }
+
+private:
+    struct State {
+        RollupBucket bucket;
+        Timestamp held_since = 0; // The held value has been credited up to here
+        HeldValue held;
+        bool open = false;
+    };
+
+    Timestamp bucket_start(Timestamp t) const {
+        const Timestamp q = t / period_;
+        return (t % period_ < 0 ? q - 1 : q) * period_;
+    }
+
+    void open(State &s, SensorHandle sensor, Timestamp start, Timestamp held_since) {
+        s.bucket = RollupBucket{};
+        s.bucket.sensor = sensor;
+        s.bucket.start = start;
+        s.bucket.period = period_;
+        s.held_since = held_since;
+        s.open = true;
+    }
+
+    // Closes the sensor's bucket, holding its value to the end of the period,
+    // and opens the bucket starting at `start` with the value held up to `t`.
+    void roll(State &s, Timestamp start, Timestamp t) {
+        const Timestamp end = s.bucket.start + period_;
+        s.held.credit(s.bucket.weighted, s.bucket.states, s.held_since, end, policy_);
+        out_.write(s.bucket);
+        const SensorHandle sensor = s.bucket.sensor;
+        open(s, sensor, start, start);
+        s.held.credit(s.bucket.weighted, s.bucket.states, start, t, policy_);
+        s.held_since = t;
+    }
+
+    Out out_;
+    Timestamp period_;
+    StatePolicy policy_;
+    Timestamp next_boundary_ = 0;
+    std::vector<State, PageAllocator<State>> states_;
+};
+
+// *** RollupCsvSink ***
+// Writes rollup buckets to a CSV file, one line per sensor and period:
+// SensorID, Start, Seconds, Count, Mean, Min, Max, TimeWeightedMean,
+// TimeWeightedStdDev, Integral, Covered (seconds with a value), Total and
+// the seconds InSpec, Low, High, Stale and Alarmed. Total is the integral in
+// the unit's time base (litres for l/min); with no catalog it is the integral.
+class RollupCsvSink {
+public:
+    static constexpr std::string_view header =
+        "SensorID,Start,Seconds,Count,Mean,Min,Max,TimeWeightedMean,TimeWeightedStdDev,Integral,Covered,Total,"
+        "InSpec,Low,High,Stale,Alarmed\n";
+
+    RollupCsvSink(SharedFile &file, const Registry &registry) : file_(&file), registry_(&registry) {}
+
+    // Takes each sensor's rate unit from `catalog` (e.g. a SensorCatalog) for the Total column.
+    template <class Catalog>
+        requires requires(const Catalog &c, SensorHandle h) {
+            { c.spec(h).unit } -> std::convertible_to<std::string_view>;
+        }
+    RollupCsvSink(SharedFile &file, const Registry &registry, const Catalog &catalog)
+        : file_(&file), registry_(&registry),
+          rate_seconds_([&catalog](SensorHandle h) { return rate_seconds(catalog.spec(h).unit); }) {}
+    RollupCsvSink(RollupCsvSink &&) = default;
+    ~RollupCsvSink() { flush(); }
+
+    void write(const RollupBucket &b) {
+        const auto id = registry_->sensor_name(b.sensor);
+        char *out = buffer_.reserve_tail(id.size() + 384);
+        char *p = out;
+        std::memcpy(p, id.data(), id.size()), p += id.size();
+        *p++ = ',';
+        p = timestamps_.format(p, b.start);
+        const bool empty = b.count == 0;
+        const StateDurations &t = b.states;
+        p += std::snprintf(p, 352, ",%g,%llu,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%g,%.6g,%g,%g,%g,%g,%g\n",
+                           static_cast<double>(b.period) / 1e9, static_cast<unsigned long long>(b.count), b.average(),
+                           empty ? 0.0 : b.min_value, empty ? 0.0 : b.max_value, b.weighted.average(),
+                           std::sqrt(b.weighted.variance()), b.weighted.integral, b.weighted.duration,
+                           b.weighted.total(rate_seconds_ ? rate_seconds_(b.sensor) : 0.0), t[SensorState::InSpec],
+                           t[SensorState::Low], t[SensorState::High], t[SensorState::Stale], t[SensorState::Alarmed]);
+        buffer_.commit(static_cast<std::size_t>(p - out));
+    }
+
+    void flush() {
+        if (buffer_.empty()) return;
+        file_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+private:
+    SharedFile *file_;
+    const Registry *registry_;
+    std::function<double(SensorHandle)> rate_seconds_;
+    ByteBuffer buffer_;
+    TimestampFormatter timestamps_;
+};
+
+} // namespace qms
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+#include "memory.hpp"
+#include "pipeline.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+// *** CriticalityTable ***
+// The criticality class of every sensor, indexed by handle. Sensors without an
+// entry are Normal.
+class CriticalityTable {
+public:
+    // Builds the table from the `criticality` directives of `config`.
+    static CriticalityTable from_config(const Config &config, Registry &registry) {
+        CriticalityTable table;
+        for (const auto &c : config.criticality) table.set(registry.sensor(c.sensor), c.level);
+        return table;
+    }
+
+    void set(SensorHandle sensor, Criticality level) {
+        if (sensor >= levels_.size()) levels_.resize(static_cast<std::size_t>(sensor) + 1, Criticality::Normal);
+        levels_[sensor] = level;
+    }
+
+    Criticality operator()(SensorHandle sensor) const {
+        return sensor < levels_.size() ? levels_[sensor] : Criticality::Normal;
+    }
+
+private:
+    std::vector<Criticality> levels_;
+};
+
+// *** RecordRing ***
+// A bounded FIFO of readings in a fixed power-of-two ring, so queuing never
+// allocates after construction. Large rings follow the MemoryPolicy.
+class RecordRing {
+public:
+    explicit RecordRing(std::size_t capacity, MemoryPolicy memory = {})
+        : slots_(std::bit_ceil(std::max<std::size_t>(capacity, 1)), SensorData{},
+                 PageAllocator<SensorData>(memory)),
+          mask_(slots_.size() - 1), capacity_(capacity) {}
+
+    // Appends `r`; returns false when the ring already holds `capacity` readings.
+    bool push(const SensorData &r) {
+        if (size() >= capacity_) return false;
+        slots_[tail_++ & mask_] = r;
+        return true;
+    }
+
+    SensorData &front() { return slots_[head_ & mask_]; }
+    // The reading `i` places behind the front; `i` must be below `size()`.
+    const SensorData &at(std::size_t i) const { return slots_[(head_ + i) & mask_]; }
+    void pop() { ++head_; }
+
+    std::size_t size() const { return static_cast<std::size_t>(tail_ - head_); }
+    bool empty() const { return head_ == tail_; }
+    std::size_t capacity() const { return capacity_; }
+
+private:
+    std::vector<SensorData, PageAllocator<SensorData>> slots_;
+    std::uint64_t head_ = 0;
+    std::uint64_t tail_ = 0;
+    std::size_t mask_;
+    std::size_t capacity_;
+};
+
+// *** SchedulerPolicy Structure ***
+// How a ClassScheduler shares the pipeline between criticality classes:
+// - `fair`: false serves classes by strict priority (a lower class only runs
+//   when every higher queue is empty); true uses weighted fair queuing, which
+//   gives each class a share of `weight` readings per round so lower classes
+//   are slowed down but never starved.
+// - `capacity`: Readings each class may queue; beyond that the class sheds
+//   its newest readings.
+// - `memory`: Placement of the queues.
+struct SchedulerPolicy {
+    bool fair = false;
+    std::array<std::size_t, criticality_classes> capacity = {4096, 4096, 4096};
+    std::array<unsigned, criticality_classes> weight = {16, 4, 1};
+    MemoryPolicy memory;
+
+    // Builds the policy from the `scheduling` directive of `config`.
+    static SchedulerPolicy from_config(const Config &config, MemoryPolicy memory = {}) {
+        SchedulerPolicy policy;
+        policy.fair = config.fair_scheduling;
+        policy.capacity.fill(config.queue_capacity);
+        policy.memory = memory;
+        return policy;
+    }
+};
+
+// *** ClassMetrics Structure ***
+// What happened to the readings of one criticality class:
+// - `dispatched`, `shed`: Readings passed on and readings dropped because the
+//   class queue was full.
+// - `depth`, `max_depth`: Readings queued now and at most.
+// - `max_wait`: Longest time from arrival to dispatch.
+struct ClassMetrics {
+    std::uint64_t dispatched = 0;
+    std::uint64_t shed = 0;
+    std::size_t depth = 0;
+    std::size_t max_depth = 0;
+    Timestamp max_wait = 0;
+};
+
+// *** ClassScheduler Stage ***
+// Queues readings by the criticality class of their sensor and passes them on
+// to `sink` in class order, so a burst from a cosmetic sensor cannot delay a
+// critical reading behind it: the critical reading waits at most for the
+// dispatch round in progress. Each class has its own bounded queue, so an
+// overloaded class sheds its own readings and never those of another class.
+//
+// `process` only queues. While dispatching, the sink is asked to prefetch the
+// state of the reading a few places ahead (see Prefetchable). A driver calls
+// `dispatch(now, budget)` to pass on up to `budget` readings between reads.
+// `poll(now)` passes on everything before polling the sink (as the Pipeline
+// does after each burst), and `flush()` before flushing it. `set_notify`
+// registers a callback run when a reading is queued while all queues were
+// empty, to wake the driver.
+//
+// Parameters:
+// - `sink`: The stage readings are dispatched to; may be a reference type.
+// - `classes`: Criticality of each sensor; must outlive the stage.
+// - `policy`: Strict priority or weighted fair queuing, and queue capacities.
+template <class Sink>
+class ClassScheduler {
+    using Inner = std::remove_reference_t<Sink>;
+
+public:
+    ClassScheduler(Sink sink, const CriticalityTable &classes, SchedulerPolicy policy = {})
+        : sink_(std::forward<Sink>(sink)), classes_(&classes), policy_(policy),
+          queues_{RecordRing(policy.capacity[0], policy.memory), RecordRing(policy.capacity[1], policy.memory),
+                  RecordRing(policy.capacity[2], policy.memory)} {}
+
+    bool process(SensorData &r) {
+        const auto c = static_cast<std::size_t>((*classes_)(r.sensor));
+        const bool was_idle = pending_ == 0;
+        ClassMetrics &m = metrics_[c];
+        if (!queues_[c].push(r)) {
+            ++m.shed;
+            return false;
+        }
+        ++pending_;
+        m.depth = queues_[c].size();
+        m.max_depth = std::max(m.max_depth, m.depth);
+        last_ = r.timestamp;
+        if (was_idle && notify_) notify_();
+        return true;
+    }
+
+    // *** Function: dispatch ***
+    // Passes up to `budget` queued readings to the sink in class order.
+    //
+    // Returns:
+    // - The number of readings dispatched.
+    std::size_t dispatch(Timestamp now, std::size_t budget) {
+        std::size_t done = 0;
+        if (!policy_.fair) {
+            for (std::size_t c = 0; c < criticality_classes; ++c)
+                while (done < budget && !queues_[c].empty()) deliver(c, now), ++done;
+            return done;
+        }
+        // Deficit round robin: each round a class may send `weight` readings;
+        // a class that runs dry forfeits the rest of its share
+        while (done < budget && pending_ > 0) {
+            for (std::size_t c = 0; c < criticality_classes && done < budget; ++c) {
+                if (queues_[c].empty()) {
+                    deficit_[c] = 0;
+                    continue;
+                }
+                if (deficit_[c] == 0) deficit_[c] = policy_.weight[c];
+                while (deficit_[c] > 0 && done < budget && !queues_[c].empty()) deliver(c, now), --deficit_[c], ++done;
+            }
+        }
+        return done;
+    }
+
+    // Dispatches everything and flushes the sink.
+    void flush() {
+        dispatch(last_, std::numeric_limits<std::size_t>::max());
+        if constexpr (Flushable<Inner>) sink_.flush();
+    }
+
+    // Dispatches everything and polls the sink.
+    void poll(Timestamp now) {
+        dispatch(now, std::numeric_limits<std::size_t>::max());
+        if constexpr (Pollable<Inner>) sink_.poll(now);
+    }
+
+    void set_notify(std::function<void()> notify) { notify_ = std::move(notify); }
+
+    bool empty() const { return pending_ == 0; }
+    std::size_t pending() const { return pending_; }
+    const ClassMetrics &metrics(Criticality c) const { return metrics_[static_cast<std::size_t>(c)]; }
+    const SchedulerPolicy &policy() const { return policy_; }
+    Inner &sink() { return sink_; }
+
+private:
+    void deliver(std::size_t c, Timestamp now) {
+        if constexpr (Prefetchable<Inner>)
+            if (queues_[c].size() > prefetch_distance) sink_.prefetch(queues_[c].at(prefetch_distance));
+        SensorData &r = queues_[c].front();
+        ClassMetrics &m = metrics_[c];
+        m.max_wait = std::max(m.max_wait, now - r.timestamp);
+        ++m.dispatched;
+        sink_.process(r);
+        queues_[c].pop();
+        m.depth = queues_[c].size();
+        --pending_;
+    }
+
+    // Readings ahead of the one dispatched whose sensor state is prefetched:
+    // far enough to hide a memory access, near enough to stay in cache
+    static constexpr std::size_t prefetch_distance = 8;
+
+    Sink sink_;
+    const CriticalityTable *classes_;
+    SchedulerPolicy policy_;
+    std::array<RecordRing, criticality_classes> queues_;
+    std::array<ClassMetrics, criticality_classes> metrics_{};
+    std::array<unsigned, criticality_classes> deficit_{};
+    std::size_t pending_ = 0;
+    Timestamp last_ = 0;
+    std::function<void()> notify_;
+};
+
+} // namespace qms
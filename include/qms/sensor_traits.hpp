@@ -0,0 +1,139 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace qms {
+
+// *** SensorSpec Structure ***
+// Describes one kind of sensor:
+// - `id`: The sensor ID the device sends (e.g., "TEMP").
+// - `unit`: Engineering unit of the value.
+// - `physical_min`, `physical_max`: Range the sensor can physically report;
+//   anything outside is a transmission or device fault and is rejected.
+// - `min_limit`, `max_limit`: Default quality limits; readings outside raise alerts.
+// - `precision`: Number of decimals used when the value is written out.
+struct SensorSpec {
+    std::string_view id;
+    std::string_view unit;
+    float physical_min;
+    float physical_max;
+    float min_limit;
+    float max_limit;
+    int precision;
+};
+
+// Seconds in the time base of a rate unit ("l/min" gives 60), for
+// totalizing; 0 when `unit` is not per second, minute or hour.
+inline constexpr double rate_seconds(std::string_view unit) {
+    if (unit.ends_with("/s")) return 1;
+    if (unit.ends_with("/min")) return 60;
+    if (unit.ends_with("/h")) return 3600;
+    return 0;
+}
+
+// *** Criticality ***
+// How much a sensor's readings matter when the pipeline is overloaded. Classes
+// are served in this order and lower classes shed load first:
+// - `Critical`: Safety-related readings (e.g. a pressure interlock).
+// - `Normal`: Process quality readings; the default.
+// - `Cosmetic`: Readings kept for trends only (e.g. a chatty vibration sensor).
+enum class Criticality : std::uint8_t { Critical, Normal, Cosmetic };
+
+inline constexpr std::size_t criticality_classes = 3;
+
+inline const char *to_string(Criticality c) {
+    switch (c) {
+    case Criticality::Critical: return "critical";
+    case Criticality::Normal: return "normal";
+    case Criticality::Cosmetic: return "cosmetic";
+    }
+    return "?";
+}
+
+inline bool parse_criticality(std::string_view s, Criticality &out) {
+    for (std::size_t i = 0; i < criticality_classes; ++i) {
+        if (s == to_string(static_cast<Criticality>(i))) {
+            out = static_cast<Criticality>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// *** SensorKind Concept ***
+// A sensor kind is a type whose static constexpr members describe a SensorSpec.
+// Code specialised on a kind sees its range, limits and precision as compile-
+// time constants, so checks and formatting are constant-folded.
+template <class K>
+concept SensorKind = requires {
+    { K::id } -> std::convertible_to<std::string_view>;
+    { K::unit } -> std::convertible_to<std::string_view>;
+    { K::physical_min } -> std::convertible_to<float>;
+    { K::physical_max } -> std::convertible_to<float>;
+    { K::min_limit } -> std::convertible_to<float>;
+    { K::max_limit } -> std::convertible_to<float>;
+    { K::precision } -> std::convertible_to<int>;
+} && (K::physical_min <= K::physical_max) && (K::precision >= 0 && K::precision <= 6);
+
+template <SensorKind K>
+constexpr SensorSpec spec_of() {
+    return {K::id, K::unit, K::physical_min, K::physical_max, K::min_limit, K::max_limit, K::precision};
+}
+
+// *** Built-in Sensor Kinds ***
+namespace kinds {
+
+struct Temp {
+    static constexpr std::string_view id = "TEMP";
+    static constexpr std::string_view unit = "degC";
+    static constexpr float physical_min = -50.0f, physical_max = 150.0f;
+    static constexpr float min_limit = 5.0f, max_limit = 25.0f;
+    static constexpr int precision = 2;
+};
+
+struct Ph {
+    static constexpr std::string_view id = "PH";
+    static constexpr std::string_view unit = "pH";
+    static constexpr float physical_min = 0.0f, physical_max = 14.0f;
+    static constexpr float min_limit = 6.5f, max_limit = 8.5f;
+    static constexpr int precision = 2;
+};
+
+struct Humidity {
+    static constexpr std::string_view id = "HUMIDITY";
+    static constexpr std::string_view unit = "%RH";
+    static constexpr float physical_min = 0.0f, physical_max = 100.0f;
+    static constexpr float min_limit = 30.0f, max_limit = 70.0f;
+    static constexpr int precision = 1;
+};
+
+struct Pressure {
+    static constexpr std::string_view id = "PRESSURE";
+    static constexpr std::string_view unit = "bar";
+    static constexpr float physical_min = 0.0f, physical_max = 400.0f;
+    static constexpr float min_limit = 1.0f, max_limit = 10.0f;
+    static constexpr int precision = 3;
+};
+
+struct Flow {
+    static constexpr std::string_view id = "FLOW";
+    static constexpr std::string_view unit = "l/min";
+    static constexpr float physical_min = 0.0f, physical_max = 1000.0f;
+    static constexpr float min_limit = 0.0f, max_limit = 800.0f;
+    static constexpr int precision = 1;
+};
+
+struct Vibration {
+    static constexpr std::string_view id = "VIBRATION";
+    static constexpr std::string_view unit = "mm/s";
+    static constexpr float physical_min = 0.0f, physical_max = 100.0f;
+    static constexpr float min_limit = 0.0f, max_limit = 7.1f;
+    static constexpr int precision = 2;
+};
+
+} // namespace kinds
+
+} // namespace qms
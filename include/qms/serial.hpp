@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#include "log.hpp"
+
+namespace qms {
+
+// *** SerialPort ***
+// Owning wrapper around an OS serial port handle (a Win32 HANDLE or a POSIX
+// file descriptor). Closed automatically when destroyed.
+class SerialPort {
+public:
+#if defined(_WIN32)
+    using native_handle_type = HANDLE;
+    static constexpr native_handle_type invalid_handle = INVALID_HANDLE_VALUE;
+#else
+    using native_handle_type = int;
+    static constexpr native_handle_type invalid_handle = -1;
+#endif
+
+    SerialPort() = default;
+    explicit SerialPort(native_handle_type h) : handle_(h) {}
+    SerialPort(SerialPort &&other) noexcept : handle_(std::exchange(other.handle_, invalid_handle)) {}
+    SerialPort &operator=(SerialPort &&other) noexcept {
+        if (this != &other) {
+            close();
+            handle_ = std::exchange(other.handle_, invalid_handle);
+        }
+        return *this;
+    }
+    SerialPort(const SerialPort &) = delete;
+    SerialPort &operator=(const SerialPort &) = delete;
+    ~SerialPort() { close(); }
+
+    bool is_open() const { return handle_ != invalid_handle; }
+    native_handle_type native_handle() const { return handle_; }
+
+    // *** Function: read ***
+    // Reads up to `size` bytes into `buffer`.
+    //
+    // Returns:
+    // - The number of bytes read (0 if the read timed out), or -1 on error.
+    long read(void *buffer, std::size_t size) {
+#if defined(_WIN32)
+        DWORD bytes_read = 0;
+        if (!ReadFile(handle_, buffer, static_cast<DWORD>(size), &bytes_read, NULL)) return -1;
+        return static_cast<long>(bytes_read);
+#else
+        const ssize_t n = ::read(handle_, buffer, size);
+        return n < 0 ? -1 : static_cast<long>(n);
+#endif
+    }
+
+    // *** Function: write ***
+    // Writes `size` bytes from `buffer`.
+    //
+    // Returns:
+    // - The number of bytes written, or -1 on error.
+    long write(const void *buffer, std::size_t size) {
+#if defined(_WIN32)
+        DWORD bytes_written = 0;
+        if (!WriteFile(handle_, buffer, static_cast<DWORD>(size), &bytes_written, NULL)) return -1;
+        return static_cast<long>(bytes_written);
+#else
+        const ssize_t n = ::write(handle_, buffer, size);
+        return n < 0 ? -1 : static_cast<long>(n);
+#endif
+    }
+
+    void close() {
+        if (!is_open()) return;
+#if defined(_WIN32)
+        CloseHandle(handle_);
+#else
+        ::close(handle_);
+#endif
+        handle_ = invalid_handle;
+    }
+
+private:
+    native_handle_type handle_ = invalid_handle;
+};
+
+#if !defined(_WIN32)
+namespace detail {
+
+inline speed_t to_speed(unsigned long baud_rate) {
+    switch (baud_rate) {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    default: return B9600;
+    }
+}
+
+} // namespace detail
+#endif
+
+// *** Function: setup_serial ***
+// This function opens and configures a serial port for communication.
+// Steps:
+// 1. Open the serial port.
+// 2. Retrieve the current configuration of the serial port.
+// 3. Set the baud rate, 8 data bits, one stop bit and no parity.
+// 4. Return the configured port.
+//
+// Parameters:
+// - `port_name`: The name of the serial port to configure (e.g., "COM3" or "/dev/ttyUSB0").
+// - `baud_rate`: The communication speed (e.g., 9600 bits per second).
+//
+// Returns:
+// - The configured port, or a closed SerialPort if an error occurs.
+inline SerialPort setup_serial(const char *port_name, unsigned long baud_rate) {
+#if defined(_WIN32)
+    SerialPort port(CreateFileA(port_name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL));
+    if (!port.is_open()) {
+        log(LogLevel::Error, "Unable to open serial port %s", port_name);
+        return port;
+    }
+
+    DCB dcbSerialParams = {0};
+    dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
+    if (!GetCommState(port.native_handle(), &dcbSerialParams)) {
+        log(LogLevel::Error, "Failed to get serial port state %s", port_name);
+        return SerialPort();
+    }
+
+    dcbSerialParams.BaudRate = static_cast<DWORD>(baud_rate); // Communication speed
+    dcbSerialParams.ByteSize = 8;                            // 8 data bits per byte
+    dcbSerialParams.StopBits = ONESTOPBIT;                   // Use one stop bit
+    dcbSerialParams.Parity = NOPARITY;                       // No parity check
+
+    if (!SetCommState(port.native_handle(), &dcbSerialParams)) {
+        log(LogLevel::Error, "Failed to set serial port state %s", port_name);
+        return SerialPort();
+    }
+    return port;
+#else
+    SerialPort port(::open(port_name, O_RDWR | O_NOCTTY | O_CLOEXEC));
+    if (!port.is_open()) {
+        log(LogLevel::Error, "Unable to open serial port %s", port_name);
+        return port;
+    }
+
+    termios tty{};
+    if (tcgetattr(port.native_handle(), &tty) != 0) {
+        log(LogLevel::Error, "Failed to get serial port state %s", port_name);
+        return SerialPort();
+    }
+
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, detail::to_speed(baud_rate)); // Communication speed
+    cfsetospeed(&tty, detail::to_speed(baud_rate));
+    tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;      // 8 data bits per byte
+    tty.c_cflag &= ~CSTOPB;                          // Use one stop bit
+    tty.c_cflag &= ~PARENB;                          // No parity check
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 1;                              // Block until at least one byte arrives
+    tty.c_cc[VTIME] = 0;
+
+    if (tcsetattr(port.native_handle(), TCSANOW, &tty) != 0) {
+        log(LogLevel::Error, "Failed to set serial port state %s", port_name);
+        return SerialPort();
+    }
+    return port;
+#endif
+}
+
+} // namespace qms
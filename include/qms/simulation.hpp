@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "catalog.hpp"
+#include "clock.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+// *** SplitMix64 ***
+// Small, fast deterministic random generator: the same seed always produces
+// the same traffic.
+class SplitMix64 {
+public:
+    explicit SplitMix64(std::uint64_t seed) : state_(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1).
+    double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+    // Approximately standard normal (Irwin-Hall with four terms).
+    double normal() { return (uniform() + uniform() + uniform() + uniform() - 2.0) * 1.7320508075688772; }
+
+private:
+    std::uint64_t state_;
+};
+
+// *** SimulatedSensor Structure ***
+// Behaviour of one synthetic sensor:
+// - `period`: Nominal interval between readings (jittered by +/-5%).
+// - `base`, `daily_amplitude`: Value follows base + amplitude * sin(time of day).
+// - `noise`: Standard deviation of the measurement noise.
+// - `excursion_probability`: Chance per reading that an excursion starts.
+// - `excursion_offset`, `excursion_length`: Shift applied during an excursion and its duration.
+// - `excursion_speedup`: The sensor reports this many times faster during an
+//   excursion, like change-triggered devices do.
+// - `saturate_low`, `saturate_high`: The output saturates at these bounds.
+struct SimulatedSensor {
+    SensorHandle sensor;
+    PortHandle port;
+    Timestamp period;
+    float base;
+    float daily_amplitude;
+    float noise;
+    double excursion_probability = 0.0;
+    float excursion_offset = 0.0f;
+    Timestamp excursion_length = 0;
+    int excursion_speedup = 1;
+    float saturate_low = -1e30f;
+    float saturate_high = 1e30f;
+};
+
+// *** SimulatedSource ***
+// A Source producing synthetic sensor traffic on a VirtualClock. Readings are
+// generated in timestamp order; before emitting each one the clock is moved to
+// its timestamp, so every stage downstream observes consistent virtual time.
+// Each `pump` emits up to `slice` of virtual time and the source ends at `end`.
+class SimulatedSource {
+public:
+    SimulatedSource(VirtualClock &clock, Timestamp end, std::uint64_t seed,
+                    Timestamp slice = 1'000'000'000)
+        : clock_(&clock), end_(end), slice_(slice), rng_(seed) {}
+
+    // Adds a sensor whose first reading is due within one period from now.
+    void add(const SimulatedSensor &sensor) {
+        const std::size_t i = sensors_.size();
+        sensors_.push_back({sensor, 0});
+        queue_.push({clock_->now() + static_cast<Timestamp>(rng_.uniform() * static_cast<double>(sensor.period)), i});
+    }
+
+    template <class Emit>
+    bool pump(Emit &&emit) {
+        if (queue_.empty() || queue_.top().first > end_) return false;
+        const Timestamp slice_end = queue_.top().first + slice_;
+        while (!queue_.empty() && queue_.top().first <= slice_end && queue_.top().first <= end_) {
+            const auto [t, i] = queue_.top();
+            queue_.pop();
+            clock_->advance_to(t);
+            State &s = sensors_[i];
+            SensorData r{.sensor = s.config.sensor, .port = s.config.port, .value = sample(s, t), .timestamp = t};
+            ++emitted_;
+            emit(r);
+            queue_.push({t + next_interval(s, t), i});
+        }
+        return true;
+    }
+
+    std::uint64_t emitted() const { return emitted_; }
+    std::size_t size() const { return sensors_.size(); }
+
+private:
+    struct State {
+        SimulatedSensor config;
+        Timestamp excursion_end;
+    };
+
+    float sample(State &s, Timestamp t) {
+        constexpr double day = 86400e9;
+        const double phase = std::fmod(static_cast<double>(t), day) / day * 6.283185307179586;
+        double v = s.config.base + s.config.daily_amplitude * std::sin(phase) + s.config.noise * rng_.normal();
+        if (t < s.excursion_end) {
+            v += s.config.excursion_offset;
+        } else if (s.config.excursion_probability > 0 && rng_.uniform() < s.config.excursion_probability) {
+            s.excursion_end = t + s.config.excursion_length;
+            v += s.config.excursion_offset;
+        }
+        return std::clamp(static_cast<float>(v), s.config.saturate_low, s.config.saturate_high);
+    }
+
+    Timestamp next_interval(const State &s, Timestamp t) {
+        double period = static_cast<double>(s.config.period) * (0.95 + 0.1 * rng_.uniform());
+        if (t < s.excursion_end) period /= s.config.excursion_speedup;
+        return static_cast<Timestamp>(period) + 1;
+    }
+
+    using Event = std::pair<Timestamp, std::size_t>;
+
+    VirtualClock *clock_;
+    Timestamp end_;
+    Timestamp slice_;
+    SplitMix64 rng_;
+    std::vector<State> sensors_;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue_;
+    std::uint64_t emitted_ = 0;
+};
+
+// *** Function: add_synthetic_plant ***
+// Populates `source` with `sensors` synthetic sensors spread round-robin over
+// `ports` ports named "SIM<n>". Each sensor is modelled on one of the
+// catalog's built-in kinds, named "<KIND>_<n>" and defined in `catalog` with
+// that kind's spec. Reporting periods are a mix of 100 ms, 1 s, 5 s and 10 s,
+// values follow a daily cycle inside the limits, and rare excursions push
+// them out of spec (about once per sensor every eight hours, for five
+// minutes) while the sensor reports ten times faster.
+template <class Catalog>
+void add_synthetic_plant(SimulatedSource &source, Catalog &catalog, std::size_t ports, std::size_t sensors,
+                         std::uint64_t seed) {
+    static constexpr Timestamp periods[] = {100'000'000, 1'000'000'000, 5'000'000'000, 10'000'000'000};
+    Registry &registry = catalog.registry();
+    SplitMix64 rng(seed ^ 0x5EED);
+    for (std::size_t i = 0; i < sensors; ++i) {
+        const SensorSpec &kind = Catalog::known_specs[i % Catalog::known_kinds];
+        char name[Registry::max_name_length + 1];
+        std::snprintf(name, sizeof(name), "%.*s_%zu", static_cast<int>(kind.id.size()), kind.id.data(), i);
+        SensorSpec spec = kind;
+        spec.id = name;
+        catalog.define(spec);
+
+        char port_name[32];
+        std::snprintf(port_name, sizeof(port_name), "SIM%zu", i % ports);
+        const float span = kind.max_limit - kind.min_limit;
+        SimulatedSensor s;
+        s.sensor = registry.sensor(name);
+        s.port = registry.port(port_name);
+        s.period = periods[rng.next() % 4];
+        s.base = kind.min_limit + span / 2;
+        s.daily_amplitude = span / 4;
+        s.noise = span / 40;
+        s.excursion_probability = static_cast<double>(s.period) / 28800e9; // About one every eight hours
+        s.excursion_offset = (rng.next() & 1 ? 1.0f : -1.0f) * span * 0.6f;
+        s.excursion_length = 300'000'000'000; // Five minutes
+        s.excursion_speedup = 10;
+        s.saturate_low = kind.physical_min;
+        s.saturate_high = kind.physical_max;
+        source.add(s);
+    }
+}
+
+} // namespace qms
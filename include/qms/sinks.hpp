@@ -0,0 +1,416 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "buffer.hpp"
+#include "format.hpp"
+#include "log.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+
+namespace qms {
+
+// *** SharedFile ***
+// An append-only output file shared by the sinks of several pipelines.
+// Each sink buffers locally and hands whole blocks to `write`, so the lock is
+// taken once per flush rather than once per reading. `header` is written when
+// the file is new or empty. A null `filename` gives a file that discards
+// everything, for optional outputs that are switched off.
+class SharedFile {
+public:
+    SharedFile(const char *filename, std::string_view header = {}) {
+        if (filename == nullptr) return;
+        file_ = std::fopen(filename, "ab");
+        if (file_ == nullptr) {
+            log(LogLevel::Error, "Unable to open file %s for logging.", filename);
+            return;
+        }
+        std::fseek(file_, 0, SEEK_END);
+        if (std::ftell(file_) == 0 && !header.empty()) std::fwrite(header.data(), 1, header.size(), file_);
+    }
+    SharedFile(const SharedFile &) = delete;
+    SharedFile &operator=(const SharedFile &) = delete;
+    ~SharedFile() {
+        if (file_) std::fclose(file_);
+    }
+
+    bool is_open() const { return file_ != nullptr; }
+
+    // Appends `size` bytes atomically with respect to other writers and pushes them to the OS.
+    void write(const void *data, std::size_t size) {
+        if (file_ == nullptr || size == 0) return;
+        std::lock_guard lock(mutex_);
+        std::fwrite(data, 1, size, file_);
+        std::fflush(file_);
+    }
+
+private:
+    std::FILE *file_ = nullptr;
+    std::mutex mutex_;
+};
+
+// Returns the production tag of a port's readings at a time (e.g. its lot,
+// see LotTracker), or nullptr for none. The pointer stays the same for as
+// long as the tag holds, so sinks only compare pointers to find where a run
+// starts.
+using TagSource = std::function<const std::string *(PortHandle, Timestamp)>;
+
+// *** TagRuns ***
+// Remembers the tag last written for each port, so a sink writes a tag only
+// where a port's run of readings with that tag starts.
+class TagRuns {
+public:
+    // Returns whether `tag` starts a new run for `port`, recording it.
+    bool starts_run(PortHandle port, const std::string *tag) {
+        if (port >= last_.size()) last_.resize(static_cast<std::size_t>(port) + 1, &unwritten());
+        if (last_[port] == tag) return false;
+        last_[port] = tag;
+        return true;
+    }
+
+private:
+    static const std::string &unwritten() {
+        static const std::string none;
+        return none;
+    }
+
+    std::vector<const std::string *> last_;
+};
+
+// *** FixedFormat ***
+// Value formatter for the text sinks that writes every value with the same
+// number of decimals ("%.2f" by default).
+template <int Precision = 2>
+struct FixedFormat {
+    char *operator()(char *out, SensorHandle, float value) const { return format_fixed<Precision>(out, value); }
+};
+
+// *** BasicCsvSink Stage ***
+// This sink logs sensor data to a CSV file. Each line in the file represents
+// a single sensor reading, formatted as:
+// Port Name, Sensor ID, Sensor Value, Timestamp
+//
+// `Format` writes the value (see FixedFormat and CatalogFormat). Lines are
+// collected in a local buffer and written to the SharedFile when the pipeline
+// flushes or the buffer exceeds `flush_bytes`.
+//
+// With a TagSource (`set_tags`), a fifth column holds the production tag as a
+// run-length column: it is written only on the first reading of a port's run
+// with that tag ("-" when the port has none) and left empty while it repeats.
+// Use `tagged_header` for such files.
+template <class Format = FixedFormat<>>
+class BasicCsvSink {
+public:
+    static constexpr std::string_view header = "Port,SensorID,Value,Timestamp\n";
+    static constexpr std::string_view tagged_header = "Port,SensorID,Value,Timestamp,Lot\n";
+
+    BasicCsvSink(SharedFile &file, const Registry &registry, Format format = {}, std::size_t flush_bytes = 64 * 1024)
+        : file_(&file), registry_(&registry), format_(std::move(format)), flush_bytes_(flush_bytes) {}
+    BasicCsvSink(BasicCsvSink &&) = default;
+    ~BasicCsvSink() { flush(); }
+
+    void set_tags(TagSource tags) { tags_ = std::move(tags); }
+
+    bool process(SensorData &r) {
+        const auto port = registry_->port_name(r.port);
+        const auto id = registry_->sensor_name(r.sensor);
+        const std::string *tag = nullptr;
+        bool run = false;
+        if (tags_) [[unlikely]] {
+            tag = tags_(r.port, r.timestamp);
+            run = runs_.starts_run(r.port, tag);
+        }
+        char *out = buffer_.reserve_tail(port.size() + id.size() + (tag ? tag->size() : 0) + 66);
+        char *p = out;
+        std::memcpy(p, port.data(), port.size()), p += port.size();
+        *p++ = ',';
+        std::memcpy(p, id.data(), id.size()), p += id.size();
+        *p++ = ',';
+        p = format_(p, r.sensor, r.value);
+        *p++ = ',';
+        p = timestamps_.format(p, r.timestamp);
+        if (tags_) [[unlikely]] {
+            *p++ = ',';
+            if (run && tag) std::memcpy(p, tag->data(), tag->size()), p += tag->size();
+            else if (run) *p++ = '-';
+        }
+        *p++ = '\n';
+        buffer_.commit(static_cast<std::size_t>(p - out));
+        if (buffer_.size() >= flush_bytes_) flush();
+        return true;
+    }
+
+    void flush() {
+        if (buffer_.empty()) return;
+        file_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+private:
+    SharedFile *file_;
+    const Registry *registry_;
+    Format format_;
+    std::size_t flush_bytes_;
+    ByteBuffer buffer_;
+    TimestampFormatter timestamps_;
+    TagSource tags_;
+    TagRuns runs_;
+};
+
+using CsvSink = BasicCsvSink<>;
+
+// *** JsonPrefixes ***
+// The start of the JSON object of each sensor's readings,
+// `{"port":"COM3","sensor":"TEMP","value":`, with both names escaped once and
+// kept in one arena, so a serialiser copies it per reading as one block.
+// A sensor's prefix names the port it was first seen on; readings from other
+// ports get theirs rendered into a scratch buffer each time. `padding` bytes
+// past every prefix are readable, so short ones can be copied at a fixed size.
+class JsonPrefixes {
+public:
+    static constexpr std::size_t padding = 64;
+
+    JsonPrefixes() : arena_(padding, '\0'), scratch_(padding, '\0') {}
+
+    // *** Function: get ***
+    // Returns the prefix of the readings of `sensor` on `port`, rendering it
+    // from the names in `registry` if needed. The view is valid until the
+    // next call.
+    std::string_view get(SensorHandle sensor, PortHandle port, const Registry &registry) {
+        if (sensor < entries_.size() && entries_[sensor].port == port) [[likely]] {
+            const Entry &e = entries_[sensor];
+            return std::string_view(arena_.data() + e.offset, e.size);
+        }
+        const std::string_view sensor_name = registry.sensor_name(sensor);
+        const std::string_view port_name = registry.port_name(port);
+        if (sensor < entries_.size() && entries_[sensor].port != no_port) // Seen on another port
+            return render(scratch_, 0, port_name, sensor_name);
+        if (sensor >= entries_.size()) entries_.resize(static_cast<std::size_t>(sensor) + 1, Entry{0, 0, no_port});
+        const std::size_t offset = arena_.size() - padding;
+        const std::string_view prefix = render(arena_, offset, port_name, sensor_name);
+        entries_[sensor] = {static_cast<std::uint32_t>(offset), static_cast<std::uint16_t>(prefix.size()), port};
+        return prefix;
+    }
+
+private:
+    struct Entry {
+        std::uint32_t offset;
+        std::uint16_t size;
+        PortHandle port; // no_port: not rendered yet
+    };
+
+    // Renders a prefix at `offset` of `out`, which keeps `padding` bytes after it.
+    static std::string_view render(std::string &out, std::size_t offset, std::string_view port,
+                                   std::string_view sensor) {
+        out.resize(offset + 30 + 6 * (port.size() + sensor.size()) + padding);
+        char *const start = out.data() + offset;
+        char *p = start;
+        std::memcpy(p, "{\"port\":", 8), p += 8;
+        p = format_json_string(p, port);
+        std::memcpy(p, ",\"sensor\":", 10), p += 10;
+        p = format_json_string(p, sensor);
+        std::memcpy(p, ",\"value\":", 9), p += 9;
+        const auto size = static_cast<std::size_t>(p - start);
+        out.resize(offset + size + padding);
+        return std::string_view(start, size);
+    }
+
+    std::string arena_; // Prefixes, then `padding` bytes
+    std::string scratch_;
+    std::vector<Entry> entries_;
+};
+
+// *** BasicJsonLinesSink Stage ***
+// This sink logs sensor data as JSON Lines, one object per reading:
+// {"port":"COM3","sensor":"TEMP","value":21.50,"timestamp":"2024-11-26 00:00:00"}
+//
+// The port and sensor members are escaped once per sensor and copied as one
+// block (see JsonPrefixes); `Format` writes the value
+// (see FixedFormat and CatalogFormat) and the TimestampFormatter the time,
+// straight into the local buffer, which is written to the SharedFile when the
+// pipeline flushes or it exceeds `flush_bytes`. Nothing is allocated per
+// reading once the names are known. Values that are not finite are written
+// as null. Readings for a file that is not open (an output that is switched
+// off) are not serialised at all.
+//
+// With a TagSource (`set_tags`), each object also has the production tag of
+// its port as "lot" (null when the port has none).
+template <class Format = FixedFormat<>>
+class BasicJsonLinesSink {
+public:
+    BasicJsonLinesSink(SharedFile &file, const Registry &registry, Format format = {},
+                       std::size_t flush_bytes = 64 * 1024)
+        : file_(&file), registry_(&registry), format_(std::move(format)), flush_bytes_(flush_bytes) {}
+    BasicJsonLinesSink(BasicJsonLinesSink &&) = default;
+    ~BasicJsonLinesSink() { flush(); }
+
+    void set_tags(TagSource tags) { tags_ = std::move(tags); }
+
+    bool process(SensorData &r) {
+        if (!file_->is_open()) return true;
+        const std::string_view prefix = prefixes_.get(r.sensor, r.port, *registry_);
+        std::string_view tag;
+        if (tags_) [[unlikely]]
+            tag = lot(r.port, r.timestamp);
+        char *out = buffer_.reserve_tail(std::max(prefix.size(), JsonPrefixes::padding) + tag.size() + 72);
+        char *p = out;
+        if (prefix.size() <= JsonPrefixes::padding) [[likely]]
+            std::memcpy(p, prefix.data(), JsonPrefixes::padding); // One fixed-size copy
+        else
+            std::memcpy(p, prefix.data(), prefix.size());
+        p += prefix.size();
+        if (std::isfinite(r.value)) [[likely]]
+            p = format_(p, r.sensor, r.value);
+        else
+            std::memcpy(p, "null", 4), p += 4;
+        std::memcpy(p, ",\"timestamp\":\"", 14), p += 14;
+        p = timestamps_.format(p, r.timestamp);
+        *p++ = '"';
+        std::memcpy(p, tag.data(), tag.size()), p += tag.size();
+        std::memcpy(p, "}\n", 2), p += 2;
+        buffer_.commit(static_cast<std::size_t>(p - out));
+        if (buffer_.size() >= flush_bytes_) flush();
+        return true;
+    }
+
+    void flush() {
+        if (buffer_.empty()) return;
+        file_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+private:
+    // The "lot" member of `port`'s readings at `t`, rendered again where its run starts.
+    std::string_view lot(PortHandle port, Timestamp t) {
+        const std::string *tag = tags_(port, t);
+        if (port >= lots_.size()) lots_.resize(static_cast<std::size_t>(port) + 1);
+        std::string &member = lots_[port];
+        if (runs_.starts_run(port, tag)) {
+            if (tag == nullptr) {
+                member = ",\"lot\":null";
+            } else {
+                member.resize(8 + 2 + 6 * tag->size());
+                std::memcpy(member.data(), ",\"lot\":", 7);
+                member.resize(static_cast<std::size_t>(format_json_string(member.data() + 7, *tag) - member.data()));
+            }
+        }
+        return member;
+    }
+
+    SharedFile *file_;
+    const Registry *registry_;
+    Format format_;
+    std::size_t flush_bytes_;
+    ByteBuffer buffer_;
+    TimestampFormatter timestamps_;
+    JsonPrefixes prefixes_;
+    TagSource tags_;
+    TagRuns runs_;
+    std::vector<std::string> lots_; // Rendered "lot" member per port
+};
+
+using JsonLinesSink = BasicJsonLinesSink<>;
+
+// *** BinaryLogSink Stage ***
+// This sink writes readings in a compact binary format, roughly a quarter of
+// the size of the CSV log and far cheaper to produce.
+//
+// File layout (little-endian):
+// - Header: the 8 bytes "QMSBLOG1".
+// - Name frame, emitted before a handle is first used:
+//   u8 'N', u8 kind (0 = sensor, 1 = port), u16 length, u32 handle, name bytes.
+// - Reading frame (20 bytes):
+//   u8 'R', u8 reserved, u16 port, u32 sensor, f32 value, i64 timestamp (ns since epoch).
+// - Tag frame, emitted with a TagSource (`set_tags`) where the production tag
+//   of a port changes; it applies to the port's following readings:
+//   u8 'T', u8 reserved, u16 port, u16 length (0: no tag), tag bytes.
+class BinaryLogSink {
+public:
+    static constexpr std::string_view header = "QMSBLOG1";
+    static constexpr std::size_t record_size = 20;
+
+    BinaryLogSink(SharedFile &file, const Registry &registry, std::size_t flush_bytes = 64 * 1024)
+        : file_(&file), registry_(&registry), flush_bytes_(flush_bytes) {}
+    BinaryLogSink(BinaryLogSink &&) = default;
+    ~BinaryLogSink() { flush(); }
+
+    void set_tags(TagSource tags) { tags_ = std::move(tags); }
+
+    bool process(SensorData &r) {
+        if (!mark(ports_, r.port)) define(1, r.port, registry_->port_name(r.port));
+        if (!mark(sensors_, r.sensor)) define(0, r.sensor, registry_->sensor_name(r.sensor));
+        if (tags_) [[unlikely]] {
+            const std::string *tag = tags_(r.port, r.timestamp);
+            if (runs_.starts_run(r.port, tag)) write_tag(r.port, tag ? std::string_view(*tag) : std::string_view());
+        }
+
+        char *p = buffer_.reserve_tail(record_size);
+        p[0] = 'R';
+        p[1] = 0;
+        std::memcpy(p + 2, &r.port, 2);
+        std::memcpy(p + 4, &r.sensor, 4);
+        std::memcpy(p + 8, &r.value, 4);
+        std::memcpy(p + 12, &r.timestamp, 8);
+        buffer_.commit(record_size);
+        if (buffer_.size() >= flush_bytes_) flush();
+        return true;
+    }
+
+    void flush() {
+        if (buffer_.empty()) return;
+        file_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+private:
+    // Returns whether `h` was already defined, marking it defined.
+    static bool mark(std::vector<bool> &known, std::size_t h) {
+        if (h >= known.size()) known.resize(h + 1, false);
+        if (known[h]) return true;
+        known[h] = true;
+        return false;
+    }
+
+    void write_tag(PortHandle port, std::string_view tag) {
+        const auto len = static_cast<std::uint16_t>(tag.size());
+        char *p = buffer_.reserve_tail(6 + tag.size());
+        p[0] = 'T';
+        p[1] = 0;
+        std::memcpy(p + 2, &port, 2);
+        std::memcpy(p + 4, &len, 2);
+        std::memcpy(p + 6, tag.data(), tag.size());
+        buffer_.commit(6 + tag.size());
+    }
+
+    void define(std::uint8_t kind, std::uint32_t handle, std::string_view name) {
+        const auto len = static_cast<std::uint16_t>(name.size());
+        char *p = buffer_.reserve_tail(8 + name.size());
+        p[0] = 'N';
+        p[1] = static_cast<char>(kind);
+        std::memcpy(p + 2, &len, 2);
+        std::memcpy(p + 4, &handle, 4);
+        std::memcpy(p + 8, name.data(), name.size());
+        buffer_.commit(8 + name.size());
+    }
+
+    SharedFile *file_;
+    const Registry *registry_;
+    std::size_t flush_bytes_;
+    ByteBuffer buffer_;
+    std::vector<bool> sensors_;
+    std::vector<bool> ports_;
+    TagSource tags_;
+    TagRuns runs_;
+};
+
+} // namespace qms
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string_view>
+#include <utility>
+
+#include "clock.hpp"
+#include "costs.hpp"
+#include "drift.hpp"
+#include "log.hpp"
+#include "parse.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "serial.hpp"
+
+namespace qms {
+
+// Handles an in-band control line ("@<command>") received on a port at a
+// time; returns false if it does not know the command.
+using ControlHandler = std::function<bool(PortHandle, std::string_view, Timestamp)>;
+
+// *** LineDecoder ***
+// Turns raw bytes from a port into SensorData readings: frames lines, parses
+// "<SensorID> <value>" and interns the sensor ID. Shared by every source that
+// carries the ASCII line protocol. Lines starting with '@' are control lines
+// from the line's controller (e.g. "@recipe B") and go to the ControlHandler.
+// Given a CostLedger, it accounts the parse of sampled lines to their sensor.
+//
+// Readings a device stamped with its own clock ("<SensorID> <value>
+// t=<seconds>") are timestamped on the gateway clock through the port's
+// DriftEstimator, so ports whose devices drift still interleave in the order
+// the readings were taken; unstamped readings get their arrival time. There
+// is one estimator per port rather than per device: the devices on a port are
+// taken to share a clock (one device, or a logger stamping for several), as
+// the line protocol does not say which device sent a reading.
+class LineDecoder {
+public:
+    LineDecoder(Registry &registry, PortHandle port) : registry_(&registry), port_(port) {}
+
+    void set_control(ControlHandler control) { control_ = std::move(control); }
+    void set_costs(CostLedger *costs) { costs_ = costs; }
+    // Whether device timestamps are corrected onto the gateway clock (default) or ignored.
+    void set_device_time(bool correct) { device_time_ = correct; }
+
+    // Decodes `size` bytes received at `now` and emits one reading per valid line.
+    template <class Emit>
+    void decode(const char *data, std::size_t size, Timestamp now, Emit &emit) {
+        const bool ok = framer_.feed(data, size, [&](std::string_view line) {
+            const std::uint64_t start = costs_ && costs_->sample() ? cycle_count() : 0;
+            std::string_view id;
+            std::int64_t device_time;
+            SensorData r;
+            if (line.front() == '@') [[unlikely]] {
+                if (!control_ || !control_(port_, line.substr(1), now))
+                    log(LogLevel::Error, "Unknown control line: %.*s", static_cast<int>(line.size()), line.data());
+            } else if (parse_reading(line, id, r.value, device_time) && id.size() <= Registry::max_name_length) {
+                r.sensor = registry_->sensor(id);
+                r.port = port_;
+                r.timestamp = device_time != no_device_time && device_time_ ? drift_.correct(device_time, now) : now;
+                if (start != 0) costs_->add(CostPhase::Parse, r.sensor, port_, cycle_count() - start);
+                emit(r);
+            } else {
+                log(LogLevel::Error, "Invalid data format: %.*s", static_cast<int>(line.size()), line.data());
+            }
+        });
+        if (!ok) log(LogLevel::Error, "Line too long on port %.*s", static_cast<int>(port_name().size()), port_name().data());
+    }
+
+    PortHandle port() const { return port_; }
+    std::string_view port_name() const { return registry_->port_name(port_); }
+    Registry &registry() const { return *registry_; }
+    const DriftEstimator &drift() const { return drift_; }
+
+    // Logs the estimated offset and drift of the device clock, if the port's
+    // readings carried device timestamps.
+    void log_device_clock() const {
+        if (drift_.samples() == 0) return;
+        log(LogLevel::Info, "Device clock on %.*s: offset %.6f s, drift %.2f ppm%s, %llu stamped readings, %u resets",
+            static_cast<int>(port_name().size()), port_name().data(), drift_.offset() / 1e9, drift_.drift_ppm(),
+            drift_.locked() ? "" : " (not yet locked)", static_cast<unsigned long long>(drift_.samples()),
+            drift_.restarts());
+    }
+
+private:
+    Registry *registry_;
+    PortHandle port_;
+    LineFramer<> framer_;
+    ControlHandler control_;
+    CostLedger *costs_ = nullptr;
+    DriftEstimator drift_;
+    bool device_time_ = true;
+};
+
+// *** SerialSource ***
+// Reads ASCII readings from a serial port. Each `pump` performs one blocking
+// read and then waits `poll_interval` before returning, matching the fixed
+// polling cadence of the original acquisition threads. Timestamps and the
+// wait come from `clock`.
+class SerialSource {
+public:
+    SerialSource(SerialPort port, Registry &registry, std::string_view port_name,
+                 std::chrono::milliseconds poll_interval = std::chrono::milliseconds(0), Clock &clock = system_clock())
+        : port_(std::move(port)), decoder_(registry, registry.port(port_name)), poll_interval_(poll_interval),
+          clock_(&clock) {}
+
+    template <class Emit>
+    bool pump(Emit &&emit) {
+        char buffer[256];
+        const long n = port_.read(buffer, sizeof(buffer));
+        if (n < 0) {
+            log(LogLevel::Error, "Failed to read from port %.*s", static_cast<int>(decoder_.port_name().size()),
+                decoder_.port_name().data());
+            return false;
+        }
+        decoder_.decode(buffer, static_cast<std::size_t>(n), clock_->now(), emit);
+        if (poll_interval_.count() > 0) clock_->sleep_for(poll_interval_);
+        return true;
+    }
+
+    PortHandle port() const { return decoder_.port(); }
+    void set_control(ControlHandler control) { decoder_.set_control(std::move(control)); }
+    void set_costs(CostLedger *costs) { decoder_.set_costs(costs); }
+    void set_device_time(bool correct) { decoder_.set_device_time(correct); }
+    const LineDecoder &decoder() const { return decoder_; }
+
+private:
+    SerialPort port_;
+    LineDecoder decoder_;
+    std::chrono::milliseconds poll_interval_;
+    Clock *clock_;
+};
+
+// *** StreamSource ***
+// Reads ASCII readings from a stdio stream (a replay file, a pipe or stdin),
+// attributing them to the given port name. Ends at end-of-file.
+class StreamSource {
+public:
+    StreamSource(std::FILE *stream, Registry &registry, std::string_view port_name, Clock &clock = system_clock())
+        : stream_(stream), decoder_(registry, registry.port(port_name)), clock_(&clock) {}
+
+    template <class Emit>
+    bool pump(Emit &&emit) {
+        char buffer[4096];
+        const std::size_t n = std::fread(buffer, 1, sizeof(buffer), stream_);
+        if (n == 0) {
+            decoder_.decode("\n", 1, clock_->now(), emit); // Terminate a final unterminated line
+            return false;
+        }
+        decoder_.decode(buffer, n, clock_->now(), emit);
+        return true;
+    }
+
+    PortHandle port() const { return decoder_.port(); }
+    void set_control(ControlHandler control) { decoder_.set_control(std::move(control)); }
+    void set_costs(CostLedger *costs) { decoder_.set_costs(costs); }
+    void set_device_time(bool correct) { decoder_.set_device_time(correct); }
+    const LineDecoder &decoder() const { return decoder_; }
+
+private:
+    std::FILE *stream_;
+    LineDecoder decoder_;
+    Clock *clock_;
+};
+
+} // namespace qms
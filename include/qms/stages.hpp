@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "alert.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "recipes.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "state_table.hpp"
+
+namespace qms {
+
+// *** Validate Stage ***
+// This stage checks that a reading is physically plausible and drops it
+// otherwise. The sensor value must be within a reasonable range
+// (0 to 1000 by default).
+class Validate {
+public:
+    explicit Validate(float min_value = 0.0f, float max_value = 1000.0f) : min_(min_value), max_(max_value) {}
+
+    bool process(SensorData &r) const {
+        if (!(r.value >= min_ && r.value <= max_)) { // Ensure the value is within realistic limits (rejects NaN)
+            log(LogLevel::Error, "Sensor value out of realistic range: %.2f", r.value);
+            return false;
+        }
+        return true; // Data is valid
+    }
+
+private:
+    float min_;
+    float max_;
+};
+
+// *** ConsoleEcho Stage ***
+// Prints every reading that reaches it, in the form
+// "[COM3] Sensor: TEMP, Value: 22.50".
+class ConsoleEcho {
+public:
+    explicit ConsoleEcho(const Registry &registry) : registry_(registry) {}
+
+    bool process(SensorData &r) const {
+        const auto port = registry_.port_name(r.port);
+        const auto id = registry_.sensor_name(r.sensor);
+        log(LogLevel::Info, "[%.*s] Sensor: %.*s, Value: %.2f", static_cast<int>(port.size()), port.data(),
+            static_cast<int>(id.size()), id.data(), r.value);
+        return true;
+    }
+
+private:
+    const Registry &registry_;
+};
+
+// *** QualityMonitor Stage ***
+// This stage monitors sensor data to ensure it stays within defined limits.
+// It keeps each sensor's statistics in a SensorTable (indexed by sensor
+// handle), updates the total, min, max, time-weighted statistics and time in
+// each quality state on every reading in O(1), marks the reading InSpec, Low
+// or High and raises an alert on the AlertPath when a value is out of range.
+// With a RecipeBook, the recipe the reading's line ran at the reading's
+// timestamp overrides the sensor's own limits. Drivers holding a queue of
+// readings call `prefetch` for a reading a few places ahead of the one they
+// process. With a compact table, `poll` evicts idle sensors a bounded batch
+// at a time.
+class QualityMonitor {
+public:
+    // Parameters:
+    // - `alerts`: Where out-of-range alerts are raised.
+    // - `defaults`: Limits given to sensors seen for the first time.
+    // - `memory`: Pages backing the per-sensor table (huge pages, NUMA node).
+    // - `states`: When held values turn Stale and excursions Alarmed.
+    // - `table`: Dense or compact per-sensor table (see SensorTablePolicy).
+    explicit QualityMonitor(const AlertPath &alerts, SensorStats defaults = {}, MemoryPolicy memory = {},
+                            StatePolicy states = {}, SensorTablePolicy table = {})
+        : alerts_(alerts), defaults_(defaults), states_(states), table_(memory, table) {}
+
+    // Seeds each sensor's limits from `catalog` (e.g. a SensorCatalog) instead of one default.
+    template <class Catalog>
+        requires requires(const Catalog &c, SensorHandle h) {
+            { c.default_stats(h) } -> std::convertible_to<SensorStats>;
+        }
+    QualityMonitor(const AlertPath &alerts, const Catalog &catalog, MemoryPolicy memory = {}, StatePolicy states = {},
+                   SensorTablePolicy table = {})
+        : alerts_(alerts), seed_([&catalog](SensorHandle h) { return catalog.default_stats(h); }), states_(states),
+          table_(memory, table) {}
+
+    bool process(SensorData &r) {
+        reserve(r.sensor);
+        SensorHot &s = table_.hot(r.sensor);
+        const SensorCold &c = table_.cold(r.sensor);
+        Limits limits{c.min_limit, c.max_limit};
+        if (recipes_)
+            if (const Limits *l = recipes_->limits(r.port, r.sensor, r.timestamp)) limits = *l;
+        r.state = r.value < limits.min_limit   ? SensorState::Low
+                  : r.value > limits.max_limit ? SensorState::High
+                                               : SensorState::InSpec;
+        s.hold(r.value, r.state, r.timestamp, states_);   // Credit the previous value with its time
+        s.total_value += r.value;                         // Add to total value for averaging
+        s.count++;                                        // Increment the count of readings
+        if (r.value > s.max_value) s.max_value = r.value; // Update max value
+        if (r.value < s.min_value) s.min_value = r.value; // Update min value
+
+        // Check if the value is out of defined limits
+        if (r.state != SensorState::InSpec)
+            alerts_.raise(
+                {AlertKind::OutOfRange, r.sensor, r.port, r.value, limits.min_limit, limits.max_limit, r.timestamp});
+        return true;
+    }
+
+    // Starts loading the state of the sensor of `r`, which is processed soon.
+    void prefetch(const SensorData &r) { table_.prefetch(r.sensor); }
+
+    // Evicts the sensors of a compact table that have been idle too long.
+    void poll(Timestamp now) { table_.evict_idle(now, eviction_sweep); }
+
+    // Returns the statistics for `sensor`, creating them with the default limits if needed.
+    SensorStats stats(SensorHandle sensor) {
+        reserve(sensor);
+        return table_.get(sensor);
+    }
+
+    // Takes limits from the active recipes of `recipes` (nullptr: the sensors' own limits only).
+    void set_recipes(const RecipeBook *recipes) { recipes_ = recipes; }
+
+    void set_limits(SensorHandle sensor, float min_limit, float max_limit) {
+        reserve(sensor);
+        SensorCold &c = table_.cold(sensor);
+        c.min_limit = min_limit;
+        c.max_limit = max_limit;
+    }
+
+    // The statistics of `sensor` with its latest value held until `now`.
+    SensorStats snapshot(SensorHandle sensor, Timestamp now) { return stats(sensor).snapshot(now, states_); }
+
+    const StatePolicy &state_policy() const { return states_; }
+
+    // Number of sensor slots currently tracked (some may not have seen a reading yet).
+    std::size_t size() const { return table_.size(); }
+
+    const SensorTable &table() const { return table_; }
+
+private:
+    // Hot records a compact table examines for eviction per poll
+    static constexpr std::size_t eviction_sweep = 4096;
+
+    // Makes room for `sensor`, seeding the new slots with their default limits.
+    void reserve(SensorHandle sensor) {
+        if (sensor < table_.size()) [[likely]] return;
+        const std::size_t first = table_.size();
+        table_.resize(static_cast<std::size_t>(sensor) + 1, SensorCold::of(defaults_));
+        if (seed_)
+            for (std::size_t h = first; h < table_.size(); ++h)
+                table_.cold(static_cast<SensorHandle>(h)) = SensorCold::of(seed_(static_cast<SensorHandle>(h)));
+    }
+
+    const AlertPath &alerts_;
+    SensorStats defaults_;
+    std::function<SensorStats(SensorHandle)> seed_;
+    StatePolicy states_;
+    const RecipeBook *recipes_ = nullptr;
+    SensorTable table_;
+};
+
+} // namespace qms
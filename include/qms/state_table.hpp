@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+#include "detail/chunked_array.hpp"
+#include "memory.hpp"
+#include "record.hpp"
+
+namespace qms {
+
+inline constexpr std::size_t cache_line_size = 64;
+
+// Hints the processor to fetch the cache line holding `p` ahead of a write.
+inline void prefetch_for_write(const void *p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 1, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char *>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+// Hints the processor to fetch the cache line holding `p` ahead of a read.
+inline void prefetch_for_read(const void *p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char *>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+// *** SensorHot Structure ***
+// The part of a sensor's statistics (see SensorStats) that every reading
+// writes: the held value and its quality state, the counters and the
+// time-weighted accumulators. It is aligned so that it fills exactly two
+// cache lines and never shares one with another sensor.
+struct alignas(cache_line_size) SensorHot {
+    HeldValue held;                                            // Latest reading and its state
+    std::uint64_t count = 0;                                   // Number of recorded values
+    double total_value = 0.0;                                  // Total value for averaging
+    float max_value = -std::numeric_limits<float>::infinity(); // Maximum recorded value
+    float min_value = std::numeric_limits<float>::infinity();  // Minimum recorded value
+    TimeWeighted weighted;                                     // Time-weighted statistics of the held values
+    StateDurations states;                                     // Time in each quality state
+
+    // As SensorStats::hold.
+    void hold(float value, SensorState state, Timestamp t, const StatePolicy &policy) {
+        held.hold(value, state, t, weighted, states, policy);
+    }
+};
+
+static_assert(sizeof(SensorHot) == 2 * cache_line_size, "SensorHot should fill two cache lines");
+
+// *** SensorCold Structure ***
+// The part of a sensor's statistics that readings only read: its limits and
+// the time base of its unit. Four sensors share a cache line.
+struct SensorCold {
+    float min_limit = 5.0f;  // Minimum acceptable limit
+    float max_limit = 25.0f; // Maximum acceptable limit
+    double rate_seconds = 0; // Time base of the unit, for the totalizer
+
+    static SensorCold of(const SensorStats &s) { return {s.min_limit, s.max_limit, s.rate_seconds}; }
+};
+
+// *** SensorDigest Structure ***
+// The hot statistics of an idle sensor, quantized to single precision to fit
+// in 72 bytes. Restoring a sensor from its digest keeps its count, extremes,
+// held value and the time of its last reading exactly; the means, variance,
+// seconds in each state and the start of an excursion keep about seven
+// significant digits.
+struct SensorDigest {
+    Timestamp read_at;
+    std::uint64_t count;
+    float average, min_value, max_value;
+    float weighted_mean, weighted_variance, weighted_seconds;
+    float state_seconds[sensor_states];
+    float held_value;
+    float excursion_seconds; // From the start of the excursion to `read_at`
+    SensorState held_state;
+    bool held_valid;
+
+    static SensorDigest of(const SensorHot &h) {
+        SensorDigest d{};
+        d.read_at = h.held.read_at;
+        d.count = h.count;
+        d.average = h.count ? static_cast<float>(h.total_value / static_cast<double>(h.count)) : 0.0f;
+        d.min_value = h.min_value;
+        d.max_value = h.max_value;
+        d.weighted_mean = static_cast<float>(h.weighted.mean);
+        d.weighted_variance = static_cast<float>(h.weighted.variance());
+        d.weighted_seconds = static_cast<float>(h.weighted.duration);
+        for (std::size_t i = 0; i < sensor_states; ++i) d.state_seconds[i] = static_cast<float>(h.states.seconds[i]);
+        d.held_value = h.held.value;
+        d.excursion_seconds = static_cast<float>(static_cast<double>(h.held.read_at - h.held.excursion_since) / 1e9);
+        d.held_state = h.held.state;
+        d.held_valid = h.held.valid;
+        return d;
+    }
+
+    SensorHot restore() const {
+        SensorHot h;
+        h.held.value = held_value;
+        h.held.state = held_state;
+        h.held.valid = held_valid;
+        h.held.read_at = read_at;
+        h.held.excursion_since = read_at - static_cast<Timestamp>(static_cast<double>(excursion_seconds) * 1e9);
+        h.count = count;
+        h.total_value = static_cast<double>(average) * static_cast<double>(count);
+        h.min_value = min_value;
+        h.max_value = max_value;
+        h.weighted.duration = weighted_seconds;
+        h.weighted.mean = weighted_mean;
+        h.weighted.m2 = static_cast<double>(weighted_variance) * weighted_seconds;
+        h.weighted.integral = h.weighted.mean * h.weighted.duration;
+        for (std::size_t i = 0; i < sensor_states; ++i) h.states.seconds[i] = state_seconds[i];
+        return h;
+    }
+};
+
+static_assert(sizeof(SensorDigest) <= 72, "SensorDigest should stay compact");
+
+// *** SensorTablePolicy Structure ***
+// How a SensorTable holds its sensors:
+// - `compact`: false gives every sensor a hot record from the moment it is
+//   known (fastest with few sensors, all of them reporting). true allocates
+//   hot records only for sensors that report and moves those idle for
+//   `evict_after` to a store of SensorDigests, for collectors with up to
+//   millions of sensors of which only some are active at a time.
+// - `evict_after`: Idle time after which a compact table evicts a sensor.
+struct SensorTablePolicy {
+    bool compact = false;
+    Timestamp evict_after = 600'000'000'000;
+};
+
+// *** SensorTable ***
+// Per-sensor statistics indexed by sensor handle, split into a hot and a cold
+// array so that a pass over many sensors pulls in only the lines it writes,
+// plus the compact limits. `prefetch` starts loading a sensor's lines before
+// its reading is processed; callers with a queue of readings issue it a few
+// readings ahead.
+//
+// All arrays are chunked (see ChunkedArray) and backed by pages of `memory`,
+// so the table grows one chunk at a time without copying. In compact mode
+// (see SensorTablePolicy) each sensor has a 4-byte slot instead of its own hot
+// record: the index of a record in a pool of hot records, the index of its
+// digest once evicted, or nothing before it first reports. `evict_idle`
+// sweeps the pool incrementally, a bounded number of records per call.
+class SensorTable {
+public:
+    explicit SensorTable(MemoryPolicy memory = {}, SensorTablePolicy policy = {})
+        : policy_(policy), hot_(memory), cold_(memory), slots_(memory), owners_(memory), digests_(memory) {
+        staged_.fill(no_sensor);
+    }
+
+    // Grows the table to `n` sensors with limits `fill`.
+    void resize(std::size_t n, const SensorCold &fill) {
+        cold_.resize(n, fill);
+        if (policy_.compact) slots_.resize(n, no_slot);
+        else hot_.resize(n, SensorHot{});
+    }
+
+    // The hot record of `sensor` for a reading to update. A compact table
+    // allocates it, or restores it from the sensor's digest, if needed.
+    SensorHot &hot(SensorHandle sensor) {
+        if (!policy_.compact) return hot_[sensor];
+        std::uint32_t &slot = slots_[sensor];
+        if (slot & evicted) [[unlikely]] slot = activate(sensor, slot);
+        return hot_[slot];
+    }
+
+    SensorCold &cold(SensorHandle sensor) { return cold_[sensor]; }
+    const SensorCold &cold(SensorHandle sensor) const { return cold_[sensor]; }
+
+    // The statistics of `sensor` as one SensorStats.
+    SensorStats get(SensorHandle sensor) const {
+        SensorHot h;
+        if (!policy_.compact) h = hot_[sensor];
+        else if (const std::uint32_t slot = slots_[sensor]; !(slot & evicted)) h = hot_[slot];
+        else if (slot != no_slot) h = digests_[slot & ~evicted].restore();
+        const SensorCold &c = cold_[sensor];
+        SensorStats s;
+        s.min_limit = c.min_limit;
+        s.max_limit = c.max_limit;
+        s.rate_seconds = c.rate_seconds;
+        s.total_value = h.total_value;
+        s.max_value = h.max_value;
+        s.min_value = h.min_value;
+        s.count = h.count;
+        s.weighted = h.weighted;
+        s.states = h.states;
+        s.held = h.held;
+        return s;
+    }
+
+    // Starts loading the lines of `sensor`, if it is in the table. A compact
+    // table loads the sensor's slot first and its hot record when asked to
+    // prefetch a later sensor, by which time the slot is in cache.
+    void prefetch(SensorHandle sensor) {
+        if (sensor >= cold_.size()) return;
+        prefetch_for_read(&cold_[sensor]);
+        if (!policy_.compact) return prefetch_hot(sensor);
+        prefetch_for_read(&slots_[sensor]);
+        const SensorHandle ready = std::exchange(staged_[staged_next_], sensor);
+        staged_next_ = (staged_next_ + 1) % staged_.size();
+        if (ready < slots_.size())
+            if (const std::uint32_t slot = slots_[ready]; !(slot & evicted)) prefetch_hot(slot);
+    }
+
+    // *** Function: evict_idle ***
+    // In compact mode, moves the sensors that have not reported since
+    // `now - evict_after` into digests. The hot records are swept
+    // incrementally, going on from where the previous call stopped, at a pace
+    // that covers them all once a quarter of `evict_after`, and at most
+    // `budget` of them per call.
+    //
+    // Returns:
+    // - The number of sensors evicted.
+    std::size_t evict_idle(Timestamp now, std::size_t budget) {
+        if (!policy_.compact || hot_.size() == 0) return 0;
+        if (swept_at_ == 0 || now <= swept_at_) {
+            swept_at_ = std::max(swept_at_, now);
+            return 0;
+        }
+        const double period = static_cast<double>(policy_.evict_after) / 4;
+        const double due = static_cast<double>(hot_.size()) * static_cast<double>(now - swept_at_) / period;
+        if (due < 1) return 0; // Let the time add up
+        swept_at_ = now;
+        const Timestamp idle_since = now - policy_.evict_after;
+        std::size_t evicted_now = 0;
+        for (auto n = std::min({static_cast<std::size_t>(due), budget, hot_.size()}); n > 0; --n) {
+            if (sweep_ >= hot_.size()) sweep_ = 0;
+            const auto slot = static_cast<std::uint32_t>(sweep_++);
+            const SensorHandle owner = owners_[slot];
+            if (owner == no_sensor || hot_[slot].held.read_at >= idle_since) continue;
+            if (free_digests_.empty() && digests_.size() > max_digest) break; // The digest store is full
+            slots_[owner] = evicted | store(SensorDigest::of(hot_[slot]));
+            owners_[slot] = no_sensor;
+            free_hot_.push_back(slot);
+            ++evicted_now;
+        }
+        return evicted_now;
+    }
+
+    const SensorTablePolicy &policy() const { return policy_; }
+
+    std::size_t size() const { return cold_.size(); }
+    // Sensors with a hot record: all of them in a dense table.
+    std::size_t active() const { return policy_.compact ? hot_.size() - free_hot_.size() : hot_.size(); }
+    // Sensors held as digests.
+    std::size_t evicted_count() const { return digests_.size() - free_digests_.size(); }
+
+    // Bytes allocated for the table.
+    std::size_t memory() const {
+        return hot_.capacity_bytes() + cold_.capacity_bytes() + slots_.capacity_bytes() + owners_.capacity_bytes() +
+               digests_.capacity_bytes() + (free_hot_.capacity() + free_digests_.capacity()) * sizeof(std::uint32_t);
+    }
+
+private:
+    static constexpr std::uint32_t evicted = 0x80000000;  // Slot holds a digest index
+    static constexpr std::uint32_t no_slot = 0xFFFFFFFF; // Sensor has not reported yet
+    // Highest digest index, so that `evicted | index` never reads as no_slot. Hot
+    // record indices stay far below it: 2^31 records would take 256 GiB.
+    static constexpr std::uint32_t max_digest = 0x7FFFFFFE;
+
+    void prefetch_hot(std::uint32_t record) const {
+        const SensorHot *h = &hot_[record];
+        prefetch_for_write(h);
+        prefetch_for_write(reinterpret_cast<const char *>(h) + cache_line_size);
+    }
+
+    // Keeps `digest` in a free entry of the digest store and returns its index.
+    std::uint32_t store(const SensorDigest &digest) {
+        if (free_digests_.empty()) return static_cast<std::uint32_t>(digests_.push_back(digest));
+        const std::uint32_t i = free_digests_.back();
+        free_digests_.pop_back();
+        digests_[i] = digest;
+        return i;
+    }
+
+    // Gives `sensor`, whose slot is `slot`, a hot record, restored from its digest if it has one.
+    std::uint32_t activate(SensorHandle sensor, std::uint32_t slot) {
+        SensorHot h;
+        if (slot != no_slot) {
+            h = digests_[slot & ~evicted].restore();
+            free_digests_.push_back(slot & ~evicted);
+        }
+        std::uint32_t record;
+        if (free_hot_.empty()) {
+            record = static_cast<std::uint32_t>(hot_.push_back(h));
+            owners_.push_back(sensor);
+        } else {
+            record = free_hot_.back();
+            free_hot_.pop_back();
+            hot_[record] = h;
+            owners_[record] = sensor;
+        }
+        return record;
+    }
+
+    SensorTablePolicy policy_;
+    detail::ChunkedArray<SensorHot> hot_;        // By sensor; in compact mode, by slot
+    detail::ChunkedArray<SensorCold> cold_;      // By sensor
+    detail::ChunkedArray<std::uint32_t> slots_;  // Compact mode: by sensor
+    detail::ChunkedArray<SensorHandle> owners_;  // Compact mode: sensor of each hot record
+    detail::ChunkedArray<SensorDigest> digests_; // Compact mode: evicted sensors
+    std::vector<std::uint32_t> free_hot_;
+    std::vector<std::uint32_t> free_digests_;
+    std::array<SensorHandle, 4> staged_; // Compact mode: sensors whose slots are being prefetched
+    std::size_t staged_next_ = 0;
+    std::size_t sweep_ = 0;   // Next hot record to examine
+    Timestamp swept_at_ = 0; // Time of the last sweep
+};
+
+} // namespace qms
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "alert.hpp"
+#include "detail/chunked_array.hpp"
+#include "memory.hpp"
+#include "record.hpp"
+
+namespace qms {
+
+// *** RateSpec Structure ***
+// The rate sensor `sensor` is configured to report at: one reading every
+// `period`, give or take `tolerance` (a fraction of the rate).
+struct RateSpec {
+    SensorHandle sensor;
+    Timestamp period;
+    double tolerance = 0.2;
+};
+
+// *** ArrivalStats Structure ***
+// Incremental statistics of the intervals between the arrivals of one
+// sensor's (or port's) readings:
+// - `last`, `count`: The last arrival and the number of intervals seen.
+// - `mean`, `variance`: Of the interval in nanoseconds; exact (Welford) for
+//   the first `memory` intervals, then exponentially weighted over about as
+//   many, so a device that changes its rate is followed.
+// - `jitter`: Histogram of how far each interval was from the expected one
+//   (the configured period, or else the mean so far), two bins per octave
+//   from 4 us to 69 s; the last bin also holds anything longer. When a bin
+//   fills up, all are halved, so old intervals fade out and the memory stays
+//   fixed.
+struct ArrivalStats {
+    static constexpr std::size_t bins = 48;
+    static constexpr int first_octave = 12; // Bin 0 holds jitter below 2^12 ns
+    static constexpr std::uint32_t memory = 256;
+
+    Timestamp last = 0;
+    std::uint32_t count = 0;
+    float mean = 0.0f;
+    float variance = 0.0f;
+    bool deviating = false;    // The rate is out of its tolerance (see ArrivalTiming)
+    PortHandle port = no_port; // Of a sensor's last reading
+    std::array<std::uint16_t, bins> jitter{};
+
+    // Records an arrival at `t`; `period` is the expected interval, or 0 to expect the mean.
+    void add(Timestamp t, Timestamp period) {
+        const Timestamp interval = t - last;
+        const bool first = last == 0;
+        last = t;
+        if (first || interval < 0) return; // Out-of-order arrivals carry no interval
+        const auto x = static_cast<float>(interval);
+        if (period > 0 || count > 0) {
+            const float expected = period > 0 ? static_cast<float>(period) : mean;
+            record_jitter(static_cast<std::uint64_t>(std::fabs(x - expected)));
+        }
+        if (count < memory) ++count;
+        const float a = 1.0f / static_cast<float>(std::min(count, memory));
+        const float d = x - mean;
+        mean += a * d;
+        variance = (1.0f - a) * (variance + a * d * d);
+    }
+
+    // Readings per second.
+    double rate() const { return mean > 0 ? 1e9 / mean : 0.0; }
+
+    // Burstiness (sd - mean) / (sd + mean) of the intervals: -1 for a
+    // strictly periodic device, 0 for random (Poisson) arrivals, towards 1
+    // for bursts separated by long gaps.
+    double burstiness() const {
+        const double sd = std::sqrt(variance);
+        return sd + mean > 0 ? (sd - mean) / (sd + mean) : 0.0;
+    }
+
+    // The jitter, in nanoseconds, that a share `q` of the recorded intervals
+    // did not exceed (the upper edge of its bin).
+    double jitter_quantile(double q) const {
+        std::uint64_t total = 0;
+        for (const std::uint16_t n : jitter) total += n;
+        if (total == 0) return 0.0;
+        const double target = q * static_cast<double>(total);
+        std::uint64_t seen = 0;
+        for (std::size_t b = 0; b < bins; ++b) {
+            seen += jitter[b];
+            if (static_cast<double>(seen) >= target) return bin_upper(b);
+        }
+        return bin_upper(bins - 1);
+    }
+
+private:
+    static std::size_t bin_of(std::uint64_t j) {
+        if (j < (std::uint64_t{1} << first_octave)) return 0;
+        const int octave = std::bit_width(j) - 1;
+        const std::size_t half = (j >> (octave - 1)) & 1;
+        return std::min<std::size_t>(1 + static_cast<std::size_t>(octave - first_octave) * 2 + half, bins - 1);
+    }
+
+    static double bin_upper(std::size_t b) {
+        if (b == 0) return std::ldexp(1.0, first_octave);
+        const int octave = first_octave + static_cast<int>((b - 1) / 2);
+        return std::ldexp((b - 1) % 2 ? 2.0 : 1.5, octave);
+    }
+
+    void record_jitter(std::uint64_t j) {
+        std::uint16_t &n = jitter[bin_of(j)];
+        if (n == UINT16_MAX) [[unlikely]]
+            for (std::uint16_t &m : jitter) m >>= 1;
+        ++n;
+    }
+};
+
+// *** ArrivalTiming Stage ***
+// Tracks how each sensor and each port actually reports: its mean rate, the
+// percentiles of its inter-arrival jitter and its burstiness (see
+// ArrivalStats), from the arrival timestamps of its readings. These are the
+// numbers to size queues and batches from, and they tell a device whose clock
+// drifts or that stalls apart from a process that changed.
+//
+// Sensors with a RateSpec are checked against it once they have reported
+// `min_intervals` times: a Rate alert is raised when the measured rate leaves
+// its tolerance, and again only after it has come back. A sensor that falls
+// silent sends nothing to measure, so `poll(now)` also raises one when a
+// sensor that has reported has been quiet for `silent_periods` of its period;
+// the alert's value is the rate the silence amounts to.
+//
+// Put it before any stage that queues or reorders readings, so it sees them
+// in arrival order. The timestamps it measures are those of the readings:
+// arrival times, or for devices that stamp their readings, the device time
+// mapped onto the gateway clock (see DriftEstimator), so the statistics
+// describe a device's own cadence rather than the transport's.
+//
+// Parameters:
+// - `alerts`: Where rate deviations are raised.
+// - `specs`: The configured rates; must outlive the stage.
+// - `memory`: Where the per-sensor table gets its pages.
+class ArrivalTiming {
+public:
+    static constexpr std::uint32_t min_intervals = 32;
+    static constexpr Timestamp silent_periods = 4;
+
+    ArrivalTiming(const AlertPath &alerts, const std::vector<RateSpec> &specs, MemoryPolicy memory = {})
+        : alerts_(&alerts), specs_(&specs), sensors_(memory) {
+        for (std::size_t i = 0; i < specs.size(); ++i) {
+            const SensorHandle s = specs[i].sensor;
+            if (s >= by_sensor_.size()) by_sensor_.resize(static_cast<std::size_t>(s) + 1, none);
+            by_sensor_[s] = i;
+        }
+    }
+
+    bool process(SensorData &r) {
+        if (r.sensor >= sensors_.size()) [[unlikely]]
+            sensors_.resize(static_cast<std::size_t>(r.sensor) + 1, ArrivalStats{});
+        if (r.port >= ports_.size()) [[unlikely]]
+            ports_.resize(static_cast<std::size_t>(r.port) + 1);
+        ports_[r.port].add(r.timestamp, 0);
+        const RateSpec *spec = r.sensor < by_sensor_.size() && by_sensor_[r.sensor] != none
+                                   ? &(*specs_)[by_sensor_[r.sensor]]
+                                   : nullptr;
+        ArrivalStats &s = sensors_[r.sensor];
+        s.add(r.timestamp, spec ? spec->period : 0);
+        s.port = r.port;
+        if (spec && s.count >= min_intervals) check(r, *spec, s);
+        return true;
+    }
+
+    // Raises a Rate alert for every sensor with a RateSpec that has been
+    // silent for `silent_periods` of its period at `now`.
+    void poll(Timestamp now) {
+        for (const RateSpec &spec : *specs_) {
+            if (spec.sensor >= sensors_.size()) continue;
+            ArrivalStats &s = sensors_[spec.sensor];
+            if (s.last == 0 || s.deviating || now - s.last <= silent_periods * spec.period) continue;
+            s.deviating = true;
+            const double expected = 1e9 / static_cast<double>(spec.period);
+            alerts_->raise({AlertKind::Rate, spec.sensor, s.port, static_cast<float>(1e9 / (now - s.last)),
+                            static_cast<float>(expected * (1 - spec.tolerance)),
+                            static_cast<float>(expected * (1 + spec.tolerance)), now});
+        }
+    }
+
+    // The statistics of `sensor`, or nullptr if it has not reported.
+    const ArrivalStats *sensor(SensorHandle sensor) const {
+        return sensor < sensors_.size() && sensors_[sensor].last != 0 ? &sensors_[sensor] : nullptr;
+    }
+    const ArrivalStats *port(PortHandle port) const {
+        return port < ports_.size() && ports_[port].last != 0 ? &ports_[port] : nullptr;
+    }
+
+    // The configured rate of `sensor`, or nullptr.
+    const RateSpec *spec(SensorHandle sensor) const {
+        return sensor < by_sensor_.size() && by_sensor_[sensor] != none ? &(*specs_)[by_sensor_[sensor]] : nullptr;
+    }
+
+    std::size_t sensors() const { return sensors_.size(); }
+    std::size_t ports() const { return ports_.size(); }
+
+private:
+    static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+    void check(const SensorData &r, const RateSpec &spec, ArrivalStats &s) {
+        const double expected = 1e9 / static_cast<double>(spec.period);
+        const double low = expected * (1 - spec.tolerance);
+        const double high = expected * (1 + spec.tolerance);
+        const double rate = s.rate();
+        const bool deviating = rate < low || rate > high;
+        if (deviating && !s.deviating)
+            alerts_->raise({AlertKind::Rate, r.sensor, r.port, static_cast<float>(rate), static_cast<float>(low),
+                            static_cast<float>(high), r.timestamp});
+        s.deviating = deviating;
+    }
+
+    const AlertPath *alerts_;
+    const std::vector<RateSpec> *specs_;
+    std::vector<std::size_t> by_sensor_; // Spec index by sensor handle
+    detail::ChunkedArray<ArrivalStats> sensors_;
+    std::vector<ArrivalStats> ports_;
+};
+
+} // namespace qms
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "alert.hpp"
+#include "clock.hpp"
+#include "log.hpp"
+#include "pipeline.hpp"
+#include "record.hpp"
+
+namespace qms {
+
+// *** Heartbeat ***
+// Progress published by one pipeline thread or port for the Watchdog. Updates
+// are relaxed stores without clock reads, cheap enough for every reading:
+// - `enter(stage)` / `leave()` bracket work that may block, such as a CSV
+//   write. `stage` must point to a string with static storage.
+// - `count()` counts a reading that made it through.
+// - `set_queue_depth` publishes how many readings wait in buffers.
+// Only the owning thread updates a heartbeat; the watchdog only reads it.
+class Heartbeat {
+public:
+    Heartbeat(std::string name, PortHandle port) : name_(std::move(name)), port_(port) {}
+
+    void enter(const char *stage) {
+        stage_.store(stage, std::memory_order_relaxed);
+        bump();
+    }
+    void leave() {
+        stage_.store(nullptr, std::memory_order_relaxed);
+        bump();
+    }
+    void count() { readings_.store(readings_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+    void set_queue_depth(std::size_t n) { queue_depth_.store(n, std::memory_order_relaxed); }
+
+    const std::string &name() const { return name_; }
+    PortHandle port() const { return port_; }
+    const char *stage() const { return stage_.load(std::memory_order_relaxed); }
+    std::uint64_t sequence() const { return sequence_.load(std::memory_order_acquire); }
+    std::uint64_t readings() const { return readings_.load(std::memory_order_relaxed); }
+    std::size_t queue_depth() const { return queue_depth_.load(std::memory_order_relaxed); }
+
+private:
+    void bump() { sequence_.store(sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    std::string name_;
+    PortHandle port_;
+    std::atomic<const char *> stage_{nullptr};
+    std::atomic<std::uint64_t> sequence_{0};
+    std::atomic<std::uint64_t> readings_{0};
+    std::atomic<std::size_t> queue_depth_{0};
+};
+
+// *** Watchdog ***
+// Watches the heartbeats of all pipeline threads and ports and raises a Stall
+// system alarm through the AlertPath when
+// - a thread has been inside the same stage for `stall_after`, e.g. a CSV
+//   write blocked on a full disk, or
+// - a port has delivered no reading for `silent_after` (0 disables this), e.g.
+//   a port read that never returns.
+// The alarm carries a state summary of every heartbeat: its current stage,
+// readings and queue depth. Each stall is reported once and logged again when
+// it clears. Alarms are raised with no lock held, so alert handlers may call
+// back into the watchdog (e.g. `summary`).
+//
+// `check(now)` may be driven by the caller (e.g. a simulation); `start` runs it
+// on a background thread every quarter of the stall threshold.
+class Watchdog {
+public:
+    Watchdog(const AlertPath &alerts, Timestamp stall_after, Timestamp silent_after = 0, Clock &clock = system_clock())
+        : alerts_(&alerts), stall_after_(stall_after), silent_after_(silent_after), clock_(&clock) {}
+    Watchdog(const Watchdog &) = delete;
+    Watchdog &operator=(const Watchdog &) = delete;
+    ~Watchdog() { stop(); }
+
+    // Registers a heartbeat. `port` is the port it belongs to, or `no_port` for
+    // a pipeline thread; only port heartbeats are checked for silence.
+    Heartbeat &heartbeat(std::string name, PortHandle port = no_port) {
+        std::lock_guard lock(mutex_);
+        Heartbeat &hb = heartbeats_.emplace_back(std::move(name), port);
+        watched_.push_back({&hb, hb.sequence(), hb.readings(), clock_->now(), clock_->now(), false, false});
+        return hb;
+    }
+
+    // *** Function: check ***
+    // Compares every heartbeat with the previous check at `now`.
+    //
+    // Returns:
+    // - The number of heartbeats currently stalled or silent.
+    std::size_t check(Timestamp now) {
+        std::vector<Report> reports; // Raised after unlocking
+        std::size_t stalled = 0;
+        std::unique_lock lock(mutex_);
+        for (Watched &w : watched_) {
+            const std::uint64_t seq = w.hb->sequence();
+            const std::uint64_t readings = w.hb->readings();
+            const char *stage = w.hb->stage();
+            if (seq != w.sequence) w.sequence = seq, w.changed_at = now;
+            if (readings != w.readings) w.readings = readings, w.progressed_at = now;
+
+            const bool stuck = stage != nullptr && now - w.changed_at >= stall_after_;
+            const bool silent = silent_after_ > 0 && w.hb->port() != no_port && now - w.progressed_at >= silent_after_;
+            if (stuck && !w.stuck) reports.push_back(report(w, now, now - w.changed_at, stall_after_, stage));
+            if (silent && !w.silent) reports.push_back(report(w, now, now - w.progressed_at, silent_after_, nullptr));
+            if (!stuck && w.stuck) log(LogLevel::Info, "Stall cleared: %s is making progress", w.hb->name().c_str());
+            if (!silent && w.silent) log(LogLevel::Info, "Stall cleared: %s is receiving data", w.hb->name().c_str());
+            w.stuck = stuck;
+            w.silent = silent;
+            stalled += stuck || silent;
+        }
+        lock.unlock();
+        for (Report &r : reports) {
+            r.alert.detail = r.detail.c_str();
+            alerts_->raise(r.alert);
+        }
+        return stalled;
+    }
+
+    // Starts checking on a background thread (real time only).
+    void start() {
+        if (thread_.joinable()) return;
+        stopping_ = false;
+        thread_ = std::thread([this] {
+            const auto period = std::chrono::nanoseconds(std::max<Timestamp>(stall_after_ / 4, 1'000'000));
+            std::unique_lock lock(stop_mutex_);
+            while (!stop_cv_.wait_for(lock, period, [this] { return stopping_; })) check(clock_->now());
+        });
+    }
+
+    void stop() {
+        {
+            std::lock_guard lock(stop_mutex_);
+            stopping_ = true;
+        }
+        stop_cv_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    // Appends the state of every heartbeat to `out` as one line of text.
+    void summary(std::string &out) const {
+        std::lock_guard lock(mutex_);
+        summarize(out);
+    }
+
+private:
+    struct Watched {
+        Heartbeat *hb;
+        std::uint64_t sequence;
+        std::uint64_t readings;
+        Timestamp changed_at;
+        Timestamp progressed_at;
+        bool stuck;
+        bool silent;
+    };
+
+    // A Stall alert and the text its `detail` points to.
+    struct Report {
+        Alert alert;
+        std::string detail;
+    };
+
+    void summarize(std::string &out) const {
+        char buffer[160];
+        const char *separator = "";
+        for (const Heartbeat &hb : heartbeats_) {
+            const char *stage = hb.stage();
+            std::snprintf(buffer, sizeof(buffer), "%s%s [%s] readings=%llu queue=%zu", separator,
+                          hb.name().c_str(), stage ? stage : "idle", static_cast<unsigned long long>(hb.readings()),
+                          hb.queue_depth());
+            out += buffer;
+            separator = "; ";
+        }
+    }
+
+    Report report(const Watched &w, Timestamp now, Timestamp stalled_for, Timestamp threshold, const char *stage) {
+        char head[192];
+        if (stage)
+            std::snprintf(head, sizeof(head), "%s stuck in '%s' for %.1f s", w.hb->name().c_str(), stage,
+                          static_cast<double>(stalled_for) / 1e9);
+        else
+            std::snprintf(head, sizeof(head), "no data from %s for %.1f s", w.hb->name().c_str(),
+                          static_cast<double>(stalled_for) / 1e9);
+        std::string detail = head;
+        detail += " | ";
+        summarize(detail);
+        return {{AlertKind::Stall, no_sensor, w.hb->port(), static_cast<float>(stalled_for / 1e9), 0.0f,
+                 static_cast<float>(threshold / 1e9), now},
+                std::move(detail)};
+    }
+
+    const AlertPath *alerts_;
+    Timestamp stall_after_;
+    Timestamp silent_after_;
+    Clock *clock_;
+    mutable std::mutex mutex_;
+    std::deque<Heartbeat> heartbeats_;
+    std::vector<Watched> watched_;
+
+    std::thread thread_;
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+};
+
+// *** Monitored Stage ***
+// Publishes the progress of a stage on a Heartbeat. Given a `stage` name, the
+// wrapped calls are bracketed by enter/leave so a stall names the stage that
+// hangs; without one the wrapper counts the readings passing through. Stages
+// with a `pending()` count (e.g. Batched) publish it as the queue depth.
+template <class S>
+class Monitored {
+    using Inner = std::remove_reference_t<S>;
+
+public:
+    Monitored(S stage, Heartbeat &heartbeat, const char *name = nullptr)
+        : stage_(std::forward<S>(stage)), heartbeat_(&heartbeat), name_(name) {}
+
+    bool process(SensorData &r) {
+        if (name_) heartbeat_->enter(name_);
+        const bool keep = stage_.process(r);
+        if (name_) heartbeat_->leave();
+        else heartbeat_->count();
+        if constexpr (requires(const Inner &s) { s.pending(); }) heartbeat_->set_queue_depth(stage_.pending());
+        return keep;
+    }
+
+    void flush()
+        requires Flushable<Inner>
+    {
+        if (name_) heartbeat_->enter(name_);
+        stage_.flush();
+        if (name_) heartbeat_->leave();
+    }
+
+    void poll(Timestamp now)
+        requires Pollable<Inner>
+    {
+        if (name_) heartbeat_->enter(name_);
+        stage_.poll(now);
+        if (name_) heartbeat_->leave();
+    }
+
+    Inner &stage() { return stage_; }
+
+private:
+    S stage_;
+    Heartbeat *heartbeat_;
+    const char *name_;
+};
+
+} // namespace qms
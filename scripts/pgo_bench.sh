@@ -0,0 +1,29 @@
+#!/bin/sh
+# *** pgo_bench.sh ***
+# Compares the monitor of a plain release build with the profile-guided one
+# on the flood workload of qms_ptyload. Runs alternate between the builds so
+# that machine noise affects both alike; compare the best `cpu per line`.
+#
+# Usage: scripts/pgo_bench.sh [plain-build-dir] [pgo-build-dir] [runs] [lines]
+set -eu
+
+src=$(cd "$(dirname "$0")/.." && pwd)
+plain=${1:-$src/_plain_build}
+pgo=${2:-$src/_pgo_build}
+runs=${3:-5}
+lines=${4:-1000000}
+
+if [ ! -x "$plain/QualityMonitoring" ]; then
+    cmake -S "$src" -B "$plain" -DCMAKE_BUILD_TYPE=Release -DQMS_LTO=OFF -DQMS_PGO=OFF
+    cmake --build "$plain" -j"$(nproc)"
+fi
+[ -x "$pgo/QualityMonitoring" ] || "$src/scripts/pgo_build.sh" "$pgo"
+
+i=1
+while [ "$i" -le "$runs" ]; do
+    for build in "$plain" "$pgo"; do
+        echo "== $(basename "$build") run $i"
+        "$pgo/qms_ptyload" --ports 32 --lines "$lines" -- "$build/QualityMonitoring" | grep -E "wall|cpu|throughput"
+    done
+    i=$((i + 1))
+done
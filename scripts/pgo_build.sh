@@ -0,0 +1,33 @@
+#!/bin/sh
+# *** pgo_build.sh ***
+# Profile-guided release build of the monitor:
+# 1. Build an instrumented monitor (QMS_PGO=GENERATE).
+# 2. Train it with the paced pseudo-terminal workload of qms_ptyload: many
+#    ports at mixed rates with alert bursts and malformed lines.
+# 3. Rebuild in the same build directory with the profile and link-time
+#    optimization (QMS_PGO=USE). Reusing the directory keeps object paths, and
+#    so profile names, identical between the phases.
+#
+# Usage: scripts/pgo_build.sh [build-dir] [training seconds]
+set -eu
+
+src=$(cd "$(dirname "$0")/.." && pwd)
+build=${1:-$src/_pgo_build}
+seconds=${2:-20}
+profiles=$build/pgo-profiles
+
+rm -rf "$profiles"
+cmake -S "$src" -B "$build" -DCMAKE_BUILD_TYPE=Release -DQMS_LTO=ON -DQMS_PGO=GENERATE -DQMS_PGO_DIR="$profiles"
+cmake --build "$build" -j"$(nproc)"
+
+echo "Training for $seconds s..."
+"$build/qms_ptyload" --ports 32 --seconds "$seconds" --rate 4 -- "$build/QualityMonitoring"
+
+# Clang writes raw profiles that have to be merged first
+if ls "$profiles"/*.profraw >/dev/null 2>&1; then
+    llvm-profdata merge -output="$profiles/default.profdata" "$profiles"/*.profraw
+fi
+
+cmake -S "$src" -B "$build" -DQMS_PGO=USE
+cmake --build "$build" -j"$(nproc)"
+echo "Profile-guided monitor: $build/QualityMonitoring"
@@ -0,0 +1,100 @@
+// Seasonal baselines across restarts: LocalWeekClock's time of week and the
+// BaselineStore save, load and take round trip.
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "qms/baseline.hpp"
+
+namespace {
+
+constexpr qms::Timestamp s = 1'000'000'000;
+
+#if !defined(_WIN32)
+void set_time_zone(const char *tz) {
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+void week_clock() {
+    set_time_zone("UTC0");
+    qms::LocalWeekClock utc;
+    CHECK(utc.seconds_of_week(4 * qms::LocalWeekClock::day * s) == 0); // Monday 1970-01-05
+    CHECK(utc.seconds_of_week(1704112496 * s) == 12 * 3600 + 34 * 60 + 56); // Monday 2024-01-01 12:34:56
+    CHECK(utc.seconds_of_week((1704112496 + 7 * qms::LocalWeekClock::day) * s) == 12 * 3600 + 34 * 60 + 56);
+
+    set_time_zone("CET-1CEST,M3.5.0,M10.5.0/3"); // Central Europe, summer time from March to October
+    qms::LocalWeekClock cet;
+    CHECK(cet.seconds_of_week(1719784800 * s) == 0);                 // Monday 2024-07-01 00:00 CEST
+    CHECK(cet.seconds_of_week(1704067200 * s) == 3600);              // Monday 2024-01-01 01:00 CET
+    CHECK(cet.seconds_of_week(1719784800 * s - 1) == 7 * 86400 - 1); // The Sunday night before
+    set_time_zone("UTC0");
+}
+#endif
+
+void store_round_trip() {
+    const char *file = "qms_baseline_test.csv";
+    std::remove(file);
+    qms::BaselineSpec spec{0};
+    spec.bucket = 6 * 3600 * s; // Four buckets a day
+    std::vector<qms::BaselineBucket> buckets(spec.buckets());
+    for (int i = 0; i < 50; ++i) buckets[3].add(20.0f + static_cast<float>(i % 5), spec.memory);
+    buckets[0].add(5.0f, spec.memory);
+
+    qms::BaselineStore saved(file);
+    saved.put("P1", "TEMP", spec, buckets);
+    CHECK(saved.save());
+
+    qms::BaselineStore loaded(file);
+    loaded.load();
+    const std::vector<qms::BaselineBucket> taken = loaded.take("P1", "TEMP", spec);
+    CHECK(taken.size() == 4);
+    CHECK(taken[3].count == 50);
+    CHECK_NEAR(taken[3].mean, buckets[3].mean, 1e-4);
+    CHECK_NEAR(taken[3].spread(), buckets[3].spread(), 1e-4);
+    CHECK(taken[0].count == 1 && taken[0].mean == 5.0f);
+    CHECK(taken[1].count == 0);
+    CHECK(loaded.take("P2", "TEMP", spec)[3].count == 0); // Another port learns afresh
+
+    qms::BaselineSpec hourly = spec;
+    hourly.bucket = 3600 * s;
+    CHECK(loaded.take("P1", "TEMP", hourly)[3].count == 0); // Different buckets: learned afresh
+    std::remove(file);
+}
+
+void load_rejects_buckets_past_the_cycle() {
+    const char *file = "qms_baseline_test.csv";
+    std::FILE *f = std::fopen(file, "w");
+    std::fputs("Port,SensorID,CycleSeconds,BucketSeconds,Bucket,Count,Mean,StdDev\n", f);
+    std::fputs("P1,TEMP,86400,21600,3,7,21,1\n", f);
+    std::fputs("P1,TEMP,86400,21600,4,9,99,1\n", f); // One past the last bucket
+    std::fclose(f);
+    qms::BaselineSpec spec{0};
+    spec.bucket = 6 * 3600 * s;
+    qms::BaselineStore store(file);
+    store.load();
+    const std::vector<qms::BaselineBucket> taken = store.take("P1", "TEMP", spec);
+    CHECK(taken.size() == 4 && taken[3].count == 7);
+    CHECK(store.save());
+    f = std::fopen(file, "r");
+    int lines = 0;
+    for (char line[128]; std::fgets(line, sizeof(line), f);) ++lines;
+    std::fclose(f);
+    CHECK(lines == 2); // The header and bucket 3
+    std::remove(file);
+}
+
+} // namespace
+
+int main() {
+#if !defined(_WIN32)
+    week_clock();
+#endif
+    store_round_trip();
+    load_rejects_buckets_past_the_cycle();
+    return qms_test::result();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// *** Test Checks ***
+// The tests are plain executables run by ctest: CHECK reports a failed
+// condition with its location and the test exits nonzero at the end.
+
+namespace qms_test {
+
+inline int failures = 0;
+
+inline void fail(const char *file, int line, const char *what) {
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    ++failures;
+}
+
+inline int result() {
+    if (failures == 0) return EXIT_SUCCESS;
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return EXIT_FAILURE;
+}
+
+} // namespace qms_test
+
+#define CHECK(condition)                                                                                               \
+    do {                                                                                                               \
+        if (!(condition)) qms_test::fail(__FILE__, __LINE__, #condition);                                              \
+    } while (false)
+
+#define CHECK_NEAR(a, b, tolerance) CHECK(((a) > (b) ? (a) - (b) : (b) - (a)) <= (tolerance))
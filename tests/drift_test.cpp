@@ -0,0 +1,89 @@
+// DriftEstimator on a synthetic device clock with a known offset and skew,
+// seen through a jittery transport.
+
+#include <cmath>
+#include <cstdint>
+
+#include "check.hpp"
+#include "qms/drift.hpp"
+#include "qms/simulation.hpp"
+
+namespace {
+
+constexpr qms::Timestamp ms = 1'000'000;
+constexpr qms::Timestamp min_delay = 2 * ms;
+
+// A device whose clock started `offset` ahead and runs `skew` fast, reporting
+// every 100 ms. Each reading takes 2 ms plus an exponential 5 ms to arrive,
+// and 1% are held up for half a second.
+struct Device {
+    qms::Timestamp offset;
+    double skew;
+    qms::SplitMix64 rng{7};
+
+    qms::Timestamp device_time(qms::Timestamp t) const {
+        return offset + t + static_cast<qms::Timestamp>(std::llround(static_cast<double>(t) * skew));
+    }
+    qms::Timestamp arrival(qms::Timestamp t) {
+        const double jitter = -5.0 * std::log(1.0 - rng.uniform());
+        const qms::Timestamp held = rng.uniform() < 0.01 ? 500 * ms : 0;
+        return t + min_delay + static_cast<qms::Timestamp>(jitter * static_cast<double>(ms)) + held;
+    }
+};
+
+// Feeds `minutes` of readings from `from` on; returns the largest error of
+// the corrected timestamps against the least-delayed arrival after `settle`.
+qms::Timestamp run(qms::DriftEstimator &drift, Device &device, qms::Timestamp from, int minutes,
+                   qms::Timestamp settle) {
+    qms::Timestamp worst = 0;
+    for (qms::Timestamp t = from; t < from + minutes * 60'000 * ms; t += 100 * ms) {
+        const qms::Timestamp arrival = device.arrival(t);
+        const qms::Timestamp corrected = drift.correct(device.device_time(t), arrival);
+        CHECK(corrected <= arrival);
+        if (t - from >= settle) worst = std::max(worst, std::abs(corrected - (t + min_delay)));
+    }
+    return worst;
+}
+
+void estimates_skew() {
+    for (const double ppm : {-80.0, -40.0, 0.0, 25.0, 200.0}) {
+        qms::DriftEstimator drift;
+        Device device{3'600'000 * ms, ppm * 1e-6};
+        const qms::Timestamp worst = run(drift, device, 1'000'000 * ms, 10, 60'000 * ms);
+        CHECK(drift.locked());
+        CHECK(drift.restarts() == 0);
+        // Lag gained per device second: a fast device clock falls behind, i.e. negative
+        CHECK_NEAR(drift.drift_ppm(), -ppm / (1 + ppm * 1e-6), 0.3);
+        CHECK(worst < 1 * ms);
+    }
+}
+
+void follows_a_clock_that_is_set() {
+    qms::DriftEstimator drift;
+    Device device{0, 50e-6};
+    run(drift, device, 0, 5, 0);
+    CHECK(drift.locked());
+    device.offset += 3'600'000 * ms; // Set an hour ahead
+    const qms::Timestamp worst = run(drift, device, 5 * 60'000 * ms, 10, 60'000 * ms);
+    CHECK(drift.restarts() == 1);
+    CHECK(drift.locked());
+    CHECK_NEAR(drift.drift_ppm(), -50.0, 0.3);
+    CHECK(worst < 1 * ms);
+}
+
+void offset_only_before_lock() {
+    qms::DriftEstimator drift;
+    CHECK(!drift.locked());
+    const qms::Timestamp corrected = drift.correct(1'000 * ms, 5'000 * ms);
+    CHECK(corrected == 5'000 * ms); // Only one reading: its arrival is the least delay seen
+    CHECK(drift.samples() == 1);
+}
+
+} // namespace
+
+int main() {
+    estimates_skew();
+    follows_a_clock_that_is_set();
+    offset_only_before_lock();
+    return qms_test::result();
+}
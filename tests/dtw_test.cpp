@@ -0,0 +1,83 @@
+// StreamingDtw against cost matrices worked out by hand.
+
+#include <cmath>
+#include <vector>
+
+#include "check.hpp"
+#include "qms/golden.hpp"
+
+namespace {
+
+// Reference 0 1 2, run 0 1 1 2, band 1. With D[i][j] the cheapest path to
+// run sample i and reference sample j (absolute differences):
+//        j=0  j=1  j=2
+//   i=0   0    1    -
+//   i=1   1    0    1
+//   i=2   -    0    1
+//   i=3   -    -    0
+// The repeated 1 is absorbed by warping, so the run matches exactly.
+void stretched_run_matches() {
+    const std::vector<float> reference{0, 1, 2};
+    qms::StreamingDtw dtw(reference, 1);
+    CHECK(dtw.push(0) == 0);
+    CHECK(std::isinf(dtw.end_cost())); // The end of the reference is outside the band
+    CHECK(dtw.push(1) == 0);
+    CHECK(dtw.end_cost() == 1);
+    CHECK(dtw.push(1) == 0);
+    CHECK(dtw.end_cost() == 1);
+    CHECK(dtw.push(2) == 0);
+    CHECK(dtw.end_cost() == 0);
+    CHECK(dtw.samples() == 4);
+}
+
+// Reference 0 1 2 3, run 0 2 2, band 1:
+//        j=0  j=1  j=2  j=3
+//   i=0   0    1    -    -
+//   i=1   2    1    1    -
+//   i=2   -    2    1    2
+// The cheapest path ending anywhere costs 1; matched end to end, 2.
+void open_end_and_end_to_end_differ() {
+    const std::vector<float> reference{0, 1, 2, 3};
+    qms::StreamingDtw dtw(reference, 1);
+    dtw.push(0);
+    CHECK(dtw.push(2) == 1);
+    CHECK(std::isinf(dtw.end_cost()));
+    CHECK(dtw.push(2) == 1);
+    CHECK(dtw.end_cost() == 2);
+}
+
+// With no band, only the diagonal is allowed: the distance is the sum of the
+// pointwise differences, and a run longer than the reference cannot match.
+void zero_band_is_pointwise() {
+    const std::vector<float> reference{1, 2, 3};
+    qms::StreamingDtw dtw(reference, 0);
+    CHECK(dtw.push(1.5f) == 0.5);
+    CHECK(dtw.push(2) == 0.5);
+    CHECK(dtw.push(1) == 2.5);
+    CHECK(dtw.end_cost() == 2.5);
+    CHECK(std::isinf(dtw.push(3)));
+    CHECK(std::isinf(dtw.end_cost()));
+}
+
+void reset_starts_over() {
+    const std::vector<float> reference{0, 1, 2};
+    qms::StreamingDtw dtw(reference, 1);
+    dtw.push(5);
+    dtw.push(5);
+    dtw.reset();
+    CHECK(dtw.samples() == 0);
+    CHECK(dtw.push(0) == 0);
+    CHECK(dtw.push(1) == 0);
+    CHECK(dtw.push(2) == 0);
+    CHECK(dtw.end_cost() == 0);
+}
+
+} // namespace
+
+int main() {
+    stretched_run_matches();
+    open_end_and_end_to_end_differ();
+    zero_band_is_pointwise();
+    reset_starts_over();
+    return qms_test::result();
+}
@@ -0,0 +1,84 @@
+// format_fixed<Precision>, the logs' value formatter: it matches to_chars
+// in fixed notation, sign and ties to even included, and falls back to the
+// shortest form for values too long for fixed notation.
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+#include "check.hpp"
+#include "qms/format.hpp"
+#include "qms/simulation.hpp"
+
+namespace {
+
+// What format_fixed<Precision> writes for `value`, in a buffer prefilled with garbage.
+template <int Precision>
+std::string_view fast(char (&buffer)[64], float value) {
+    std::memset(buffer, '?', sizeof(buffer));
+    return {buffer, static_cast<std::size_t>(qms::format_fixed<Precision>(buffer, value) - buffer)};
+}
+
+template <int Precision>
+std::string_view reference(char (&buffer)[64], float value) {
+    const auto r = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, Precision);
+    return {buffer, static_cast<std::size_t>(r.ptr - buffer)};
+}
+
+// Compares the fast path with to_chars on random floats of every magnitude it handles.
+template <int Precision>
+void matches_to_chars(std::size_t n) {
+    qms::SplitMix64 rng(Precision + 1);
+    std::size_t mismatches = 0;
+    char a[64];
+    char b[64];
+    for (std::size_t i = 0; i < n; ++i) {
+        const auto bits = static_cast<std::uint32_t>(rng.next());
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        if (!(std::fabs(value) < 1e12f)) continue;
+        mismatches += fast<Precision>(a, value) != reference<Precision>(b, value);
+    }
+    CHECK(mismatches == 0);
+}
+
+void keeps_the_sign_and_rounds_ties_to_even() {
+    char buffer[64];
+    CHECK(fast<2>(buffer, -0.001f) == "-0.00");
+    CHECK(fast<0>(buffer, -0.4f) == "-0");
+    CHECK(fast<2>(buffer, -0.0f) == "-0.00");
+    CHECK(fast<2>(buffer, 0.125f) == "0.12"); // Exactly halfway: to the even digit
+    CHECK(fast<2>(buffer, 0.375f) == "0.38");
+    CHECK(fast<0>(buffer, 2.5f) == "2");
+    CHECK(fast<0>(buffer, -3.5f) == "-4");
+    CHECK(fast<3>(buffer, 21.5f) == "21.500");
+    CHECK(fast<6>(buffer, -1234.5678f) == "-1234.567749"); // The float's exact value
+}
+
+void huge_values_fall_back_to_the_shortest_form() {
+    char buffer[64];
+    CHECK(fast<6>(buffer, 1e30f) == "1e+30");
+    CHECK(fast<2>(buffer, -1e29f) == "-1e+29");
+    CHECK(fast<6>(buffer, std::numeric_limits<float>::max()) == "3.4028235e+38");
+    CHECK(fast<2>(buffer, 1e20f) == "100000002004087734272.00"); // Still fits fixed notation
+    CHECK(fast<2>(buffer, std::numeric_limits<float>::infinity()) == "inf");
+    CHECK(qms::format_fixed_fast(buffer, 1e30f, 6) - buffer == 5);
+
+    char small[4];
+    CHECK(qms::format_fixed(small, small + sizeof(small), 1e30f, 2) == small); // Nothing fits
+}
+
+} // namespace
+
+int main() {
+    matches_to_chars<0>(500000);
+    matches_to_chars<2>(500000);
+    matches_to_chars<3>(500000);
+    matches_to_chars<6>(500000);
+    keeps_the_sign_and_rounds_ties_to_even();
+    huge_values_fall_back_to_the_shortest_form();
+    return qms_test::result();
+}
@@ -0,0 +1,99 @@
+// LotTracker: readings still queued when a lot command is decoded belong to
+// the context of their timestamp, and closed lots are summarised once they
+// settle.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "qms/lots.hpp"
+
+namespace {
+
+constexpr qms::Timestamp s = 1'000'000'000;
+
+struct Summary {
+    std::string lot;
+    std::uint64_t count;
+};
+
+// One line L1 served by port P1.
+struct Plant {
+    qms::Registry registry;
+    qms::RecipeBook book{registry};
+    std::vector<Summary> summaries;
+    qms::LotTracker lots{with_line(book),
+                         [](qms::PortHandle, qms::SensorHandle, qms::Timestamp) { return qms::Limits{0.0f, 10.0f}; },
+                         [this](const qms::LotContext &lot, qms::Timestamp, const qms::Recipe *,
+                                const std::vector<qms::LotSensorStats> &sensors) {
+                             std::uint64_t count = 0;
+                             for (const qms::LotSensorStats &x : sensors) count += x.count;
+                             summaries.push_back({lot.lot, count});
+                         }};
+    qms::PortHandle port = registry.port("P1");
+
+    static qms::RecipeBook &with_line(qms::RecipeBook &book) {
+        book.add_line("L1", {"P1"});
+        return book;
+    }
+
+    void record(qms::Timestamp t) {
+        lots.record({.sensor = registry.sensor("T1"), .port = port, .value = 5.0f, .timestamp = t});
+    }
+};
+
+void tags_by_timestamp() {
+    Plant p;
+    CHECK(p.lots.context(p.port, 1 * s) == nullptr);
+    p.lots.command(p.port, "lot start A", 10 * s);
+    p.lots.command(p.port, "batch 1", 20 * s);
+    p.lots.command(p.port, "lot start B", 30 * s);
+    p.lots.command(p.port, "lot end", 40 * s);
+
+    // Looked up after every command was decoded, as a queued reading is
+    CHECK(p.lots.context(p.port, 5 * s) == nullptr);
+    const qms::LotContext *a = p.lots.context(p.port, 15 * s);
+    CHECK(a && a->tag == "A" && a->opening == a);
+    const qms::LotContext *batch = p.lots.context(p.port, 20 * s);
+    CHECK(batch && batch->tag == "A/1" && batch->opening == a);
+    const qms::LotContext *b = p.lots.context(p.port, 35 * s);
+    CHECK(b && b->tag == "B");
+    CHECK(p.lots.context(p.port, 45 * s) == nullptr);
+    CHECK(p.lots.context(p.registry.port("P2"), 15 * s) == nullptr);
+}
+
+void aggregates_queued_readings_into_their_lot() {
+    constexpr qms::Timestamp ms = s / 1000;
+    Plant p;
+    p.lots.command(p.port, "lot start A", 10 * s);
+    p.lots.command(p.port, "lot start B", 20 * s);
+    p.lots.command(p.port, "lot end", 21 * s);
+    for (const qms::Timestamp t : {5 * s, 11 * s, 12 * s, 19 * s, 20 * s + 500 * ms, 22 * s}) p.record(t);
+
+    p.lots.settle(22 * s + 500 * ms); // A ended at 20 s and has settled; B has not
+    CHECK(p.summaries.size() == 1 && p.summaries[0].lot == "A" && p.summaries[0].count == 3);
+    p.record(20 * s + 800 * ms);
+    p.lots.settle(23 * s);
+    CHECK(p.summaries.size() == 2 && p.summaries[1].lot == "B" && p.summaries[1].count == 2);
+    p.record(15 * s); // Too late for A
+    p.lots.close_all(40 * s);
+    CHECK(p.summaries.size() == 2);
+}
+
+void close_all_summarises_open_lots() {
+    Plant p;
+    p.lots.command(p.port, "lot start A", 10 * s);
+    p.record(11 * s);
+    p.lots.close_all(12 * s);
+    CHECK(p.summaries.size() == 1 && p.summaries[0].lot == "A" && p.summaries[0].count == 1);
+}
+
+} // namespace
+
+int main() {
+    tags_by_timestamp();
+    aggregates_queued_readings_into_their_lot();
+    close_all_summarises_open_lots();
+    return qms_test::result();
+}
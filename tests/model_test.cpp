@@ -0,0 +1,166 @@
+// Anomaly models: load_model's validation, linear and tree ensemble scoring,
+// and ModelScoring's batches and delays.
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "qms/model.hpp"
+
+namespace {
+
+constexpr qms::Timestamp s = 1'000'000'000;
+
+const char *model_file = "qms_model_test.txt";
+
+bool load(const char *text, qms::Registry &registry, qms::Model &model) {
+    std::FILE *f = std::fopen(model_file, "w");
+    std::fputs(text, f);
+    std::fclose(f);
+    const bool ok = qms::load_model(model_file, registry, model);
+    std::remove(model_file);
+    return ok;
+}
+
+bool loads(const char *text) {
+    qms::Registry registry;
+    qms::Model model;
+    return load(text, registry, model);
+}
+
+void validation() {
+    CHECK(loads("feature A last\nfeature B mean 30 # comment\nweights 1 2\n"));
+    CHECK(!loads("feature A last\nweights 1\nbogus 1\n"));                 // Unknown directive
+    CHECK(!loads("feature A median\nweights 1\n"));                        // Unknown kind
+    CHECK(!loads("feature A last\nweights 1\ndelay -1\n"));                // Negative delay
+    CHECK(!loads("feature A last\nfeature B last\nweights 1\n"));          // Weights do not match the inputs
+    CHECK(!loads("weights 1\n"));                                          // No input
+    CHECK(!loads("feature A last\ntree\nsplit 0 1 5\nleaf 1\nleaf 2\n"));  // Right child past the tree
+    CHECK(!loads("feature A last\ntree\nsplit 0 1 0\nleaf 1\nleaf 2\n"));  // Right child before the split
+    CHECK(!loads("feature A last\ntree\nsplit 1 1 2\nleaf 1\nleaf 2\n"));  // Split on a missing input
+    CHECK(!loads("feature A last\ntree\nsplit 0 1 2\nleaf 1\n"));          // Unfinished tree
+    CHECK(!loads("feature A last\ntree\nleaf 1\nleaf 2\n"));               // Two roots in one tree
+    CHECK(!loads("feature A last\nsplit 0 1 2\n"));                        // Split outside a tree
+
+    qms::Registry registry;
+    qms::Model model;
+    CHECK(!qms::load_model("qms_model_test_missing.txt", registry, model));
+    CHECK(load("feature TEMP last\nstep 2\nbatch 8\nweights 1\n", registry, model));
+    CHECK(model.name == model_file);
+    CHECK(model.features.size() == 1 && model.features[0].sensor == registry.sensor("TEMP"));
+    CHECK(model.max_delay() == 16 * s); // A full batch by default
+
+    qms::Model delayed;
+    CHECK(load("name fast\nfeature TEMP last\ndelay 0.5\nweights 1\n", registry, delayed));
+    CHECK(delayed.name == "fast");
+    CHECK(delayed.max_delay() == s / 2);
+}
+
+void linear_scoring() {
+    qms::Registry registry;
+    qms::Model model;
+    CHECK(load("feature A last\nfeature B last\nbias 0.5\nweights 2 -1\n", registry, model));
+    const float rows[] = {1.0f, 1.0f, 0.0f, 3.0f};
+    float out[2];
+    model.score(rows, 2, out);
+    CHECK_NEAR(out[0], 1.5, 1e-6);
+    CHECK_NEAR(out[1], -2.5, 1e-6);
+
+    model.logistic = true;
+    model.score(rows, 2, out);
+    CHECK_NEAR(out[0], 1.0 / (1.0 + std::exp(-1.5)), 1e-6);
+    CHECK_NEAR(out[1], 1.0 / (1.0 + std::exp(2.5)), 1e-6);
+}
+
+void tree_scoring() {
+    qms::Registry registry;
+    qms::Model model;
+    CHECK(load("feature A last\n"
+               "feature B last\n"
+               "bias 1\n"
+               "tree\n"
+               "split 0 10 4\n" // A < 10
+               "split 1 0 3\n"  //   B < 0
+               "leaf -1\n"
+               "leaf 2\n"
+               "leaf 5\n"
+               "tree\n"
+               "split 1 5 2\n" // B < 5
+               "leaf 0.25\n"
+               "leaf 0.5\n",
+               registry, model));
+    CHECK(model.roots.size() == 2 && model.nodes.size() == 8);
+    const float rows[] = {0.0f, -1.0f, 0.0f, 1.0f, 10.0f, 7.0f};
+    float out[3];
+    model.score(rows, 3, out);
+    CHECK_NEAR(out[0], 1.0 - 1.0 + 0.25, 1e-6);
+    CHECK_NEAR(out[1], 1.0 + 2.0 + 0.25, 1e-6);
+    CHECK_NEAR(out[2], 1.0 + 5.0 + 0.5, 1e-6);
+}
+
+// TEMP read every second on P1, scored on its last value.
+struct Line {
+    qms::Registry registry;
+    qms::AlertPath alerts{registry};
+    std::vector<qms::Model> models{1};
+    std::vector<qms::Alert> raised;
+    qms::PortHandle port = registry.port("P1");
+
+    explicit Line(const char *text) {
+        CHECK(load(text, registry, models[0]));
+        alerts.subscribe([this](const qms::Alert &a) { raised.push_back(a); });
+    }
+
+    void read(qms::ModelScoring &scoring, float value, qms::Timestamp t) {
+        qms::SensorData r{.sensor = registry.sensor("TEMP"), .port = port, .value = value, .timestamp = t};
+        scoring.process(r);
+    }
+};
+
+void batches() {
+    Line line("name M\nfeature TEMP last\nbatch 4\nthreshold 50\nweights 1\n");
+    qms::ModelScoring scoring(line.alerts, line.models);
+    for (int t = 1; t <= 4; ++t) line.read(scoring, t == 3 ? 100.0f : 20.0f, t * s);
+    CHECK(scoring.scored() == 0); // Rows at 1 s to 3 s wait for the fourth
+    line.read(scoring, 20.0f, 5 * s);
+    CHECK(scoring.scored() == 4 && scoring.flagged() == 1);
+    CHECK(line.raised.size() == 1);
+    CHECK(line.raised[0].kind == qms::AlertKind::ModelScore && line.raised[0].sensor == qms::no_sensor);
+    CHECK(line.raised[0].port == line.port && line.raised[0].timestamp == 3 * s);
+    CHECK(line.raised[0].value == 100.0f && line.raised[0].detail == std::string("M"));
+
+    // A quiet port keeps being scored: rows at 5 s to 8 s form the next batch
+    scoring.poll(8 * s);
+    CHECK(scoring.scored() == 4);
+    scoring.poll(9 * s);
+    CHECK(scoring.scored() == 8);
+    scoring.poll(10 * s);
+    scoring.close();
+    CHECK(scoring.scored() == 9 && line.raised.size() == 1);
+}
+
+void delays() {
+    Line line("feature TEMP last\nbatch 16\ndelay 2\nweights 1\n");
+    qms::ModelScoring scoring(line.alerts, line.models);
+    line.read(scoring, 20.0f, 1 * s);
+    line.read(scoring, 20.0f, 2 * s);
+    scoring.poll(3 * s); // Rows at 1 s and 2 s; the oldest has waited 2 s
+    CHECK(scoring.scored() == 2);
+    scoring.poll(4 * s);
+    CHECK(scoring.scored() == 2);
+    scoring.poll(5 * s);
+    CHECK(scoring.scored() == 4);
+}
+
+} // namespace
+
+int main() {
+    validation();
+    linear_scoring();
+    tree_scoring();
+    batches();
+    delays();
+    return qms_test::result();
+}
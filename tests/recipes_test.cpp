@@ -0,0 +1,57 @@
+// RecipeBook: limits follow the recipe a line ran at a reading's timestamp,
+// from a ring of the line's last changeovers.
+
+#include "check.hpp"
+#include "qms/recipes.hpp"
+
+namespace {
+
+constexpr qms::Timestamp s = 1'000'000'000;
+
+void limits_by_timestamp() {
+    qms::Registry registry;
+    qms::RecipeBook book(registry);
+    const qms::SensorHandle temp = registry.sensor("TEMP");
+    book.recipe("A").set(temp, {18.0f, 22.0f});
+    book.recipe("B").set(temp, {30.0f, 35.0f});
+    const std::size_t line = book.add_line("L1", {"P1"});
+    const qms::PortHandle port = registry.port("P1");
+
+    CHECK(book.changeover(line, "A", 10 * s));
+    CHECK(book.changeover(line, "B", 20 * s));
+    CHECK(!book.changeover(line, "C", 25 * s));
+    CHECK(book.changeover(line, "none", 30 * s));
+
+    CHECK(book.limits(port, temp, 5 * s) == nullptr);
+    const qms::Limits *a = book.limits(port, temp, 15 * s); // Queued behind the changeover to B
+    CHECK(a && a->min_limit == 18.0f);
+    const qms::Limits *b = book.limits(port, temp, 20 * s);
+    CHECK(b && b->max_limit == 35.0f);
+    CHECK(book.limits(port, temp, 40 * s) == nullptr);
+    CHECK(book.active(line) == nullptr);
+    CHECK(book.limits(registry.port("P2"), temp, 15 * s) == nullptr);
+}
+
+void history_is_bounded() {
+    qms::Registry registry;
+    qms::RecipeBook book(registry);
+    book.recipe("A");
+    book.recipe("B");
+    const std::size_t line = book.add_line("L1", {"P1"});
+    const std::size_t n = 3 * qms::RecipeBook::history_depth;
+    for (std::size_t i = 0; i < n; ++i) book.changeover(line, i % 2 ? "B" : "A", static_cast<qms::Timestamp>(i) * s);
+
+    CHECK(book.active(line) == book.find("B"));
+    CHECK(book.active_at(line, static_cast<qms::Timestamp>(n - 2) * s) == book.find("A"));
+    const auto oldest = static_cast<qms::Timestamp>(n - qms::RecipeBook::history_depth + 1);
+    CHECK(book.active_at(line, oldest * s) == book.find(oldest % 2 ? "B" : "A"));
+    CHECK(book.active_at(line, (oldest - 1) * s) == nullptr); // Dropped from the ring
+}
+
+} // namespace
+
+int main() {
+    limits_by_timestamp();
+    history_is_bounded();
+    return qms_test::result();
+}
@@ -0,0 +1,103 @@
+// Growth and lookup of the interning containers: StableVector, InternIndex
+// and the Registry built on them.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "check.hpp"
+#include "qms/registry.hpp"
+
+namespace {
+
+void stable_vector_keeps_addresses() {
+    qms::detail::StableVector<std::string, 4, 64> v; // Chunks of 16
+    CHECK(v.size() == 0);
+    const std::size_t first = v.emplace_back("first");
+    const std::string *address = &v[first];
+    for (int i = 1; i < 1000; ++i) CHECK(v.emplace_back(std::to_string(i)) == static_cast<std::size_t>(i));
+    CHECK(v.size() == 1000);
+    CHECK(&v[first] == address); // Growing never moved the first element
+    CHECK(v[0] == "first");
+    CHECK(v[999] == "999");
+    CHECK(v[16] == "16"); // First element of the second chunk
+}
+
+void stable_vector_rejects_overflow() {
+    qms::detail::StableVector<int, 1, 2> v; // Room for 4
+    for (int i = 0; i < 4; ++i) v.emplace_back(i);
+    bool threw = false;
+    try {
+        v.emplace_back(4);
+    } catch (const std::length_error &) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(v.size() == 4);
+}
+
+// Every name hashes alike, so lookups probe past all the others and growth
+// moves clustered slots.
+void intern_index_with_colliding_hashes() {
+    std::vector<std::string> names;
+    qms::detail::InternIndex index;
+    for (int i = 0; i < 300; ++i) {
+        names.push_back("N" + std::to_string(i));
+        CHECK(index.find(names.back(), 42, names) == qms::detail::InternIndex::npos);
+        index.insert(42, names.size() - 1);
+    }
+    CHECK(index.size() == 300);
+    for (std::size_t i = 0; i < names.size(); ++i) CHECK(index.find(names[i], 42, names) == i);
+    CHECK(index.find("N300", 42, names) == qms::detail::InternIndex::npos);
+}
+
+// Lookups must find every name while the index is part way through moving
+// its old table into the new one, and after.
+void intern_index_during_growth() {
+    std::vector<std::string> names;
+    qms::detail::InternIndex index;
+    const auto hash = [](std::string_view s) { return std::hash<std::string_view>{}(s); };
+    std::size_t checked = 0;
+    for (int i = 0; i < 20000; ++i) {
+        names.push_back("S" + std::to_string(i));
+        index.insert(hash(names.back()), names.size() - 1);
+        if (i % 97 == 0)
+            for (std::size_t j = 0; j < names.size(); j += 7, ++checked)
+                CHECK(index.find(names[j], hash(names[j]), names) == j);
+    }
+    CHECK(checked > 0);
+    for (std::size_t j = 0; j < names.size(); ++j) CHECK(index.find(names[j], hash(names[j]), names) == j);
+    CHECK(index.find("S20000", hash("S20000"), names) == qms::detail::InternIndex::npos);
+}
+
+void registry_interns_once() {
+    qms::Registry registry;
+    std::vector<qms::SensorHandle> handles;
+    char id[24];
+    for (int i = 0; i < 100000; ++i) {
+        std::snprintf(id, sizeof id, "S%07d", i);
+        handles.push_back(registry.sensor(id));
+    }
+    CHECK(registry.sensor_count() == 100000);
+    for (int i = 0; i < 100000; i += 13) {
+        std::snprintf(id, sizeof id, "S%07d", i);
+        CHECK(registry.sensor(id) == handles[static_cast<std::size_t>(i)]);
+        CHECK(registry.sensor_name(handles[static_cast<std::size_t>(i)]) == id);
+    }
+    CHECK(registry.sensor_count() == 100000); // Lookups interned nothing new
+    CHECK(registry.port("COM3") == registry.port("COM3"));
+    CHECK(registry.port("COM3") != registry.port("COM4"));
+}
+
+} // namespace
+
+int main() {
+    stable_vector_keeps_addresses();
+    stable_vector_rejects_overflow();
+    intern_index_with_colliding_hashes();
+    intern_index_during_growth();
+    registry_interns_once();
+    return qms_test::result();
+}
@@ -0,0 +1,126 @@
+// Compact SensorTable: hot records only for reporting sensors, eviction of
+// idle ones to digests and restoring them when they report again; and the
+// chunks behind its arrays sharing huge pages.
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "check.hpp"
+#include "qms/detail/chunked_array.hpp"
+#include "qms/state_table.hpp"
+
+namespace {
+
+constexpr qms::Timestamp second = 1'000'000'000;
+
+void report(qms::SensorTable &table, qms::SensorHandle sensor, float value, qms::Timestamp t) {
+    qms::SensorHot &h = table.hot(sensor);
+    h.hold(value, qms::SensorState::InSpec, t, qms::StatePolicy{});
+    ++h.count;
+    h.total_value += value;
+}
+
+// Calls evict_idle every second from `from` to `to`, returning how many it evicted.
+std::size_t sweep(qms::SensorTable &table, qms::Timestamp from, qms::Timestamp to) {
+    std::size_t evicted = 0;
+    for (qms::Timestamp t = from; t <= to; t += second) evicted += table.evict_idle(t, 1000);
+    return evicted;
+}
+
+void dense_table_holds_everyone() {
+    qms::SensorTable table;
+    table.resize(10, qms::SensorCold{});
+    CHECK(table.active() == 10);
+    report(table, 3, 7.0f, 1 * second);
+    CHECK(table.get(3).count == 1);
+    CHECK(table.evict_idle(1000 * second, 1000) == 0); // Only compact tables evict
+}
+
+void compact_table_evicts_and_restores() {
+    qms::SensorTable table({}, {true, 10 * second});
+    table.resize(1000, qms::SensorCold{});
+    CHECK(table.active() == 0); // Nothing has reported
+
+    const qms::Timestamp start = 100 * second;
+    for (qms::SensorHandle s = 0; s < 100; ++s) report(table, s, static_cast<float>(s), start);
+    report(table, 7, 8.0f, start + second);
+    CHECK(table.active() == 100);
+    CHECK(table.get(7).count == 2);
+    CHECK(table.get(500).count == 0); // Never reported
+
+    // Sensors 0-49 keep reporting; 50-99 fall idle
+    qms::Timestamp t = start + 2 * second;
+    for (; t <= start + 30 * second; t += second) {
+        for (qms::SensorHandle s = 0; s < 50; ++s) report(table, s, 1.0f, t);
+        table.evict_idle(t, 1000);
+    }
+    CHECK(table.evicted_count() == 50);
+    CHECK(table.active() == 50);
+
+    // An evicted sensor keeps its count, extremes and held value
+    const qms::SensorStats idle = table.get(80);
+    CHECK(idle.count == 1);
+    CHECK(idle.held.valid);
+    CHECK(idle.held.value == 80.0f);
+    CHECK(idle.held.read_at == start);
+    CHECK(idle.max_value == -std::numeric_limits<float>::infinity()); // Never set by `report`
+    CHECK_NEAR(idle.average(), 80.0, 1e-4);
+
+    // Reporting again restores it into a hot record, reusing a free one
+    report(table, 80, 81.0f, t);
+    CHECK(table.evicted_count() == 49);
+    CHECK(table.active() == 51);
+    const qms::SensorStats back = table.get(80);
+    CHECK(back.count == 2);
+    CHECK(back.held.value == 81.0f);
+    CHECK_NEAR(back.average(), 80.5, 1e-4);
+
+    // Everyone falls idle
+    CHECK(sweep(table, t + second, t + 40 * second) == 51);
+    CHECK(table.active() == 0);
+    CHECK(table.evicted_count() == 100);
+    CHECK(table.get(7).count == 31); // 2 + 29 while the others idled
+}
+
+// A sweep covers the hot records a quarter of `evict_after` at a time, at
+// most `budget` per call, so a first sweep right after a burst does nothing.
+void eviction_is_incremental() {
+    qms::SensorTable table({}, {true, 100 * second});
+    table.resize(4000, qms::SensorCold{});
+    for (qms::SensorHandle s = 0; s < 4000; ++s) report(table, s, 1.0f, second);
+    CHECK(table.evict_idle(second, 100) == 0); // Sets the pace
+    CHECK(table.evict_idle(500 * second, 100) == 100); // Capped by the budget
+    CHECK(table.evicted_count() == 100);
+}
+
+// 128-byte records, as SensorHot: 512 KiB chunks, four to a huge page.
+struct Record {
+    char bytes[128];
+};
+
+void chunks_share_huge_pages() {
+    qms::detail::ChunkedArray<Record> huge(qms::MemoryPolicy{true});
+    huge.resize(3 * 4096, Record{});
+    CHECK(huge.capacity_bytes() == qms::huge_page_size); // Mapped, not 3 x 512 KiB
+    CHECK(&huge[2 * 4096] == &huge[0] + 2 * 4096);       // Carved from one block
+#if defined(__linux__)
+    CHECK(reinterpret_cast<std::uintptr_t>(&huge[0]) % qms::huge_page_size == 0);
+#endif
+    huge.resize(5 * 4096, Record{});
+    CHECK(huge.capacity_bytes() == 2 * qms::huge_page_size);
+
+    qms::detail::ChunkedArray<Record> normal;
+    normal.resize(5 * 4096, Record{});
+    CHECK(normal.capacity_bytes() == 5 * 4096 * sizeof(Record));
+}
+
+} // namespace
+
+int main() {
+    dense_table_holds_everyone();
+    compact_table_evicts_and_restores();
+    eviction_is_incremental();
+    chunks_share_huge_pages();
+    return qms_test::result();
+}
@@ -0,0 +1,148 @@
+// *** qms_batchbench ***
+// Batching benchmark across the load curve. Feeds Poisson arrivals at rates
+// from 10 to 1,000,000 readings/s through a CSV sink on a VirtualClock under
+// three flush strategies and reports, per strategy and rate, how many file
+// writes were made, the CPU time per reading and how long readings waited in
+// the batch:
+// - `per-reading`: batch size fixed at 1 (lowest latency, most writes).
+// - `fixed-4096`: batch size fixed at 4096 with no deadline.
+// - `adaptive`: BatchController with a 100 ms latency target.
+//
+// Usage: qms_batchbench [--seconds S] [--max-readings N] [--seed S]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "qms/qms.hpp"
+
+namespace {
+
+// *** LatencyProbe Stage ***
+// Records when each reading arrived and, on flush, how long it waited.
+struct LatencyProbe {
+    const qms::Clock *clock;
+    std::vector<qms::Timestamp> pending;
+    std::vector<qms::Timestamp> waits;
+
+    bool process(qms::SensorData &r) {
+        pending.push_back(r.timestamp);
+        return true;
+    }
+
+    void flush() {
+        const qms::Timestamp now = clock->now();
+        for (qms::Timestamp t : pending) waits.push_back(now - t);
+        pending.clear();
+    }
+};
+
+struct Strategy {
+    const char *name;
+    qms::BatchPolicy policy;
+    qms::Timestamp target;
+};
+
+struct Result {
+    std::uint64_t writes;
+    double cpu_per_reading_us;
+    double mean_wait_ms;
+    double p99_wait_ms;
+    double max_wait_ms;
+};
+
+Result run(const Strategy &strategy, double rate, std::uint64_t readings, std::uint64_t seed, const char *path) {
+    constexpr qms::Timestamp start = 1732579200'000000000;
+    constexpr qms::Timestamp poll_period = 25'000'000; // Driver poll period: a quarter of the 100 ms target
+
+    qms::VirtualClock clock(start);
+    qms::Registry registry;
+    const qms::SensorHandle sensor = registry.sensor("TEMP");
+    const qms::PortHandle port = registry.port("BENCH");
+    qms::LatencyTargets targets(strategy.target);
+    std::remove(path);
+    qms::SharedFile file(path, qms::CsvSink::header);
+    LatencyProbe probe{&clock, {}, {}};
+    probe.waits.reserve(readings);
+    auto stage = qms::Batched<qms::Chain<qms::CsvSink, LatencyProbe &>>(
+        qms::Chain<qms::CsvSink, LatencyProbe &>(qms::CsvSink(file, registry, {}, SIZE_MAX), probe), targets,
+        strategy.policy);
+
+    qms::SplitMix64 rng(seed);
+    qms::Timestamp t = start;
+    qms::Timestamp next_poll = start + poll_period;
+    const auto cpu_start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < readings; ++i) {
+        t += static_cast<qms::Timestamp>(-std::log(1.0 - rng.uniform()) / rate * 1e9) + 1;
+        for (; next_poll <= t; next_poll += poll_period) {
+            clock.advance_to(next_poll);
+            stage.poll(next_poll);
+        }
+        clock.advance_to(t);
+        qms::SensorData r{
+            .sensor = sensor, .port = port, .value = static_cast<float>(15 + rng.normal()), .timestamp = t};
+        stage.process(r);
+    }
+    // Let the last batch run into its deadline as an idle driver would; without
+    // a deadline it is written at end of input
+    if (strategy.target == qms::no_latency_target) stage.flush();
+    for (; stage.pending() > 0; next_poll += poll_period) {
+        clock.advance_to(next_poll);
+        stage.poll(next_poll);
+    }
+    const double cpu = std::chrono::duration<double>(std::chrono::steady_clock::now() - cpu_start).count();
+    std::remove(path);
+
+    std::vector<qms::Timestamp> &w = probe.waits;
+    std::sort(w.begin(), w.end());
+    double sum = 0;
+    for (qms::Timestamp x : w) sum += static_cast<double>(x);
+    const auto &m = stage.metrics();
+    return {m.flushes, cpu / static_cast<double>(readings) * 1e6, sum / static_cast<double>(w.size()) / 1e6,
+            static_cast<double>(w[w.size() * 99 / 100]) / 1e6, static_cast<double>(w.back()) / 1e6};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double seconds = 10;
+    std::uint64_t max_readings = 2'000'000;
+    std::uint64_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--seconds") == 0 && has_value) seconds = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--max-readings") == 0 && has_value)
+            max_readings = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0 && has_value) seed = std::strtoull(argv[++i], nullptr, 10);
+        else {
+            std::fprintf(stderr, "usage: %s [--seconds S] [--max-readings N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const Strategy strategies[] = {
+        {"per-reading", {1, 1}, qms::no_latency_target},
+        {"fixed-4096", {4096, 4096}, qms::no_latency_target},
+        {"adaptive", {1, 4096}, 100'000'000},
+    };
+    const double rates[] = {10, 100, 1'000, 10'000, 100'000, 1'000'000};
+    char path[] = "/tmp/qms_batchbench.csv";
+
+    std::printf("%10s  %-12s %10s %10s %12s %12s %12s %12s\n", "rate/s", "strategy", "readings", "writes",
+                "cpu/reading", "mean wait", "p99 wait", "max wait");
+    for (double rate : rates) {
+        const auto readings = std::min<std::uint64_t>(max_readings, static_cast<std::uint64_t>(rate * seconds));
+        for (const Strategy &s : strategies) {
+            const Result r = run(s, rate, readings, seed, path);
+            std::printf("%10.0f  %-12s %10llu %10llu %9.3f us %9.1f ms %9.1f ms %9.1f ms\n", rate, s.name,
+                        static_cast<unsigned long long>(readings), static_cast<unsigned long long>(r.writes),
+                        r.cpu_per_reading_us, r.mean_wait_ms, r.p99_wait_ms, r.max_wait_ms);
+        }
+    }
+    return 0;
+}
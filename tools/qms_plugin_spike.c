@@ -0,0 +1,98 @@
+/*
+ * *** Spike Filter Plugin ***
+ * An example plugin for the plugin ABI (include/qms/qms_plugin.h): drops
+ * readings that jump more than `max_step` from the last kept reading of the
+ * same sensor on the same port, and raises an alert for each.
+ *
+ * Configuration:
+ *   plugin <path>/libqms_plugin_spike.so <scope> max_step=<value>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "qms/qms_plugin.h"
+
+/* Last kept value of one port and sensor, in an open-addressing table. */
+typedef struct {
+    uint64_t key; /* (port << 32 | sensor) + 1; 0: empty */
+    float last;
+} slot;
+
+typedef struct {
+    const qms_host *host;
+    float max_step;
+    slot *slots;
+    size_t capacity; /* Power of two */
+    size_t used;
+} spike_filter;
+
+static slot *find(spike_filter *f, uint64_t key) {
+    size_t i = (size_t)(key * 0x9E3779B97F4A7C15ull) & (f->capacity - 1);
+    while (f->slots[i].key != 0 && f->slots[i].key != key) i = (i + 1) & (f->capacity - 1);
+    return &f->slots[i];
+}
+
+static int grow(spike_filter *f) {
+    slot *old = f->slots;
+    const size_t old_capacity = f->capacity;
+    slot *slots = calloc(old_capacity * 2, sizeof(slot));
+    if (slots == NULL) return 0;
+    f->slots = slots;
+    f->capacity = old_capacity * 2;
+    for (size_t i = 0; i < old_capacity; ++i)
+        if (old[i].key != 0) *find(f, old[i].key) = old[i];
+    free(old);
+    return 1;
+}
+
+static void *spike_create(const qms_host *host, const char *args) {
+    float max_step = 0;
+    if (sscanf(args, "max_step=%f", &max_step) != 1 || max_step <= 0) return NULL;
+    spike_filter *f = calloc(1, sizeof(spike_filter));
+    if (f == NULL) return NULL;
+    f->host = host;
+    f->max_step = max_step;
+    f->capacity = 64;
+    f->slots = calloc(f->capacity, sizeof(slot));
+    if (f->slots == NULL) {
+        free(f);
+        return NULL;
+    }
+    return f;
+}
+
+static int spike_process(void *instance, qms_batch *batch) {
+    spike_filter *f = instance;
+    for (uint32_t i = 0; i < batch->count; ++i) {
+        if (2 * (f->used + 1) > f->capacity && !grow(f)) return 1;
+        const uint64_t key = ((uint64_t)batch->port[i] << 32 | batch->sensor[i]) + 1;
+        slot *s = find(f, key);
+        const float x = batch->value[i];
+        if (s->key == 0) {
+            s->key = key;
+            s->last = x;
+            ++f->used;
+        } else if (x - s->last > f->max_step || s->last - x > f->max_step) {
+            batch->keep[i] = 0;
+            f->host->alert(f->host->context, batch->sensor[i], batch->port[i], x, s->last - f->max_step,
+                           s->last + f->max_step, batch->timestamp[i]);
+        } else {
+            s->last = x;
+        }
+    }
+    return 0;
+}
+
+static void spike_destroy(void *instance) {
+    spike_filter *f = instance;
+    free(f->slots);
+    free(f);
+}
+
+QMS_PLUGIN_EXPORT const qms_plugin *qms_plugin_entry(void) {
+    static const qms_plugin plugin = {QMS_PLUGIN_ABI_VERSION, "spike filter", spike_create, spike_process,
+                                      spike_destroy};
+    return &plugin;
+}
@@ -0,0 +1,206 @@
+// *** qms_pollbench ***
+// Adaptive polling benchmark (Linux). Simulates a 9600 baud Modbus RTU line
+// with 32 slaves on a VirtualClock: a slave coroutine on one end of a socket
+// pair answers read requests after the time the request and response take on
+// the wire. Every slave reports a value that idles mid-band and, once per run
+// at a staggered time, ramps through its upper limit and back. Reports, per
+// polling strategy, how many polls were made, how busy the line was and how
+// long after a value crossed its limit the poller reported it:
+// - `fixed 1 s`, `fixed 100 ms`: modbus_port_task cycling over all slaves.
+// - `adaptive N%`: adaptive_modbus_port_task, intervals 100 ms to 10 s, bus
+//   budget N%.
+//
+// Usage: qms_pollbench [--seconds S]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "qms/qms.hpp"
+
+#if defined(QMS_HAS_EXECUTOR)
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr qms::Timestamp start = 1732579200'000000000;
+constexpr int slaves = 32;
+constexpr float min_limit = 20.0f;
+constexpr float max_limit = 80.0f;
+constexpr double baud = 9600;
+constexpr qms::Timestamp second = 1'000'000'000;
+
+// Seconds a frame of `bytes` occupies the line (10 bits per byte).
+qms::Timestamp line_time(std::size_t bytes) { return static_cast<qms::Timestamp>(bytes * 10 / baud * 1e9); }
+
+// *** Plant ***
+// Slave `k` idles at 50 with a small wobble. At `excursion(k)` it ramps up by
+// 40 over 20 s, holds for 10 s and ramps back over 20 s, crossing the upper
+// limit 15 s into the ramp.
+struct Plant {
+    qms::Timestamp run;
+
+    qms::Timestamp excursion(int k) const {
+        return start + run * (2 * k + 1) / (2 * slaves) - 25 * second + k * 137'000'000; // Off the poll cycle
+    }
+    qms::Timestamp crossing(int k) const { return excursion(k) + 15 * second; }
+
+    float value(int k, qms::Timestamp t) const {
+        const double s = static_cast<double>(t - start) / 1e9;
+        double v = 50 + 0.2 * std::sin(s * 0.7 * (k + 1));
+        const double dt = static_cast<double>(t - excursion(k)) / 1e9;
+        if (dt >= 0 && dt < 20) v += 2 * dt;
+        else if (dt >= 20 && dt < 30) v += 40;
+        else if (dt >= 30 && dt < 50) v += 2 * (50 - dt);
+        return static_cast<float>(v);
+    }
+};
+
+// *** Function: slave_task ***
+// Answers "read holding registers" requests for one Int16 register (scale
+// 0.1) per slave, after the wire time of request and response.
+qms::Task<> slave_task(qms::Executor &ex, qms::SerialPort port, const Plant &plant, qms::Timestamp &busy) {
+    qms::AsyncPort io(ex, std::move(port));
+    std::uint8_t request[8];
+    for (;;) {
+        std::size_t have = 0;
+        while (have < sizeof(request)) {
+            const long n = co_await io.read(request + have, sizeof(request) - have);
+            if (n <= 0) co_return;
+            have += static_cast<std::size_t>(n);
+        }
+        const qms::Timestamp wire = line_time(sizeof(request) + 7);
+        co_await ex.sleep_for(std::chrono::nanoseconds(wire));
+        busy += wire;
+        const auto raw = static_cast<std::int16_t>(std::lround(plant.value(request[0] - 1, ex.now()) * 10));
+        std::uint8_t response[7] = {request[0], 0x03, 2, static_cast<std::uint8_t>(raw >> 8),
+                                    static_cast<std::uint8_t>(raw), 0, 0};
+        const std::uint16_t crc = qms::modbus_crc16(response, 5);
+        response[5] = static_cast<std::uint8_t>(crc);
+        response[6] = static_cast<std::uint8_t>(crc >> 8);
+        const bool sent = co_await io.write_all(response, sizeof(response));
+        if (!sent) co_return;
+    }
+}
+
+// *** Detector Stage ***
+// Records when each slave was first reported beyond its upper limit after
+// its value crossed it.
+struct Detector {
+    const Plant *plant;
+    std::vector<qms::Timestamp> detected = std::vector<qms::Timestamp>(slaves, 0);
+    std::uint64_t readings = 0;
+
+    bool process(qms::SensorData &r) {
+        ++readings;
+        const int k = static_cast<int>(r.sensor);
+        if (r.value > max_limit && detected[k] == 0 && r.timestamp >= plant->crossing(k)) detected[k] = r.timestamp;
+        return true;
+    }
+};
+
+qms::Task<> stop_at(qms::Executor &ex, qms::Timestamp end) {
+    co_await ex.sleep_until(end);
+    ex.stop();
+}
+
+struct Strategy {
+    const char *name;
+    qms::Timestamp fixed_interval; // 0: adaptive
+    double busload;
+};
+
+void run(const Strategy &strategy, qms::Timestamp duration) {
+    qms::VirtualClock clock(start);
+    qms::Executor ex(clock);
+    qms::Registry registry;
+    const Plant plant{duration};
+    Detector detector{&plant};
+
+    std::vector<qms::ModbusPoint> points;
+    qms::PollSchedule schedule(strategy.busload);
+    for (int k = 0; k < slaves; ++k) {
+        const qms::SensorHandle sensor = registry.sensor("P" + std::to_string(k));
+        points.push_back({static_cast<std::uint8_t>(k + 1), 0, qms::ModbusFormat::Int16, 0.1f, sensor});
+        schedule.add(qms::AdaptivePoller({100'000'000, 10 * second}, min_limit, max_limit));
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    qms::Timestamp busy = 0;
+    ex.spawn(slave_task(ex, qms::SerialPort(fds[1]), plant, busy));
+    if (strategy.fixed_interval > 0)
+        ex.spawn(qms::modbus_port_task(ex, qms::SerialPort(fds[0]), registry, "BUS", points,
+                                       std::chrono::nanoseconds(strategy.fixed_interval), 100ms, detector));
+    else
+        ex.spawn(qms::adaptive_modbus_port_task(ex, qms::SerialPort(fds[0]), registry, "BUS", points, schedule, 100ms,
+                                                detector));
+    ex.spawn(stop_at(ex, start + duration));
+    ex.run();
+
+    double sum = 0;
+    qms::Timestamp worst = 0;
+    int found = 0;
+    for (int k = 0; k < slaves; ++k) {
+        if (detector.detected[k] == 0) continue;
+        const qms::Timestamp latency = detector.detected[k] - plant.crossing(k);
+        sum += static_cast<double>(latency);
+        worst = std::max(worst, latency);
+        ++found;
+    }
+    std::printf("%-14s %10llu %9.1f %% %7d/%-2d %10.0f ms %10.0f ms\n", strategy.name,
+                static_cast<unsigned long long>(detector.readings),
+                100.0 * static_cast<double>(busy) / static_cast<double>(duration), found, slaves,
+                found ? sum / found / 1e6 : 0.0, static_cast<double>(worst) / 1e6);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double seconds = 3200;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = std::atof(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--seconds S]\n", argv[0]);
+            return 2;
+        }
+    }
+    const auto duration = static_cast<qms::Timestamp>(seconds * 1e9);
+    if (duration < slaves * 60 * second) { // Room for every excursion
+        std::fprintf(stderr, "%s: --seconds must be at least %d\n", argv[0], slaves * 60);
+        return 2;
+    }
+
+    const Strategy strategies[] = {
+        {"fixed 1 s", second, 1.0},
+        {"fixed 100 ms", 100'000'000, 1.0},
+        {"adaptive 50%", 0, 0.5},
+        {"adaptive 20%", 0, 0.2},
+    };
+    std::printf("%-14s %10s %11s %10s %13s %13s\n", "strategy", "polls", "line busy", "detected", "mean delay",
+                "max delay");
+    for (const Strategy &s : strategies) run(s, duration);
+    return 0;
+}
+
+#else
+
+int main() {
+    std::fprintf(stderr, "qms_pollbench needs the Linux executor\n");
+    return 1;
+}
+
+#endif
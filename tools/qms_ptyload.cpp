@@ -0,0 +1,353 @@
+// *** qms_ptyload ***
+// Pseudo-terminal workload for the monitor. Creates one pty per simulated
+// port, starts the monitor on the slave ends and writes ASCII sensor traffic
+// into the masters: many ports at mixed rates, occasional malformed lines and
+// bursts of out-of-limit readings that trigger alerts. When the traffic ends
+// the masters are closed, the monitor sees its ports hang up and exits, and
+// its CPU time is reported.
+//
+// Two modes:
+// - Paced (default): every port writes at its own rate for `--seconds`. This
+//   is the training workload of the profile-guided build.
+// - Flood (`--lines N`): N lines are written as fast as the monitor accepts
+//   them. This is the benchmark.
+//
+// With `--device-clock PPM`, paced lines carry the time they were due on a
+// device clock ("t=<seconds>") that runs PPM parts per million slow and is
+// offset by 1000 s per port, to check the monitor's drift estimates.
+//
+// Usage: qms_ptyload [--ports P] [--seconds S] [--rate X] [--lines N] [--seed S]
+//                    [--device-clock PPM] [--verbose] -- <monitor> [monitor args...]
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "qms/qms.hpp"
+
+namespace {
+
+using Catalog = qms::DefaultCatalog;
+using steady = std::chrono::steady_clock;
+
+constexpr double port_rates[] = {2, 20, 200, 1000}; // Lines per second, assigned round-robin
+constexpr std::size_t flood_weights[] = {1, 2, 8, 16}; // Lines per round in flood mode
+constexpr std::size_t sensors_per_port = 4;
+
+struct Options {
+    std::size_t ports = 32;
+    double seconds = 10.0;
+    double rate = 1.0;
+    std::uint64_t lines = 0; // Flood mode when non-zero
+    std::uint64_t seed = 1;
+    bool device_clock = false; // Stamp paced lines with a drifting device time
+    double device_ppm = 0;
+    bool verbose = false;
+    std::vector<char *> monitor;
+};
+
+bool parse_options(int argc, char **argv, Options &o) {
+    int i = 1;
+    for (; i < argc && std::strcmp(argv[i], "--") != 0; i++) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--ports") == 0 && has_value) o.ports = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) o.seconds = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--rate") == 0 && has_value) o.rate = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--lines") == 0 && has_value) o.lines = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0 && has_value) o.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--device-clock") == 0 && has_value)
+            o.device_clock = true, o.device_ppm = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--verbose") == 0) o.verbose = true;
+        else return false;
+    }
+    for (++i; i < argc; i++) o.monitor.push_back(argv[i]);
+    return !o.monitor.empty() && o.ports > 0 && o.seconds > 0 && o.rate > 0;
+}
+
+// One simulated port: the pty pair and the sensors reporting on it.
+struct Port {
+    int master = -1;
+    int slave = -1;
+    std::string slave_name;
+    std::vector<std::string> sensors;
+    std::vector<qms::SensorSpec> specs;
+    double interval = 0; // Seconds between lines in paced mode
+    steady::time_point next_due;
+    std::string pending;
+};
+
+struct Counters {
+    std::uint64_t lines = 0;
+    std::uint64_t burst_lines = 0;
+    std::uint64_t bursts = 0;
+    std::uint64_t malformed = 0;
+};
+
+class Traffic {
+public:
+    explicit Traffic(std::uint64_t seed) : rng_(seed) {}
+
+    // Appends one in-spec reading (or, rarely, a malformed line) from `port`.
+    void normal_line(Port &port, Counters &c) {
+        if (rng_.uniform() < 0.005) {
+            port.pending += "garbage-without-value\n";
+            ++c.malformed;
+        } else {
+            const std::size_t k = rng_.next() % port.sensors.size();
+            const qms::SensorSpec &spec = port.specs[k];
+            const double span = spec.max_limit - spec.min_limit;
+            append(port, k, spec.min_limit + span * (0.5 + 0.15 * rng_.normal()));
+        }
+        ++c.lines;
+    }
+
+    // Appends a burst of out-of-limit readings from one sensor of `port`; about
+    // one in ten is outside the physical range as well.
+    void burst(Port &port, Counters &c) {
+        const std::size_t k = rng_.next() % port.sensors.size();
+        const qms::SensorSpec &spec = port.specs[k];
+        const double span = spec.max_limit - spec.min_limit;
+        const std::size_t n = 50 + rng_.next() % 150;
+        for (std::size_t i = 0; i < n; ++i) {
+            const double excess = rng_.uniform() < 0.1 ? spec.physical_max - spec.physical_min : span * 0.5;
+            append(port, k, spec.max_limit + excess * (0.2 + rng_.uniform()));
+        }
+        c.lines += n;
+        c.burst_lines += n;
+        ++c.bursts;
+    }
+
+    qms::SplitMix64 &rng() { return rng_; }
+
+    // Stamps the following lines with device time `seconds` (negative: no stamp).
+    void stamp(double seconds) { stamp_ = seconds; }
+
+private:
+    void append(Port &port, std::size_t k, double value) {
+        char line[96];
+        int n = std::snprintf(line, sizeof(line), "%s %.*f", port.sensors[k].c_str(), port.specs[k].precision, value);
+        if (stamp_ >= 0) n += std::snprintf(line + n, sizeof(line) - static_cast<std::size_t>(n), " t=%.6f", stamp_);
+        line[n++] = '\n';
+        port.pending.append(line, static_cast<std::size_t>(n));
+    }
+
+    qms::SplitMix64 rng_;
+    double stamp_ = -1;
+};
+
+// Writes the pending lines of `port`, waiting while the pty is full. Returns
+// false once the monitor is gone.
+bool drain(Port &port, pid_t monitor) {
+    std::size_t done = 0;
+    while (done < port.pending.size()) {
+        const ssize_t n = ::write(port.master, port.pending.data() + done, port.pending.size() - done);
+        if (n > 0) {
+            done += static_cast<std::size_t>(n);
+        } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            pollfd p{port.master, POLLOUT, 0};
+            ::poll(&p, 1, 100);
+            if (::waitpid(monitor, nullptr, WNOHANG) != 0) return false;
+        } else {
+            return false;
+        }
+    }
+    port.pending.clear();
+    return true;
+}
+
+bool open_ports(const Options &opt, std::vector<Port> &ports) {
+    ports.resize(opt.ports);
+    for (std::size_t i = 0; i < opt.ports; ++i) {
+        Port &p = ports[i];
+        char name[PATH_MAX];
+        if (::openpty(&p.master, &p.slave, name, nullptr, nullptr) != 0) {
+            std::fprintf(stderr, "openpty failed: %s\n", std::strerror(errno));
+            return false;
+        }
+        p.slave_name = name;
+        termios tty;
+        ::tcgetattr(p.slave, &tty);
+        ::cfmakeraw(&tty); // No echo or line editing before the monitor configures the port
+        ::tcsetattr(p.slave, TCSANOW, &tty);
+        ::fcntl(p.master, F_SETFD, FD_CLOEXEC);
+        ::fcntl(p.slave, F_SETFD, FD_CLOEXEC);
+        ::fcntl(p.master, F_SETFL, ::fcntl(p.master, F_GETFL) | O_NONBLOCK);
+
+        for (std::size_t k = 0; k < sensors_per_port; ++k) {
+            const std::size_t n = i * sensors_per_port + k;
+            if (n % 3 == 2) {
+                // Sensors missing from the catalog use the generic spec
+                p.sensors.push_back("LINE" + std::to_string(i) + "_" + std::to_string(k));
+                p.specs.push_back(qms::generic_sensor_spec);
+            } else {
+                const qms::SensorSpec &spec = Catalog::known_specs[n % Catalog::known_kinds];
+                p.sensors.emplace_back(spec.id);
+                p.specs.push_back(spec);
+            }
+        }
+        p.interval = 1.0 / (port_rates[i % std::size(port_rates)] * opt.rate);
+    }
+    return true;
+}
+
+pid_t start_monitor(const Options &opt, const std::vector<Port> &ports, const char *workdir) {
+    std::vector<char *> args(opt.monitor.begin(), opt.monitor.end());
+    for (const Port &p : ports) args.push_back(const_cast<char *>(p.slave_name.c_str()));
+    args.push_back(nullptr);
+
+    char monitor[PATH_MAX];
+    if (!::realpath(args[0], monitor)) {
+        std::fprintf(stderr, "monitor %s not found\n", args[0]);
+        return -1;
+    }
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+        if (::chdir(workdir) != 0) ::_exit(127); // sensor_data.csv lands in the scratch directory
+        if (!opt.verbose) {
+            const int null = ::open("/dev/null", O_WRONLY);
+            ::dup2(null, STDOUT_FILENO);
+            ::dup2(null, STDERR_FILENO);
+        }
+        ::execv(monitor, args.data());
+        ::_exit(127);
+    }
+    return pid;
+}
+
+void run_paced(const Options &opt, std::vector<Port> &ports, Traffic &traffic, pid_t monitor, Counters &c) {
+    const auto start = steady::now();
+    const auto end = start + std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(opt.seconds));
+    for (Port &p : ports) p.next_due = start + std::chrono::duration_cast<steady::duration>(
+                                                   std::chrono::duration<double>(p.interval * traffic.rng().uniform()));
+    auto next_burst = start + std::chrono::milliseconds(500);
+    // Device time of `port` at `t`
+    const auto device_time = [&](const Port &port, steady::time_point t) {
+        const double elapsed = std::chrono::duration<double>(t - start).count();
+        return opt.device_clock ? 1000.0 * static_cast<double>(&port - ports.data() + 1) +
+                                      elapsed * (1 - opt.device_ppm * 1e-6)
+                                : -1.0;
+    };
+    for (auto now = steady::now(); now < end; now = steady::now()) {
+        for (Port &p : ports) {
+            while (p.next_due <= now) {
+                traffic.stamp(device_time(p, p.next_due));
+                traffic.normal_line(p, c);
+                const double jitter = p.interval * (0.9 + 0.2 * traffic.rng().uniform());
+                p.next_due += std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(jitter));
+            }
+        }
+        if (now >= next_burst) {
+            Port &p = ports[traffic.rng().next() % ports.size()];
+            traffic.stamp(device_time(p, now));
+            traffic.burst(p, c);
+            next_burst = now + std::chrono::milliseconds(1000 + traffic.rng().next() % 2000);
+        }
+        for (Port &p : ports) {
+            if (!drain(p, monitor)) return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void run_flood(const Options &opt, std::vector<Port> &ports, Traffic &traffic, pid_t monitor, Counters &c) {
+    std::uint64_t next_burst = 5000;
+    while (c.lines < opt.lines) {
+        for (std::size_t i = 0; i < ports.size() && c.lines < opt.lines; ++i) {
+            for (std::size_t n = flood_weights[i % std::size(flood_weights)]; n > 0; --n) traffic.normal_line(ports[i], c);
+            if (c.lines >= next_burst) {
+                traffic.burst(ports[i], c);
+                next_burst += 5000;
+            }
+            if (!drain(ports[i], monitor)) return;
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr,
+                     "usage: %s [--ports P] [--seconds S] [--rate X] [--lines N] [--seed S] [--device-clock PPM] "
+                     "[--verbose] -- <monitor> [args...]\n",
+                     argv[0]);
+        return 2;
+    }
+
+    std::vector<Port> ports;
+    if (!open_ports(opt, ports)) return 1;
+    char workdir[] = "/tmp/qms_ptyload.XXXXXX";
+    if (!::mkdtemp(workdir)) {
+        std::fprintf(stderr, "mkdtemp failed: %s\n", std::strerror(errno));
+        return 1;
+    }
+
+    const auto start = steady::now();
+    const pid_t monitor = start_monitor(opt, ports, workdir);
+    if (monitor < 0) return 1;
+
+    Traffic traffic(opt.seed);
+    Counters counters;
+    if (opt.lines > 0) run_flood(opt, ports, traffic, monitor, counters);
+    else run_paced(opt, ports, traffic, monitor, counters);
+
+    // Wait until the monitor has read everything, then hang up every port. The
+    // slave input queue only counts bytes the line discipline has received, so
+    // it must stay empty for a while before it is trusted.
+    for (int quiet = 0; quiet < 20 && ::waitpid(monitor, nullptr, WNOHANG) == 0;) {
+        bool empty = true;
+        for (const Port &p : ports) {
+            int queued = 0;
+            if (::ioctl(p.slave, TIOCINQ, &queued) == 0 && queued > 0) empty = false;
+        }
+        quiet = empty ? quiet + 1 : 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (Port &p : ports) {
+        ::close(p.master);
+        ::close(p.slave);
+    }
+    int status = 0;
+    rusage usage{};
+    ::wait4(monitor, &status, 0, &usage);
+    const double wall = std::chrono::duration<double>(steady::now() - start).count();
+
+    const std::string csv = std::string(workdir) + "/sensor_data.csv";
+    std::remove(csv.c_str());
+    ::rmdir(workdir);
+
+    const double user = static_cast<double>(usage.ru_utime.tv_sec) + usage.ru_utime.tv_usec / 1e6;
+    const double sys = static_cast<double>(usage.ru_stime.tv_sec) + usage.ru_stime.tv_usec / 1e6;
+    const double lines = static_cast<double>(counters.lines);
+    std::printf("mode             %s\n", opt.lines > 0 ? "flood" : "paced");
+    std::printf("ports            %zu\n", opt.ports);
+    std::printf("lines            %llu written (%llu in %llu alert bursts, %llu malformed)\n",
+                static_cast<unsigned long long>(counters.lines), static_cast<unsigned long long>(counters.burst_lines),
+                static_cast<unsigned long long>(counters.bursts), static_cast<unsigned long long>(counters.malformed));
+    std::printf("wall time        %.3f s\n", wall);
+    std::printf("monitor cpu      %.3f s user, %.3f s sys\n", user, sys);
+    std::printf("cpu per line     %.2f us\n", lines > 0 ? (user + sys) / lines * 1e6 : 0.0);
+    std::printf("throughput       %.0f lines/s\n", wall > 0 ? lines / wall : 0.0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::fprintf(stderr, "monitor exited abnormally (status %d)\n", status);
+        return 1;
+    }
+    return 0;
+}
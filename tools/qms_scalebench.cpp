@@ -0,0 +1,159 @@
+// *** qms_scalebench ***
+// Million-sensor scaling benchmark. Interns `--sensors` sensor IDs into a
+// Registry, reporting the memory per ID and the longest single interning
+// (which an index that rehashes all at once would make grow with the number
+// of sensors). Then feeds `--readings` readings over one simulated hour
+// through a ClassScheduler and QualityMonitor, with `--active` of the
+// sensors producing 90% of the readings and the rest reporting rarely, once
+// with a dense and once with a compact sensor table (idle eviction after 10
+// minutes). Reports, per table, the time per reading, the longest burst of
+// 4096 readings and the table's memory per sensor.
+//
+// Usage: qms_scalebench [--sensors N] [--readings N] [--active SHARE] [--seed S]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "qms/qms.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t burst = 4096;
+constexpr qms::Timestamp start = 1732579200'000000000;
+constexpr qms::Timestamp span = 3600'000'000'000; // Simulated time covered by the readings
+
+// Resident memory of the process in bytes, or 0 where it cannot be read.
+std::size_t resident_bytes() {
+#if defined(__linux__)
+    unsigned long pages = 0;
+    unsigned long resident = 0;
+    std::FILE *f = std::fopen("/proc/self/statm", "r");
+    if (f == nullptr) return 0;
+    const int n = std::fscanf(f, "%lu %lu", &pages, &resident);
+    std::fclose(f);
+    return n == 2 ? resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+double seconds_since(Clock::time_point t) { return std::chrono::duration<double>(Clock::now() - t).count(); }
+
+struct Result {
+    double ns_per_reading;
+    double max_burst_ms;
+    std::size_t table_bytes;
+    std::size_t active;
+    std::size_t evicted;
+};
+
+Result run(qms::SensorTablePolicy policy, const std::vector<qms::SensorData> &readings, std::size_t sensors,
+           const qms::AlertPath &alerts, const qms::CriticalityTable &classes) {
+    qms::SensorStats limits;
+    limits.min_limit = 0.0f;
+    limits.max_limit = 30.0f;
+    qms::QualityMonitor quality(alerts, limits, {}, {}, policy);
+    quality.set_limits(static_cast<qms::SensorHandle>(sensors - 1), 0.0f, 30.0f); // Room for every sensor
+    qms::SchedulerPolicy scheduling;
+    scheduling.capacity.fill(burst);
+    qms::ClassScheduler<qms::QualityMonitor &> scheduler(quality, classes, scheduling);
+
+    double max_burst = 0;
+    const auto begin = Clock::now();
+    for (std::size_t i = 0; i < readings.size(); i += burst) {
+        const auto t0 = Clock::now();
+        const std::size_t end = std::min(i + burst, readings.size());
+        for (std::size_t j = i; j < end; ++j) {
+            qms::SensorData r = readings[j];
+            scheduler.process(r);
+        }
+        scheduler.flush();
+        quality.poll(readings[end - 1].timestamp);
+        max_burst = std::max(max_burst, seconds_since(t0));
+    }
+    const double elapsed = seconds_since(begin);
+    const qms::SensorTable &table = quality.table();
+    return {elapsed / static_cast<double>(readings.size()) * 1e9, max_burst * 1e3, table.memory(), table.active(),
+            table.evicted_count()};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::size_t sensors = 1'000'000;
+    std::size_t count = 20'000'000;
+    double active_share = 0.1;
+    std::uint64_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--sensors") == 0 && has_value) sensors = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--readings") == 0 && has_value) count = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--active") == 0 && has_value) active_share = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--seed") == 0 && has_value) seed = std::strtoull(argv[++i], nullptr, 10);
+        else {
+            std::fprintf(stderr, "usage: %s [--sensors N] [--readings N] [--active SHARE] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (sensors == 0 || count == 0 || !(active_share > 0 && active_share <= 1)) {
+        std::fprintf(stderr, "%s: need at least one sensor and reading, and 0 < SHARE <= 1\n", argv[0]);
+        return 2;
+    }
+
+    // Interning
+    qms::Registry registry;
+    const std::size_t rss_before = resident_bytes();
+    double max_intern = 0;
+    const auto begin = Clock::now();
+    for (std::size_t i = 0; i < sensors; ++i) {
+        char id[24]; // "S" and up to 20 digits
+        std::snprintf(id, sizeof id, "S%07zu", i);
+        const auto t0 = Clock::now();
+        registry.sensor(id);
+        max_intern = std::max(max_intern, seconds_since(t0));
+    }
+    const double intern_seconds = seconds_since(begin);
+    const std::size_t rss_registry = resident_bytes() - rss_before;
+    std::printf("registry  %zu sensors: %.0f ns per ID, longest %.1f us, %.1f bytes per ID (resident)\n", sensors,
+                intern_seconds / static_cast<double>(sensors) * 1e9, max_intern * 1e6,
+                static_cast<double>(rss_registry) / static_cast<double>(sensors));
+
+    // Traffic: 90% of the readings from the active sensors, the rest from any sensor
+    const auto active = std::max<std::size_t>(1, static_cast<std::size_t>(static_cast<double>(sensors) * active_share));
+    qms::SplitMix64 rng(seed);
+    std::vector<qms::SensorData> readings(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t range = rng.uniform() < 0.9 ? active : sensors;
+        readings[i] = {.sensor = static_cast<qms::SensorHandle>(rng.next() % range),
+                       .port = 0,
+                       .value = static_cast<float>(15 + 5 * rng.normal()),
+                       .timestamp = start + static_cast<qms::Timestamp>(static_cast<double>(span) * i / count)};
+    }
+
+    qms::AlertPath alerts(registry);
+    alerts.subscribe([](const qms::Alert &) {});
+    const qms::CriticalityTable classes;
+    std::printf("%-8s %12s %12s %14s %10s %10s\n", "table", "per reading", "max burst", "bytes/sensor", "active",
+                "evicted");
+    const struct {
+        const char *name;
+        qms::SensorTablePolicy policy;
+    } tables[] = {{"dense", {false}}, {"compact", {true, 600'000'000'000}}};
+    for (const auto &t : tables) {
+        const Result r = run(t.policy, readings, sensors, alerts, classes);
+        std::printf("%-8s %9.1f ns %9.2f ms %14.1f %10zu %10zu\n", t.name, r.ns_per_reading, r.max_burst_ms,
+                    static_cast<double>(r.table_bytes) / static_cast<double>(sensors), r.active, r.evicted);
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+// *** qms_schedbench ***
+// Criticality scheduling benchmark. Overloads a pipeline on a VirtualClock: a
+// sink that costs a fixed time per reading receives Poisson arrivals from a
+// cosmetic vibration sensor flooding at several times the sink's capacity, a
+// normal temperature sensor and a low-rate critical pressure sensor. A loop
+// like the executor's dispatch task alternates between taking in arrivals and
+// dispatching a budget of readings. Reports, per scheduling mode and sensor,
+// how long readings waited from arrival until the sink processed them and how
+// many were shed:
+// - `fifo`: every sensor in one class, i.e. one shared queue.
+// - `strict`: strict priority across criticality classes.
+// - `fair`: weighted fair queuing across criticality classes.
+//
+// Usage: qms_schedbench [--seconds S] [--flood RATE] [--seed S]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "qms/qms.hpp"
+
+namespace {
+
+constexpr std::chrono::nanoseconds service_time(2'000); // Sink cost per reading: capacity 500,000 readings/s
+constexpr std::size_t budget = 1024;                     // Readings dispatched per round, as dispatch_task
+
+struct Source {
+    Source(const char *name, qms::Criticality criticality, double per_second)
+        : id(name), level(criticality), rate(per_second) {}
+
+    const char *id;
+    qms::Criticality level;
+    double rate;
+    qms::SensorHandle sensor = 0;
+    qms::Timestamp next = 0;
+    std::uint64_t offered = 0;
+    std::vector<qms::Timestamp> waits; // Arrival to end of processing
+};
+
+// *** CostlySink Stage ***
+// Advances the virtual clock by the service time of every reading and records
+// how long the reading waited.
+struct CostlySink {
+    qms::VirtualClock *clock;
+    std::vector<Source> *sources;
+
+    bool process(qms::SensorData &r) {
+        clock->advance(service_time);
+        for (Source &s : *sources)
+            if (s.sensor == r.sensor) s.waits.push_back(clock->now() - r.timestamp);
+        return true;
+    }
+};
+
+struct Mode {
+    const char *name;
+    bool classify;
+    bool fair;
+};
+
+void run(const Mode &mode, double seconds, double flood, std::uint64_t seed) {
+    constexpr qms::Timestamp start = 1732579200'000000000;
+    const auto end = start + static_cast<qms::Timestamp>(seconds * 1e9);
+
+    qms::VirtualClock clock(start);
+    qms::Registry registry;
+    std::vector<Source> sources = {{"PRESSURE", qms::Criticality::Critical, 1'000},
+                                   {"TEMP", qms::Criticality::Normal, 100'000},
+                                   {"VIBRATION", qms::Criticality::Cosmetic, flood}};
+    qms::CriticalityTable classes;
+    for (Source &s : sources) {
+        s.sensor = registry.sensor(s.id);
+        if (mode.classify) classes.set(s.sensor, s.level);
+    }
+    qms::SchedulerPolicy policy;
+    policy.fair = mode.fair;
+    if (!mode.classify) policy.capacity = {1, 3 * 4096, 1}; // One queue as large as the three together
+    qms::ClassScheduler<CostlySink> scheduler(CostlySink{&clock, &sources}, classes, policy);
+
+    qms::SplitMix64 rng(seed);
+    auto gap = [&rng](double rate) {
+        return static_cast<qms::Timestamp>(-std::log(1.0 - rng.uniform()) / rate * 1e9) + 1;
+    };
+    for (Source &s : sources) s.next = start + gap(s.rate);
+    for (;;) {
+        // Take in everything that arrived while the last round was dispatched
+        qms::Timestamp next = end;
+        for (Source &s : sources) {
+            for (; s.next <= clock.now() && s.next < end; s.next += gap(s.rate), ++s.offered) {
+                qms::SensorData r{.sensor = s.sensor, .port = 0, .value = 1.0f, .timestamp = s.next};
+                scheduler.process(r);
+            }
+            next = std::min(next, s.next);
+        }
+        if (scheduler.empty()) {
+            if (next >= end) break;
+            clock.advance_to(next);
+            continue;
+        }
+        scheduler.dispatch(clock.now(), budget);
+    }
+
+    for (Source &s : sources) {
+        std::vector<qms::Timestamp> &w = s.waits;
+        std::sort(w.begin(), w.end());
+        const double shed = s.offered ? 100.0 * static_cast<double>(s.offered - w.size()) / s.offered : 0.0;
+        std::printf("%-8s %-10s %-9s %10llu %8.1f %% %9.2f ms %9.2f ms\n", mode.name, s.id,
+                    qms::to_string(mode.classify ? s.level : qms::Criticality::Normal),
+                    static_cast<unsigned long long>(s.offered), shed,
+                    w.empty() ? 0.0 : static_cast<double>(w[w.size() * 99 / 100]) / 1e6,
+                    w.empty() ? 0.0 : static_cast<double>(w.back()) / 1e6);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double seconds = 2;
+    double flood = 2'000'000;
+    std::uint64_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--seconds") == 0 && has_value) seconds = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--flood") == 0 && has_value) flood = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--seed") == 0 && has_value) seed = std::strtoull(argv[++i], nullptr, 10);
+        else {
+            std::fprintf(stderr, "usage: %s [--seconds S] [--flood RATE] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const Mode modes[] = {{"fifo", false, false}, {"strict", true, false}, {"fair", true, true}};
+    std::printf("%-8s %-10s %-9s %10s %10s %12s %12s\n", "mode", "sensor", "class", "offered", "shed", "p99 wait",
+                "max wait");
+    for (const Mode &m : modes) run(m, seconds, flood, seed);
+    return 0;
+}